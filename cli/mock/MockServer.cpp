@@ -0,0 +1,450 @@
+/**
+ * @file MockServer.cpp
+ * @brief Implementation of the virtual-fleet HTTP server
+ */
+
+#include "MockServer.h"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <netinet/tcp.h>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static const uint64_t LISTENER_FLAG = 1ull << 63;
+static const size_t MAX_HEADER_BYTES = 65536;
+static const int MAX_EVENTS = 512;
+static const int IDLE_WAIT_MS = 100;
+
+MockServer::MockServer(std::vector<VirtualSwitch> &switches, const SwitchOptions &options,
+                       const LatencyModel &latency, double slowFactor, uint64_t seed)
+    : switches_(switches), options_(options), latency_(latency), slow_factor_(slowFactor), rng_(seed),
+      epoll_(epoll_create1(EPOLL_CLOEXEC)), listeners_(switches.size(), -1), next_generation_(1), started_us_(0),
+      counters_(), reported_(), reported_us_(0)
+{
+ started_us_ = nowUs();
+}
+
+MockServer::~MockServer()
+{
+ for (auto &connection : connections_)
+ {
+  if (connection)
+  {
+   ::close(connection->fd);
+  }
+ }
+ for (int fd : listeners_)
+ {
+  if (fd >= 0)
+  {
+   ::close(fd);
+  }
+ }
+ if (epoll_ >= 0)
+ {
+  ::close(epoll_);
+ }
+}
+
+int64_t MockServer::nowUs() const
+{
+ return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch())
+            .count() -
+        started_us_;
+}
+
+bool MockServer::listen(const std::vector<sockaddr_in> &addresses, std::string &error)
+{
+ if (epoll_ < 0)
+ {
+  error = "epoll_create1: " + std::string(std::strerror(errno));
+  return false;
+ }
+
+ for (uint32_t i = 0; i < switches_.size() && i < addresses.size(); i++)
+ {
+  if (switches_[i].health() == HEALTH_DEAD)
+  {
+   continue;
+  }
+
+  int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  int reuse = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+  if (fd < 0 || bind(fd, reinterpret_cast<const sockaddr *>(&addresses[i]), sizeof(addresses[i])) < 0 ||
+      ::listen(fd, 512) < 0)
+  {
+   char address[INET_ADDRSTRLEN];
+   inet_ntop(AF_INET, &addresses[i].sin_addr, address, sizeof(address));
+   error = "Cannot listen on " + std::string(address) + ":" + std::to_string(ntohs(addresses[i].sin_port)) + ": " +
+           std::strerror(errno);
+   if (fd >= 0)
+   {
+    ::close(fd);
+   }
+   return false;
+  }
+
+  epoll_event event;
+  event.events = EPOLLIN;
+  event.data.u64 = LISTENER_FLAG | i;
+  epoll_ctl(epoll_, EPOLL_CTL_ADD, fd, &event);
+  listeners_[i] = fd;
+ }
+ return true;
+}
+
+void MockServer::accept(int listener, uint32_t switchIndex)
+{
+ for (;;)
+ {
+  int fd = accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+  if (fd < 0)
+  {
+   return; // EAGAIN, or out of descriptors until some close
+  }
+
+  int noDelay = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+  if (static_cast<size_t>(fd) >= connections_.size())
+  {
+   connections_.resize(static_cast<size_t>(fd) * 2 + 1);
+  }
+
+  std::unique_ptr<Connection> connection(new Connection());
+  connection->fd = fd;
+  connection->switchIndex = switchIndex;
+  connection->generation = next_generation_++;
+  connection->written = 0;
+  connection->waiting = false;
+  connection->closeAfter = false;
+  connection->writeArmed = false;
+  connections_[fd] = std::move(connection);
+
+  epoll_event event;
+  event.events = EPOLLIN | EPOLLRDHUP;
+  event.data.u64 = static_cast<uint64_t>(fd);
+  epoll_ctl(epoll_, EPOLL_CTL_ADD, fd, &event);
+  counters_.connections++;
+ }
+}
+
+void MockServer::close(Connection &connection)
+{
+ int fd = connection.fd;
+ epoll_ctl(epoll_, EPOLL_CTL_DEL, fd, nullptr);
+ ::close(fd);
+ connections_[fd].reset();
+}
+
+void MockServer::readable(Connection &connection)
+{
+ char buffer[16384];
+ for (;;)
+ {
+  ssize_t received = recv(connection.fd, buffer, sizeof(buffer), 0);
+  if (received > 0)
+  {
+   connection.in.append(buffer, static_cast<size_t>(received));
+   continue;
+  }
+  if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+  {
+   break;
+  }
+  if (received < 0 && errno == EINTR)
+  {
+   continue;
+  }
+  close(connection); // Peer closed, or a hard error
+  return;
+ }
+ process(connection);
+}
+
+// Answer buffered requests one at a time; a delayed answer holds back the rest
+void MockServer::process(Connection &connection)
+{
+ int fd = connection.fd;
+ uint64_t generation = connection.generation;
+ while (connections_[fd] && connections_[fd]->generation == generation && !connection.waiting)
+ {
+  size_t consumed = 0;
+  if (!parseRequest(connection, consumed))
+  {
+   if (connection.in.size() > MAX_HEADER_BYTES)
+   {
+    close(connection);
+   }
+   return;
+  }
+  connection.in.erase(0, consumed);
+  counters_.requests++;
+  respond(connection);
+ }
+}
+
+bool MockServer::parseRequest(Connection &connection, size_t &consumed)
+{
+ const std::string &in = connection.in;
+ size_t headerEnd = in.find("\r\n\r\n");
+ if (headerEnd == std::string::npos)
+ {
+  return false;
+ }
+
+ size_t lineEnd = in.find("\r\n");
+ size_t methodEnd = in.find(' ');
+ size_t targetEnd = in.find(' ', methodEnd + 1);
+ if (methodEnd == std::string::npos || targetEnd == std::string::npos || targetEnd > lineEnd)
+ {
+  connection.closeAfter = true;
+  methodEnd = targetEnd = 0;
+ }
+ request_.post = in.compare(0, methodEnd, "POST") == 0;
+ request_.path.assign(in, methodEnd + 1, targetEnd > methodEnd ? targetEnd - methodEnd - 1 : 0);
+ size_t query = request_.path.find('?');
+ if (query != std::string::npos)
+ {
+  request_.path.resize(query);
+ }
+ if (in.compare(targetEnd + 1, 8, "HTTP/1.0") == 0)
+ {
+  connection.closeAfter = true;
+ }
+
+ size_t contentLength = 0;
+ request_.sid.clear();
+ for (size_t line = lineEnd + 2; line < headerEnd;)
+ {
+  size_t next = in.find("\r\n", line);
+  const char *text = in.c_str() + line;
+  if (strncasecmp(text, "Content-Length:", 15) == 0)
+  {
+   contentLength = std::strtoul(text + 15, nullptr, 10);
+  }
+  else if (strncasecmp(text, "Cookie:", 7) == 0)
+  {
+   size_t sid = in.find("SID=", line);
+   if (sid != std::string::npos && sid < next)
+   {
+    size_t end = in.find_first_of(";\r", sid + 4);
+    request_.sid.assign(in, sid + 4, end - sid - 4);
+   }
+  }
+  else if (strncasecmp(text, "Connection:", 11) == 0)
+  {
+   size_t value = in.find_first_not_of(' ', line + 11);
+   if (value < next && strncasecmp(in.c_str() + value, "close", 5) == 0)
+   {
+    connection.closeAfter = true;
+   }
+  }
+  line = next + 2;
+ }
+
+ if (in.size() < headerEnd + 4 + contentLength)
+ {
+  return false;
+ }
+ request_.body.assign(in, headerEnd + 4, contentLength);
+ consumed = headerEnd + 4 + contentLength;
+ return true;
+}
+
+static const char *reason(int status)
+{
+ switch (status)
+ {
+ case 200:
+  return "OK";
+ case 404:
+  return "Not Found";
+ case 500:
+  return "Internal Server Error";
+ case 503:
+  return "Service Unavailable";
+ default:
+  return "Bad Request";
+ }
+}
+
+void MockServer::respond(Connection &connection)
+{
+ VirtualSwitch &target = switches_[connection.switchIndex];
+ if (target.health() == HEALTH_HUNG)
+ {
+  counters_.hung++;
+  connection.waiting = true; // Forever; the client gives up and closes
+  return;
+ }
+
+ int64_t now = nowUs();
+ uint64_t loginsBefore = target.logins();
+ target.handle(request_, now / 1000, options_, rng_, response_);
+ counters_.logins += target.logins() - loginsBefore;
+ counters_.errors += response_.status != 200 ? 1 : 0;
+
+ char head[256];
+ int length = std::snprintf(head, sizeof(head), "HTTP/1.1 %d %s\r\nContent-Type: text/html\r\nContent-Length: %zu\r\n%s",
+                            response_.status, reason(response_.status), response_.body.size(),
+                            connection.closeAfter ? "Connection: close\r\n" : "");
+ connection.pending.assign(head, static_cast<size_t>(std::min<int>(length, sizeof(head) - 1)));
+ if (!response_.setSid.empty())
+ {
+  connection.pending.append("Set-Cookie: SID=").append(response_.setSid).append("; path=/\r\n");
+ }
+ connection.pending.append("\r\n").append(response_.body);
+
+ double delayMs = latency_.sampleMs(rng_) * (target.health() == HEALTH_SLOW ? slow_factor_ : 1.0);
+ connection.waiting = true;
+ timers_.push(Timer{now + static_cast<int64_t>(delayMs * 1000.0), connection.fd, connection.generation});
+}
+
+void MockServer::flush(Connection &connection)
+{
+ while (connection.written < connection.out.size())
+ {
+  ssize_t sent = send(connection.fd, connection.out.data() + connection.written,
+                      connection.out.size() - connection.written, MSG_NOSIGNAL);
+  if (sent < 0 && errno == EINTR)
+  {
+   continue;
+  }
+  if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+  {
+   if (!connection.writeArmed)
+   {
+    epoll_event event;
+    event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP;
+    event.data.u64 = static_cast<uint64_t>(connection.fd);
+    epoll_ctl(epoll_, EPOLL_CTL_MOD, connection.fd, &event);
+    connection.writeArmed = true;
+   }
+   return;
+  }
+  if (sent < 0)
+  {
+   close(connection);
+   return;
+  }
+  connection.written += static_cast<size_t>(sent);
+ }
+
+ connection.out.clear();
+ connection.written = 0;
+ if (connection.writeArmed)
+ {
+  epoll_event event;
+  event.events = EPOLLIN | EPOLLRDHUP;
+  event.data.u64 = static_cast<uint64_t>(connection.fd);
+  epoll_ctl(epoll_, EPOLL_CTL_MOD, connection.fd, &event);
+  connection.writeArmed = false;
+ }
+ if (connection.closeAfter && !connection.waiting)
+ {
+  close(connection);
+ }
+}
+
+void MockServer::fireTimers()
+{
+ int64_t now = nowUs();
+ while (!timers_.empty() && timers_.top().dueUs <= now)
+ {
+  Timer timer = timers_.top();
+  timers_.pop();
+  Connection *connection = connections_[timer.fd].get();
+  if (!connection || connection->generation != timer.generation)
+  {
+   continue; // Closed while the response was waiting
+  }
+
+  double lagMs = static_cast<double>(now - timer.dueUs) / 1000.0;
+  counters_.maxLagMs = std::max(counters_.maxLagMs, lagMs);
+  counters_.responses++;
+
+  connection->out.append(connection->pending);
+  connection->pending.clear();
+  connection->waiting = false;
+  flush(*connection);
+  if (connections_[timer.fd] && connections_[timer.fd]->generation == timer.generation)
+  {
+   process(*connection);
+  }
+ }
+}
+
+void MockServer::report(int64_t elapsedUs)
+{
+ double seconds = static_cast<double>(elapsedUs - reported_us_) / 1e6;
+ size_t open = 0;
+ for (const auto &connection : connections_)
+ {
+  open += connection ? 1 : 0;
+ }
+ std::fprintf(stderr, "[%8.1fs] %.0f req/s, %zu open, %llu logins, %llu errors, %llu hung, max lag %.2f ms\n",
+              static_cast<double>(elapsedUs) / 1e6,
+              seconds > 0.0 ? static_cast<double>(counters_.requests - reported_.requests) / seconds : 0.0, open,
+              static_cast<unsigned long long>(counters_.logins), static_cast<unsigned long long>(counters_.errors),
+              static_cast<unsigned long long>(counters_.hung), counters_.maxLagMs);
+ reported_ = counters_;
+ reported_us_ = elapsedUs;
+}
+
+void MockServer::run(const volatile sig_atomic_t &stop, int reportMs)
+{
+ epoll_event events[MAX_EVENTS];
+ int64_t nextReport = reportMs > 0 ? nowUs() + static_cast<int64_t>(reportMs) * 1000 : INT64_MAX;
+
+ while (!stop)
+ {
+  int timeout = IDLE_WAIT_MS;
+  if (!timers_.empty())
+  {
+   int64_t waitUs = timers_.top().dueUs - nowUs();
+   timeout = waitUs <= 0 ? 0 : static_cast<int>(std::min<int64_t>((waitUs + 999) / 1000, IDLE_WAIT_MS));
+  }
+
+  int ready = epoll_wait(epoll_, events, MAX_EVENTS, timeout);
+  for (int i = 0; i < ready; i++)
+  {
+   uint64_t data = events[i].data.u64;
+   if (data & LISTENER_FLAG)
+   {
+    uint32_t index = static_cast<uint32_t>(data & ~LISTENER_FLAG);
+    accept(listeners_[index], index);
+    continue;
+   }
+
+   Connection *connection = connections_[static_cast<size_t>(data)].get();
+   if (!connection)
+   {
+    continue;
+   }
+   if (events[i].events & EPOLLOUT)
+   {
+    flush(*connection);
+    connection = connections_[static_cast<size_t>(data)].get();
+   }
+   if (connection && (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)))
+   {
+    readable(*connection);
+   }
+  }
+
+  fireTimers();
+  int64_t now = nowUs();
+  if (now >= nextReport)
+  {
+   report(now);
+   nextReport = now + static_cast<int64_t>(reportMs) * 1000;
+  }
+ }
+}
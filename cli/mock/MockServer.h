@@ -0,0 +1,108 @@
+/**
+ * @file MockServer.h
+ * @brief Single-threaded epoll HTTP front end for a fleet of virtual switches
+ *
+ * Every live switch has its own listening socket, either on consecutive
+ * ports of one address or on consecutive loopback addresses. One thread
+ * accepts, parses keep-alive HTTP/1.1 requests and hands them to the
+ * switch. Responses are held on a timer heap until their sampled latency
+ * has passed, so thousands of slow switches cost no threads and no
+ * sleeping. The server reports how late timers fire. A growing lag means
+ * the mock itself has become the bottleneck.
+ */
+
+#ifndef MOCK_SERVER_H
+#define MOCK_SERVER_H
+
+#include <csignal>
+#include <cstdint>
+#include <memory>
+#include <netinet/in.h>
+#include <queue>
+#include <random>
+#include <string>
+#include <vector>
+#include "VirtualSwitch.h"
+
+struct ServerCounters
+{
+ uint64_t connections; // Accepted
+ uint64_t requests;
+ uint64_t responses;
+ uint64_t logins;
+ uint64_t errors; // Responses other than 200
+ uint64_t hung;   // Requests deliberately left unanswered
+ double maxLagMs; // Latest a response went out after its due time
+};
+
+class MockServer
+{
+public:
+ MockServer(std::vector<VirtualSwitch> &switches, const SwitchOptions &options, const LatencyModel &latency,
+            double slowFactor, uint64_t seed);
+ ~MockServer();
+
+ // Bind one listener per switch that is not dead; false with error on failure
+ bool listen(const std::vector<sockaddr_in> &addresses, std::string &error);
+
+ // Serve until stop is set, printing counters every reportMs (0 for never)
+ void run(const volatile sig_atomic_t &stop, int reportMs);
+
+ ServerCounters counters() const { return counters_; }
+
+private:
+ struct Connection
+ {
+  int fd;
+  uint32_t switchIndex;
+  uint64_t generation;
+  std::string in;
+  std::string out;     // Response being written
+  std::string pending; // Response waiting for its latency to pass
+  size_t written;
+  bool waiting; // A request is being answered; later ones stay buffered
+  bool closeAfter;
+  bool writeArmed; // Waiting for EPOLLOUT
+ };
+
+ struct Timer
+ {
+  int64_t dueUs;
+  int fd;
+  uint64_t generation;
+  bool operator>(const Timer &other) const { return dueUs > other.dueUs; }
+ };
+
+ std::vector<VirtualSwitch> &switches_;
+ SwitchOptions options_;
+ LatencyModel latency_;
+ double slow_factor_;
+ std::mt19937_64 rng_;
+ int epoll_;
+ std::vector<int> listeners_;
+ std::vector<std::unique_ptr<Connection>> connections_; // Indexed by fd
+ std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer>> timers_;
+ uint64_t next_generation_;
+ int64_t started_us_;
+ ServerCounters counters_;
+ ServerCounters reported_; // As of the last report
+ int64_t reported_us_;
+ MockRequest request_;
+ MockResponse response_;
+
+ int64_t nowUs() const;
+ void accept(int listener, uint32_t switchIndex);
+ void readable(Connection &connection);
+ void process(Connection &connection);
+ bool parseRequest(Connection &connection, size_t &consumed);
+ void respond(Connection &connection);
+ void flush(Connection &connection);
+ void close(Connection &connection);
+ void fireTimers();
+ void report(int64_t elapsedUs);
+
+ MockServer(const MockServer &) = delete;
+ MockServer &operator=(const MockServer &) = delete;
+};
+
+#endif // MOCK_SERVER_H
@@ -0,0 +1,327 @@
+/**
+ * @file VirtualSwitch.cpp
+ * @brief Implementation of the emulated switch
+ */
+
+#include "VirtualSwitch.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <openssl/evp.h>
+
+static const char *LOGIN_URL = "/login.cgi";
+static const char *POE_CONFIG_URL = "/PoEPortConfig.cgi";
+static const char *POE_STATUS_URL = "/getPoePortStatus.cgi";
+
+const char *healthName(SwitchHealth health)
+{
+ switch (health)
+ {
+ case HEALTH_SLOW:
+  return "slow";
+ case HEALTH_HUNG:
+  return "hung";
+ case HEALTH_DEAD:
+  return "dead";
+ default:
+  return "up";
+ }
+}
+
+LatencyModel::LatencyModel() : kind_(LATENCY_FIXED), a_(0.0), b_(0.0)
+{
+}
+
+bool LatencyModel::parse(const std::string &spec, std::string &error)
+{
+ size_t colon = spec.find(':');
+ std::string name = spec.substr(0, colon);
+ double values[2] = {0.0, 0.0};
+ int count = 0;
+ while (colon != std::string::npos && count < 2)
+ {
+  char *end = nullptr;
+  values[count++] = std::strtod(spec.c_str() + colon + 1, &end);
+  colon = (*end == ':') ? static_cast<size_t>(end - spec.c_str()) : std::string::npos;
+ }
+
+ struct
+ {
+  const char *name;
+  Kind kind;
+  int arguments;
+ } kinds[] = {{"fixed", LATENCY_FIXED, 1},
+              {"uniform", LATENCY_UNIFORM, 2},
+              {"normal", LATENCY_NORMAL, 2},
+              {"exp", LATENCY_EXPONENTIAL, 1},
+              {"lognormal", LATENCY_LOGNORMAL, 2}};
+ for (const auto &entry : kinds)
+ {
+  if (name == entry.name)
+  {
+   if (count != entry.arguments || values[0] < 0.0 || values[1] < 0.0)
+   {
+    error = "Latency '" + spec + "' needs " + std::to_string(entry.arguments) + " non-negative value(s)";
+    return false;
+   }
+   kind_ = entry.kind;
+   a_ = values[0];
+   b_ = values[1];
+   return true;
+  }
+ }
+ error = "Unknown latency distribution '" + name + "' (fixed, uniform, normal, exp or lognormal)";
+ return false;
+}
+
+double LatencyModel::sampleMs(std::mt19937_64 &rng) const
+{
+ switch (kind_)
+ {
+ case LATENCY_UNIFORM:
+  return std::uniform_real_distribution<double>(std::min(a_, b_), std::max(a_, b_))(rng);
+ case LATENCY_NORMAL:
+  return std::max(0.0, std::normal_distribution<double>(a_, b_)(rng));
+ case LATENCY_EXPONENTIAL:
+  return a_ > 0.0 ? std::exponential_distribution<double>(1.0 / a_)(rng) : 0.0;
+ case LATENCY_LOGNORMAL:
+  return a_ > 0.0 ? std::lognormal_distribution<double>(std::log(a_), b_)(rng) : 0.0;
+ default:
+  return a_;
+ }
+}
+
+VirtualSwitch::VirtualSwitch(uint32_t index, SwitchHealth health, std::mt19937_64 &rng)
+    : index_(index), health_(health), last_activity_ms_(0),
+      tokens_(std::numeric_limits<double>::infinity()), last_refill_ms_(0), session_counter_(0),
+      logins_(0), expiries_(0)
+{
+ std::uniform_real_distribution<float> watts(1.5f, 9.0f);
+ std::uniform_int_distribution<int> powerClass(0, 4);
+ for (int i = 0; i < 8; i++)
+ {
+  ports_[i].enabled = rng() % 8 != 0;
+  ports_[i].powerClass = powerClass(rng);
+  ports_[i].baseWatts = watts(rng);
+  ports_[i].enabledAtMs = INT64_MIN / 2;
+ }
+}
+
+std::string VirtualSwitch::formValue(const std::string &body, const char *name)
+{
+ std::string key = std::string(name) + "=";
+ size_t pos = 0;
+ while ((pos = body.find(key, pos)) != std::string::npos)
+ {
+  if (pos == 0 || body[pos - 1] == '&')
+  {
+   size_t start = pos + key.size();
+   return body.substr(start, body.find('&', start) - start);
+  }
+  pos += key.size();
+ }
+ return "";
+}
+
+static std::string md5Hex(const std::string &input)
+{
+ unsigned char digest[EVP_MAX_MD_SIZE];
+ unsigned int length = 0;
+ EVP_Digest(input.data(), input.size(), digest, &length, EVP_md5(), nullptr);
+
+ std::string hex;
+ char byte[3];
+ for (unsigned int i = 0; i < length; i++)
+ {
+  std::snprintf(byte, sizeof(byte), "%02x", digest[i]);
+  hex += byte;
+ }
+ return hex;
+}
+
+bool VirtualSwitch::sessionValid(const std::string &sid, int64_t nowMs, const SwitchOptions &options)
+{
+ if (sid_.empty() || sid != sid_)
+ {
+  return false;
+ }
+ if (options.sessionTtlMs > 0 && nowMs - last_activity_ms_ > options.sessionTtlMs)
+ {
+  sid_.clear();
+  expiries_++;
+  return false;
+ }
+ last_activity_ms_ = nowMs;
+ return true;
+}
+
+// Token bucket holding one second's worth of requests
+bool VirtualSwitch::admit(int64_t nowMs, const SwitchOptions &options)
+{
+ if (options.maxRate <= 0.0)
+ {
+  return true;
+ }
+ tokens_ = std::min(options.maxRate, tokens_ + static_cast<double>(nowMs - last_refill_ms_) * options.maxRate / 1000.0);
+ last_refill_ms_ = nowMs;
+ if (tokens_ < 1.0)
+ {
+  return false;
+ }
+ tokens_ -= 1.0;
+ return true;
+}
+
+void VirtualSwitch::loginPage(std::mt19937_64 &rng, MockResponse &response)
+{
+ rand_ = std::to_string(1000000000u + rng() % 1000000000u);
+ response.body = "<html><body><form method=\"post\" action=\"/login.cgi\">"
+                 "<input type=hidden id=\"rand\" name=\"rand\" value='" +
+                 rand_ + "'><input type=\"password\" name=\"password\"></form></body></html>";
+}
+
+void VirtualSwitch::login(const std::string &body, const SwitchOptions &options, MockResponse &response)
+{
+ // A failed login gets the login page back, with no cookie
+ if (rand_.empty() || formValue(body, "password") != md5Hex(options.password + rand_))
+ {
+  response.body = "<html><body><input type=hidden id=\"rand\" name=\"rand\" value='" + rand_ +
+                  "'><div class=\"error\">Invalid password</div></body></html>";
+  return;
+ }
+
+ // The firmware allows one admin session; a new login replaces the old one
+ session_counter_++;
+ logins_++;
+ char sid[48];
+ std::snprintf(sid, sizeof(sid), "V%04xS%08llx", index_ & 0xffffu, static_cast<unsigned long long>(session_counter_));
+ sid_ = sid;
+ hash_ = md5Hex(sid_).substr(0, 16);
+ response.setSid = sid_;
+ response.body = "<html><body>Login successful</body></html>";
+}
+
+void VirtualSwitch::applyConfig(const std::string &body, int64_t nowMs, MockResponse &response)
+{
+ std::string portId = formValue(body, "portID");
+ std::string mode = formValue(body, "ADMIN_MODE");
+ int port = portId.empty() ? -1 : std::atoi(portId.c_str());
+ if (formValue(body, "hash") != hash_ || port < 0 || port > 7 || (mode != "0" && mode != "1"))
+ {
+  response.body = "FAIL";
+  return;
+ }
+ if (mode == "1" && !ports_[port].enabled)
+ {
+  ports_[port].enabledAtMs = nowMs;
+ }
+ ports_[port].enabled = mode == "1";
+ response.body = "SUCCESS";
+}
+
+// A port just turned on spends BOOT_DETECT_MS in detection and classification,
+// then its device draws an inrush peak that settles to its base draw by BOOT_SETTLE_MS
+static const int64_t BOOT_DETECT_MS = 150;
+static const int64_t BOOT_SETTLE_MS = 1500;
+
+void VirtualSwitch::statusPage(int64_t nowMs, std::mt19937_64 &rng, std::string &out) const
+{
+ std::uniform_real_distribution<float> jitter(0.9f, 1.1f);
+ char item[1024];
+ out = "<html><body><ul>";
+ for (int i = 0; i < 8; i++)
+ {
+  const Port &port = ports_[i];
+  int64_t sinceOn = nowMs - port.enabledAtMs;
+  bool delivering = port.enabled && sinceOn >= BOOT_DETECT_MS;
+  float boot = 1.0f;
+  if (delivering && sinceOn < BOOT_SETTLE_MS)
+  {
+   float t = static_cast<float>(sinceOn - BOOT_DETECT_MS) / static_cast<float>(BOOT_SETTLE_MS - BOOT_DETECT_MS);
+   boot = t < 0.2f ? 0.5f + 5.0f * t : 1.5f - 0.625f * (t - 0.2f);
+  }
+  float watts = delivering ? port.baseWatts * boot * jitter(rng) : 0.0f;
+  float volts = delivering ? 53.2f : 0.0f;
+  int length = std::snprintf(
+      item, sizeof(item),
+      "<li class=\"poePortStatusListItem\">\n"
+      "<span class=\"pull-right poe-power-mode\"><span>%s</span></span>\n"
+      "<span class=\"powClassShow\">ml003@%d@</span>\n"
+      "<input type=\"hidden\" class=\"port\" value=\"%d\">\n"
+      "<input type=\"hidden\" class=\"hidPortPwr\" id=\"hidPortPwr\" value=\"%d\">\n"
+      "<div><span class='hid-txt wid-full'>ml570</span></div><div><span>%.1f</span></div>\n"
+      "<div><span class='hid-txt wid-full'>ml572</span></div><div><span>%d</span></div>\n"
+      "<div><span class='hid-txt wid-full'>ml574</span></div><div><span>%.1f</span></div>\n"
+      "<div><span class='hid-txt wid-full'>ml575</span></div><div><span>%d</span></div>\n"
+      "<div><span class='hid-txt wid-full'>ml581</span></div><div><span>No Error</span></div>\n"
+      "</li>\n",
+      delivering ? "Delivering Power" : port.enabled ? "Searching" : "Disabled", port.powerClass, i + 1,
+      port.enabled ? 1 : 0,
+      static_cast<double>(volts), delivering ? static_cast<int>(watts * 1000.0f / 53.2f) : 0, static_cast<double>(watts),
+      30 + i + static_cast<int>(watts));
+  out.append(item, static_cast<size_t>(std::min<int>(length, sizeof(item) - 1)));
+ }
+ out += "</ul></body></html>";
+}
+
+void VirtualSwitch::handle(const MockRequest &request, int64_t nowMs, const SwitchOptions &options,
+                           std::mt19937_64 &rng, MockResponse &response)
+{
+ response.status = 200;
+ response.body.clear();
+ response.setSid.clear();
+
+ if (!admit(nowMs, options))
+ {
+  response.status = 503;
+  return;
+ }
+ if (options.errorRate > 0.0 && std::uniform_real_distribution<double>(0.0, 1.0)(rng) < options.errorRate)
+ {
+  response.status = 500;
+  return;
+ }
+
+ if (request.path == LOGIN_URL)
+ {
+  if (request.post)
+  {
+   login(request.body, options, response);
+  }
+  else
+  {
+   loginPage(rng, response);
+  }
+  return;
+ }
+
+ bool known = request.path == POE_CONFIG_URL || request.path == POE_STATUS_URL;
+ if (!known)
+ {
+  response.status = 404;
+  return;
+ }
+
+ // Without a valid session every page is the login page
+ if (!sessionValid(request.sid, nowMs, options))
+ {
+  loginPage(rng, response);
+  return;
+ }
+
+ if (request.path == POE_STATUS_URL)
+ {
+  statusPage(nowMs, rng, response.body);
+ }
+ else if (request.post)
+ {
+  applyConfig(request.body, nowMs, response);
+ }
+ else
+ {
+  response.body = "<html><body><form><input type=hidden name='hash' id='hash' value=\"" + hash_ +
+                  "\"></form></body></html>";
+ }
+}
@@ -0,0 +1,126 @@
+/**
+ * @file VirtualSwitch.h
+ * @brief Emulated GS308EP switch for the virtual-fleet mock
+ *
+ * Each virtual switch answers the endpoints the CLI uses: the login page and
+ * login form, the PoE config page and form, and the status page. It keeps its
+ * own port states and a single admin session that expires after an idle
+ * time, like the real firmware. Logins are checked against the same salted
+ * MD5 the CLI sends. A port turned on reports Searching during detection,
+ * then an inrush peak that settles to its steady draw, so burst captures
+ * have a boot curve to record. A switch's health decides how the server
+ * treats it: up and slow switches answer (slow ones after a multiplied
+ * latency), hung switches accept connections but never reply, and dead
+ * switches have no listener at all.
+ */
+
+#ifndef VIRTUAL_SWITCH_H
+#define VIRTUAL_SWITCH_H
+
+#include <cstdint>
+#include <random>
+#include <string>
+
+enum SwitchHealth
+{
+ HEALTH_UP,
+ HEALTH_SLOW,
+ HEALTH_HUNG,
+ HEALTH_DEAD
+};
+
+const char *healthName(SwitchHealth health);
+
+// Response latency drawn per request. Specs: fixed:MS, uniform:MIN:MAX,
+// normal:MEAN:STDDEV, exp:MEAN, lognormal:MEDIAN:SIGMA
+class LatencyModel
+{
+public:
+ LatencyModel();
+
+ bool parse(const std::string &spec, std::string &error);
+ double sampleMs(std::mt19937_64 &rng) const;
+
+private:
+ enum Kind
+ {
+  LATENCY_FIXED,
+  LATENCY_UNIFORM,
+  LATENCY_NORMAL,
+  LATENCY_EXPONENTIAL,
+  LATENCY_LOGNORMAL
+ };
+ Kind kind_;
+ double a_;
+ double b_;
+};
+
+// Behaviour shared by every switch of the fleet
+struct SwitchOptions
+{
+ std::string password;
+ int64_t sessionTtlMs; // Idle time before a session expires; 0 for never
+ double maxRate;       // Requests per second before answering 503; 0 for unlimited
+ double errorRate;     // Fraction of requests answered with 500
+};
+
+struct MockRequest
+{
+ bool post;
+ std::string path; // Without the query string
+ std::string sid;  // SID cookie sent, if any
+ std::string body;
+};
+
+struct MockResponse
+{
+ int status;
+ std::string body;
+ std::string setSid; // Sent as a SID cookie when non-empty
+};
+
+class VirtualSwitch
+{
+public:
+ VirtualSwitch(uint32_t index, SwitchHealth health, std::mt19937_64 &rng);
+
+ void handle(const MockRequest &request, int64_t nowMs, const SwitchOptions &options, std::mt19937_64 &rng,
+             MockResponse &response);
+
+ SwitchHealth health() const { return health_; }
+ uint64_t logins() const { return logins_; }
+ uint64_t expiries() const { return expiries_; }
+
+private:
+ struct Port
+ {
+  bool enabled;
+  int powerClass;
+  float baseWatts;
+  int64_t enabledAtMs; // When the port was last turned on; drives the boot curve
+ };
+
+ uint32_t index_;
+ SwitchHealth health_;
+ Port ports_[8];
+ std::string rand_; // Issued with the last login page
+ std::string sid_;  // Current session; empty when logged out
+ std::string hash_; // Form hash belonging to the session
+ int64_t last_activity_ms_;
+ double tokens_;
+ int64_t last_refill_ms_;
+ uint64_t session_counter_;
+ uint64_t logins_;
+ uint64_t expiries_;
+
+ bool sessionValid(const std::string &sid, int64_t nowMs, const SwitchOptions &options);
+ bool admit(int64_t nowMs, const SwitchOptions &options);
+ void loginPage(std::mt19937_64 &rng, MockResponse &response);
+ void login(const std::string &body, const SwitchOptions &options, MockResponse &response);
+ void applyConfig(const std::string &body, int64_t nowMs, MockResponse &response);
+ void statusPage(int64_t nowMs, std::mt19937_64 &rng, std::string &out) const;
+
+ static std::string formValue(const std::string &body, const char *name);
+};
+
+#endif // VIRTUAL_SWITCH_H
@@ -0,0 +1,323 @@
+/**
+ * @file main.cpp
+ * @brief gs308ep-mock: one process emulating a fleet of GS308EP switches
+ *
+ * Starts hundreds or thousands of virtual switches on a port range or a
+ * loopback address range, optionally writes a matching fleet file, and
+ * serves them until interrupted. Used to measure fleet polling, session
+ * handling and failure behaviour at scale before pointing them at hardware.
+ */
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <getopt.h>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <string>
+#include <sys/resource.h>
+#include <vector>
+#include "MockServer.h"
+#include "VirtualSwitch.h"
+
+static const char *PROGRAM_NAME = "gs308ep-mock";
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void handle_signal(int)
+{
+ stop_requested = 1;
+}
+
+void print_usage()
+{
+ std::cout << "Usage: " << PROGRAM_NAME << " [OPTIONS]" << std::endl;
+ std::cout << std::endl;
+ std::cout << "Emulate a fleet of GS308EP switches for scale testing." << std::endl;
+ std::cout << std::endl;
+ std::cout << "Fleet:" << std::endl;
+ std::cout << "  -n, --switches=N       Number of virtual switches (default 100)" << std::endl;
+ std::cout << "  -a, --address=ADDR     Listen address (default 127.0.0.1)" << std::endl;
+ std::cout << "  -b, --base-port=PORT   Port of the first switch; switch i listens on PORT+i (default 20000)" << std::endl;
+ std::cout << "      --spread-addresses Give switch i address ADDR+i on the base port instead" << std::endl;
+ std::cout << "  -p, --password=PASS    Administrator password every switch accepts (default password)" << std::endl;
+ std::cout << "      --fleet-file=FILE  Write a fleet file listing every switch, for gs308ep --fleet" << std::endl;
+ std::cout << "      --sites=N          Sites to spread switches over in the fleet file (default 4)" << std::endl;
+ std::cout << "      --racks=N          Racks per site in the fleet file (default 4)" << std::endl;
+ std::cout << std::endl;
+ std::cout << "Behaviour:" << std::endl;
+ std::cout << "      --latency=SPEC     Response latency: fixed:MS, uniform:MIN:MAX, normal:MEAN:SD," << std::endl;
+ std::cout << "                         exp:MEAN or lognormal:MEDIAN:SIGMA (default fixed:2)" << std::endl;
+ std::cout << "      --slow=FRACTION    Fraction of switches answering slowly (default 0)" << std::endl;
+ std::cout << "      --slow-factor=X    Latency multiplier for slow switches (default 10)" << std::endl;
+ std::cout << "      --hung=FRACTION    Fraction accepting connections but never answering (default 0)" << std::endl;
+ std::cout << "      --dead=FRACTION    Fraction not listening at all (default 0)" << std::endl;
+ std::cout << "      --session-ttl=SECS Idle time before a session expires; 0 for never (default 300)" << std::endl;
+ std::cout << "      --max-rate=N       Requests per second per switch before answering 503 (default unlimited)" << std::endl;
+ std::cout << "      --error-rate=P     Fraction of requests answered with 500 (default 0)" << std::endl;
+ std::cout << "      --seed=N           Random seed for health, readings and latency (default 1)" << std::endl;
+ std::cout << std::endl;
+ std::cout << "Other:" << std::endl;
+ std::cout << "      --report=SECS      Print request rate, connections and timer lag every SECS (default 10; 0 off)" << std::endl;
+ std::cout << "      --help             Display this help message" << std::endl;
+}
+
+static bool parse_fraction(const char *text, double &value)
+{
+ char *end = nullptr;
+ value = std::strtod(text, &end);
+ return end != text && *end == '\0' && value >= 0.0 && value <= 1.0;
+}
+
+// Raise the descriptor limit as far as allowed; every switch needs a listener
+// and every client connection a socket
+static void raise_file_limit()
+{
+ rlimit limit;
+ if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max)
+ {
+  limit.rlim_cur = limit.rlim_max;
+  setrlimit(RLIMIT_NOFILE, &limit);
+ }
+}
+
+int main(int argc, char *argv[])
+{
+ long switch_count = 100;
+ std::string address = "127.0.0.1";
+ long base_port = 20000;
+ bool spread_addresses = false;
+ std::string fleet_path;
+ long sites = 4;
+ long racks = 4;
+ LatencyModel latency;
+ std::string latency_spec = "fixed:2";
+ double slow = 0.0;
+ double slow_factor = 10.0;
+ double hung = 0.0;
+ double dead = 0.0;
+ double session_ttl = 300.0;
+ SwitchOptions options;
+ options.password = "password";
+ options.maxRate = 0.0;
+ options.errorRate = 0.0;
+ uint64_t seed = 1;
+ int report_seconds = 10;
+
+ static struct option long_options[] = {{"switches", required_argument, 0, 'n'},
+                                        {"address", required_argument, 0, 'a'},
+                                        {"base-port", required_argument, 0, 'b'},
+                                        {"password", required_argument, 0, 'p'},
+                                        {"spread-addresses", no_argument, 0, 2},
+                                        {"fleet-file", required_argument, 0, 3},
+                                        {"sites", required_argument, 0, 4},
+                                        {"racks", required_argument, 0, 5},
+                                        {"latency", required_argument, 0, 6},
+                                        {"slow", required_argument, 0, 7},
+                                        {"slow-factor", required_argument, 0, 8},
+                                        {"hung", required_argument, 0, 9},
+                                        {"dead", required_argument, 0, 10},
+                                        {"session-ttl", required_argument, 0, 11},
+                                        {"max-rate", required_argument, 0, 12},
+                                        {"error-rate", required_argument, 0, 13},
+                                        {"seed", required_argument, 0, 14},
+                                        {"report", required_argument, 0, 15},
+                                        {"help", no_argument, 0, 16},
+                                        {0, 0, 0, 0}};
+
+ int opt;
+ int option_index = 0;
+ while ((opt = getopt_long(argc, argv, "n:a:b:p:", long_options, &option_index)) != -1)
+ {
+  switch (opt)
+  {
+  case 'n':
+   switch_count = std::atol(optarg);
+   break;
+  case 'a':
+   address = optarg;
+   break;
+  case 'b':
+   base_port = std::atol(optarg);
+   break;
+  case 'p':
+   options.password = optarg;
+   break;
+  case 2:
+   spread_addresses = true;
+   break;
+  case 3:
+   fleet_path = optarg;
+   break;
+  case 4:
+   sites = std::max(1L, std::atol(optarg));
+   break;
+  case 5:
+   racks = std::max(1L, std::atol(optarg));
+   break;
+  case 6:
+   latency_spec = optarg;
+   break;
+  case 7:
+  case 9:
+  case 10:
+  case 13:
+  {
+   double value = 0.0;
+   if (!parse_fraction(optarg, value))
+   {
+    std::cerr << "Error: --" << long_options[option_index].name << " must be a fraction between 0 and 1" << std::endl;
+    return 1;
+   }
+   (opt == 7 ? slow : opt == 9 ? hung : opt == 10 ? dead : options.errorRate) = value;
+   break;
+  }
+  case 8:
+   slow_factor = std::max(0.0, std::atof(optarg));
+   break;
+  case 11:
+   session_ttl = std::max(0.0, std::atof(optarg));
+   break;
+  case 12:
+   options.maxRate = std::max(0.0, std::atof(optarg));
+   break;
+  case 14:
+   seed = std::strtoull(optarg, nullptr, 10);
+   break;
+  case 15:
+   report_seconds = std::max(0, std::atoi(optarg));
+   break;
+  case 16:
+   print_usage();
+   return 0;
+  default:
+   print_usage();
+   return 1;
+  }
+ }
+ options.sessionTtlMs = static_cast<int64_t>(session_ttl * 1000.0);
+
+ std::string error;
+ if (!latency.parse(latency_spec, error))
+ {
+  std::cerr << "Error: " << error << std::endl;
+  return 1;
+ }
+ if (switch_count < 1 || switch_count > 65535)
+ {
+  std::cerr << "Error: --switches must be between 1 and 65535" << std::endl;
+  return 1;
+ }
+ if (slow + hung + dead > 1.0)
+ {
+  std::cerr << "Error: --slow, --hung and --dead add up to more than the whole fleet" << std::endl;
+  return 1;
+ }
+
+ in_addr base_address;
+ if (inet_pton(AF_INET, address.c_str(), &base_address) != 1)
+ {
+  std::cerr << "Error: Invalid address '" << address << "'" << std::endl;
+  return 1;
+ }
+ long last_port = spread_addresses ? base_port : base_port + switch_count - 1;
+ if (base_port < 1 || last_port > 65535)
+ {
+  std::cerr << "Error: Port range " << base_port << "-" << last_port << " is out of range" << std::endl;
+  return 1;
+ }
+
+ std::vector<sockaddr_in> addresses(static_cast<size_t>(switch_count));
+ std::vector<std::string> hosts(addresses.size());
+ for (size_t i = 0; i < addresses.size(); i++)
+ {
+  sockaddr_in &entry = addresses[i];
+  std::memset(&entry, 0, sizeof(entry));
+  entry.sin_family = AF_INET;
+  entry.sin_addr.s_addr = spread_addresses ? htonl(ntohl(base_address.s_addr) + static_cast<uint32_t>(i))
+                                           : base_address.s_addr;
+  entry.sin_port = htons(static_cast<uint16_t>(spread_addresses ? base_port : base_port + static_cast<long>(i)));
+  char text[INET_ADDRSTRLEN];
+  inet_ntop(AF_INET, &entry.sin_addr, text, sizeof(text));
+  hosts[i] = std::string(text) + ":" + std::to_string(ntohs(entry.sin_port));
+ }
+
+ // Health is assigned to a seeded shuffle of the fleet, so runs are repeatable
+ std::mt19937_64 rng(seed);
+ std::vector<size_t> order(addresses.size());
+ std::iota(order.begin(), order.end(), 0);
+ std::shuffle(order.begin(), order.end(), rng);
+ std::vector<SwitchHealth> health(addresses.size(), HEALTH_UP);
+ size_t deadCount = static_cast<size_t>(dead * static_cast<double>(order.size()));
+ size_t hungCount = static_cast<size_t>(hung * static_cast<double>(order.size()));
+ size_t slowCount = static_cast<size_t>(slow * static_cast<double>(order.size()));
+ for (size_t i = 0; i < order.size(); i++)
+ {
+  health[order[i]] = i < deadCount                         ? HEALTH_DEAD
+                     : i < deadCount + hungCount             ? HEALTH_HUNG
+                     : i < deadCount + hungCount + slowCount ? HEALTH_SLOW
+                                                             : HEALTH_UP;
+ }
+
+ std::vector<VirtualSwitch> switches;
+ switches.reserve(addresses.size());
+ for (size_t i = 0; i < addresses.size(); i++)
+ {
+  switches.emplace_back(static_cast<uint32_t>(i), health[i], rng);
+ }
+
+ if (!fleet_path.empty())
+ {
+  std::ofstream fleet(fleet_path);
+  fleet << "# " << switch_count << " virtual switches from " << PROGRAM_NAME << " (seed " << seed << ")\n";
+  for (size_t i = 0; i < hosts.size(); i++)
+  {
+   size_t site = i % static_cast<size_t>(sites);
+   size_t rack = (i / static_cast<size_t>(sites)) % static_cast<size_t>(racks);
+   fleet << hosts[i] << " site=site" << site << " rack=r" << rack;
+   if (health[i] != HEALTH_UP)
+   {
+    fleet << " tags=" << healthName(health[i]);
+   }
+   fleet << "\n";
+  }
+  if (!fleet)
+  {
+   std::cerr << "Error: Cannot write fleet file " << fleet_path << std::endl;
+   return 1;
+  }
+ }
+
+ raise_file_limit();
+ MockServer server(switches, options, latency, slow_factor, seed + 1);
+ if (!server.listen(addresses, error))
+ {
+  std::cerr << "Error: " << error << std::endl;
+  return 1;
+ }
+
+ std::signal(SIGINT, handle_signal);
+ std::signal(SIGTERM, handle_signal);
+ std::signal(SIGPIPE, SIG_IGN);
+
+ std::cerr << "Serving " << switch_count << " switches, " << hosts.front() << " to " << hosts.back() << " ("
+           << slowCount << " slow, " << hungCount << " hung, " << deadCount << " dead; latency " << latency_spec << ")"
+           << std::endl;
+ server.run(stop_requested, report_seconds * 1000);
+
+ ServerCounters counters = server.counters();
+ uint64_t expiries = 0;
+ for (const auto &entry : switches)
+ {
+  expiries += entry.expiries();
+ }
+ std::cerr << "Served " << counters.requests << " requests on " << counters.connections << " connections: "
+           << counters.logins << " logins, " << expiries << " session expiries, " << counters.errors << " errors, "
+           << counters.hung << " left hanging; max timer lag " << counters.maxLagMs << " ms" << std::endl;
+ return 0;
+}
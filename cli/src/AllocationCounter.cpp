@@ -0,0 +1,151 @@
+/**
+ * @file AllocationCounter.cpp
+ * @brief Replacement global operator new and libcurl allocation hooks
+ */
+
+#include "AllocationCounter.h"
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <curl/curl.h>
+
+static std::atomic<uint64_t> heap_allocations(0);
+static std::atomic<uint64_t> curl_allocations(0);
+
+AllocationCounts allocationCounts()
+{
+ AllocationCounts counts;
+ counts.heap = heap_allocations.load(std::memory_order_relaxed);
+ counts.curl = curl_allocations.load(std::memory_order_relaxed);
+ return counts;
+}
+
+static void *counted(size_t size)
+{
+ heap_allocations.fetch_add(1, std::memory_order_relaxed);
+ return std::malloc(size ? size : 1);
+}
+
+static void *countedAligned(size_t size, std::align_val_t alignment)
+{
+ heap_allocations.fetch_add(1, std::memory_order_relaxed);
+ size_t align = static_cast<size_t>(alignment);
+ return std::aligned_alloc(align, (size + align - 1) / align * align);
+}
+
+void *operator new(size_t size)
+{
+ void *memory = counted(size);
+ if (!memory)
+ {
+  throw std::bad_alloc();
+ }
+ return memory;
+}
+
+void *operator new[](size_t size)
+{
+ return operator new(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+ return counted(size);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept
+{
+ return counted(size);
+}
+
+void *operator new(size_t size, std::align_val_t alignment)
+{
+ void *memory = countedAligned(size, alignment);
+ if (!memory)
+ {
+  throw std::bad_alloc();
+ }
+ return memory;
+}
+
+void *operator new[](size_t size, std::align_val_t alignment)
+{
+ return operator new(size, alignment);
+}
+
+void operator delete(void *memory) noexcept
+{
+ std::free(memory);
+}
+
+void operator delete[](void *memory) noexcept
+{
+ std::free(memory);
+}
+
+void operator delete(void *memory, size_t) noexcept
+{
+ std::free(memory);
+}
+
+void operator delete[](void *memory, size_t) noexcept
+{
+ std::free(memory);
+}
+
+void operator delete(void *memory, std::align_val_t) noexcept
+{
+ std::free(memory);
+}
+
+void operator delete[](void *memory, std::align_val_t) noexcept
+{
+ std::free(memory);
+}
+
+void operator delete(void *memory, size_t, std::align_val_t) noexcept
+{
+ std::free(memory);
+}
+
+void operator delete[](void *memory, size_t, std::align_val_t) noexcept
+{
+ std::free(memory);
+}
+
+static void *curlMalloc(size_t size)
+{
+ curl_allocations.fetch_add(1, std::memory_order_relaxed);
+ return std::malloc(size);
+}
+
+static void *curlCalloc(size_t count, size_t size)
+{
+ curl_allocations.fetch_add(1, std::memory_order_relaxed);
+ return std::calloc(count, size);
+}
+
+static void *curlRealloc(void *memory, size_t size)
+{
+ curl_allocations.fetch_add(1, std::memory_order_relaxed);
+ return std::realloc(memory, size);
+}
+
+static char *curlStrdup(const char *text)
+{
+ curl_allocations.fetch_add(1, std::memory_order_relaxed);
+ size_t length = std::strlen(text) + 1;
+ char *copy = static_cast<char *>(std::malloc(length));
+ if (copy)
+ {
+  std::memcpy(copy, text, length);
+ }
+ return copy;
+}
+
+bool countCurlAllocations()
+{
+ return curl_global_init_mem(CURL_GLOBAL_DEFAULT, curlMalloc, std::free, curlRealloc, curlStrdup, curlCalloc) ==
+        CURLE_OK;
+}
@@ -0,0 +1,28 @@
+/**
+ * @file AllocationCounter.h
+ * @brief Process-wide counts of heap allocations
+ *
+ * The program replaces the global operator new, so every C++ allocation is
+ * counted. libcurl allocates through malloc and is counted separately once
+ * countCurlAllocations() has installed counting callbacks. Fleet polling uses
+ * the counts to show that steady-state sweeps stay off the allocator.
+ */
+
+#ifndef ALLOCATION_COUNTER_H
+#define ALLOCATION_COUNTER_H
+
+#include <cstdint>
+
+struct AllocationCounts
+{
+ uint64_t heap; // operator new calls
+ uint64_t curl; // libcurl malloc, calloc, realloc and strdup calls
+};
+
+AllocationCounts allocationCounts();
+
+// Route libcurl's allocations through counting wrappers. Must run before any
+// other libcurl initialisation; pair it with curl_global_cleanup().
+bool countCurlAllocations();
+
+#endif // ALLOCATION_COUNTER_H
@@ -0,0 +1,440 @@
+/**
+ * @file AuditLog.cpp
+ * @brief Implementation of the group-committed audit log
+ */
+
+#include "AuditLog.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char AUDIT_MAGIC[4] = {'G', 'S', '8', 'A'};
+static const uint32_t AUDIT_VERSION = 1;
+
+// Largest group commit; a deeper queue is committed in several
+static const size_t MAX_BATCH = 512;
+
+struct AuditFileHeader
+{
+ char magic[4];
+ uint32_t version;
+ uint32_t recordBytes;
+ uint32_t reserved[5];
+};
+
+static_assert(sizeof(AuditRecord) == 96, "audit record layout");
+static_assert(sizeof(AuditFileHeader) == 32, "audit file header layout");
+
+static bool validHeader(const AuditFileHeader &header)
+{
+ return std::memcmp(header.magic, AUDIT_MAGIC, sizeof(AUDIT_MAGIC)) == 0 && header.version == AUDIT_VERSION &&
+        header.recordBytes == sizeof(AuditRecord);
+}
+
+static uint32_t fnv1a(const void *data, size_t length)
+{
+ const uint8_t *bytes = static_cast<const uint8_t *>(data);
+ uint32_t value = 2166136261u;
+ for (size_t i = 0; i < length; i++)
+ {
+  value = (value ^ bytes[i]) * 16777619u;
+ }
+ return value;
+}
+
+// Covers every byte of the record before the check itself
+static uint32_t recordCheck(const AuditRecord &record)
+{
+ return fnv1a(&record, offsetof(AuditRecord, check));
+}
+
+// Several processes may append to one log, so each holds an exclusive
+// lock on the file from checking its end until its commit is on disk
+class AuditFileLock
+{
+public:
+ explicit AuditFileLock(int fd) : fd_(fd), locked_(false)
+ {
+  int result;
+  do
+  {
+   result = flock(fd_, LOCK_EX);
+  } while (result < 0 && errno == EINTR);
+  locked_ = result == 0;
+ }
+ ~AuditFileLock()
+ {
+  if (locked_)
+  {
+   flock(fd_, LOCK_UN);
+  }
+ }
+ bool locked() const { return locked_; }
+
+private:
+ int fd_;
+ bool locked_;
+};
+
+// Cut off part of a record left by a writer that died mid-commit, which
+// would misalign every record appended after it. Only called under the
+// file lock, when no other writer can be part-way through a commit.
+static bool trimTornTail(int fd)
+{
+ struct stat info;
+ if (fstat(fd, &info) < 0)
+ {
+  return false;
+ }
+ size_t size = static_cast<size_t>(info.st_size);
+ if (size < sizeof(AuditFileHeader))
+ {
+  return true;
+ }
+ size_t torn = (size - sizeof(AuditFileHeader)) % sizeof(AuditRecord);
+ return !torn || ftruncate(fd, info.st_size - static_cast<off_t>(torn)) == 0;
+}
+
+uint32_t auditHostHash(const std::string &host)
+{
+ return fnv1a(host.data(), host.size());
+}
+
+AuditActor::AuditActor() : source(AUDIT_COMMAND), uid(static_cast<uint32_t>(getuid())), actionId(0)
+{
+}
+
+AuditActor::AuditActor(AuditSource source, uint32_t uid, uint32_t actionId)
+    : source(source), uid(uid), actionId(actionId)
+{
+}
+
+static thread_local AuditActor current_actor;
+
+AuditScope::AuditScope(const AuditActor &actor) : previous_(current_actor)
+{
+ current_actor = actor;
+}
+
+AuditScope::~AuditScope()
+{
+ current_actor = previous_;
+}
+
+const AuditActor &AuditScope::current()
+{
+ return current_actor;
+}
+
+AuditLog::AuditLog()
+    : fd_(-1), commit_delay_(0), queue_(QUEUE_CAPACITY), stop_(false), records_(0), commits_(0), failures_(0),
+      write_failed_(false)
+{
+}
+
+AuditLog::~AuditLog()
+{
+ close();
+}
+
+bool AuditLog::open(const std::string &path, std::chrono::milliseconds commitDelay, std::string &error)
+{
+ path_ = path;
+ commit_delay_ = commitDelay;
+ fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+ if (fd_ < 0)
+ {
+  error = "Cannot open " + path + ": " + std::strerror(errno);
+  return false;
+ }
+
+ AuditFileLock lock(fd_);
+ if (!lock.locked())
+ {
+  error = "Cannot lock " + path + ": " + std::strerror(errno);
+  return false;
+ }
+
+ struct stat info;
+ if (fstat(fd_, &info) < 0)
+ {
+  error = "Cannot stat " + path + ": " + std::strerror(errno);
+  return false;
+ }
+
+ AuditFileHeader header;
+ if (info.st_size == 0)
+ {
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, AUDIT_MAGIC, sizeof(AUDIT_MAGIC));
+  header.version = AUDIT_VERSION;
+  header.recordBytes = sizeof(AuditRecord);
+  if (write(fd_, &header, sizeof(header)) != static_cast<ssize_t>(sizeof(header)) || fdatasync(fd_) < 0)
+  {
+   error = "Cannot initialise " + path + ": " + std::strerror(errno);
+   return false;
+  }
+ }
+ else if (pread(fd_, &header, sizeof(header), 0) != static_cast<ssize_t>(sizeof(header)) || !validHeader(header))
+ {
+  error = path + " is not an audit log";
+  return false;
+ }
+
+ writer_ = std::thread(&AuditLog::run, this);
+ return true;
+}
+
+void AuditLog::record(AuditRecord record)
+{
+ record.check = recordCheck(record);
+ queue_.push(std::move(record));
+}
+
+void AuditLog::close()
+{
+ if (writer_.joinable())
+ {
+  stop_.store(true, std::memory_order_release);
+  writer_.join();
+ }
+ if (fd_ >= 0)
+ {
+  ::close(fd_);
+  fd_ = -1;
+ }
+}
+
+AuditLog::Stats AuditLog::stats() const
+{
+ Stats stats;
+ stats.records = records_.load(std::memory_order_relaxed);
+ stats.commits = commits_.load(std::memory_order_relaxed);
+ stats.failures = failures_.load(std::memory_order_relaxed);
+ return stats;
+}
+
+void AuditLog::run()
+{
+ using Clock = std::chrono::steady_clock;
+
+ std::vector<AuditRecord> batch;
+ batch.reserve(MAX_BATCH);
+ AuditRecord record;
+
+ while (queue_.pop(record, stop_))
+ {
+  // The first record opens the commit window; whatever arrives before it
+  // closes shares the same write and sync
+  batch.clear();
+  batch.push_back(record);
+  auto deadline = Clock::now() + commit_delay_;
+  while (batch.size() < MAX_BATCH)
+  {
+   if (queue_.tryPop(record))
+   {
+    batch.push_back(record);
+    continue;
+   }
+   auto now = Clock::now();
+   if (now >= deadline || stop_.load(std::memory_order_acquire))
+   {
+    break;
+   }
+   std::this_thread::sleep_for(std::min<Clock::duration>(deadline - now, std::chrono::milliseconds(1)));
+  }
+  commit(batch);
+ }
+
+ // Stopping commits whatever is still queued
+ batch.clear();
+ while (queue_.tryPop(record))
+ {
+  batch.push_back(record);
+  if (batch.size() == MAX_BATCH)
+  {
+   commit(batch);
+   batch.clear();
+  }
+ }
+ if (!batch.empty())
+ {
+  commit(batch);
+ }
+}
+
+void AuditLog::commit(const std::vector<AuditRecord> &batch)
+{
+ AuditFileLock lock(fd_);
+ off_t start = -1;
+ const char *data = reinterpret_cast<const char *>(batch.data());
+ size_t remaining = batch.size() * sizeof(AuditRecord);
+ if (lock.locked() && trimTornTail(fd_))
+ {
+  start = lseek(fd_, 0, SEEK_END);
+  while (remaining > 0)
+  {
+   ssize_t written = write(fd_, data, remaining);
+   if (written < 0 && errno == EINTR)
+   {
+    continue;
+   }
+   if (written <= 0)
+   {
+    break;
+   }
+   data += written;
+   remaining -= static_cast<size_t>(written);
+  }
+ }
+
+ if (start < 0 || remaining > 0 || fdatasync(fd_) < 0)
+ {
+  std::string reason = std::strerror(errno);
+  failures_.fetch_add(batch.size(), std::memory_order_relaxed);
+
+  // Cut a partial batch off again, so later commits stay aligned. The lock
+  // keeps other writers from having appended after it.
+  if (start >= 0 && remaining > 0 && ftruncate(fd_, start) < 0)
+  {
+   reason += ", and the partial commit could not be removed";
+  }
+
+  // Say so once; the control path carries on without its audit trail
+  if (!write_failed_)
+  {
+   write_failed_ = true;
+   std::cerr << "[ERROR] Cannot write audit log " << path_ << ": " << reason << std::endl;
+  }
+  return;
+ }
+ records_.fetch_add(batch.size(), std::memory_order_relaxed);
+ commits_.fetch_add(1, std::memory_order_relaxed);
+}
+
+AuditFile::AuditFile()
+    : data_(nullptr), size_(0), records_(nullptr), count_(0)
+{
+}
+
+AuditFile::~AuditFile()
+{
+ if (data_)
+ {
+  munmap(const_cast<uint8_t *>(data_), size_);
+ }
+}
+
+bool AuditFile::open(const std::string &path, std::string &error)
+{
+ int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+ if (fd < 0)
+ {
+  error = "Cannot open " + path + ": " + std::strerror(errno);
+  return false;
+ }
+
+ struct stat info;
+ if (fstat(fd, &info) < 0 || static_cast<size_t>(info.st_size) < sizeof(AuditFileHeader))
+ {
+  ::close(fd);
+  error = path + " is not an audit log";
+  return false;
+ }
+
+ size_ = static_cast<size_t>(info.st_size);
+ void *memory = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+ ::close(fd);
+ if (memory == MAP_FAILED)
+ {
+  error = "Cannot map " + path + ": " + std::strerror(errno);
+  return false;
+ }
+ data_ = static_cast<const uint8_t *>(memory);
+
+ AuditFileHeader header;
+ std::memcpy(&header, data_, sizeof(header));
+ if (!validHeader(header))
+ {
+  error = path + " is not an audit log";
+  return false;
+ }
+
+ // A commit still in progress shows up as a partial record, which is left out
+ records_ = reinterpret_cast<const AuditRecord *>(data_ + sizeof(header));
+ count_ = (size_ - sizeof(header)) / sizeof(AuditRecord);
+
+ madvise(memory, size_, MADV_SEQUENTIAL);
+ return true;
+}
+
+size_t AuditFile::select(const AuditFilter &filter, std::vector<AuditRecord> &out) const
+{
+ // Hosts are compared by hash first and by their stored prefix only on a hit
+ std::vector<uint32_t> hashes;
+ for (const auto &host : filter.hosts)
+ {
+  hashes.push_back(auditHostHash(host));
+ }
+
+ size_t corrupt = 0;
+ for (size_t i = 0; i < count_; i++)
+ {
+  const AuditRecord &record = records_[i];
+  if (record.timestampMs < filter.fromMs || record.timestampMs >= filter.toMs)
+  {
+   continue;
+  }
+  if (filter.portMask && (record.port < 1 || record.port > 8 || !(filter.portMask & (1u << (record.port - 1)))))
+  {
+   continue;
+  }
+  if (!hashes.empty())
+  {
+   bool matched = false;
+   for (size_t h = 0; h < hashes.size() && !matched; h++)
+   {
+    matched = record.hostHash == hashes[h] &&
+              std::strncmp(record.host, filter.hosts[h].c_str(), sizeof(record.host) - 1) == 0;
+   }
+   if (!matched)
+   {
+    continue;
+   }
+  }
+  if (record.check != recordCheck(record))
+  {
+   corrupt++;
+   continue;
+  }
+  out.push_back(record);
+ }
+ return corrupt;
+}
+
+bool queryAudit(const std::vector<std::string> &paths, const AuditFilter &filter, std::vector<AuditRecord> &records,
+                size_t &corrupt, std::string &error)
+{
+ records.clear();
+ corrupt = 0;
+ for (const auto &path : paths)
+ {
+  AuditFile file;
+  if (!file.open(path, error))
+  {
+   return false;
+  }
+  corrupt += file.select(filter, records);
+ }
+
+ // Several writers, or a clock step, can append slightly out of order
+ std::stable_sort(records.begin(), records.end(),
+                  [](const AuditRecord &a, const AuditRecord &b) { return a.timestampMs < b.timestampMs; });
+ return true;
+}
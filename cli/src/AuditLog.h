@@ -0,0 +1,188 @@
+/**
+ * @file AuditLog.h
+ * @brief Append-only binary audit log of port control actions
+ *
+ * Every on/off the controller sends is described by one fixed-size record:
+ * who asked (source, uid, pid, scheduled action id), what was done (switch,
+ * port, operation, state before and after, result), when it was issued and
+ * how long the switch took to apply it.
+ *
+ * Recording never touches the disk on the control path. Records go through
+ * a bounded queue to a writer thread, which gathers everything arriving
+ * within the commit delay into one write() and one fdatasync(). A record is
+ * therefore durable at most the commit delay plus one sync after its action
+ * completed. Each record carries a checksum.
+ *
+ * Several processes may share a log, such as a daemon and one-shot
+ * commands. Each commit holds an exclusive flock() on the file, so commits
+ * never interleave. A torn tail left by a writer that crashed is cut off
+ * by the next commit, under the same lock.
+ *
+ * Readers map the file and scan the records in place.
+ */
+
+#ifndef AUDIT_LOG_H
+#define AUDIT_LOG_H
+
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+#include "BoundedQueue.h"
+
+// Who asked for an action
+enum AuditSource : uint8_t
+{
+ AUDIT_COMMAND = 0,  // A one-shot --on, --off or --cycle
+ AUDIT_SCHEDULE = 1, // The daemon's schedule file
+ AUDIT_SOCKET = 2,   // The daemon's control socket
+ AUDIT_SHEDDER = 3,  // Load shedding or restoring
+ AUDIT_CAPTURE = 4   // A burst capture's power-on
+};
+
+// Port state as recorded before and after an action
+enum AuditState : uint8_t
+{
+ AUDIT_STATE_OFF = 0,
+ AUDIT_STATE_ON = 1,
+ AUDIT_STATE_UNKNOWN = 2
+};
+
+struct AuditActor
+{
+ AuditSource source;
+ uint32_t uid;
+ uint32_t actionId; // Scheduled action, or zero
+
+ AuditActor();
+ AuditActor(AuditSource source, uint32_t uid, uint32_t actionId = 0);
+};
+
+// Attributes the actions made on the calling thread to an actor while alive
+class AuditScope
+{
+public:
+ explicit AuditScope(const AuditActor &actor);
+ ~AuditScope();
+
+ // The innermost scope's actor; a command-line actor for this process outside any scope
+ static const AuditActor &current();
+
+private:
+ AuditActor previous_;
+
+ AuditScope(const AuditScope &) = delete;
+ AuditScope &operator=(const AuditScope &) = delete;
+};
+
+// On-disk record; the layout is part of the file format
+struct AuditRecord
+{
+ int64_t timestampMs; // Wall clock when the action was sent
+ uint32_t latencyUs;  // Until the switch answered
+ uint32_t hostHash;   // Of the full host name
+ uint32_t uid;
+ uint32_t pid;
+ uint32_t actionId;
+ uint8_t port;
+ uint8_t enable; // 1 for on, 0 for off
+ uint8_t source; // AuditSource
+ uint8_t success;
+ uint8_t before; // AuditState
+ uint8_t after;  // AuditState
+ uint8_t reserved[2];
+ char host[56]; // NUL-terminated, truncated if longer
+ uint32_t check;
+};
+
+uint32_t auditHostHash(const std::string &host);
+
+class AuditLog
+{
+public:
+ static const size_t QUEUE_CAPACITY = 4096;
+
+ AuditLog();
+ // Commits whatever is still queued
+ ~AuditLog();
+
+ // Open or create a log and start the writer; records are durable at most commitDelay after they are queued
+ bool open(const std::string &path, std::chrono::milliseconds commitDelay, std::string &error);
+
+ // Queue one record; waits only if the writer has fallen a whole queue behind
+ void record(AuditRecord record);
+
+ // Commit everything queued so far and stop the writer
+ void close();
+
+ struct Stats
+ {
+  uint64_t records; // Committed to the file
+  uint64_t commits; // Group commits (one write and one sync each)
+  uint64_t failures; // Records lost to a failed write
+ };
+ Stats stats() const;
+
+private:
+ int fd_;
+ std::string path_;
+ std::chrono::milliseconds commit_delay_;
+ BoundedQueue<AuditRecord> queue_;
+ std::atomic<bool> stop_;
+ std::thread writer_;
+ std::atomic<uint64_t> records_;
+ std::atomic<uint64_t> commits_;
+ std::atomic<uint64_t> failures_;
+ bool write_failed_;
+
+ void run();
+ void commit(const std::vector<AuditRecord> &batch);
+
+ AuditLog(const AuditLog &) = delete;
+ AuditLog &operator=(const AuditLog &) = delete;
+};
+
+struct AuditFilter
+{
+ int64_t fromMs; // Inclusive
+ int64_t toMs;   // Exclusive
+ uint8_t portMask; // Bit (port - 1); zero selects every port
+ std::vector<std::string> hosts; // Empty selects every switch
+
+ AuditFilter() : fromMs(LLONG_MIN), toMs(LLONG_MAX), portMask(0) {}
+};
+
+// Read-only view of one log
+class AuditFile
+{
+public:
+ AuditFile();
+ ~AuditFile();
+
+ bool open(const std::string &path, std::string &error);
+
+ size_t size() const { return count_; }
+ const AuditRecord &operator[](size_t index) const { return records_[index]; }
+
+ // Append the records matching filter; returns how many failed their checksum
+ size_t select(const AuditFilter &filter, std::vector<AuditRecord> &out) const;
+
+private:
+ const uint8_t *data_;
+ size_t size_;
+ const AuditRecord *records_;
+ size_t count_;
+
+ AuditFile(const AuditFile &) = delete;
+ AuditFile &operator=(const AuditFile &) = delete;
+};
+
+// Matching records of every file in time order; corrupt counts checksum failures
+bool queryAudit(const std::vector<std::string> &paths, const AuditFilter &filter, std::vector<AuditRecord> &records,
+                size_t &corrupt, std::string &error);
+
+#endif // AUDIT_LOG_H
@@ -0,0 +1,184 @@
+/**
+ * @file BoundedQueue.h
+ * @brief Bounded lock-free multi-producer, multi-consumer queue
+ *
+ * A ring of cells, each carrying a sequence number that tells producers and
+ * consumers whether the cell is free for the current lap (D. Vyukov's
+ * design). tryPush and tryPop never block and never allocate; push and pop
+ * wrap them with a spin-then-sleep backoff for threads that have nothing
+ * else to do.
+ */
+
+#ifndef BOUNDED_QUEUE_H
+#define BOUNDED_QUEUE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <utility>
+
+template <typename T>
+class BoundedQueue
+{
+public:
+ // Capacity is rounded up to a power of two
+ explicit BoundedQueue(size_t capacity)
+     : mask_(roundUp(capacity) - 1), cells_(new Cell[mask_ + 1]), enqueue_pos_(0), dequeue_pos_(0), high_water_(0)
+ {
+  for (size_t i = 0; i <= mask_; i++)
+  {
+   cells_[i].sequence.store(i, std::memory_order_relaxed);
+  }
+ }
+
+ bool tryPush(T &&value)
+ {
+  size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+  for (;;)
+  {
+   Cell &cell = cells_[pos & mask_];
+   size_t sequence = cell.sequence.load(std::memory_order_acquire);
+   intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+   if (diff == 0)
+   {
+    if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+    {
+     cell.value = std::move(value);
+     cell.sequence.store(pos + 1, std::memory_order_release);
+     noteDepth(pos + 1);
+     return true;
+    }
+   }
+   else if (diff < 0)
+   {
+    return false; // Full
+   }
+   else
+   {
+    pos = enqueue_pos_.load(std::memory_order_relaxed);
+   }
+  }
+ }
+
+ bool tryPop(T &value)
+ {
+  size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+  for (;;)
+  {
+   Cell &cell = cells_[pos & mask_];
+   size_t sequence = cell.sequence.load(std::memory_order_acquire);
+   intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos + 1);
+   if (diff == 0)
+   {
+    if (dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+    {
+     value = std::move(cell.value);
+     cell.sequence.store(pos + mask_ + 1, std::memory_order_release);
+     return true;
+    }
+   }
+   else if (diff < 0)
+   {
+    return false; // Empty
+   }
+   else
+   {
+    pos = dequeue_pos_.load(std::memory_order_relaxed);
+   }
+  }
+ }
+
+ void push(T &&value)
+ {
+  for (unsigned attempt = 0; !tryPush(std::move(value)); attempt++)
+  {
+   backoff(attempt);
+  }
+ }
+
+ // Wait for an item until stop becomes true; false if stopped while empty
+ bool pop(T &value, const std::atomic<bool> &stop)
+ {
+  for (unsigned attempt = 0; !tryPop(value); attempt++)
+  {
+   if (stop.load(std::memory_order_acquire))
+   {
+    return false;
+   }
+   backoff(attempt);
+  }
+  return true;
+ }
+
+ // Approximate number of queued items
+ size_t depth() const
+ {
+  size_t enqueued = enqueue_pos_.load(std::memory_order_relaxed);
+  size_t dequeued = dequeue_pos_.load(std::memory_order_relaxed);
+  return enqueued > dequeued ? enqueued - dequeued : 0;
+ }
+
+ // Deepest the queue has been since the last call
+ size_t takeHighWater() { return high_water_.exchange(depth(), std::memory_order_relaxed); }
+
+ size_t capacity() const { return mask_ + 1; }
+
+private:
+ struct Cell
+ {
+  std::atomic<size_t> sequence;
+  T value;
+ };
+
+ // Producer and consumer positions sit on separate cache lines
+ const size_t mask_;
+ std::unique_ptr<Cell[]> cells_;
+ alignas(64) std::atomic<size_t> enqueue_pos_;
+ alignas(64) std::atomic<size_t> dequeue_pos_;
+ alignas(64) std::atomic<size_t> high_water_;
+
+ static size_t roundUp(size_t capacity)
+ {
+  size_t size = 2;
+  while (size < capacity)
+  {
+   size <<= 1;
+  }
+  return size;
+ }
+
+ void noteDepth(size_t enqueued)
+ {
+  size_t dequeued = dequeue_pos_.load(std::memory_order_relaxed);
+  size_t depth = enqueued > dequeued ? enqueued - dequeued : 0;
+  size_t seen = high_water_.load(std::memory_order_relaxed);
+  while (depth > seen && !high_water_.compare_exchange_weak(seen, depth, std::memory_order_relaxed))
+  {
+  }
+ }
+
+ static void backoff(unsigned attempt)
+ {
+  // Idle consumers settle at a few hundred wakeups a second
+  if (attempt < 64)
+  {
+   std::this_thread::yield();
+  }
+  else if (attempt < 1024)
+  {
+   std::this_thread::sleep_for(std::chrono::microseconds(attempt < 256 ? 50 : 500));
+  }
+  else
+  {
+   std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+ }
+
+ BoundedQueue(const BoundedQueue &) = delete;
+ BoundedQueue &operator=(const BoundedQueue &) = delete;
+};
+
+#endif // BOUNDED_QUEUE_H
@@ -0,0 +1,181 @@
+/**
+ * @file Capture.cpp
+ * @brief Implementation of burst capture
+ */
+
+#include "Capture.h"
+#include "AuditLog.h"
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <thread>
+#include <unistd.h>
+
+// A switch that keeps failing has stopped answering; give up rather than spin
+static const uint32_t MAX_CONSECUTIVE_FAILURES = 10;
+
+static double millisBetween(std::chrono::steady_clock::time_point from, std::chrono::steady_clock::time_point to)
+{
+ return std::chrono::duration<double, std::milli>(to - from).count();
+}
+
+bool runCapture(GS308EP_CLI &controller, const CaptureOptions &options, volatile sig_atomic_t &stop,
+                CaptureResult &result, std::string &error)
+{
+ using Clock = std::chrono::steady_clock;
+
+ result = CaptureResult();
+ result.port = options.port;
+ std::vector<int> ports(1, options.port);
+ AuditScope scope(AuditActor(AUDIT_CAPTURE, getuid()));
+
+ // Everything the power-on needs is fetched first, so it is a single POST
+ if (!controller.prepareControl())
+ {
+  error = "Cannot read the port configuration form";
+  return false;
+ }
+
+ if (options.precycleMs >= 0)
+ {
+  if (!controller.setPortStates(ports, false))
+  {
+   error = "Failed to turn off port " + std::to_string(options.port);
+   return false;
+  }
+  auto until = Clock::now() + std::chrono::milliseconds(options.precycleMs);
+  while (!stop && Clock::now() < until)
+  {
+   std::this_thread::sleep_for(std::min<Clock::duration>(until - Clock::now(), std::chrono::milliseconds(100)));
+  }
+  if (stop)
+  {
+   error = "Interrupted before the port was turned on";
+   return false;
+  }
+ }
+
+ // Room for a generous rate, so the series is not copied while sampling
+ result.samples.reserve(static_cast<size_t>(options.durationMs) / 2 + 64);
+ std::string page;
+
+ auto sent = Clock::now();
+ if (!controller.setPortStates(ports, true))
+ {
+  error = "Failed to turn on port " + std::to_string(options.port);
+  return false;
+ }
+ auto answered = Clock::now();
+ auto zero = sent + (answered - sent) / 2;
+ result.powerOnRttMs = millisBetween(sent, answered);
+ result.powerOnNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        (std::chrono::system_clock::now() - (answered - zero)).time_since_epoch())
+                        .count();
+
+ auto deadline = zero + std::chrono::milliseconds(options.durationMs);
+ PoEPortStats stats;
+ uint32_t consecutiveFailures = 0;
+ auto samplingStart = Clock::now();
+ auto samplingEnd = samplingStart;
+ while (!stop && (samplingEnd = Clock::now()) < deadline)
+ {
+  auto before = samplingEnd;
+  bool ok = controller.fetchStatusPage(page) && GS308EP_CLI::parsePortStats(page, options.port, stats);
+  auto after = Clock::now();
+  if (!ok)
+  {
+   result.failed++;
+   if (++consecutiveFailures >= MAX_CONSECUTIVE_FAILURES)
+   {
+    // What was sampled up to here is kept; a port that brings the switch
+    // down is the curve the capture is for
+    error = "Switch stopped answering during the capture";
+    samplingEnd = after;
+    break;
+   }
+   continue;
+  }
+  consecutiveFailures = 0;
+
+  CaptureSample sample;
+  sample.atMs = millisBetween(zero, before + (after - before) / 2);
+  sample.rttMs = millisBetween(before, after);
+  sample.status = stats.status;
+  sample.voltage = stats.voltage;
+  sample.current = stats.current;
+  sample.power = stats.power;
+  result.samples.push_back(sample);
+ }
+
+ result.samplingMs = millisBetween(samplingStart, samplingEnd);
+ result.rateHz = result.samplingMs > 0.0 ? result.samples.size() * 1000.0 / result.samplingMs : 0.0;
+ if (!result.samples.empty())
+ {
+  std::vector<double> rtts;
+  rtts.reserve(result.samples.size());
+  for (const auto &sample : result.samples)
+  {
+   rtts.push_back(sample.rttMs);
+  }
+  auto middle = rtts.begin() + rtts.size() / 2;
+  std::nth_element(rtts.begin(), middle, rtts.end());
+  result.rttMedianMs = *middle;
+  auto range = std::minmax_element(rtts.begin(), rtts.end());
+  result.rttMinMs = *range.first;
+  result.rttMaxMs = *range.second;
+ }
+ return consecutiveFailures < MAX_CONSECUTIVE_FAILURES;
+}
+
+void writeCapture(const CaptureResult &result, const std::string &format, bool quiet, std::ostream &out)
+{
+ out << std::fixed;
+ if (format == "json")
+ {
+  out << std::setprecision(3) << "{\"port\":" << result.port << ",\"power_on\":" << result.powerOnNs
+      << ",\"power_on_rtt_ms\":" << result.powerOnRttMs << ",\"sampling_ms\":" << result.samplingMs
+      << ",\"samples\":" << result.samples.size() << ",\"rate_hz\":" << std::setprecision(1) << result.rateHz
+      << std::setprecision(3) << ",\"rtt_ms\":{\"min\":" << result.rttMinMs << ",\"median\":" << result.rttMedianMs
+      << ",\"max\":" << result.rttMaxMs << "},\"failed\":" << result.failed << ",\"series\":[";
+  for (size_t i = 0; i < result.samples.size(); i++)
+  {
+   const CaptureSample &sample = result.samples[i];
+   out << (i ? ",{" : "{") << std::setprecision(3) << "\"t_ms\":" << sample.atMs << ",\"rtt_ms\":" << sample.rttMs
+       << ",\"status\":\"" << internedText(sample.status) << "\"" << std::setprecision(2)
+       << ",\"voltage\":" << sample.voltage << ",\"current\":" << sample.current << ",\"power\":" << sample.power
+       << "}";
+  }
+  out << "]}" << std::endl;
+  return;
+ }
+
+ if (format == "csv")
+ {
+  out << "t_ms,rtt_ms,status,voltage,current,power\n";
+  for (const auto &sample : result.samples)
+  {
+   out << std::setprecision(3) << sample.atMs << "," << sample.rttMs << "," << internedText(sample.status) << ","
+       << std::setprecision(2) << sample.voltage << "," << sample.current << "," << sample.power << "\n";
+  }
+  out << std::flush;
+  return;
+ }
+
+ if (!quiet)
+ {
+  out << std::setprecision(1) << "Port " << result.port << ": " << result.samples.size() << " samples in "
+      << result.samplingMs / 1000.0 << " s (" << result.rateHz << " samples/s), RTT min/median/max "
+      << std::setprecision(2) << result.rttMinMs << "/" << result.rttMedianMs << "/" << result.rttMaxMs
+      << " ms, " << result.failed << " failed" << std::endl;
+ }
+ out << std::setw(10) << "TIME_MS" << std::setw(9) << "RTT_MS" << "  " << std::left << std::setw(18) << "STATUS"
+     << std::right << std::setw(9) << "VOLTAGE" << std::setw(9) << "CURRENT" << std::setw(8) << "POWER" << std::endl;
+ for (const auto &sample : result.samples)
+ {
+  out << std::setprecision(1) << std::setw(10) << sample.atMs << std::setprecision(2) << std::setw(9) << sample.rttMs
+      << "  " << std::left << std::setw(18) << internedText(sample.status) << std::right << std::setprecision(1)
+      << std::setw(9) << sample.voltage << std::setprecision(0) << std::setw(9) << sample.current
+      << std::setprecision(2) << std::setw(8) << sample.power << "\n";
+ }
+ out << std::flush;
+}
@@ -0,0 +1,68 @@
+/**
+ * @file Capture.h
+ * @brief Burst capture of one port's power curve from the moment it is turned on
+ *
+ * A capture turns a port on and then fetches the status page back-to-back,
+ * with no pause, for a fixed time, so it samples as fast as the switch
+ * answers. The session and the port form's hash are set up before the port
+ * is switched, and each page is parsed for the target port only. Nothing
+ * else runs on the sampling path.
+ *
+ * Times come from the monotonic clock. A sample is stamped at the midpoint
+ * of its request, halfway between sending it and receiving the answer,
+ * because that is the best estimate of when the switch read its counters.
+ * Time zero is the midpoint of the request that turned the port on.
+ */
+
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <csignal>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "GS308EP_CLI.h"
+
+struct CaptureOptions
+{
+ int port;
+ int durationMs;
+ int precycleMs; // Hold the port off this long before turning it on; -1 to turn it on as it is
+};
+
+struct CaptureSample
+{
+ double atMs;  // Request midpoint, relative to the power-on midpoint
+ double rttMs; // Round trip of the request
+ TextId status;
+ float voltage;
+ float current;
+ float power;
+};
+
+struct CaptureResult
+{
+ int port;
+ int64_t powerOnNs;    // Wall-clock time of time zero, for correlating with other logs
+ double powerOnRttMs;  // Round trip of the request that turned the port on
+ double samplingMs;    // Time spent sampling
+ double rateHz;        // Samples achieved per second of sampling
+ double rttMinMs;
+ double rttMedianMs;
+ double rttMaxMs;
+ uint32_t failed;      // Requests that returned no reading for the port
+ std::vector<CaptureSample> samples;
+};
+
+// Turn the port on and sample it until the duration has passed or stop is
+// set. The controller must be logged in. False, with error set, if the port
+// could not be switched or the switch stopped answering. In the latter case
+// result still holds everything sampled until then.
+bool runCapture(GS308EP_CLI &controller, const CaptureOptions &options, volatile sig_atomic_t &stop,
+                CaptureResult &result, std::string &error);
+
+// Write a capture as text, json or csv. quiet drops the text summary line.
+void writeCapture(const CaptureResult &result, const std::string &format, bool quiet, std::ostream &out);
+
+#endif // CAPTURE_H
@@ -0,0 +1,47 @@
+/**
+ * @file CurlShare.cpp
+ * @brief Implementation of the shared libcurl caches
+ */
+
+#include "CurlShare.h"
+#include <curl/curl.h>
+
+static void lockShare(CURL *, curl_lock_data data, curl_lock_access, void *user)
+{
+ static_cast<std::mutex *>(user)[data].lock();
+}
+
+static void unlockShare(CURL *, curl_lock_data data, void *user)
+{
+ static_cast<std::mutex *>(user)[data].unlock();
+}
+
+CurlShare::CurlShare(long connections)
+    : share_(nullptr), connections_(connections), locks_(new std::mutex[CURL_LOCK_DATA_LAST])
+{
+ curl_global_init(CURL_GLOBAL_DEFAULT);
+ CURLSH *share = curl_share_init();
+ if (!share)
+ {
+  return;
+ }
+ curl_share_setopt(share, CURLSHOPT_LOCKFUNC, lockShare);
+ curl_share_setopt(share, CURLSHOPT_UNLOCKFUNC, unlockShare);
+ curl_share_setopt(share, CURLSHOPT_USERDATA, locks_.get());
+ curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+ curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+#if LIBCURL_VERSION_NUM >= 0x073900
+ curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+#endif
+ share_ = share;
+}
+
+// Every handle using the share must have been cleaned up first
+CurlShare::~CurlShare()
+{
+ if (share_)
+ {
+  curl_share_cleanup(static_cast<CURLSH *>(share_));
+ }
+ curl_global_cleanup();
+}
@@ -0,0 +1,44 @@
+/**
+ * @file CurlShare.h
+ * @brief libcurl state shared by every controller of a process
+ *
+ * A fleet has one controller per switch, and any fetch worker may run a
+ * controller's requests. The share lets every handle use the same DNS cache,
+ * connection pool and TLS session cache. A switch resolved or connected once
+ * stays warm for whichever thread talks to it next. This includes the
+ * short-lived handles used for logins and for concurrent requests. libcurl
+ * calls back into the share to lock each kind of data.
+ *
+ * Cookies are deliberately not shared. Switches often differ only by port,
+ * and cookies are not scoped by port, so one jar would mix their session ids.
+ * Each controller already keeps its own session for every thread that uses it.
+ */
+
+#ifndef CURL_SHARE_H
+#define CURL_SHARE_H
+
+#include <memory>
+#include <mutex>
+
+class CurlShare
+{
+public:
+ // Connections is how many idle connections the pool keeps; one per switch.
+ // Each request applies it, since libcurl otherwise keeps only a handful.
+ explicit CurlShare(long connections);
+ ~CurlShare();
+
+ // The CURLSH handle, or nullptr if libcurl could not create one
+ void *handle() const { return share_; }
+ long connections() const { return connections_; }
+
+private:
+ void *share_;
+ long connections_;
+ std::unique_ptr<std::mutex[]> locks_; // One per curl_lock_data kind
+
+ CurlShare(const CurlShare &) = delete;
+ CurlShare &operator=(const CurlShare &) = delete;
+};
+
+#endif // CURL_SHARE_H
@@ -0,0 +1,774 @@
+/**
+ * @file Daemon.cpp
+ * @brief Implementation of the long-running controller daemon
+ */
+
+#include "Daemon.h"
+#include "Deadline.h"
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static const size_t MAX_CLIENTS = 64;
+static const size_t MAX_LINE = 1024;
+static const char *DAY_NAMES[] = {"sun", "mon", "tue", "wed", "thu", "fri", "sat"};
+
+static bool parseClock(const std::string &text, int &hour, int &minute)
+{
+ char extra = 0;
+ if (std::sscanf(text.c_str(), "%d:%d%c", &hour, &minute, &extra) != 2)
+ {
+  return false;
+ }
+ return hour >= 0 && hour <= 23 && minute >= 0 && minute <= 59;
+}
+
+static bool parseWeekday(std::string text, int &weekday)
+{
+ std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return std::tolower(c); });
+ for (int i = 0; i < 7; i++)
+ {
+  if (text.compare(0, 3, DAY_NAMES[i]) == 0)
+  {
+   weekday = i;
+   return true;
+  }
+ }
+ return false;
+}
+
+static bool parseOperation(const std::string &text, ScheduledAction &action)
+{
+ action.cycleDelayMs = 2000;
+ if (text == "on")
+ {
+  action.operation = ScheduledAction::ON;
+ }
+ else if (text == "off")
+ {
+  action.operation = ScheduledAction::OFF;
+ }
+ else if (text == "cycle" || text.compare(0, 6, "cycle:") == 0)
+ {
+  action.operation = ScheduledAction::CYCLE;
+  if (text.size() > 6)
+  {
+   action.cycleDelayMs = std::atoi(text.c_str() + 6);
+   if (action.cycleDelayMs < 0)
+   {
+    return false;
+   }
+  }
+ }
+ else
+ {
+  return false;
+ }
+ return true;
+}
+
+bool parseScheduledAction(const std::string &line, ScheduledAction &action, std::string &error)
+{
+ std::istringstream in(line);
+ std::vector<std::string> words;
+ std::string word;
+ while (in >> word)
+ {
+  words.push_back(word);
+ }
+
+ action = ScheduledAction();
+ action.spec = line;
+ action.weekday = -1;
+ action.seconds = 0;
+
+ size_t next = 0;
+ if (words.empty())
+ {
+  error = "empty schedule entry";
+  return false;
+ }
+
+ const std::string &kind = words[next++];
+ if (kind == "daily" || kind == "at")
+ {
+  action.kind = (kind == "daily") ? ScheduledAction::DAILY : ScheduledAction::ONCE_AT;
+  if (next >= words.size() || !parseClock(words[next++], action.hour, action.minute))
+  {
+   error = "expected HH:MM after '" + kind + "'";
+   return false;
+  }
+ }
+ else if (kind == "weekly")
+ {
+  action.kind = ScheduledAction::WEEKLY;
+  if (next >= words.size() || !parseWeekday(words[next++], action.weekday))
+  {
+   error = "expected day name after 'weekly'";
+   return false;
+  }
+  if (next >= words.size() || !parseClock(words[next++], action.hour, action.minute))
+  {
+   error = "expected HH:MM after day name";
+   return false;
+  }
+ }
+ else if (kind == "in" || kind == "every")
+ {
+  action.kind = (kind == "in") ? ScheduledAction::ONCE_IN : ScheduledAction::INTERVAL;
+  if (next >= words.size())
+  {
+   error = "expected seconds after '" + kind + "'";
+   return false;
+  }
+  action.seconds = std::atol(words[next++].c_str());
+  if (action.seconds < 0 || (action.kind == ScheduledAction::INTERVAL && action.seconds == 0))
+  {
+   error = "invalid number of seconds";
+   return false;
+  }
+ }
+ else
+ {
+  error = "unknown schedule kind '" + kind + "'";
+  return false;
+ }
+
+ if (next >= words.size() || !parseOperation(words[next++], action))
+ {
+  error = "expected on, off or cycle[:MS]";
+  return false;
+ }
+
+ if (next >= words.size())
+ {
+  error = "expected port number";
+  return false;
+ }
+ action.port = std::atoi(words[next++].c_str());
+ if (action.port < 1 || action.port > 8)
+ {
+  error = "port must be between 1 and 8";
+  return false;
+ }
+
+ if (next != words.size())
+ {
+  error = "unexpected trailing input";
+  return false;
+ }
+ return true;
+}
+
+// Next wall-clock occurrence strictly after now (local time, DST-aware via mktime)
+static time_t nextOccurrence(const ScheduledAction &action, time_t now)
+{
+ if (action.kind == ScheduledAction::ONCE_IN || action.kind == ScheduledAction::INTERVAL)
+ {
+  return now + action.seconds;
+ }
+
+ struct tm local;
+ localtime_r(&now, &local);
+ local.tm_hour = action.hour;
+ local.tm_min = action.minute;
+ local.tm_sec = 0;
+ local.tm_isdst = -1;
+
+ if (action.kind == ScheduledAction::WEEKLY)
+ {
+  local.tm_mday += (action.weekday - local.tm_wday + 7) % 7;
+ }
+
+ time_t when = mktime(&local);
+ if (when <= now)
+ {
+  local.tm_mday += (action.kind == ScheduledAction::WEEKLY) ? 7 : 1;
+  local.tm_isdst = -1;
+  when = mktime(&local);
+ }
+ return when;
+}
+
+Daemon::Daemon(GS308EP_CLI &controller, const DaemonOptions &options, StatsWriter *writer)
+    : controller_(controller), options_(options), writer_(writer), shedder_(nullptr), baselines_(nullptr), snapshot_(nullptr), history_(nullptr), wheel_(0), listen_fd_(-1),
+      next_action_id_(1), poll_due_(false), session_due_(false)
+{
+ if (options_.tickMs <= 0)
+ {
+  options_.tickMs = 100;
+ }
+ wheel_ = TimerWheel(nowTick());
+}
+
+Daemon::~Daemon()
+{
+ for (auto &client : clients_)
+ {
+  close(client.fd);
+ }
+ if (listen_fd_ >= 0)
+ {
+  close(listen_fd_);
+  unlink(options_.socketPath.c_str());
+ }
+}
+
+uint64_t Daemon::nowTick() const
+{
+ auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+     std::chrono::steady_clock::now().time_since_epoch());
+ return static_cast<uint64_t>(elapsed.count()) / options_.tickMs;
+}
+
+uint64_t Daemon::tickAt(time_t when, time_t now) const
+{
+ int64_t delayMs = (when > now) ? static_cast<int64_t>(when - now) * 1000 : 0;
+ return nowTick() + static_cast<uint64_t>((delayMs + options_.tickMs - 1) / options_.tickMs);
+}
+
+void Daemon::arm(ScheduledAction &action, time_t now)
+{
+ if (action.kind == ScheduledAction::INTERVAL && action.nextFire != 0)
+ {
+  // Advance from the previous fire so the cadence does not slip
+  action.nextFire += action.seconds;
+  if (action.nextFire <= now)
+  {
+   action.nextFire = now + action.seconds;
+  }
+ }
+ else
+ {
+  action.nextFire = nextOccurrence(action, now);
+ }
+
+ uint64_t payload = (static_cast<uint64_t>(TIMER_ACTION) << 32) | action.id;
+ action.timer = wheel_.schedule(tickAt(action.nextFire, now), payload);
+}
+
+uint32_t Daemon::addAction(const std::string &spec, const AuditActor &origin, std::string &error)
+{
+ ScheduledAction action;
+ if (!parseScheduledAction(spec, action, error))
+ {
+  return 0;
+ }
+ action.origin = origin;
+
+ action.id = next_action_id_++;
+ action.nextFire = 0;
+ arm(action, time(nullptr));
+ actions_[action.id] = action;
+
+ log("Scheduled #" + std::to_string(action.id) + ": " + spec);
+ return action.id;
+}
+
+bool Daemon::cancelAction(uint32_t id)
+{
+ auto it = actions_.find(id);
+ if (it == actions_.end())
+ {
+  return false;
+ }
+
+ wheel_.cancel(it->second.timer);
+ actions_.erase(it);
+ return true;
+}
+
+void Daemon::onTimer(uint64_t payload)
+{
+ uint32_t type = static_cast<uint32_t>(payload >> 32);
+ uint32_t id = static_cast<uint32_t>(payload & 0xffffffffu);
+
+ if (type == TIMER_ACTION)
+ {
+  auto it = actions_.find(id);
+  if (it == actions_.end())
+  {
+   return;
+  }
+
+  ScheduledAction &action = it->second;
+  ControlRequest request;
+  request.port = action.port;
+  request.enable = (action.operation == ScheduledAction::ON);
+  request.restoreAfterMs = (action.operation == ScheduledAction::CYCLE) ? action.cycleDelayMs : -1;
+  request.actor = action.origin;
+  request.actor.actionId = action.id;
+  control_queue_.push_back(request);
+
+  if (action.kind == ScheduledAction::ONCE_AT || action.kind == ScheduledAction::ONCE_IN)
+  {
+   actions_.erase(it);
+  }
+  else
+  {
+   arm(action, time(nullptr));
+  }
+ }
+ else if (type == TIMER_CYCLE_RESTORE)
+ {
+  ControlRequest request;
+  request.port = static_cast<int>(id);
+  request.enable = true;
+  request.restoreAfterMs = -1;
+  auto origin = restore_actors_.find(request.port);
+  if (origin != restore_actors_.end())
+  {
+   request.actor = origin->second;
+   restore_actors_.erase(origin);
+  }
+  control_queue_.push_back(request);
+ }
+ else if (type == TIMER_POLL)
+ {
+  poll_due_ = true;
+  uint64_t firedTick = wheel_.currentTick() - 1;
+  uint64_t interval = static_cast<uint64_t>(options_.pollIntervalSec) * 1000 / options_.tickMs;
+  wheel_.schedule(firedTick + std::max<uint64_t>(interval, 1), payload);
+ }
+ else if (type == TIMER_SESSION)
+ {
+  session_due_ = true;
+  uint64_t interval = static_cast<uint64_t>(options_.keepaliveCheckSec) * 1000 / options_.tickMs;
+  wheel_.schedule(wheel_.currentTick() - 1 + std::max<uint64_t>(interval, 1), payload);
+ }
+}
+
+void Daemon::drainControlQueue()
+{
+ while (!control_queue_.empty())
+ {
+  ControlRequest request = control_queue_.front();
+  control_queue_.pop_front();
+
+  // A bounded action cannot hold up the loop, and the timers behind it, for longer than its deadline
+  std::unique_ptr<Deadline> deadline;
+  if (options_.actionDeadlineMs > 0)
+  {
+   deadline.reset(new Deadline(std::chrono::milliseconds(options_.actionDeadlineMs)));
+  }
+  AuditScope scope(request.actor);
+  DeadlineScope bounded(deadline.get());
+  bool ok = request.enable ? controller_.turnOnPort(request.port, false, true)
+                           : controller_.turnOffPort(request.port, false, true);
+
+  std::string what = request.enable ? "on" : "off";
+  log("Port " + std::to_string(request.port) + " " + what + (ok ? "" : " FAILED") +
+      (request.actor.actionId ? " (#" + std::to_string(request.actor.actionId) + ")" : ""));
+  if (deadline && deadline->exceeded())
+  {
+   error("Port " + std::to_string(request.port) + " " + what + ": deadline of " +
+         std::to_string(options_.actionDeadlineMs) + " ms expired during " + deadline->stage());
+  }
+
+  if (ok && request.restoreAfterMs >= 0)
+  {
+   // Cycle restore is a timer, so the loop keeps serving while the port is off
+   uint64_t delayTicks = static_cast<uint64_t>(request.restoreAfterMs) / options_.tickMs;
+   uint64_t payload = (static_cast<uint64_t>(TIMER_CYCLE_RESTORE) << 32) | static_cast<uint32_t>(request.port);
+   wheel_.schedule(nowTick() + delayTicks, payload);
+   restore_actors_[request.port] = request.actor;
+  }
+ }
+}
+
+void Daemon::pollStats()
+{
+ int64_t timestampNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                           std::chrono::system_clock::now().time_since_epoch())
+                           .count();
+ if (!controller_.pollAllStats(last_stats_))
+ {
+  return;
+ }
+
+ // Shedding acts on the sample before anything else sees it
+ if (shedder_)
+ {
+  shedder_->enforce(controller_, last_stats_);
+ }
+
+ if (snapshot_)
+ {
+  snapshot_->publish(timestampNs, last_stats_);
+ }
+
+ if (history_ && !history_->append(timestampNs / 1000000, last_stats_))
+ {
+  error("Failed to append to the history file");
+  history_ = nullptr;
+ }
+
+ if (baselines_)
+ {
+  baselines_->observe(controller_.host(), last_stats_);
+ }
+
+ if (subscriptions_.size())
+ {
+  subscriptions_.publish(controller_.host(), timestampNs, last_stats_);
+ }
+
+ if (writer_)
+ {
+  writer_->writeSample(controller_.host(), timestampNs, last_stats_);
+ }
+}
+
+bool Daemon::loadSchedule(const std::string &path)
+{
+ std::ifstream in(path);
+ if (!in)
+ {
+  error("Cannot open schedule file " + path);
+  return false;
+ }
+
+ std::string line;
+ int lineNumber = 0;
+ while (std::getline(in, line))
+ {
+  lineNumber++;
+  size_t start = line.find_first_not_of(" \t\r");
+  if (start == std::string::npos || line[start] == '#')
+  {
+   continue;
+  }
+
+  std::string message;
+  if (addAction(line.substr(start, line.find_last_not_of(" \t\r") - start + 1), AuditActor(AUDIT_SCHEDULE, getuid()),
+                message) == 0)
+  {
+   error(path + ":" + std::to_string(lineNumber) + ": " + message);
+   return false;
+  }
+ }
+ return true;
+}
+
+bool Daemon::openSocket()
+{
+ sockaddr_un addr;
+ std::memset(&addr, 0, sizeof(addr));
+ addr.sun_family = AF_UNIX;
+ if (options_.socketPath.size() >= sizeof(addr.sun_path))
+ {
+  error("Socket path too long: " + options_.socketPath);
+  return false;
+ }
+ std::strncpy(addr.sun_path, options_.socketPath.c_str(), sizeof(addr.sun_path) - 1);
+
+ listen_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+ if (listen_fd_ < 0)
+ {
+  error("socket: " + std::string(std::strerror(errno)));
+  return false;
+ }
+
+ unlink(options_.socketPath.c_str());
+ if (bind(listen_fd_, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0 || listen(listen_fd_, 16) < 0)
+ {
+  error("Cannot listen on " + options_.socketPath + ": " + std::strerror(errno));
+  close(listen_fd_);
+  listen_fd_ = -1;
+  return false;
+ }
+ return true;
+}
+
+bool Daemon::start()
+{
+ if (!options_.socketPath.empty() && !openSocket())
+ {
+  return false;
+ }
+
+ if (!options_.schedulePath.empty() && !loadSchedule(options_.schedulePath))
+ {
+  return false;
+ }
+
+ if (options_.pollIntervalSec > 0)
+ {
+  wheel_.schedule(nowTick(), static_cast<uint64_t>(TIMER_POLL) << 32);
+ }
+
+ if (options_.keepaliveCheckSec > 0)
+ {
+  uint64_t first = static_cast<uint64_t>(options_.keepaliveCheckSec) * 1000 / options_.tickMs;
+  wheel_.schedule(nowTick() + first, static_cast<uint64_t>(TIMER_SESSION) << 32);
+ }
+ return true;
+}
+
+void Daemon::acceptClients()
+{
+ while (true)
+ {
+  int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+  if (fd < 0)
+  {
+   return;
+  }
+  if (clients_.size() >= MAX_CLIENTS)
+  {
+   close(fd);
+   continue;
+  }
+
+  // Actions requested over the socket are audited as the peer's
+  struct ucred peer;
+  socklen_t length = sizeof(peer);
+  Client client;
+  client.fd = fd;
+  client.uid = getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &peer, &length) == 0 ? peer.uid : UINT32_MAX;
+  client.subscription = 0;
+  clients_.push_back(client);
+ }
+}
+
+void Daemon::handleCommand(Client &client, const std::string &line)
+{
+ std::istringstream in(line);
+ std::string verb;
+ in >> verb;
+
+ if (verb.empty() || verb[0] == '#')
+ {
+  return;
+ }
+
+ if (verb == "list")
+ {
+  for (const auto &entry : actions_)
+  {
+   char when[32];
+   struct tm local;
+   localtime_r(&entry.second.nextFire, &local);
+   strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", &local);
+   client.output += std::to_string(entry.first) + " " + entry.second.spec + " next=" + when + "\n";
+  }
+  client.output += "OK\n";
+ }
+ else if (verb == "cancel")
+ {
+  uint32_t id = 0;
+  in >> id;
+  client.output += cancelAction(id) ? "OK\n" : "ERR no such action\n";
+ }
+ else if (verb == "subscribe")
+ {
+  std::string rest;
+  std::getline(in, rest);
+  SubscriptionFilter filter;
+  std::string message;
+  if (options_.pollIntervalSec <= 0)
+  {
+   client.output += "ERR daemon is not polling (start it with --watch)\n";
+  }
+  else if (client.subscription)
+  {
+   client.output += "ERR already subscribed\n";
+  }
+  else if (!parseSubscriptionFilter(rest, filter, message))
+  {
+   client.output += "ERR " + message + "\n";
+  }
+  else
+  {
+   client.subscription = subscriptions_.subscribe(filter);
+   client.output += "OK " + std::to_string(client.subscription) + "\n";
+   log("Subscriber " + std::to_string(client.subscription) + " attached (" + std::to_string(subscriptions_.size()) +
+       " active)");
+  }
+ }
+ else if (verb == "unsubscribe")
+ {
+  subscriptions_.unsubscribe(client.subscription);
+  client.subscription = 0;
+  client.output += "OK\n";
+ }
+ else
+ {
+  std::string message;
+  uint32_t id = addAction(line, AuditActor(AUDIT_SOCKET, client.uid), message);
+  client.output += id ? "OK " + std::to_string(id) + "\n" : "ERR " + message + "\n";
+ }
+}
+
+// Returns false when the client should be dropped
+bool Daemon::serviceClient(Client &client, short events)
+{
+ if (events & POLLIN)
+ {
+  char buffer[512];
+  ssize_t n = read(client.fd, buffer, sizeof(buffer));
+  if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR))
+  {
+   return false;
+  }
+  if (n > 0)
+  {
+   client.input.append(buffer, static_cast<size_t>(n));
+  }
+
+  size_t newline;
+  while ((newline = client.input.find('\n')) != std::string::npos)
+  {
+   std::string line = client.input.substr(0, newline);
+   client.input.erase(0, newline + 1);
+   if (!line.empty() && line.back() == '\r')
+   {
+    line.pop_back();
+   }
+   handleCommand(client, line);
+  }
+
+  if (client.input.size() > MAX_LINE)
+  {
+   return false;
+  }
+ }
+
+ if ((events & POLLOUT) && !client.output.empty())
+ {
+  ssize_t n = write(client.fd, client.output.data(), client.output.size());
+  if (n < 0 && errno != EAGAIN && errno != EINTR)
+  {
+   return false;
+  }
+  if (n > 0)
+  {
+   client.output.erase(0, static_cast<size_t>(n));
+  }
+ }
+
+ // Pushed statistics follow any pending command replies
+ if ((events & POLLOUT) && client.output.empty() && client.subscription &&
+     !subscriptions_.flush(client.subscription, client.fd))
+ {
+  return false;
+ }
+
+ return !(events & (POLLHUP | POLLERR)) || !client.output.empty();
+}
+
+void Daemon::dropClient(size_t index)
+{
+ if (clients_[index].subscription)
+ {
+  subscriptions_.unsubscribe(clients_[index].subscription);
+  log("Subscriber " + std::to_string(clients_[index].subscription) + " detached");
+ }
+ close(clients_[index].fd);
+ clients_.erase(clients_.begin() + static_cast<std::ptrdiff_t>(index));
+}
+
+int Daemon::run(volatile sig_atomic_t &stop)
+{
+ std::vector<pollfd> fds;
+
+ while (!stop)
+ {
+  wheel_.advance(nowTick(), [this](uint64_t payload) { onTimer(payload); });
+
+  drainControlQueue();
+  if (poll_due_)
+  {
+   poll_due_ = false;
+   pollStats();
+   // Actions that came due during the poll still run before anything else
+   continue;
+  }
+
+  // Refresh the session only when idle, so control actions find it warm
+  if (session_due_)
+  {
+   session_due_ = false;
+   controller_.maintainSession(std::chrono::seconds(options_.keepaliveMarginSec));
+   continue;
+  }
+
+  fds.clear();
+  if (listen_fd_ >= 0)
+  {
+   fds.push_back({listen_fd_, POLLIN, 0});
+  }
+  for (const auto &client : clients_)
+  {
+   short events = POLLIN;
+   if (!client.output.empty() || subscriptions_.pending(client.subscription))
+   {
+    events |= POLLOUT;
+   }
+   fds.push_back({client.fd, events, 0});
+  }
+
+  // Sleep until the next tick boundary or socket activity
+  auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now().time_since_epoch());
+  int timeoutMs = options_.tickMs - static_cast<int>(elapsed.count() % options_.tickMs);
+
+  int ready = ::poll(fds.data(), fds.size(), timeoutMs);
+  if (ready <= 0)
+  {
+   continue;
+  }
+
+  size_t first = 0;
+  if (listen_fd_ >= 0)
+  {
+   first = 1;
+   if (fds[0].revents & POLLIN)
+   {
+    acceptClients();
+   }
+  }
+
+  // Walk backwards so dropping a client does not disturb the remaining indexes
+  size_t polledClients = fds.size() - first;
+  for (size_t i = polledClients; i-- > 0;)
+  {
+   short revents = fds[first + i].revents;
+   if (revents && !serviceClient(clients_[i], revents))
+   {
+    dropClient(i);
+   }
+  }
+ }
+
+ if (writer_)
+ {
+  writer_->finish();
+ }
+ return 0;
+}
+
+void Daemon::log(const std::string &message)
+{
+ if (options_.verbose)
+ {
+  std::cerr << "[INFO] " << message << std::endl;
+ }
+}
+
+void Daemon::error(const std::string &message)
+{
+ std::cerr << "[ERROR] " << message << std::endl;
+}
@@ -0,0 +1,186 @@
+/**
+ * @file Daemon.h
+ * @brief Long-running controller with scheduled actions and a local control socket
+ */
+
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#include <csignal>
+#include <ctime>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+#include "AuditLog.h"
+#include "GS308EP_CLI.h"
+#include "LoadShedder.h"
+#include "PortBaseline.h"
+#include "History.h"
+#include "Snapshot.h"
+#include "StatsWriter.h"
+#include "SubscriptionHub.h"
+#include "TimerWheel.h"
+
+/**
+ * A port action that fires once or on a recurring wall-clock schedule
+ *
+ * Grammar (schedule file lines and socket commands):
+ *   daily HH:MM ACTION PORT
+ *   weekly DAY HH:MM ACTION PORT     (DAY = sun, mon, ... sat)
+ *   at HH:MM ACTION PORT             (next occurrence, once)
+ *   in SECONDS ACTION PORT           (once, after a delay)
+ *   every SECONDS ACTION PORT        (fixed interval)
+ * where ACTION is on, off or cycle[:DELAY_MS].
+ *
+ * The control socket also accepts list, cancel ID, and
+ *   subscribe [switch=H,...] [ports=N,...] [fields=F,...] [min-change=X]
+ * after which every poll is pushed to the client as JSON lines.
+ */
+struct ScheduledAction
+{
+ enum Kind
+ {
+  ONCE_AT,
+  ONCE_IN,
+  DAILY,
+  WEEKLY,
+  INTERVAL
+ };
+
+ enum Operation
+ {
+  ON,
+  OFF,
+  CYCLE
+ };
+
+ uint32_t id;
+ Kind kind;
+ Operation operation;
+ int port;
+ int cycleDelayMs;
+ int hour;
+ int minute;
+ int weekday;
+ long seconds;
+ time_t nextFire;
+ TimerWheel::TimerId timer;
+ std::string spec;
+ AuditActor origin; // Who scheduled it; its actions are audited as theirs
+};
+
+bool parseScheduledAction(const std::string &line, ScheduledAction &action, std::string &error);
+
+struct DaemonOptions
+{
+ std::string socketPath;
+ std::string schedulePath;
+ int pollIntervalSec;
+ int tickMs;
+ int keepaliveCheckSec; // How often to check whether the session needs refreshing
+ int keepaliveMarginSec; // How far ahead of the expected expiry to refresh it
+ int actionDeadlineMs; // Total time each port action may take, retries included; zero for none
+ bool verbose;
+
+ DaemonOptions()
+     : pollIntervalSec(0), tickMs(100), keepaliveCheckSec(5), keepaliveMarginSec(15), actionDeadlineMs(0),
+       verbose(false)
+ {
+ }
+};
+
+class Daemon
+{
+public:
+ Daemon(GS308EP_CLI &controller, const DaemonOptions &options, StatsWriter *writer = nullptr);
+ ~Daemon();
+
+ // Evaluate every poll against a load-shedding policy
+ void setLoadShedder(LoadShedder *shedder) { shedder_ = shedder; }
+
+ // Track per-port baselines and report anomalies for every poll
+ void setBaselineTracker(BaselineTracker *baselines) { baselines_ = baselines; }
+
+ // Publish every poll to the shared-memory snapshot
+ void setSnapshotPublisher(SnapshotPublisher *snapshot) { snapshot_ = snapshot; }
+
+ // Append every poll to a history file
+ void setHistoryWriter(HistoryWriter *history) { history_ = history; }
+
+ // Bind the control socket and load the schedule file
+ bool start();
+
+ // Run until stop becomes non-zero; returns a process exit code
+ int run(volatile sig_atomic_t &stop);
+
+ // Parse and schedule an action on behalf of origin; returns its id, or 0 with error set
+ uint32_t addAction(const std::string &spec, const AuditActor &origin, std::string &error);
+ bool cancelAction(uint32_t id);
+
+private:
+ // Timer payloads carry a type tag in the high half and an id in the low half
+ enum TimerType
+ {
+  TIMER_ACTION = 1,
+  TIMER_CYCLE_RESTORE = 2,
+  TIMER_POLL = 3,
+  TIMER_SESSION = 4
+ };
+
+ // Control requests always run ahead of status polling
+ struct ControlRequest
+ {
+  int port;
+  bool enable;
+  int restoreAfterMs;
+  AuditActor actor;
+ };
+
+ struct Client
+ {
+  int fd;
+  uint32_t uid; // Of the connected process
+  uint32_t subscription; // Zero unless the client subscribed to statistics
+  std::string input;
+  std::string output;
+ };
+
+ GS308EP_CLI &controller_;
+ DaemonOptions options_;
+ StatsWriter *writer_;
+ LoadShedder *shedder_;
+ BaselineTracker *baselines_;
+ SnapshotPublisher *snapshot_;
+ HistoryWriter *history_;
+ TimerWheel wheel_;
+ int listen_fd_;
+ uint32_t next_action_id_;
+ bool poll_due_;
+ bool session_due_;
+ std::map<uint32_t, ScheduledAction> actions_;
+ std::deque<ControlRequest> control_queue_;
+ std::map<int, AuditActor> restore_actors_; // Per port with a cycle restore pending
+ std::vector<Client> clients_;
+ std::vector<PoEPortStats> last_stats_;
+ SubscriptionHub subscriptions_;
+
+ uint64_t nowTick() const;
+ uint64_t tickAt(time_t when, time_t now) const;
+ void arm(ScheduledAction &action, time_t now);
+ void onTimer(uint64_t payload);
+ void drainControlQueue();
+ void pollStats();
+
+ bool loadSchedule(const std::string &path);
+ bool openSocket();
+ void acceptClients();
+ bool serviceClient(Client &client, short events);
+ void dropClient(size_t index);
+ void handleCommand(Client &client, const std::string &line);
+
+ void log(const std::string &message);
+ void error(const std::string &message);
+};
+
+#endif // DAEMON_H
@@ -0,0 +1,49 @@
+/**
+ * @file Deadline.cpp
+ * @brief Implementation of operation deadlines
+ */
+
+#include "Deadline.h"
+
+Deadline::Deadline(std::chrono::milliseconds budget)
+    : budget_(budget), expiry_(Clock::now() + budget), stage_(nullptr)
+{
+}
+
+std::chrono::milliseconds Deadline::remaining() const
+{
+ Clock::duration left = expiry_ - Clock::now();
+ if (left <= Clock::duration::zero())
+ {
+  return std::chrono::milliseconds(0);
+ }
+ return std::chrono::duration_cast<std::chrono::milliseconds>(left);
+}
+
+void Deadline::expire(const char *stage)
+{
+ if (!stage_)
+ {
+  stage_ = stage;
+ }
+}
+
+static thread_local Deadline *current_deadline = nullptr;
+
+DeadlineScope::DeadlineScope(Deadline *deadline) : previous_(current_deadline)
+{
+ if (deadline)
+ {
+  current_deadline = deadline;
+ }
+}
+
+DeadlineScope::~DeadlineScope()
+{
+ current_deadline = previous_;
+}
+
+Deadline *DeadlineScope::current()
+{
+ return current_deadline;
+}
@@ -0,0 +1,67 @@
+/**
+ * @file Deadline.h
+ * @brief Total time budgets for compound switch operations
+ *
+ * One command can take many requests: a port cycle logs in (two requests),
+ * fetches the config form, posts the change, waits, and does the last two
+ * again. Each request has its own timeout, so without a deadline the whole
+ * command has no useful upper bound.
+ *
+ * A Deadline holds the budget of one whole operation. While a DeadlineScope
+ * is alive, every request the calling thread makes gets only the budget that
+ * is left as its timeout, and so does every wait. Once the budget is spent,
+ * the remaining steps fail without touching the network. The deadline
+ * records the stage that ran out, so the caller can say where the time went.
+ */
+
+#ifndef DEADLINE_H
+#define DEADLINE_H
+
+#include <chrono>
+
+class Deadline
+{
+public:
+ typedef std::chrono::steady_clock Clock;
+
+ // Starts counting now
+ explicit Deadline(std::chrono::milliseconds budget);
+
+ std::chrono::milliseconds budget() const { return budget_; }
+ Clock::time_point expiry() const { return expiry_; }
+
+ // Never negative
+ std::chrono::milliseconds remaining() const;
+
+ // Note that stage ran out of time; only the first stage is kept
+ void expire(const char *stage);
+
+ bool exceeded() const { return stage_ != nullptr; }
+ // The stage that ran out, or nullptr
+ const char *stage() const { return stage_; }
+
+private:
+ std::chrono::milliseconds budget_;
+ Clock::time_point expiry_;
+ const char *stage_;
+};
+
+// Bounds the operations made on the calling thread by a deadline while alive
+class DeadlineScope
+{
+public:
+ // A null deadline leaves the enclosing scope's deadline, if any, in force
+ explicit DeadlineScope(Deadline *deadline);
+ ~DeadlineScope();
+
+ // The innermost scope's deadline, or nullptr outside any scope
+ static Deadline *current();
+
+private:
+ Deadline *previous_;
+
+ DeadlineScope(const DeadlineScope &) = delete;
+ DeadlineScope &operator=(const DeadlineScope &) = delete;
+};
+
+#endif // DEADLINE_H
@@ -0,0 +1,750 @@
+/**
+ * @file Fleet.cpp
+ * @brief Implementation of fleet polling and incremental group aggregation
+ */
+
+#include "Fleet.h"
+#include "PollSchedule.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <curl/curl.h>
+
+static std::vector<std::string> splitTags(const std::string &text)
+{
+ std::vector<std::string> tags;
+ std::istringstream in(text);
+ std::string tag;
+ while (std::getline(in, tag, ','))
+ {
+  if (!tag.empty() && std::find(tags.begin(), tags.end(), tag) == tags.end())
+  {
+   tags.push_back(tag);
+  }
+ }
+ return tags;
+}
+
+bool loadFleet(const std::string &path, const std::string &defaultPassword, std::vector<FleetSwitch> &switches,
+               std::string &error)
+{
+ std::ifstream in(path);
+ if (!in)
+ {
+  error = "Cannot open fleet file " + path;
+  return false;
+ }
+
+ std::string line;
+ int lineNumber = 0;
+ while (std::getline(in, line))
+ {
+  lineNumber++;
+  size_t start = line.find_first_not_of(" \t\r");
+  if (start == std::string::npos || line[start] == '#')
+  {
+   continue;
+  }
+
+  std::istringstream fields(line);
+  FleetSwitch entry;
+  fields >> entry.host;
+  entry.password = defaultPassword;
+
+  std::string field;
+  while (fields >> field)
+  {
+   size_t equals = field.find('=');
+   std::string key = field.substr(0, equals);
+   std::string value = equals == std::string::npos ? "" : field.substr(equals + 1);
+   if (key == "password")
+   {
+    entry.password = value;
+   }
+   else if (key == "site")
+   {
+    entry.site = value;
+   }
+   else if (key == "rack")
+   {
+    entry.rack = value;
+   }
+   else if (key == "tags")
+   {
+    entry.tags = splitTags(value);
+   }
+   else
+   {
+    error = path + ":" + std::to_string(lineNumber) + ": unknown field '" + field + "'";
+    return false;
+   }
+  }
+
+  if (entry.password.empty())
+  {
+   error = path + ":" + std::to_string(lineNumber) + ": no password for " + entry.host;
+   return false;
+  }
+  for (const auto &existing : switches)
+  {
+   if (existing.host == entry.host)
+   {
+    error = path + ":" + std::to_string(lineNumber) + ": duplicate switch " + entry.host;
+    return false;
+   }
+  }
+  switches.push_back(entry);
+ }
+
+ if (switches.empty())
+ {
+  error = "No switches in fleet file " + path;
+  return false;
+ }
+ return true;
+}
+
+static bool portFaulted(const PoEPortStats &stats)
+{
+ return stats.fault != TEXT_EMPTY && stats.fault != TEXT_NO_ERROR && stats.fault != TEXT_UNKNOWN;
+}
+
+FleetAggregator::FleetAggregator(const std::vector<FleetSwitch> &switches, size_t hottest)
+    : switches_(switches), hottest_(hottest), memberships_(switches.size()), contributions_(switches.size()),
+      active_(switches.size(), 1)
+{
+ std::map<std::string, uint32_t> index;
+ for (size_t i = 0; i < switches.size(); i++)
+ {
+  const FleetSwitch &entry = switches[i];
+  std::vector<uint32_t> &groups = memberships_[i];
+  groups.push_back(groupIndex(index, "fleet", "all"));
+  if (!entry.site.empty())
+  {
+   groups.push_back(groupIndex(index, "site", entry.site));
+  }
+  if (!entry.rack.empty())
+  {
+   // Rack names are only unique within a site
+   groups.push_back(groupIndex(index, "rack", entry.site.empty() ? entry.rack : entry.site + "/" + entry.rack));
+  }
+  for (const auto &tag : entry.tags)
+  {
+   groups.push_back(groupIndex(index, "tag", tag));
+  }
+  Contribution &contribution = contributions_[i];
+  contribution.reachable = false;
+  contribution.delivering = 0;
+  contribution.faulted = 0;
+  contribution.milliwatts = 0;
+  std::fill(contribution.present, contribution.present + 8, false);
+  std::fill(contribution.temperature, contribution.temperature + 8, 0.0f);
+ }
+
+ // Report groups by kind, then by name, however the inventory was ordered
+ static const char *KINDS[] = {"fleet", "site", "rack", "tag"};
+ auto rank = [](const std::string &kind) { return std::find(KINDS, KINDS + 4, kind) - KINDS; };
+ std::vector<uint32_t> order(groups_.size());
+ for (uint32_t i = 0; i < order.size(); i++)
+ {
+  order[i] = i;
+ }
+ std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+  return rank(groups_[a].kind) != rank(groups_[b].kind) ? rank(groups_[a].kind) < rank(groups_[b].kind)
+                                                        : groups_[a].name < groups_[b].name;
+ });
+ std::vector<uint32_t> position(order.size());
+ std::vector<Group> sorted;
+ for (uint32_t i = 0; i < order.size(); i++)
+ {
+  position[order[i]] = i;
+  sorted.push_back(groups_[order[i]]);
+ }
+ groups_.swap(sorted);
+ for (auto &groups : memberships_)
+ {
+  for (auto &group : groups)
+  {
+   group = position[group];
+   groups_[group].switches++;
+  }
+ }
+
+ hot_.reserve(groups_.size());
+ for (size_t i = 0; i < groups_.size(); i++)
+ {
+  hot_.emplace_back(&pool_);
+ }
+}
+
+uint32_t FleetAggregator::groupIndex(std::map<std::string, uint32_t> &index, const std::string &kind,
+                                     const std::string &name)
+{
+ auto inserted = index.insert(std::make_pair(kind + ":" + name, static_cast<uint32_t>(groups_.size())));
+ if (inserted.second)
+ {
+  Group group;
+  group.kind = kind;
+  group.name = name;
+  group.switches = 0;
+  group.reporting = 0;
+  group.delivering = 0;
+  group.faulted = 0;
+  group.milliwatts = 0;
+  groups_.push_back(group);
+ }
+ return inserted.first->second;
+}
+
+void FleetAggregator::update(size_t index, const std::vector<PoEPortStats> *stats)
+{
+ // Build the new contribution outside the lock
+ Contribution next;
+ next.reachable = stats != nullptr;
+ next.delivering = 0;
+ next.faulted = 0;
+ next.milliwatts = 0;
+ std::fill(next.present, next.present + 8, false);
+ std::fill(next.temperature, next.temperature + 8, 0.0f);
+ if (stats)
+ {
+  for (const auto &port : *stats)
+  {
+   if (port.port < 1 || port.port > 8)
+   {
+    continue;
+   }
+   next.delivering += port.enabled ? 1 : 0;
+   next.faulted += portFaulted(port) ? 1 : 0;
+   next.milliwatts += static_cast<int64_t>(std::lround(port.power * 1000.0f));
+   next.present[port.port - 1] = true;
+   next.temperature[port.port - 1] = port.temperature;
+  }
+ }
+
+ std::lock_guard<std::mutex> lock(mutex_);
+ Contribution &previous = contributions_[index];
+ int64_t reporting = static_cast<int64_t>(next.reachable) - static_cast<int64_t>(previous.reachable);
+ int64_t delivering = static_cast<int64_t>(next.delivering) - static_cast<int64_t>(previous.delivering);
+ int64_t faulted = static_cast<int64_t>(next.faulted) - static_cast<int64_t>(previous.faulted);
+ int64_t milliwatts = next.milliwatts - previous.milliwatts;
+
+ for (uint32_t member : memberships_[index])
+ {
+  Group &group = groups_[member];
+  std::pmr::set<HotEntry> &hot = hot_[member];
+  group.reporting += reporting;
+  group.delivering += delivering;
+  group.faulted += faulted;
+  group.milliwatts += milliwatts;
+
+  // Only ports whose temperature moved touch the ranking
+  if (hottest_ == 0)
+  {
+   continue;
+  }
+  for (uint8_t port = 0; port < 8; port++)
+  {
+   if (previous.present[port] == next.present[port] && previous.temperature[port] == next.temperature[port])
+   {
+    continue;
+   }
+   if (previous.present[port])
+   {
+    hot.erase(HotEntry{previous.temperature[port], static_cast<uint32_t>(index), port});
+   }
+   if (next.present[port])
+   {
+    hot.insert(HotEntry{next.temperature[port], static_cast<uint32_t>(index), port});
+   }
+  }
+ }
+ previous = next;
+}
+
+void FleetAggregator::setActive(size_t index, bool active)
+{
+ {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (active_[index] == (active ? 1 : 0))
+  {
+   return;
+  }
+  active_[index] = active ? 1 : 0;
+  for (uint32_t member : memberships_[index])
+  {
+   groups_[member].switches += active ? 1 : -1;
+  }
+ }
+
+ // Whatever the switch last contributed leaves with it
+ if (!active)
+ {
+  update(index, nullptr);
+ }
+}
+
+void FleetAggregator::snapshot(std::vector<GroupAggregate> &groups) const
+{
+ std::lock_guard<std::mutex> lock(mutex_);
+ groups.resize(groups_.size());
+ for (size_t i = 0; i < groups_.size(); i++)
+ {
+  const Group &group = groups_[i];
+  const std::pmr::set<HotEntry> &hot = hot_[i];
+  GroupAggregate &out = groups[i];
+  out.kind = group.kind;
+  out.name = group.name;
+  out.switches = group.switches;
+  out.reporting = static_cast<uint32_t>(group.reporting);
+  out.delivering = static_cast<uint32_t>(group.delivering);
+  out.faulted = static_cast<uint32_t>(group.faulted);
+  out.powerWatts = static_cast<double>(group.milliwatts) / 1000.0;
+  out.averageWatts = group.reporting ? out.powerWatts / static_cast<double>(group.reporting) : 0.0;
+
+  // Overwrite in place so the host strings keep their capacity
+  out.hottest.resize(std::min(hottest_, hot.size()));
+  auto it = hot.begin();
+  for (HotPort &port : out.hottest)
+  {
+   port.host = switches_[it->index].host;
+   port.port = it->port + 1;
+   port.temperature = it->temperature;
+   ++it;
+  }
+ }
+}
+
+// Every queue holds a whole sweep, so a stage never waits for room downstream
+FleetPoller::FleetPoller(const std::vector<FleetSwitch> &switches, size_t fetchers, size_t parsers, bool verbose)
+    : curl_counted_(countCurlAllocations()), share_(static_cast<long>(switches.size())), connections_seen_(0),
+      retry_(nullptr), retries_seen_(),
+      slots_(switches.size()), fetch_queue_(switches.size()), parse_queue_(switches.size()),
+      emit_queue_(switches.size()), stop_(false)
+{
+ for (const auto &entry : switches)
+ {
+  controllers_.emplace_back(new GS308EP_CLI(entry.host, entry.password, verbose));
+  controllers_.back()->setShare(&share_);
+ }
+ for (auto &slot : slots_)
+ {
+  slot.ok = false;
+ }
+ for (auto &counters : counters_)
+ {
+  counters.items = 0;
+  counters.busyNs = 0;
+  counters.maxNs = 0;
+  counters.waitNs = 0;
+ }
+
+ for (size_t i = 0; i < std::max<size_t>(1, std::min(fetchers, switches.size())); i++)
+ {
+  threads_.emplace_back(&FleetPoller::fetchLoop, this);
+ }
+ for (size_t i = 0; i < std::max<size_t>(1, parsers); i++)
+ {
+  threads_.emplace_back(&FleetPoller::parseLoop, this);
+ }
+}
+
+FleetPoller::~FleetPoller()
+{
+ stop_ = true;
+ for (auto &thread : threads_)
+ {
+  thread.join();
+ }
+ if (curl_counted_)
+ {
+  curl_global_cleanup();
+ }
+}
+
+void FleetPoller::record(FleetStage stage, Clock::time_point queued, Clock::time_point started,
+                         Clock::time_point finished)
+{
+ Counters &counters = counters_[stage];
+ uint64_t busy = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(finished - started).count());
+ counters.items++;
+ counters.busyNs += busy;
+ counters.waitNs += static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(started - queued).count());
+ uint64_t seen = counters.maxNs.load(std::memory_order_relaxed);
+ while (busy > seen && !counters.maxNs.compare_exchange_weak(seen, busy, std::memory_order_relaxed))
+ {
+ }
+}
+
+// I/O stage: the only threads that talk to switches
+void FleetPoller::fetchLoop()
+{
+ StageItem item;
+ while (fetch_queue_.pop(item, stop_))
+ {
+  Clock::time_point started = Clock::now();
+  Slot &slot = slots_[item.index];
+  GS308EP_CLI &controller = *controllers_[item.index];
+  slot.ok = (controller.isAuthenticated() || controller.login()) && controller.fetchStatusPage(slot.html);
+  Clock::time_point finished = Clock::now();
+  slot.sampled = finished;
+  record(STAGE_FETCH, item.queued, started, finished);
+  parse_queue_.push(StageItem{item.index, finished});
+ }
+}
+
+// Parse stage: CPU-only work on pages that have already arrived
+void FleetPoller::parseLoop()
+{
+ StageItem item;
+ while (parse_queue_.pop(item, stop_))
+ {
+  Clock::time_point started = Clock::now();
+  Slot &slot = slots_[item.index];
+  if (slot.ok)
+  {
+   GS308EP_CLI::parseStatusPage(slot.html, slot.stats);
+  }
+  Clock::time_point finished = Clock::now();
+  record(STAGE_PARSE, item.queued, started, finished);
+  emit_queue_.push(StageItem{item.index, finished});
+ }
+}
+
+void FleetPoller::setRetryPolicy(RetryPolicy *retry)
+{
+ retry_ = retry;
+ for (auto &controller : controllers_)
+ {
+  controller->setRetryPolicy(retry);
+ }
+}
+
+void FleetPoller::sweep(FleetAggregator &aggregator, FleetReport &report, const std::vector<uint8_t> *owned)
+{
+ Clock::time_point queued = Clock::now();
+ size_t queuedItems = 0;
+ for (uint32_t index = 0; index < controllers_.size(); index++)
+ {
+  if (!owned || (*owned)[index])
+  {
+   fetch_queue_.push(StageItem{index, queued});
+   queuedItems++;
+  }
+ }
+
+ // Emit stage: this thread alone folds samples into the aggregator
+ uint32_t reporting = 0;
+ std::atomic<bool> never(false);
+ StageItem item;
+ for (size_t received = 0; received < queuedItems; received++)
+ {
+  emit_queue_.pop(item, never);
+  emit(aggregator, item, reporting);
+ }
+
+ report.reporting = reporting;
+ report.spread = false;
+ collect(report);
+}
+
+void FleetPoller::sweep(FleetAggregator &aggregator, FleetReport &report, const PollSchedule &schedule,
+                        Clock::time_point start, volatile sig_atomic_t &stop)
+{
+ uint32_t reporting = 0;
+ size_t started = 0;
+ size_t received = 0;
+ StageItem item;
+ for (size_t tick = 0; tick < schedule.ticks() && !stop; tick++)
+ {
+  std::this_thread::sleep_until(start + schedule.tick() * static_cast<int64_t>(tick));
+  Clock::time_point queued = Clock::now();
+  for (uint32_t index : schedule.due(tick))
+  {
+   fetch_queue_.push(StageItem{index, queued});
+   started++;
+  }
+  // Samples wait at most a tick to be folded in
+  while (received < started && emit_queue_.tryPop(item))
+  {
+   emit(aggregator, item, reporting);
+   received++;
+  }
+ }
+
+ std::atomic<bool> never(false);
+ for (; received < started; received++)
+ {
+  emit_queue_.pop(item, never);
+  emit(aggregator, item, reporting);
+ }
+
+ // The synchronised switches lead the first tick
+ Clock::time_point first = Clock::time_point::max();
+ Clock::time_point last = Clock::time_point::min();
+ for (uint32_t i = 0; i < schedule.synchronisedCount(); i++)
+ {
+  const Slot &slot = slots_[schedule.due(0)[i]];
+  if (slot.ok)
+  {
+   first = std::min(first, slot.sampled);
+   last = std::max(last, slot.sampled);
+  }
+ }
+ report.epochSkewMs = first < last ? std::chrono::duration<double, std::milli>(last - first).count() : 0.0;
+ report.spread = true;
+ report.tickBudget = schedule.budget();
+ report.synchronised = schedule.synchronisedCount();
+ report.reporting = reporting;
+ collect(report);
+}
+
+// Emit stage: only the thread that called sweep() folds samples into the aggregator
+void FleetPoller::emit(FleetAggregator &aggregator, const StageItem &item, uint32_t &reporting)
+{
+ Clock::time_point started = Clock::now();
+ const Slot &slot = slots_[item.index];
+ aggregator.update(item.index, slot.ok ? &slot.stats : nullptr);
+ reporting += slot.ok ? 1 : 0;
+ record(STAGE_EMIT, item.queued, started, Clock::now());
+}
+
+void FleetPoller::collect(FleetReport &report)
+{
+ size_t depths[FLEET_STAGES] = {fetch_queue_.takeHighWater(), parse_queue_.takeHighWater(),
+                                emit_queue_.takeHighWater()};
+ for (int stage = 0; stage < FLEET_STAGES; stage++)
+ {
+  Counters &counters = counters_[stage];
+  StageMetrics &metrics = report.stages[stage];
+  metrics.items = counters.items.exchange(0);
+  double items = metrics.items ? static_cast<double>(metrics.items) : 1.0;
+  metrics.meanMs = static_cast<double>(counters.busyNs.exchange(0)) / items / 1e6;
+  metrics.waitMs = static_cast<double>(counters.waitNs.exchange(0)) / items / 1e6;
+  metrics.maxMs = static_cast<double>(counters.maxNs.exchange(0)) / 1e6;
+  metrics.maxDepth = depths[stage];
+ }
+
+ uint64_t connections = 0;
+ for (const auto &controller : controllers_)
+ {
+  connections += controller->connectionsOpened();
+ }
+ report.connections = connections - connections_seen_;
+ connections_seen_ = connections;
+
+ report.retries = RetryStats();
+ if (retry_)
+ {
+  RetryStats retries = retry_->stats();
+  report.retries.requests = retries.requests - retries_seen_.requests;
+  report.retries.retries = retries.retries - retries_seen_.retries;
+  report.retries.saved = retries.saved - retries_seen_.saved;
+  report.retries.exhausted = retries.exhausted - retries_seen_.exhausted;
+  report.retries.denied = retries.denied - retries_seen_.denied;
+  retries_seen_ = retries;
+ }
+}
+
+static const char *STAGE_NAMES[FLEET_STAGES] = {"fetch", "parse", "emit"};
+
+static void appendJsonString(std::string &out, const std::string &value)
+{
+ out += '"';
+ for (char c : value)
+ {
+  if (c == '"' || c == '\\')
+  {
+   out += '\\';
+  }
+  if (static_cast<unsigned char>(c) >= 0x20)
+  {
+   out += c;
+  }
+ }
+ out += '"';
+}
+
+static void appendInfluxTag(std::string &out, const std::string &value)
+{
+ for (char c : value)
+ {
+  if (c == ',' || c == ' ' || c == '=' || c == '\\')
+  {
+   out += '\\';
+  }
+  if (c != '\n' && c != '\r')
+  {
+   out += c;
+  }
+ }
+}
+
+// Append printf-style output without building temporaries
+static void appendf(std::string &out, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+static void appendf(std::string &out, const char *format, ...)
+{
+ char text[256];
+ va_list args;
+ va_start(args, format);
+ int length = std::vsnprintf(text, sizeof(text), format, args);
+ va_end(args);
+ if (length > 0)
+ {
+  out.append(text, std::min(static_cast<size_t>(length), sizeof(text) - 1));
+ }
+}
+
+static unsigned long long ull(uint64_t value)
+{
+ return static_cast<unsigned long long>(value);
+}
+
+void formatFleetReport(const FleetReport &report, const std::string &format, std::string &out)
+{
+ out.clear();
+ if (format == "json")
+ {
+  out += '{';
+  if (!report.collector.empty())
+  {
+   out += "\"collector\":";
+   appendJsonString(out, report.collector);
+   out += ',';
+  }
+  appendf(out, "\"time\":%lld,\"switches\":%u,\"reporting\":%u,\"sweep_ms\":%.1f,\"groups\":[",
+          static_cast<long long>(report.timestampNs), report.switches, report.reporting, report.sweepMs);
+  for (size_t i = 0; i < report.groups.size(); i++)
+  {
+   const GroupAggregate &group = report.groups[i];
+   out += i ? ",{\"kind\":" : "{\"kind\":";
+   appendJsonString(out, group.kind);
+   out += ",\"name\":";
+   appendJsonString(out, group.name);
+   appendf(out,
+           ",\"switches\":%u,\"reporting\":%u,\"power\":%.1f,\"avg_power\":%.2f,\"delivering\":%u,"
+           "\"faulted\":%u,\"hottest\":[",
+           group.switches, group.reporting, group.powerWatts, group.averageWatts, group.delivering, group.faulted);
+   for (size_t h = 0; h < group.hottest.size(); h++)
+   {
+    out += h ? ",{\"host\":" : "{\"host\":";
+    appendJsonString(out, group.hottest[h].host);
+    appendf(out, ",\"port\":%d,\"temperature\":%.0f}", group.hottest[h].port,
+            static_cast<double>(group.hottest[h].temperature));
+   }
+   out += "]}";
+  }
+  out += "],\"stages\":{";
+  for (int stage = 0; stage < FLEET_STAGES; stage++)
+  {
+   const StageMetrics &metrics = report.stages[stage];
+   appendf(out, "%s\"%s\":{\"items\":%llu,\"mean_ms\":%.2f,\"max_ms\":%.2f,\"wait_ms\":%.2f,\"max_depth\":%zu}",
+           stage ? "," : "", STAGE_NAMES[stage], ull(metrics.items), metrics.meanMs, metrics.maxMs, metrics.waitMs,
+           metrics.maxDepth);
+  }
+  appendf(out,
+          "},\"allocations\":{\"heap\":%llu,\"libcurl\":%llu},\"connections\":%llu,"
+          "\"retries\":{\"sent\":%llu,\"saved\":%llu,\"denied\":%llu}",
+          ull(report.allocations.heap), ull(report.allocations.curl), ull(report.connections),
+          ull(report.retries.retries), ull(report.retries.saved), ull(report.retries.denied));
+  if (report.spread)
+  {
+   appendf(out, ",\"schedule\":{\"tick_budget\":%u,\"synchronised\":%u,\"epoch_skew_ms\":%.1f}",
+           report.tickBudget, report.synchronised, report.epochSkewMs);
+  }
+  out += "}\n";
+  return;
+ }
+
+ if (format == "influx")
+ {
+  // Each collector's partial aggregates stay separate series; sum them downstream
+  std::string collector;
+  if (!report.collector.empty())
+  {
+   collector = ",collector=";
+   appendInfluxTag(collector, report.collector);
+  }
+  for (const auto &group : report.groups)
+  {
+   out += "poe_group";
+   out += collector;
+   out += ",kind=";
+   appendInfluxTag(out, group.kind);
+   out += ",group=";
+   appendInfluxTag(out, group.name);
+   appendf(out, " power=%.1f,avg_power=%.2f,switches=%ui,reporting=%ui,delivering=%ui,faulted=%ui",
+           group.powerWatts, group.averageWatts, group.switches, group.reporting, group.delivering, group.faulted);
+   if (!group.hottest.empty())
+   {
+    appendf(out, ",max_temperature=%.0f", static_cast<double>(group.hottest.front().temperature));
+   }
+   appendf(out, " %lld\n", static_cast<long long>(report.timestampNs));
+  }
+  for (int stage = 0; stage < FLEET_STAGES; stage++)
+  {
+   const StageMetrics &metrics = report.stages[stage];
+   appendf(out, "poe_fleet_stage%s,stage=%s items=%llui,mean_ms=%.2f,max_ms=%.2f,wait_ms=%.2f,max_depth=%zui %lld\n",
+           collector.c_str(), STAGE_NAMES[stage], ull(metrics.items), metrics.meanMs, metrics.maxMs, metrics.waitMs,
+           metrics.maxDepth, static_cast<long long>(report.timestampNs));
+  }
+  appendf(out,
+          "poe_fleet%s switches=%ui,reporting=%ui,sweep_ms=%.1f,heap_allocations=%llui,curl_allocations=%llui,"
+          "connections=%llui,retries=%llui,retries_saved=%llui,retries_denied=%llui %lld\n",
+          collector.c_str(), report.switches, report.reporting, report.sweepMs, ull(report.allocations.heap),
+          ull(report.allocations.curl), ull(report.connections), ull(report.retries.retries),
+          ull(report.retries.saved), ull(report.retries.denied), static_cast<long long>(report.timestampNs));
+  if (report.spread)
+  {
+   appendf(out, "poe_fleet_schedule%s tick_budget=%ui,synchronised=%ui,epoch_skew_ms=%.1f %lld\n", collector.c_str(),
+           report.tickBudget, report.synchronised, report.epochSkewMs, static_cast<long long>(report.timestampNs));
+  }
+  return;
+ }
+
+ if (!report.collector.empty())
+ {
+  appendf(out, "Collector: %s\n", report.collector.c_str());
+ }
+ appendf(out, "Sweep: %u/%u switches reporting in %.0f ms\n", report.reporting, report.switches, report.sweepMs);
+ appendf(out, "%-6s %-20s %9s %10s %9s %6s %6s  %s\n", "KIND", "GROUP", "SWITCHES", "POWER_W", "AVG_W", "ON",
+         "FAULT", "HOTTEST");
+ for (const auto &group : report.groups)
+ {
+  char counts[24];
+  std::snprintf(counts, sizeof(counts), "%u/%u", group.reporting, group.switches);
+  appendf(out, "%-6s %-20s %9s %10.1f %9.2f %6u %6u  ", group.kind.c_str(), group.name.c_str(), counts,
+          group.powerWatts, group.averageWatts, group.delivering, group.faulted);
+  for (size_t h = 0; h < group.hottest.size(); h++)
+  {
+   const HotPort &hot = group.hottest[h];
+   appendf(out, "%s%s:%d %.0fC", h ? ", " : "", hot.host.c_str(), hot.port, static_cast<double>(hot.temperature));
+  }
+  out += '\n';
+ }
+ for (int stage = 0; stage < FLEET_STAGES; stage++)
+ {
+  const StageMetrics &metrics = report.stages[stage];
+  appendf(out, "%s %s %llu items, mean %.2f ms, max %.2f ms, queued %.2f ms, depth %zu", stage ? " |" : "Stages:",
+          STAGE_NAMES[stage], ull(metrics.items), metrics.meanMs, metrics.maxMs, metrics.waitMs, metrics.maxDepth);
+ }
+ appendf(out, "\nAllocations: %llu heap, %llu libcurl | Connections opened: %llu\n", ull(report.allocations.heap),
+         ull(report.allocations.curl), ull(report.connections));
+ appendf(out, "Retries: %llu sent, %llu saved, %llu denied by the budget\n", ull(report.retries.retries),
+         ull(report.retries.saved), ull(report.retries.denied));
+ if (report.spread)
+ {
+  appendf(out, "Schedule: spread, at most %u switches started per tick", report.tickBudget);
+  if (report.synchronised)
+  {
+   appendf(out, " | %u synchronised, sampled within %.1f ms", report.synchronised, report.epochSkewMs);
+  }
+  out += '\n';
+ }
+}
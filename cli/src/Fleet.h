@@ -0,0 +1,272 @@
+/**
+ * @file Fleet.h
+ * @brief Polling many switches and aggregating them by site, rack and tag
+ *
+ * Every switch belongs to a fixed set of groups (the whole fleet, its site,
+ * its rack and each of its tags), resolved once when the inventory is
+ * loaded. The aggregator remembers what each switch last contributed, so a
+ * new sample is folded in by applying the difference to that switch's
+ * groups only. Reading the aggregates at the end of a sweep costs O(groups),
+ * however many switches the fleet holds.
+ *
+ * A sweep runs as a pipeline. I/O threads only talk to switches (login and
+ * status page fetch) and hand raw pages to a small parse pool; parsed samples
+ * go to a single emitter, the thread that called sweep(), which folds them
+ * into the aggregator. Bounded lock-free queues sit between the stages, so a
+ * slow parse or emit never holds a fetch thread inside a network call.
+ *
+ * Nothing on the sweep path is allocated per request. Each switch owns a slot
+ * whose page buffer and parsed readings are overwritten in place every sweep,
+ * the queues carry only slot numbers, the hot-port rankings draw their nodes
+ * from a pool that recycles them, and reports are formatted into a reused
+ * buffer. Once buffers have grown to size a sweep makes no operator new
+ * calls, which each report shows through the allocation counter.
+ *
+ * A sweep either starts every switch at once, or follows a PollSchedule
+ * that spreads the starts over the poll interval (PollSchedule.h).
+ */
+
+#ifndef FLEET_H
+#define FLEET_H
+
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include "AllocationCounter.h"
+#include "BoundedQueue.h"
+#include "CurlShare.h"
+#include "GS308EP_CLI.h"
+
+struct FleetSwitch
+{
+ std::string host;
+ std::string password;
+ std::string site;
+ std::string rack;
+ std::vector<std::string> tags;
+};
+
+// Load an inventory: one "HOST [password=P] [site=S] [rack=R] [tags=a,b]" per line.
+// Switches without a password use defaultPassword.
+bool loadFleet(const std::string &path, const std::string &defaultPassword, std::vector<FleetSwitch> &switches,
+               std::string &error);
+
+struct HotPort
+{
+ std::string host;
+ int port;
+ float temperature;
+};
+
+struct GroupAggregate
+{
+ std::string kind; // fleet, site, rack or tag
+ std::string name;
+ uint32_t switches;  // Members of the group
+ uint32_t reporting; // Members whose latest poll succeeded
+ uint32_t delivering;
+ uint32_t faulted;
+ double powerWatts;
+ double averageWatts; // Per reporting switch
+ std::vector<HotPort> hottest;
+};
+
+class FleetAggregator
+{
+public:
+ FleetAggregator(const std::vector<FleetSwitch> &switches, size_t hottest);
+
+ // Fold in one switch's latest poll; null stats mark it unreachable.
+ // Safe to call from several polling threads.
+ void update(size_t index, const std::vector<PoEPortStats> *stats);
+
+ // Count a switch as a member of its groups or not; a sharded collector
+ // deactivates the switches other collectors poll. All start active.
+ void setActive(size_t index, bool active);
+
+ void snapshot(std::vector<GroupAggregate> &groups) const;
+
+private:
+ // Temperatures are ordered hottest first; switch and port break ties
+ struct HotEntry
+ {
+  float temperature;
+  uint32_t index;
+  uint8_t port;
+
+  bool operator<(const HotEntry &other) const
+  {
+   if (temperature != other.temperature)
+   {
+    return temperature > other.temperature;
+   }
+   return index != other.index ? index < other.index : port < other.port;
+  }
+ };
+
+ // Power is kept in integer milliwatts so repeated deltas never drift
+ struct Contribution
+ {
+  bool reachable;
+  uint32_t delivering;
+  uint32_t faulted;
+  int64_t milliwatts;
+  bool present[8];
+  float temperature[8];
+ };
+
+ struct Group
+ {
+  std::string kind;
+  std::string name;
+  uint32_t switches;
+  int64_t reporting;
+  int64_t delivering;
+  int64_t faulted;
+  int64_t milliwatts;
+ };
+
+ const std::vector<FleetSwitch> &switches_;
+ size_t hottest_;
+ std::vector<Group> groups_;
+ std::pmr::unsynchronized_pool_resource pool_; // Recycles ranking nodes; guarded by mutex_
+ std::vector<std::pmr::set<HotEntry>> hot_;    // Per group, hottest first
+ std::vector<std::vector<uint32_t>> memberships_; // Group indices of each switch
+ std::vector<Contribution> contributions_;
+ std::vector<uint8_t> active_;
+ mutable std::mutex mutex_;
+
+ uint32_t groupIndex(std::map<std::string, uint32_t> &index, const std::string &kind, const std::string &name);
+};
+
+enum FleetStage
+{
+ STAGE_FETCH,
+ STAGE_PARSE,
+ STAGE_EMIT,
+ FLEET_STAGES
+};
+
+// One stage's work during a sweep
+struct StageMetrics
+{
+ uint64_t items;
+ double meanMs;   // Time an item spent being processed
+ double maxMs;
+ double waitMs;   // Mean time items waited in the stage's input queue
+ size_t maxDepth; // Deepest the stage's input queue got
+};
+
+// Per-sweep results, ready for output
+struct FleetReport
+{
+ std::string collector; // Set when the fleet is sharded across collectors
+ int64_t timestampNs;
+ uint32_t switches;
+ uint32_t reporting;
+ double sweepMs;
+ std::vector<GroupAggregate> groups;
+ StageMetrics stages[FLEET_STAGES];
+ AllocationCounts allocations; // Made by the sweep and the aggregation
+ uint64_t connections;         // New connections libcurl opened during the sweep
+ RetryStats retries;           // Made during the sweep
+
+ // Set when the sweep followed a spread schedule
+ bool spread;
+ uint32_t tickBudget;   // Most switches started in one tick
+ uint32_t synchronised; // Switches started together at the epoch
+ double epochSkewMs;    // Between the first and last synchronised sample
+
+ FleetReport()
+     : timestampNs(0), switches(0), reporting(0), sweepMs(0.0), stages(), allocations(), connections(0), retries(),
+       spread(false), tickBudget(0), synchronised(0), epochSkewMs(0.0)
+ {
+ }
+};
+
+class PollSchedule;
+
+// Polls every switch of the fleet once per sweep through fetch, parse and emit stages
+class FleetPoller
+{
+public:
+ FleetPoller(const std::vector<FleetSwitch> &switches, size_t fetchers, size_t parsers, bool verbose);
+ ~FleetPoller();
+
+ // Poll every switch, or those flagged in owned, folding each sample into the
+ // aggregator as it arrives. Fills in the report's reporting count and stage metrics.
+ void sweep(FleetAggregator &aggregator, FleetReport &report, const std::vector<uint8_t> *owned = nullptr);
+
+ // Start the switches of a planned schedule tick by tick from start, folding
+ // samples in between ticks. Returns once every switch started has
+ // reported; stop ends the interval early.
+ void sweep(FleetAggregator &aggregator, FleetReport &report, const PollSchedule &schedule,
+            std::chrono::steady_clock::time_point start, volatile sig_atomic_t &stop);
+
+ // Retry the fleet's failed requests under one policy, whose budget the whole fleet shares
+ void setRetryPolicy(RetryPolicy *retry);
+
+private:
+ typedef std::chrono::steady_clock Clock;
+
+ // Queues carry slot numbers only; the data stays in the slot
+ struct StageItem
+ {
+  uint32_t index;
+  Clock::time_point queued;
+ };
+
+ // One per switch, reused every sweep
+ struct Slot
+ {
+  std::string html;
+  std::vector<PoEPortStats> stats;
+  bool ok;
+  Clock::time_point sampled; // When the status page arrived
+ };
+
+ struct Counters
+ {
+  std::atomic<uint64_t> items;
+  std::atomic<uint64_t> busyNs;
+  std::atomic<uint64_t> maxNs;
+  std::atomic<uint64_t> waitNs;
+ };
+
+ bool curl_counted_;
+ CurlShare share_; // Declared before the controllers so it outlives their handles
+ std::vector<std::unique_ptr<GS308EP_CLI>> controllers_;
+ uint64_t connections_seen_;
+ RetryPolicy *retry_;
+ RetryStats retries_seen_;
+ std::vector<Slot> slots_;
+ BoundedQueue<StageItem> fetch_queue_;
+ BoundedQueue<StageItem> parse_queue_;
+ BoundedQueue<StageItem> emit_queue_;
+ Counters counters_[FLEET_STAGES];
+ std::atomic<bool> stop_;
+ std::vector<std::thread> threads_;
+
+ void fetchLoop();
+ void parseLoop();
+ void record(FleetStage stage, Clock::time_point queued, Clock::time_point started, Clock::time_point finished);
+ void emit(FleetAggregator &aggregator, const StageItem &item, uint32_t &reporting);
+ void collect(FleetReport &report);
+
+ FleetPoller(const FleetPoller &) = delete;
+ FleetPoller &operator=(const FleetPoller &) = delete;
+};
+
+// Format one sweep as text, json (one line) or influx line protocol, replacing out
+void formatFleetReport(const FleetReport &report, const std::string &format, std::string &out);
+
+#endif // FLEET_H
@@ -4,6 +4,11 @@
  */
 
 #include "GS308EP_CLI.h"
+#include "AuditLog.h"
+#include "CurlShare.h"
+#include "Deadline.h"
+#include "RetryPolicy.h"
+#include "StatusPage.h"
 #include <iostream>
 #include <sstream>
 #include <iomanip>
@@ -12,12 +17,22 @@
 #include <curl/curl.h>
 #include <openssl/md5.h>
 #include <unistd.h>
+#include <thread>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 
 // Constants
 static const char *LOGIN_URL = "/login.cgi";
 static const char *POE_CONFIG_URL = "/PoEPortConfig.cgi";
 static const char *POE_STATUS_URL = "/getPoePortStatus.cgi";
 
+// Longest any single request may take, deadline or not
+static const long REQUEST_TIMEOUT_MS = 5000;
+
+thread_local long GS308EP_CLI::last_response_code_ = 0;
+thread_local int GS308EP_CLI::last_result_ = CURLE_OK;
+
 // CURL write callback
 static size_t WriteCallback(void *contents, size_t size, size_t nmemb, void *userp)
 {
@@ -33,76 +48,275 @@ static size_t HeaderCallback(char *buffer, size_t size, size_t nitems, void *use
 }
 
 GS308EP_CLI::GS308EP_CLI(const std::string &host, const std::string &password, bool verbose)
-    : host_(host), password_(password), authenticated_(false), verbose_(verbose), last_response_code_(0)
+    : host_(host), password_(password), authenticated_(false), verbose_(verbose), login_in_flight_(false),
+      session_generation_(0), login_interval_(1000), login_stats_(), idle_timeout_(300000), session_lifetime_(0),
+      base_url_("http://" + host), handle_(nullptr), share_(nullptr),
+      connections_opened_(0), retry_(nullptr), audit_(nullptr), host_hash_(auditHostHash(host))
 {
+ for (auto &state : port_state_)
+ {
+  state.store(AUDIT_STATE_UNKNOWN, std::memory_order_relaxed);
+ }
  curl_global_init(CURL_GLOBAL_DEFAULT);
+ handle_ = curl_easy_init();
 }
 
 GS308EP_CLI::~GS308EP_CLI()
 {
+ if (verbose_)
+ {
+  LoginStats stats = loginStats();
+  log("Logins: " + std::to_string(stats.attempts) + " attempted, " + std::to_string(stats.successes) +
+      " succeeded, " + std::to_string(stats.coalesced) + " coalesced, " + std::to_string(stats.throttled) +
+      " throttled, " + std::to_string(stats.expiries) + " session expiries");
+ }
+ if (handle_)
+ {
+  curl_easy_cleanup(static_cast<CURL *>(handle_));
+ }
  curl_global_cleanup();
 }
 
+std::string GS308EP_CLI::sessionCookie() const
+{
+ std::lock_guard<std::mutex> lock(session_mutex_);
+ return cookie_sid_;
+}
+
+std::string GS308EP_CLI::clientHash() const
+{
+ std::lock_guard<std::mutex> lock(session_mutex_);
+ return client_hash_;
+}
+
+GS308EP_CLI::LoginStats GS308EP_CLI::loginStats() const
+{
+ std::lock_guard<std::mutex> lock(session_mutex_);
+ return login_stats_;
+}
+
+void GS308EP_CLI::countConnections(void *handle)
+{
+ long connects = 0;
+ if (curl_easy_getinfo(static_cast<CURL *>(handle), CURLINFO_NUM_CONNECTS, &connects) == CURLE_OK && connects > 0)
+ {
+  connections_opened_.fetch_add(static_cast<uint64_t>(connects), std::memory_order_relaxed);
+ }
+}
+
+static RequestKind requestKind(const char *path, bool post)
+{
+ if (std::strcmp(path, LOGIN_URL) == 0)
+ {
+  return post ? REQUEST_LOGIN : REQUEST_LOGIN_PAGE;
+ }
+ if (std::strcmp(path, POE_CONFIG_URL) == 0)
+ {
+  return post ? REQUEST_APPLY : REQUEST_CONFIG;
+ }
+ return REQUEST_STATUS;
+}
+
+bool GS308EP_CLI::requestTimeout(const char *stage, long &timeoutMs)
+{
+ timeoutMs = REQUEST_TIMEOUT_MS;
+ Deadline *deadline = DeadlineScope::current();
+ if (!deadline)
+ {
+  return true;
+ }
+
+ long left = static_cast<long>(deadline->remaining().count());
+ if (left <= 0)
+ {
+  // Steps after the one that ran out fail quietly; the caller reports the first
+  if (!deadline->exceeded())
+  {
+   error("Deadline expired before " + std::string(stage));
+  }
+  deadline->expire(stage);
+  return false;
+ }
+ timeoutMs = std::min(timeoutMs, left);
+ return true;
+}
+
+// A request cut short by the operation's deadline, rather than by its own timeout
+void GS308EP_CLI::noteRequestTimeout(const char *stage, int result)
+{
+ Deadline *deadline = DeadlineScope::current();
+ if (deadline && result == CURLE_OPERATION_TIMEDOUT && deadline->remaining().count() == 0)
+ {
+  deadline->expire(stage);
+ }
+}
+
+// After a failed attempt, wait out the policy's backoff and get the next attempt's timeout; false to give up
+bool GS308EP_CLI::retryAfter(RequestKind kind, int retry, int result, long status, long &timeoutMs)
+{
+ std::chrono::milliseconds delay;
+ if (!retry_ || !retry_->shouldRetry(retry, result, status, delay))
+ {
+  return false;
+ }
+ if (verbose_)
+ {
+  std::string reason = result == CURLE_OK ? "HTTP " + std::to_string(status)
+                                          : std::string(curl_easy_strerror(static_cast<CURLcode>(result)));
+  log(std::string(requestKindName(kind)) + " failed (" + reason + "); retry " + std::to_string(retry) + " in " +
+      std::to_string(delay.count()) + " ms");
+ }
+ std::this_thread::sleep_for(delay);
+ return requestTimeout(requestKindName(kind), timeoutMs);
+}
+
 std::string GS308EP_CLI::httpGet(const std::string &path)
 {
- CURL *curl = curl_easy_init();
  std::string response;
- std::string headers;
+ httpGetInto(path.c_str(), response);
+ return response;
+}
 
- if (curl)
+// Writes the body into the caller's buffer, whose capacity survives between
+// requests. The controller's handle (and the connection it keeps open to the
+// switch) is reused; a concurrent request falls back to a handle of its own,
+// which still finds the connection warm if the controller has a share.
+bool GS308EP_CLI::httpGetInto(const char *path, std::string &response)
+{
+ thread_local std::string url;
+ thread_local std::string headers;
+ thread_local std::string cookie;
+
+ RequestKind kind = requestKind(path, false);
+ const char *stage = requestKindName(kind);
+ long timeoutMs;
+ if (!requestTimeout(stage, timeoutMs))
+ {
+  response.clear();
+  last_response_code_ = 0;
+  last_result_ = CURLE_FAILED_INIT;
+  return false;
+ }
+
+ std::unique_lock<std::mutex> handleLock(handle_mutex_, std::try_to_lock);
+ CURL *curl = handleLock.owns_lock() ? static_cast<CURL *>(handle_) : curl_easy_init();
+ response.clear();
+ if (!curl)
  {
-  std::string url = "http://" + host_ + path;
+  last_response_code_ = 0;
+  last_result_ = CURLE_FAILED_INIT;
+  return false;
+ }
+ if (handleLock.owns_lock())
+ {
+  curl_easy_reset(curl);
+ }
 
-  curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
-  curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
-  curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, HeaderCallback);
-  curl_easy_setopt(curl, CURLOPT_HEADERDATA, &headers);
-  curl_easy_setopt(curl, CURLOPT_TIMEOUT, 5L);
+ url.assign(base_url_).append(path);
+ headers.clear();
 
-  // Add cookie if authenticated
-  if (!cookie_sid_.empty())
+ curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+ curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
+ curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
+ curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, HeaderCallback);
+ curl_easy_setopt(curl, CURLOPT_HEADERDATA, &headers);
+ curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, timeoutMs);
+ if (share_)
+ {
+  curl_easy_setopt(curl, CURLOPT_SHARE, share_->handle());
+  curl_easy_setopt(curl, CURLOPT_MAXCONNECTS, share_->connections());
+ }
+
+ // Add cookie if authenticated
+ cookie.assign("SID=");
+ {
+  std::lock_guard<std::mutex> lock(session_mutex_);
+  cookie.append(cookie_sid_);
+ }
+ if (cookie.size() > 4)
+ {
+  curl_easy_setopt(curl, CURLOPT_COOKIE, cookie.c_str());
+ }
+
+ if (verbose_)
+ {
+  log("GET " + url);
+ }
+
+ if (retry_)
+ {
+  retry_->noteRequest();
+ }
+ CURLcode res;
+ long status;
+ int attempt = 1;
+ for (;; attempt++)
+ {
+  res = curl_easy_perform(curl);
+  countConnections(curl);
+  noteRequestTimeout(stage, res);
+  status = 0;
+  if (res == CURLE_OK)
   {
-   std::string cookie = "SID=" + cookie_sid_;
-   curl_easy_setopt(curl, CURLOPT_COOKIE, cookie.c_str());
+   curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
   }
-
-  if (verbose_)
+  if (!RetryPolicy::idempotent(kind) || !retryAfter(kind, attempt, res, status, timeoutMs))
   {
-   log("GET " + url);
+   break;
   }
+  response.clear();
+  headers.clear();
+  curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, timeoutMs);
+ }
+ if (attempt > 1 && res == CURLE_OK && !RetryPolicy::transient(res, status))
+ {
+  retry_->noteSaved();
+ }
+ last_result_ = res;
 
-  CURLcode res = curl_easy_perform(curl);
+ if (res == CURLE_OK)
+ {
+  last_response_code_ = status;
 
-  if (res == CURLE_OK)
+  // Extract cookie from headers if present
+  if (headers.find("SID=") != std::string::npos)
   {
-   curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &last_response_code_);
-
-   // Extract cookie from headers if present
-   std::string cookie = extractCookie(headers);
-   if (!cookie.empty())
+   std::string newSid = extractCookie(headers);
+   if (!newSid.empty())
    {
-    cookie_sid_ = cookie;
+    std::lock_guard<std::mutex> lock(session_mutex_);
+    cookie_sid_ = newSid;
    }
   }
-  else
-  {
-   error("HTTP GET failed: " + std::string(curl_easy_strerror(res)));
-   last_response_code_ = 0;
-  }
+ }
+ else
+ {
+  error("HTTP GET failed: " + std::string(curl_easy_strerror(res)));
+  last_response_code_ = 0;
+ }
 
+ if (!handleLock.owns_lock())
+ {
   curl_easy_cleanup(curl);
  }
-
- return response;
+ return res == CURLE_OK;
 }
 
 std::string GS308EP_CLI::httpPost(const std::string &path, const std::string &data)
 {
- CURL *curl = curl_easy_init();
  std::string response;
  std::string headers;
+ RequestKind kind = requestKind(path.c_str(), true);
+ const char *stage = requestKindName(kind);
+ long timeoutMs;
+ if (!requestTimeout(stage, timeoutMs))
+ {
+  last_response_code_ = 0;
+  last_result_ = CURLE_FAILED_INIT;
+  return response;
+ }
 
+ CURL *curl = curl_easy_init();
  if (curl)
  {
   std::string url = "http://" + host_ + path;
@@ -113,12 +327,18 @@ std::string GS308EP_CLI::httpPost(const std::string &path, const std::string &da
   curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
   curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, HeaderCallback);
   curl_easy_setopt(curl, CURLOPT_HEADERDATA, &headers);
-  curl_easy_setopt(curl, CURLOPT_TIMEOUT, 5L);
+  curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, timeoutMs);
+  if (share_)
+  {
+   curl_easy_setopt(curl, CURLOPT_SHARE, share_->handle());
+   curl_easy_setopt(curl, CURLOPT_MAXCONNECTS, share_->connections());
+  }
 
   // Add cookie if authenticated
-  if (!cookie_sid_.empty())
+  std::string sid = sessionCookie();
+  std::string cookie = "SID=" + sid;
+  if (!sid.empty())
   {
-   std::string cookie = "SID=" + cookie_sid_;
    curl_easy_setopt(curl, CURLOPT_COOKIE, cookie.c_str());
   }
 
@@ -127,17 +347,48 @@ std::string GS308EP_CLI::httpPost(const std::string &path, const std::string &da
    log("POST " + url + " [" + data + "]");
   }
 
-  CURLcode res = curl_easy_perform(curl);
+  // Port changes set an absolute state, so a repeated POST does no harm
+  if (retry_)
+  {
+   retry_->noteRequest();
+  }
+  CURLcode res;
+  long status;
+  int attempt = 1;
+  for (;; attempt++)
+  {
+   res = curl_easy_perform(curl);
+   countConnections(curl);
+   noteRequestTimeout(stage, res);
+   status = 0;
+   if (res == CURLE_OK)
+   {
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+   }
+   if (!RetryPolicy::idempotent(kind) || !retryAfter(kind, attempt, res, status, timeoutMs))
+   {
+    break;
+   }
+   response.clear();
+   headers.clear();
+   curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, timeoutMs);
+  }
+  if (attempt > 1 && res == CURLE_OK && !RetryPolicy::transient(res, status))
+  {
+   retry_->noteSaved();
+  }
+  last_result_ = res;
 
   if (res == CURLE_OK)
   {
-   curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &last_response_code_);
+   last_response_code_ = status;
 
    // Extract cookie from headers if present
-   std::string cookie = extractCookie(headers);
-   if (!cookie.empty())
+   std::string newSid = extractCookie(headers);
+   if (!newSid.empty())
    {
-    cookie_sid_ = cookie;
+    std::lock_guard<std::mutex> lock(session_mutex_);
+    cookie_sid_ = newSid;
    }
   }
   else
@@ -280,325 +531,521 @@ bool GS308EP_CLI::extractClientHash(const std::string &html)
   return false;
  }
 
- client_hash_ = html.substr(startPos, endPos - startPos);
+ std::string hash = html.substr(startPos, endPos - startPos);
+ std::lock_guard<std::mutex> lock(session_mutex_);
+ client_hash_ = hash;
  return !client_hash_.empty();
 }
 
+uint64_t GS308EP_CLI::sessionGeneration() const
+{
+ std::lock_guard<std::mutex> lock(session_mutex_);
+ return session_generation_;
+}
+
 bool GS308EP_CLI::login()
 {
- // Step 1: Get login page and extract rand token
- std::string loginPage = httpGet(LOGIN_URL);
- if (last_response_code_ != 200)
+ return loginSingleFlight(sessionGeneration());
+}
+
+// Only one thread talks to the login page at a time. A caller that saw
+// generation N expire either performs the login or, if another caller is
+// already doing so (or has since produced generation N+1), waits for and
+// shares that result instead of sending its own GET/POST pair.
+bool GS308EP_CLI::loginSingleFlight(uint64_t observedGeneration)
+{
+ std::unique_lock<std::mutex> lock(session_mutex_);
+
+ if (login_in_flight_ || session_generation_ != observedGeneration)
  {
-  error("Failed to fetch login page");
-  return false;
+  login_stats_.coalesced++;
+  auto done = [this] { return !login_in_flight_; };
+  Deadline *deadline = DeadlineScope::current();
+  if (!deadline)
+  {
+   login_done_.wait(lock, done);
+  }
+  else if (!login_done_.wait_until(lock, deadline->expiry(), done))
+  {
+   deadline->expire("login");
+   return false;
+  }
+  if (session_generation_ != observedGeneration)
+  {
+   return authenticated_;
+  }
  }
 
- std::string rand = extractRand(loginPage);
- if (rand.empty())
+ login_in_flight_ = true;
+
+ // Space attempts so a dead or misconfigured switch is not hammered
+ auto now = std::chrono::steady_clock::now();
+ auto earliest = last_login_attempt_ + login_interval_;
+ if (login_stats_.attempts > 0 && now < earliest)
  {
-  error("Failed to extract rand token");
-  return false;
+  login_stats_.throttled++;
+  Deadline *deadline = DeadlineScope::current();
+  if (deadline && earliest >= deadline->expiry())
+  {
+   // Waiting out the interval would spend the whole budget before the first request
+   deadline->expire("login interval");
+   login_in_flight_ = false;
+   lock.unlock();
+   login_done_.notify_all();
+   return false;
+  }
+  lock.unlock();
+  std::this_thread::sleep_until(earliest);
+  lock.lock();
  }
+ last_login_attempt_ = std::chrono::steady_clock::now();
+ login_stats_.attempts++;
+ lock.unlock();
 
- if (verbose_)
+ bool ok = authenticate();
+
+ lock.lock();
+ if (ok)
  {
-  log("Rand token: " + rand);
+  login_stats_.successes++;
+  session_started_ = std::chrono::steady_clock::now();
+  last_activity_ = session_started_;
  }
+ authenticated_ = ok;
+ session_generation_++;
+ login_in_flight_ = false;
+ lock.unlock();
+ login_done_.notify_all();
 
- // Step 2: Calculate password hash
- std::string hash = mergeHash(password_, rand);
+ return ok;
+}
 
- if (verbose_)
+// An expired SID makes the switch answer with its login page (or 401)
+bool GS308EP_CLI::sessionExpired(const std::string &response) const
+{
+ if (last_response_code_ == 401)
  {
-  log("Password hash: " + hash);
+  return true;
  }
+ return last_response_code_ == 200 &&
+        (response.find("name=\"rand\"") != std::string::npos || response.find("name='rand'") != std::string::npos ||
+         response.find("id=\"rand\"") != std::string::npos || response.find("id='rand'") != std::string::npos);
+}
 
- // Step 3: POST login with hashed password
- std::string postData = "password=" + hash;
- httpPost(LOGIN_URL, postData);
+void GS308EP_CLI::noteSessionActive()
+{
+ std::lock_guard<std::mutex> lock(session_mutex_);
+ last_activity_ = std::chrono::steady_clock::now();
+}
 
- if (last_response_code_ != 200 || cookie_sid_.empty())
+// A session that was mostly idle when it expired bounds the idle timeout;
+// one that was in regular use points to a fixed lifetime instead.
+void GS308EP_CLI::noteSessionExpired()
+{
+ std::lock_guard<std::mutex> lock(session_mutex_);
+ login_stats_.expiries++;
+ if (!authenticated_)
  {
-  error("Authentication failed");
-  return false;
+  return;
  }
 
- if (verbose_)
+ auto now = std::chrono::steady_clock::now();
+ auto idle = std::chrono::duration_cast<std::chrono::milliseconds>(now - last_activity_);
+ auto age = std::chrono::duration_cast<std::chrono::milliseconds>(now - session_started_);
+ if (idle * 2 >= age)
+ {
+  idle_timeout_ = std::max(std::min(idle_timeout_, idle), std::chrono::milliseconds(10000));
+ }
+ else if (session_lifetime_.count() == 0 || age < session_lifetime_)
  {
-  log("Session ID: " + cookie_sid_);
+  session_lifetime_ = age;
  }
+}
 
- authenticated_ = true;
- return true;
+void GS308EP_CLI::setSessionTimeout(std::chrono::milliseconds idle)
+{
+ std::lock_guard<std::mutex> lock(session_mutex_);
+ idle_timeout_ = std::max(idle, std::chrono::milliseconds(10000));
 }
 
-bool GS308EP_CLI::isValidPort(int port) const
+std::chrono::milliseconds GS308EP_CLI::sessionTimeout() const
 {
- return port >= 1 && port <= 8;
+ std::lock_guard<std::mutex> lock(session_mutex_);
+ return idle_timeout_;
 }
 
-bool GS308EP_CLI::setPortState(int port, bool enabled)
+bool GS308EP_CLI::maintainSession(std::chrono::milliseconds margin)
 {
  if (!authenticated_)
  {
-  error("Not authenticated");
-  return false;
+  return login();
  }
 
- if (!isValidPort(port))
+ bool renew;
+ bool touch;
+ uint64_t generation;
  {
-  error("Invalid port number");
-  return false;
+  std::lock_guard<std::mutex> lock(session_mutex_);
+  auto now = std::chrono::steady_clock::now();
+  renew = session_lifetime_.count() > 0 && now - session_started_ + margin >= session_lifetime_;
+  touch = now - last_activity_ + margin >= idle_timeout_;
+  generation = session_generation_;
  }
 
- // Get current config to extract client hash
- std::string configPage = httpGet(POE_CONFIG_URL);
- if (last_response_code_ != 200)
+ // A fixed lifetime cannot be extended, so start the next session early
+ if (renew)
  {
-  error("Failed to fetch PoE config");
-  return false;
+  log("Renewing session ahead of its lifetime");
+  return loginSingleFlight(generation);
  }
 
- if (!extractClientHash(configPage))
+ // The config page doubles as the touch, keeping the form hash current too
+ if (touch)
  {
-  error("Failed to extract client hash");
-  return false;
+  log("Refreshing idle session");
+  fetchClientHash();
  }
+ return authenticated_;
+}
 
- // Build POST data (port is zero-indexed for API)
- std::ostringstream postData;
- postData << "ACTION=Apply";
- postData << "&portID=" << (port - 1);
- postData << "&ADMIN_MODE=" << (enabled ? "1" : "0");
- postData << "&PORT_PRIO=0";
- postData << "&POW_MOD=3";
- postData << "&POW_LIMT_TYP=0";
- postData << "&DETEC_TYP=2";
- postData << "&DISCONNECT_TYP=2";
- postData << "&hash=" << client_hash_;
-
- httpPost(POE_CONFIG_URL, postData.str());
-
- return last_response_code_ == 200;
+std::string GS308EP_CLI::sessionGet(const std::string &path)
+{
+ std::string response;
+ sessionGetInto(path.c_str(), response);
+ return response;
 }
 
-bool GS308EP_CLI::getPortStatus(int port)
+void GS308EP_CLI::sessionGetInto(const char *path, std::string &response)
 {
- if (!authenticated_ || !isValidPort(port))
+ uint64_t generation = sessionGeneration();
+ httpGetInto(path, response);
+ if (!sessionExpired(response))
  {
-  return false;
+  if (last_response_code_ == 200)
+  {
+   noteSessionActive();
+  }
+  return;
  }
 
- std::string statusPage = httpGet(POE_STATUS_URL);
- if (last_response_code_ != 200)
+ noteSessionExpired();
+ log("Session expired, logging in again");
+ if (!loginSingleFlight(generation))
  {
-  return false;
+  last_response_code_ = 401;
+  response.clear();
+  return;
  }
+ httpGetInto(path, response);
+}
 
- // Look for port marker and enabled status
- std::string portMarker = "value=\"" + std::to_string(port) + "\"";
- size_t portPos = statusPage.find(portMarker);
- if (portPos == std::string::npos)
+bool GS308EP_CLI::authenticate()
+{
+ std::string sid;
+ for (int retry = 1;; retry++)
  {
-  return false;
- }
+  // Step 1: Get login page and extract rand token
+  std::string loginPage = httpGet(LOGIN_URL);
+  if (last_response_code_ != 200)
+  {
+   error("Failed to fetch login page");
+   return false;
+  }
 
- // Search within 1000 chars after port marker
- size_t searchEnd = std::min(portPos + 1000, statusPage.length());
- std::string searchArea = statusPage.substr(portPos, searchEnd - portPos);
+  std::string rand = extractRand(loginPage);
+  if (rand.empty())
+  {
+   error("Failed to extract rand token");
+   return false;
+  }
 
- // Look for hidPortPwr value (1=on, 0=off)
- size_t pwrPos = searchArea.find("hidPortPwr");
- if (pwrPos != std::string::npos)
- {
-  size_t valuePos = searchArea.find("value", pwrPos);
-  if (valuePos != std::string::npos)
+  if (verbose_)
   {
-   size_t quotePos = searchArea.find("\"", valuePos);
-   if (quotePos != std::string::npos)
-   {
-    char statusChar = searchArea[quotePos + 1];
-    return statusChar == '1';
-   }
+   log("Rand token: " + rand);
+  }
+
+  // Step 2: Calculate password hash
+  std::string hash = mergeHash(password_, rand);
+
+  if (verbose_)
+  {
+   log("Password hash: " + hash);
+  }
+
+  // Step 3: POST login with hashed password
+  std::string postData = "password=" + hash;
+  httpPost(LOGIN_URL, postData);
+
+  sid = sessionCookie();
+  if (last_response_code_ == 200 && !sid.empty())
+  {
+   break;
+  }
+
+  // The POST spent its rand token, so a transient failure starts over from a fresh login page
+  long timeoutMs;
+  if (!retryAfter(REQUEST_LOGIN, retry, last_result_, last_response_code_, timeoutMs))
+  {
+   error("Authentication failed");
+   return false;
   }
  }
 
- return false;
+ if (verbose_)
+ {
+  log("Session ID: " + sid);
+ }
+
+ return true;
 }
 
-float GS308EP_CLI::extractPortPower(const std::string &html, int port)
+bool GS308EP_CLI::isValidPort(int port) const
 {
- std::string portMarker = "value=\"" + std::to_string(port) + "\"";
- size_t portPos = html.find(portMarker);
+ return port >= 1 && port <= 8;
+}
 
- if (portPos == std::string::npos)
+bool GS308EP_CLI::setPortState(int port, bool enabled)
+{
+ if (!authenticated_)
  {
-  return -1.0f;
+  error("Not authenticated");
+  return false;
  }
 
- size_t ml574Pos = html.find("ml574", portPos);
- if (ml574Pos == std::string::npos || ml574Pos > portPos + 2000)
+ if (!isValidPort(port))
  {
-  return -1.0f;
+  error("Invalid port number");
+  return false;
  }
 
- size_t spanStart = html.find("<span>", ml574Pos + 5);
- if (spanStart == std::string::npos)
+ // A poll or an earlier change normally knows the port's state already.
+ // A one-shot command does not, so it reads the status page before the
+ // change is timed.
+ if (audit_ && port_state_[port - 1].load(std::memory_order_relaxed) == AUDIT_STATE_UNKNOWN)
  {
-  return -1.0f;
+  observePortStates();
  }
 
- spanStart += 6;
- size_t spanEnd = html.find("</span>", spanStart);
- if (spanEnd == std::string::npos)
+ auto sent = std::chrono::system_clock::now();
+ auto start = std::chrono::steady_clock::now();
+
+ // Get current config to extract client hash
+ bool applied = fetchClientHash() && postPortState(port, enabled);
+ audit(port, enabled, applied, sent, std::chrono::steady_clock::now() - start);
+ return applied;
+}
+
+void GS308EP_CLI::audit(int port, bool enabled, bool success, std::chrono::system_clock::time_point sent,
+                        std::chrono::steady_clock::duration latency)
+{
+ // A failed POST may or may not have reached the switch
+ uint8_t before = port_state_[port - 1].load(std::memory_order_relaxed);
+ uint8_t after = success ? (enabled ? AUDIT_STATE_ON : AUDIT_STATE_OFF) : AUDIT_STATE_UNKNOWN;
+ port_state_[port - 1].store(after, std::memory_order_relaxed);
+ if (!audit_)
+ {
+  return;
+ }
+
+ const AuditActor &actor = AuditScope::current();
+ AuditRecord record;
+ std::memset(&record, 0, sizeof(record));
+ record.timestampMs = std::chrono::duration_cast<std::chrono::milliseconds>(sent.time_since_epoch()).count();
+ record.latencyUs = static_cast<uint32_t>(std::min<int64_t>(
+     std::chrono::duration_cast<std::chrono::microseconds>(latency).count(), UINT32_MAX));
+ record.hostHash = host_hash_;
+ record.uid = actor.uid;
+ record.pid = static_cast<uint32_t>(getpid());
+ record.actionId = actor.actionId;
+ record.port = static_cast<uint8_t>(port);
+ record.enable = enabled ? 1 : 0;
+ record.source = actor.source;
+ record.success = success ? 1 : 0;
+ record.before = before;
+ record.after = after;
+ std::strncpy(record.host, host_.c_str(), sizeof(record.host) - 1);
+ audit_->record(record);
+}
+
+void GS308EP_CLI::notePortStates(const std::vector<PoEPortStats> &stats)
+{
+ for (const auto &port : stats)
  {
-  return -1.0f;
+  if (isValidPort(port.port))
+  {
+   port_state_[port.port - 1].store(port.enabled ? AUDIT_STATE_ON : AUDIT_STATE_OFF, std::memory_order_relaxed);
+  }
  }
+}
 
- std::string powerStr = html.substr(spanStart, spanEnd - spanStart);
-
- try
+void GS308EP_CLI::observePortStates()
+{
+ // On failure each port keeps the last state this process saw, or unknown
+ std::string statusPage = sessionGet(POE_STATUS_URL);
+ if (last_response_code_ != 200)
  {
-  return std::stof(powerStr);
+  return;
  }
- catch (...)
+
+ StatusPageView view(statusPage);
+ for (int port = 1; port <= 8; port++)
  {
-  return -1.0f;
+  if (view.hasPort(port))
+  {
+   port_state_[port - 1].store(view.powerFlag(port) ? AUDIT_STATE_ON : AUDIT_STATE_OFF, std::memory_order_relaxed);
+  }
  }
 }
 
-bool GS308EP_CLI::extractPortStats(const std::string &html, int port, PoEPortStats &stats)
+bool GS308EP_CLI::fetchClientHash()
 {
- stats.port = port;
- stats.enabled = false;
- stats.status = "Unknown";
- stats.voltage = 0.0f;
- stats.current = 0.0f;
- stats.power = 0.0f;
- stats.temperature = 0.0f;
- stats.fault = "Unknown";
- stats.powerClass = "Unknown";
-
- std::string portMarker = "value=\"" + std::to_string(port) + "\"";
- size_t portPos = html.find(portMarker);
- if (portPos == std::string::npos)
+ std::string configPage = sessionGet(POE_CONFIG_URL);
+ if (last_response_code_ != 200)
  {
+  error("Failed to fetch PoE config");
   return false;
  }
 
- // Extract status (search backwards)
- size_t searchStart = (portPos > 500) ? portPos - 500 : 0;
- std::string searchArea = html.substr(searchStart, portPos - searchStart);
-
- // Find last occurrence of poe-power-mode
- size_t statusModePos = std::string::npos;
- size_t tempPos = 0;
- while ((tempPos = searchArea.find("poe-power-mode", tempPos)) != std::string::npos)
+ if (!extractClientHash(configPage))
  {
-  statusModePos = tempPos;
-  tempPos++;
+  error("Failed to extract client hash");
+  return false;
  }
 
- if (statusModePos != std::string::npos)
+ return true;
+}
+
+bool GS308EP_CLI::postPortState(int port, bool enabled)
+{
+ // Build POST data (port is zero-indexed for API)
+ std::ostringstream postData;
+ postData << "ACTION=Apply";
+ postData << "&portID=" << (port - 1);
+ postData << "&ADMIN_MODE=" << (enabled ? "1" : "0");
+ postData << "&PORT_PRIO=0";
+ postData << "&POW_MOD=3";
+ postData << "&POW_LIMT_TYP=0";
+ postData << "&DETEC_TYP=2";
+ postData << "&DISCONNECT_TYP=2";
+ std::string form = postData.str();
+
+ uint64_t generation = sessionGeneration();
+ std::string response = httpPost(POE_CONFIG_URL, form + "&hash=" + clientHash());
+
+ // The form hash belongs to the session, so after logging in again it has
+ // to be refetched before the change can be re-posted. Like a GET, the
+ // change is re-posted once; a switch that still answers with the login
+ // page is not accepting the session.
+ if (sessionExpired(response))
  {
-  size_t spanStart = searchArea.find("<span>", statusModePos);
-  if (spanStart != std::string::npos)
+  noteSessionExpired();
+  log("Session expired, logging in again");
+  if (!loginSingleFlight(generation) || !fetchClientHash())
   {
-   spanStart += 6;
-   size_t spanEnd = searchArea.find("</span>", spanStart);
-   if (spanEnd != std::string::npos)
-   {
-    stats.status = searchArea.substr(spanStart, spanEnd - spanStart);
-    stats.enabled = (stats.status == "Delivering Power");
-   }
+   return false;
   }
+  response = httpPost(POE_CONFIG_URL, form + "&hash=" + clientHash());
+  if (sessionExpired(response))
+  {
+   error("Session expired again after logging in");
+   return false;
+  }
+ }
+
+ if (last_response_code_ == 200)
+ {
+  noteSessionActive();
+  return true;
  }
+ return false;
+}
 
- // Extract power class
- size_t classPos = std::string::npos;
- tempPos = 0;
- while ((tempPos = searchArea.find("powClassShow", tempPos)) != std::string::npos)
+bool GS308EP_CLI::prepareControl()
+{
+ if (!authenticated_)
  {
-  classPos = tempPos;
-  tempPos++;
+  error("Not authenticated");
+  return false;
  }
+ return !clientHash().empty() || fetchClientHash();
+}
 
- if (classPos != std::string::npos)
+bool GS308EP_CLI::setPortStates(const std::vector<int> &ports, bool enabled)
+{
+ if (!authenticated_)
  {
-  size_t spanStart = searchArea.find(">", classPos);
-  if (spanStart != std::string::npos)
+  error("Not authenticated");
+  return false;
+ }
+
+ // Reuse the client hash from the last config fetch so the whole batch is
+ // just the POSTs; fetch a fresh one only if there is none or it was rejected
+ bool freshHash = false;
+ if (clientHash().empty())
+ {
+  if (!fetchClientHash())
   {
-   spanStart++;
-   size_t spanEnd = searchArea.find("</span>", spanStart);
-   if (spanEnd != std::string::npos)
-   {
-    std::string classText = searchArea.substr(spanStart, spanEnd - spanStart);
-    if (classText.find("ml003@") == 0 && classText.length() > 7)
-    {
-     size_t atPos = classText.find("@", 6);
-     if (atPos != std::string::npos)
-     {
-      std::string classNum = classText.substr(6, atPos - 6);
-      stats.powerClass = "Class " + classNum;
-     }
-    }
-    else
-    {
-     stats.powerClass = classText;
-    }
-   }
+   return false;
   }
+  freshHash = true;
  }
 
- // Helper lambda to extract value
- auto extractValue = [&](const std::string &field) -> float
+ bool allApplied = true;
+ for (int port : ports)
  {
-  size_t fieldPos = html.find(field, portPos);
-  if (fieldPos != std::string::npos && fieldPos < portPos + 2000)
+  if (!isValidPort(port))
   {
-   size_t spanStart = html.find("<span>", fieldPos + 5);
-   if (spanStart != std::string::npos)
-   {
-    spanStart += 6;
-    size_t spanEnd = html.find("</span>", spanStart);
-    if (spanEnd != std::string::npos)
-    {
-     try
-     {
-      return std::stof(html.substr(spanStart, spanEnd - spanStart));
-     }
-     catch (...)
-     {
-     }
-    }
-   }
+   error("Invalid port number");
+   allApplied = false;
+   continue;
   }
-  return 0.0f;
- };
 
- stats.voltage = extractValue("ml570");
- stats.current = extractValue("ml572");
- stats.power = extractPortPower(html, port);
- stats.temperature = extractValue("ml575");
+  auto sent = std::chrono::system_clock::now();
+  auto start = std::chrono::steady_clock::now();
+  bool applied = postPortState(port, enabled);
 
- // Extract fault status
- size_t ml581Pos = html.find("ml581", portPos);
- if (ml581Pos != std::string::npos && ml581Pos < portPos + 2000)
- {
-  size_t spanStart = html.find("<span>", ml581Pos + 5);
-  if (spanStart != std::string::npos)
+  // A cached hash may have gone stale; refresh it once and retry
+  if (!applied && !freshHash)
   {
-   spanStart += 6;
-   size_t spanEnd = html.find("</span>", spanStart);
-   if (spanEnd != std::string::npos)
-   {
-    stats.fault = html.substr(spanStart, spanEnd - spanStart);
-   }
+   freshHash = true;
+   applied = fetchClientHash() && postPortState(port, enabled);
   }
+  audit(port, enabled, applied, sent, std::chrono::steady_clock::now() - start);
+  allApplied = allApplied && applied;
  }
 
- return true;
+ return allApplied;
+}
+
+bool GS308EP_CLI::getPortStatus(int port)
+{
+ if (!authenticated_ || !isValidPort(port))
+ {
+  return false;
+ }
+
+ std::string statusPage = sessionGet(POE_STATUS_URL);
+ if (last_response_code_ != 200)
+ {
+  return false;
+ }
+
+ // The hidPortPwr flag after the port's marker is 1 when PoE is on
+ bool enabled = StatusPageView(statusPage).powerFlag(port);
+ port_state_[port - 1].store(enabled ? AUDIT_STATE_ON : AUDIT_STATE_OFF, std::memory_order_relaxed);
+ return enabled;
+}
+
+// Failed port action, naming the stage that used up the deadline if one did
+static std::string failureJSON(int port, const char *action)
+{
+ std::string json = "{\"port\":" + std::to_string(port) + ",\"action\":\"" + action + "\",\"success\":false";
+ Deadline *deadline = DeadlineScope::current();
+ if (deadline && deadline->exceeded())
+ {
+  json += ",\"deadline_expired\":\"" + std::string(deadline->stage()) + "\"";
+ }
+ return json + "}";
 }
 
 // Action implementations
@@ -619,7 +1066,7 @@ bool GS308EP_CLI::turnOnPort(int port, bool json, bool quiet)
 
  if (json)
  {
-  outputJSON("{\"port\":" + std::to_string(port) + ",\"action\":\"on\",\"success\":false}");
+  outputJSON(failureJSON(port, "on"));
  }
  else
  {
@@ -645,7 +1092,7 @@ bool GS308EP_CLI::turnOffPort(int port, bool json, bool quiet)
 
  if (json)
  {
-  outputJSON("{\"port\":" + std::to_string(port) + ",\"action\":\"off\",\"success\":false}");
+  outputJSON(failureJSON(port, "off"));
  }
  else
  {
@@ -656,11 +1103,28 @@ bool GS308EP_CLI::turnOffPort(int port, bool json, bool quiet)
 
 bool GS308EP_CLI::cyclePort(int port, int delayMs, bool json, bool quiet)
 {
+ // A budget that cannot even cover the wait would leave the port off; refuse before touching it
+ Deadline *deadline = DeadlineScope::current();
+ std::chrono::milliseconds delay(delayMs);
+ if (deadline && deadline->remaining() <= delay)
+ {
+  deadline->expire("cycle delay");
+  if (json)
+  {
+   outputJSON(failureJSON(port, "cycle"));
+  }
+  else
+  {
+   error("Deadline too short for a " + std::to_string(delayMs) + "ms cycle of port " + std::to_string(port));
+  }
+  return false;
+ }
+
  if (!setPortState(port, false))
  {
   if (json)
   {
-   outputJSON("{\"port\":" + std::to_string(port) + ",\"action\":\"cycle\",\"success\":false}");
+   outputJSON(failureJSON(port, "cycle"));
   }
   else
   {
@@ -674,17 +1138,25 @@ bool GS308EP_CLI::cyclePort(int port, int delayMs, bool json, bool quiet)
   std::cout << "Port " << port << " turned OFF, waiting " << delayMs << "ms..." << std::endl;
  }
 
- usleep(delayMs * 1000);
+ // Turning the port off took part of the budget; what is left may no longer cover the wait
+ if (deadline && deadline->remaining() <= delay)
+ {
+  deadline->expire("cycle delay");
+ }
+ else
+ {
+  usleep(delayMs * 1000);
+ }
 
- if (!setPortState(port, true))
+ if ((deadline && deadline->exceeded()) || !setPortState(port, true))
  {
   if (json)
   {
-   outputJSON("{\"port\":" + std::to_string(port) + ",\"action\":\"cycle\",\"success\":false}");
+   outputJSON(failureJSON(port, "cycle"));
   }
   else
   {
-   error("Failed to turn on port " + std::to_string(port));
+   error("Failed to turn on port " + std::to_string(port) + "; it is left OFF");
   }
   return false;
  }
@@ -710,31 +1182,32 @@ bool GS308EP_CLI::showPortStatus(int port, bool json, bool quiet)
 
 bool GS308EP_CLI::showPortPower(int port, bool json, bool quiet)
 {
- std::string statusPage = httpGet(POE_STATUS_URL);
+ std::string statusPage = sessionGet(POE_STATUS_URL);
  if (last_response_code_ != 200)
  {
   error("Failed to fetch PoE status");
   return false;
  }
 
- float power = extractPortPower(statusPage, port);
+ float power = StatusPageView(statusPage).power(port);
  outputPortPower(port, power, json, quiet);
  return power >= 0;
 }
 
 bool GS308EP_CLI::showTotalPower(bool json, bool quiet)
 {
- std::string statusPage = httpGet(POE_STATUS_URL);
+ std::string statusPage = sessionGet(POE_STATUS_URL);
  if (last_response_code_ != 200)
  {
   error("Failed to fetch PoE status");
   return false;
  }
 
+ StatusPageView view(statusPage);
  float total = 0.0f;
  for (int port = 1; port <= 8; port++)
  {
-  float power = extractPortPower(statusPage, port);
+  float power = view.power(port);
   if (power >= 0)
   {
    total += power;
@@ -747,25 +1220,61 @@ bool GS308EP_CLI::showTotalPower(bool json, bool quiet)
 
 bool GS308EP_CLI::showAllStats(bool json, bool quiet)
 {
- std::string statusPage = httpGet(POE_STATUS_URL);
+ std::vector<PoEPortStats> stats;
+ if (!pollAllStats(stats))
+ {
+  return false;
+ }
+
+ outputAllStats(stats, json, quiet);
+ return !stats.empty();
+}
+
+bool GS308EP_CLI::pollAllStats(std::vector<PoEPortStats> &stats)
+{
+ // Repeated polls on a thread reuse its page buffer
+ thread_local std::string statusPage;
+ if (!fetchStatusPage(statusPage))
+ {
+  stats.clear();
+  return false;
+ }
+
+ parseStatusPage(statusPage, stats);
+ notePortStates(stats);
+ return true;
+}
+
+bool GS308EP_CLI::fetchStatusPage(std::string &html)
+{
+ sessionGetInto(POE_STATUS_URL, html);
  if (last_response_code_ != 200)
  {
   error("Failed to fetch PoE status");
   return false;
  }
+ return true;
+}
 
- std::vector<PoEPortStats> stats;
+void GS308EP_CLI::parseStatusPage(const std::string &html, std::vector<PoEPortStats> &stats)
+{
+ // Parse into the existing entries so a reused vector never reallocates
+ stats.resize(8);
+ StatusPageView view(html);
+ size_t found = 0;
  for (int port = 1; port <= 8; port++)
  {
-  PoEPortStats portStats;
-  if (extractPortStats(statusPage, port, portStats))
+  if (view.stats(port, stats[found]))
   {
-   stats.push_back(portStats);
+   found++;
   }
  }
+ stats.resize(found);
+}
 
- outputAllStats(stats, json, quiet);
- return !stats.empty();
+bool GS308EP_CLI::parsePortStats(const std::string &html, int port, PoEPortStats &stats)
+{
+ return StatusPageView(html).stats(port, stats);
 }
 
 // Output methods
@@ -836,13 +1345,13 @@ void GS308EP_CLI::outputAllStats(const std::vector<PoEPortStats> &stats, bool js
     oss << ",";
    oss << "{\"port\":" << (int)stats[i].port
        << ",\"enabled\":" << (stats[i].enabled ? "true" : "false")
-       << ",\"status\":\"" << stats[i].status << "\""
-       << ",\"class\":\"" << stats[i].powerClass << "\""
+       << ",\"status\":\"" << internedText(stats[i].status) << "\""
+       << ",\"class\":\"" << internedText(stats[i].powerClass) << "\""
        << ",\"voltage\":" << std::fixed << std::setprecision(1) << stats[i].voltage
        << ",\"current\":" << std::fixed << std::setprecision(0) << stats[i].current
        << ",\"power\":" << std::fixed << std::setprecision(1) << stats[i].power
        << ",\"temperature\":" << std::fixed << std::setprecision(0) << stats[i].temperature
-       << ",\"fault\":\"" << stats[i].fault << "\"}";
+       << ",\"fault\":\"" << internedText(stats[i].fault) << "\"}";
   }
 
   float total = std::accumulate(stats.begin(), stats.end(), 0.0f,
@@ -858,13 +1367,13 @@ void GS308EP_CLI::outputAllStats(const std::vector<PoEPortStats> &stats, bool js
 
   for (const auto &s : stats)
   {
-   std::cout << "Port " << (int)s.port << ": " << s.status << std::endl;
-   std::cout << "  Class: " << s.powerClass
+   std::cout << "Port " << (int)s.port << ": " << internedText(s.status) << std::endl;
+   std::cout << "  Class: " << internedText(s.powerClass)
              << "  |  Voltage: " << std::fixed << std::setprecision(1) << s.voltage << " V"
              << "  |  Current: " << std::fixed << std::setprecision(0) << s.current << " mA" << std::endl;
    std::cout << "  Power: " << std::fixed << std::setprecision(1) << s.power << " W"
              << "  |  Temperature: " << std::fixed << std::setprecision(0) << s.temperature << " °C"
-             << "  |  Fault: " << s.fault << std::endl;
+             << "  |  Fault: " << internedText(s.fault) << std::endl;
    std::cout << std::endl;
   }
 
@@ -10,19 +10,29 @@
 #include <map>
 #include <vector>
 #include <memory>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstdint>
+#include "InternTable.h"
+#include "RetryPolicy.h"
+
+class AuditLog;
+class CurlShare;
 
 // Forward declaration
 struct PoEPortStats
 {
  uint8_t port;
  bool enabled;
- std::string status;
+ TextId status; // Interned; internedText() gives the text
  float voltage;
  float current;
  float power;
  float temperature;
- std::string fault;
- std::string powerClass;
+ TextId fault;
+ TextId powerClass;
 };
 
 class GS308EP_CLI
@@ -31,10 +41,31 @@ public:
  GS308EP_CLI(const std::string &host, const std::string &password, bool verbose = false);
  ~GS308EP_CLI();
 
- // Authentication
+ // Every operation below is bounded by the calling thread's DeadlineScope, if any.
+
+ // Authentication. login() is single-flight: concurrent callers share one
+ // attempt and its result, and attempts are spaced by the login interval.
  bool login();
  bool isAuthenticated() const { return authenticated_; }
 
+ struct LoginStats
+ {
+  uint64_t attempts;  // Login exchanges actually sent to the switch
+  uint64_t successes; // Attempts that produced a session
+  uint64_t coalesced; // Callers that waited on another caller's attempt
+  uint64_t throttled; // Attempts delayed by the minimum login interval
+  uint64_t expiries;  // Requests that found the session expired
+ };
+ LoginStats loginStats() const;
+ void setLoginInterval(std::chrono::milliseconds interval) { login_interval_ = interval; }
+
+ // Session keep-alive for long-running callers. Touches an idle session (and
+ // refreshes the form hash) or logs in again ahead of a learned fixed
+ // lifetime, when either is due within margin. Returns false without a session.
+ bool maintainSession(std::chrono::milliseconds margin);
+ void setSessionTimeout(std::chrono::milliseconds idle);
+ std::chrono::milliseconds sessionTimeout() const;
+
  // Port control operations
  bool turnOnPort(int port, bool json, bool quiet);
  bool turnOffPort(int port, bool json, bool quiet);
@@ -46,18 +77,112 @@ public:
  bool showTotalPower(bool json, bool quiet);
  bool showAllStats(bool json, bool quiet);
 
+ // Fetch one status page and parse every port, without producing output
+ bool pollAllStats(std::vector<PoEPortStats> &stats);
+
+ // The two halves of pollAllStats, for callers that fetch and parse on different threads.
+ // Both reuse the capacity of the buffers they are given, so a caller that keeps
+ // them between polls does not allocate once they have grown to size.
+ bool fetchStatusPage(std::string &html);
+ static void parseStatusPage(const std::string &html, std::vector<PoEPortStats> &stats);
+
+ // Parse a single port, leaving the rest of the page untouched. False if the port is absent.
+ static bool parsePortStats(const std::string &html, int port, PoEPortStats &stats);
+
+ // Apply one state to several ports back-to-back, reusing the cached client hash
+ bool setPortStates(const std::vector<int> &ports, bool enabled);
+
+ // Fetch the client hash now if none is cached, so the next setPortStates is a single POST
+ bool prepareControl();
+
+ // Output formatting, shared with callers that already hold the data
+ static void outputPortStatus(int port, bool status, bool json, bool quiet);
+ static void outputPortPower(int port, float power, bool json, bool quiet);
+ static void outputTotalPower(float power, bool json, bool quiet);
+ static void outputAllStats(const std::vector<PoEPortStats> &stats, bool json, bool quiet);
+
+ const std::string &host() const { return host_; }
+
+ // Attach every request to a CurlShare's caches. Call before the first request;
+ // the share must outlive the controller.
+ void setShare(const CurlShare *share) { share_ = share; }
+
+ // Connections libcurl has had to open for this controller's requests
+ uint64_t connectionsOpened() const { return connections_opened_.load(std::memory_order_relaxed); }
+
+ // Retry transient failures under a policy, which may be shared with other
+ // controllers and must outlive this one. Without one, nothing is retried.
+ void setRetryPolicy(RetryPolicy *retry) { retry_ = retry; }
+
+ // Record every port change in an audit log, attributed to the calling
+ // thread's AuditScope. The log must outlive the controller.
+ void setAuditLog(AuditLog *audit) { audit_ = audit; }
+
+ // Unit tests reach the private parsers through this wrapper
+ friend class GS308EP_CLI_Testable;
+
 private:
  std::string host_;
  std::string password_;
  std::string cookie_sid_;
  std::string client_hash_;
- bool authenticated_;
+ std::atomic<bool> authenticated_;
  bool verbose_;
- int last_response_code_;
+
+ // Response code of the calling thread's most recent request
+ static thread_local long last_response_code_;
+ // CURLcode of the calling thread's most recent request
+ static thread_local int last_result_;
+
+ // Session state shared by all threads using this controller
+ mutable std::mutex session_mutex_;
+ std::condition_variable login_done_;
+ bool login_in_flight_;
+ uint64_t session_generation_;
+ std::chrono::steady_clock::time_point last_login_attempt_;
+ std::chrono::milliseconds login_interval_;
+ LoginStats login_stats_;
+ std::chrono::steady_clock::time_point session_started_;
+ std::chrono::steady_clock::time_point last_activity_;
+ std::chrono::milliseconds idle_timeout_;
+ std::chrono::milliseconds session_lifetime_; // Zero until observed
+
+ // Reusable GET handle; it keeps the connection to the switch open
+ std::string base_url_;
+ std::mutex handle_mutex_;
+ void *handle_;
+ const CurlShare *share_;
+ std::atomic<uint64_t> connections_opened_;
+ RetryPolicy *retry_;
+
+ // Audit trail, with each port's last known state (an AuditState) for the
+ // before column; learned from polls and from the changes this controller made
+ AuditLog *audit_;
+ uint32_t host_hash_;
+ std::atomic<uint8_t> port_state_[8];
 
  // HTTP operations
  std::string httpGet(const std::string &url);
+ bool httpGetInto(const char *path, std::string &response);
  std::string httpPost(const std::string &url, const std::string &data);
+ void countConnections(void *handle);
+
+ // Timeout for the next request, within the calling thread's deadline; false once it has run out
+ bool requestTimeout(const char *stage, long &timeoutMs);
+ void noteRequestTimeout(const char *stage, int result);
+ bool retryAfter(RequestKind kind, int retry, int result, long status, long &timeoutMs);
+
+ // Requests that detect an expired session, log in again once, and retry
+ std::string sessionGet(const std::string &path);
+ void sessionGetInto(const char *path, std::string &response);
+ bool sessionExpired(const std::string &response) const;
+ uint64_t sessionGeneration() const;
+ void noteSessionActive();
+ void noteSessionExpired();
+ bool loginSingleFlight(uint64_t observedGeneration);
+ bool authenticate();
+ std::string sessionCookie() const;
+ std::string clientHash() const;
 
  // Helper methods
  std::string extractRand(const std::string &html);
@@ -68,17 +193,17 @@ private:
 
  // Parsing methods
  bool getPortStatus(int port);
- float extractPortPower(const std::string &html, int port);
- bool extractPortStats(const std::string &html, int port, PoEPortStats &stats);
  bool setPortState(int port, bool enabled);
+ bool fetchClientHash();
+ bool postPortState(int port, bool enabled);
+ void audit(int port, bool enabled, bool success, std::chrono::system_clock::time_point sent,
+            std::chrono::steady_clock::duration latency);
+ void notePortStates(const std::vector<PoEPortStats> &stats);
+ // Read every port's state from the switch, for an audited change whose port state is not yet known
+ void observePortStates();
 
  // Output methods
- void outputJSON(const std::string &json);
- void outputPortStatus(int port, bool status, bool json, bool quiet);
- void outputPortPower(int port, float power, bool json, bool quiet);
- void outputTotalPower(float power, bool json, bool quiet);
- void outputAllStats(const std::vector<PoEPortStats> &stats, bool json, bool quiet);
-
+ static void outputJSON(const std::string &json);
  // Validation
  bool isValidPort(int port) const;
 
@@ -0,0 +1,497 @@
+/**
+ * @file History.cpp
+ * @brief Implementation of the columnar history file
+ */
+
+#include "History.h"
+#include "HistorySegment.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char HISTORY_MAGIC[4] = {'G', 'S', '8', 'H'};
+static const uint32_t HISTORY_VERSION_RAW = 1;
+static const uint32_t HISTORY_VERSION = 2;
+
+// The file header gets a page of its own so every block starts page-aligned
+static const size_t HEADER_BYTES = 4096;
+static const size_t INDEX_OFFSET = sizeof(HistoryFileHeader);
+
+static const size_t TIMESTAMPS_OFFSET = sizeof(HistoryBlockHeader);
+static const size_t COLUMNS_OFFSET = TIMESTAMPS_OFFSET + HISTORY_BLOCK_ROWS * sizeof(int64_t);
+static const size_t ENABLED_OFFSET = COLUMNS_OFFSET + HISTORY_COLUMNS * HISTORY_PORTS * HISTORY_BLOCK_ROWS * sizeof(float);
+static const size_t BLOCK_BYTES = (ENABLED_OFFSET + HISTORY_PORTS * HISTORY_BLOCK_ROWS + 4095) / 4096 * 4096;
+
+// Version 2 files keep two raw blocks, then the segments
+static const size_t STAGING_BLOCKS = 2;
+static const size_t SEGMENTS_OFFSET = HEADER_BYTES + STAGING_BLOCKS * BLOCK_BYTES;
+
+static_assert(sizeof(HistoryFileHeader) == 128, "history file header layout");
+static_assert(sizeof(HistorySegmentIndex) == 16, "history segment index layout");
+static_assert(sizeof(HistoryBlockHeader) == 64, "history block header layout");
+
+int64_t historyGapMs(int intervalMs)
+{
+ return std::max<int64_t>(static_cast<int64_t>(intervalMs) * 3, 3000);
+}
+
+static size_t columnOffset(int column, int port)
+{
+ return COLUMNS_OFFSET + (static_cast<size_t>(column) * HISTORY_PORTS + port) * HISTORY_BLOCK_ROWS * sizeof(float);
+}
+
+static size_t blockOffset(size_t index)
+{
+ return HEADER_BYTES + index * BLOCK_BYTES;
+}
+
+static bool validHeader(const HistoryFileHeader &header)
+{
+ return std::memcmp(header.magic, HISTORY_MAGIC, sizeof(HISTORY_MAGIC)) == 0 &&
+        (header.version == HISTORY_VERSION_RAW || header.version == HISTORY_VERSION) &&
+        header.blockRows == HISTORY_BLOCK_ROWS && header.ports == HISTORY_PORTS;
+}
+
+static HistoryBlock blockView(const uint8_t *base)
+{
+ const HistoryBlockHeader *header = reinterpret_cast<const HistoryBlockHeader *>(base);
+
+ HistoryBlock block;
+ block.rows = std::min(header->rows.load(std::memory_order_acquire), HISTORY_BLOCK_ROWS);
+ block.firstMs = header->firstMs;
+ block.lastMs = header->lastMs;
+ block.timestamps = reinterpret_cast<const int64_t *>(base + TIMESTAMPS_OFFSET);
+ for (int column = 0; column < HISTORY_COLUMNS; column++)
+ {
+  for (int port = 0; port < HISTORY_PORTS; port++)
+  {
+   block.columns[column][port] = reinterpret_cast<const float *>(base + columnOffset(column, port));
+  }
+ }
+ for (int port = 0; port < HISTORY_PORTS; port++)
+ {
+  block.enabled[port] = base + ENABLED_OFFSET + port * HISTORY_BLOCK_ROWS;
+ }
+ return block;
+}
+
+HistoryWriter::HistoryWriter()
+    : fd_(-1), version_(HISTORY_VERSION), gap_ms_(0), block_index_(0), block_(nullptr), staging_(nullptr),
+      segment_end_(0)
+{
+}
+
+HistoryWriter::~HistoryWriter()
+{
+ if (staging_)
+ {
+  munmap(staging_, SEGMENTS_OFFSET);
+ }
+ else if (block_)
+ {
+  munmap(block_, BLOCK_BYTES);
+ }
+ if (fd_ >= 0)
+ {
+  close(fd_);
+ }
+}
+
+bool HistoryWriter::open(const std::string &path, const std::string &host, int intervalMs, std::string &error)
+{
+ fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+ if (fd_ < 0)
+ {
+  error = "Cannot open " + path + ": " + std::strerror(errno);
+  return false;
+ }
+
+ struct stat info;
+ if (fstat(fd_, &info) < 0)
+ {
+  error = "Cannot stat " + path + ": " + std::strerror(errno);
+  return false;
+ }
+
+ HistoryFileHeader header;
+ if (info.st_size == 0)
+ {
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, HISTORY_MAGIC, sizeof(HISTORY_MAGIC));
+  header.version = HISTORY_VERSION;
+  header.blockRows = HISTORY_BLOCK_ROWS;
+  header.ports = HISTORY_PORTS;
+  header.intervalMs = intervalMs;
+  std::strncpy(header.host, host.c_str(), sizeof(header.host) - 1);
+  if (pwrite(fd_, &header, sizeof(header), 0) != static_cast<ssize_t>(sizeof(header)) ||
+      ftruncate(fd_, SEGMENTS_OFFSET) < 0)
+  {
+   error = "Cannot initialise " + path + ": " + std::strerror(errno);
+   return false;
+  }
+  gap_ms_ = historyGapMs(intervalMs);
+  return openSegmented(path, error);
+ }
+
+ if (pread(fd_, &header, sizeof(header), 0) != static_cast<ssize_t>(sizeof(header)) || !validHeader(header))
+ {
+  error = path + " is not a history file";
+  return false;
+ }
+ header.host[sizeof(header.host) - 1] = '\0';
+ if (host != header.host)
+ {
+  error = path + " records " + header.host + ", not " + host;
+  return false;
+ }
+ version_ = header.version;
+ gap_ms_ = historyGapMs(header.intervalMs);
+ if (version_ == HISTORY_VERSION)
+ {
+  return openSegmented(path, error);
+ }
+
+ size_t blocks = (static_cast<size_t>(info.st_size) - HEADER_BYTES) / BLOCK_BYTES;
+ return mapBlock(blocks ? blocks - 1 : 0);
+}
+
+bool HistoryWriter::openSegmented(const std::string &path, std::string &error)
+{
+ struct stat info;
+ if (fstat(fd_, &info) < 0 ||
+     (static_cast<size_t>(info.st_size) < SEGMENTS_OFFSET && ftruncate(fd_, SEGMENTS_OFFSET) < 0) ||
+     fstat(fd_, &info) < 0)
+ {
+  error = "Cannot initialise " + path + ": " + std::strerror(errno);
+  return false;
+ }
+ size_t size = static_cast<size_t>(info.st_size);
+
+ void *memory = mmap(nullptr, SEGMENTS_OFFSET, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+ if (memory == MAP_FAILED)
+ {
+  error = "Cannot map " + path + ": " + std::strerror(errno);
+  return false;
+ }
+ staging_ = static_cast<uint8_t *>(memory);
+
+ // Find the end of the published segments. A recorder that stopped mid-write
+ // leaves a torn tail, which is cut off; only the last segment is verified,
+ // since it is the only one that can be torn.
+ HistorySegmentIndex *index = segmentIndex();
+ uint32_t published = index->segments.load(std::memory_order_relaxed);
+ uint32_t valid = 0;
+ size_t end = SEGMENTS_OFFSET;
+ if (published && size > SEGMENTS_OFFSET)
+ {
+  void *file = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd_, 0);
+  if (file == MAP_FAILED)
+  {
+   error = "Cannot map " + path + ": " + std::strerror(errno);
+   return false;
+  }
+  const uint8_t *data = static_cast<const uint8_t *>(file);
+  HistorySegment segment;
+  while (valid < published && segment.open(data + end, size - end, valid + 1 == published))
+  {
+   end += segment.bytes();
+   valid++;
+  }
+  munmap(file, size);
+ }
+ if (valid != published)
+ {
+  index->segments.store(valid, std::memory_order_release);
+ }
+ if (size > end && ftruncate(fd_, static_cast<off_t>(end)) < 0)
+ {
+  error = "Cannot truncate " + path + ": " + std::strerror(errno);
+  return false;
+ }
+ segment_end_ = static_cast<int64_t>(end);
+
+ // A block that filled just before the recorder stopped may not have been sealed
+ for (size_t i = 0; i < STAGING_BLOCKS; i++)
+ {
+  HistoryBlockHeader *header = reinterpret_cast<HistoryBlockHeader *>(stagingBlock(i));
+  if (header->sequence.load(std::memory_order_relaxed) == index->segments.load(std::memory_order_relaxed) &&
+      header->rows.load(std::memory_order_relaxed) == HISTORY_BLOCK_ROWS && !seal(stagingBlock(i)))
+  {
+   error = "Cannot write to " + path + ": " + std::strerror(errno);
+   return false;
+  }
+ }
+
+ // Carry on in the block for the next segment, or start one over the older block
+ uint32_t next = index->segments.load(std::memory_order_relaxed);
+ HistoryBlockHeader *oldest = nullptr;
+ for (size_t i = 0; i < STAGING_BLOCKS; i++)
+ {
+  HistoryBlockHeader *header = reinterpret_cast<HistoryBlockHeader *>(stagingBlock(i));
+  if (header->sequence.load(std::memory_order_relaxed) == next &&
+      header->rows.load(std::memory_order_relaxed) < HISTORY_BLOCK_ROWS)
+  {
+   block_index_ = i;
+   block_ = stagingBlock(i);
+   return true;
+  }
+  if (!oldest || header->sequence.load(std::memory_order_relaxed) < oldest->sequence.load(std::memory_order_relaxed))
+  {
+   oldest = header;
+   block_index_ = i;
+  }
+ }
+ oldest->rows.store(0, std::memory_order_relaxed);
+ oldest->sequence.store(next, std::memory_order_release);
+ block_ = stagingBlock(block_index_);
+ return true;
+}
+
+uint8_t *HistoryWriter::stagingBlock(size_t index) const
+{
+ return staging_ + blockOffset(index);
+}
+
+HistorySegmentIndex *HistoryWriter::segmentIndex() const
+{
+ return reinterpret_cast<HistorySegmentIndex *>(staging_ + INDEX_OFFSET);
+}
+
+bool HistoryWriter::seal(uint8_t *block)
+{
+ encodeHistorySegment(blockView(block), gap_ms_, encoded_);
+ ssize_t written = pwrite(fd_, encoded_.data(), encoded_.size(), static_cast<off_t>(segment_end_));
+ if (written != static_cast<ssize_t>(encoded_.size()))
+ {
+  if (written >= 0)
+  {
+   errno = ENOSPC;
+  }
+  return false;
+ }
+ segment_end_ += static_cast<int64_t>(encoded_.size());
+
+ // Readers switch from the raw block to the segment from here on
+ HistorySegmentIndex *index = segmentIndex();
+ index->segments.store(index->segments.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+ return true;
+}
+
+bool HistoryWriter::nextBlock()
+{
+ if (version_ != HISTORY_VERSION)
+ {
+  return mapBlock(block_index_ + 1);
+ }
+
+ // Empty the other block first: the full one stays readable as it is until its segment is published
+ size_t other = (block_index_ + 1) % STAGING_BLOCKS;
+ HistoryBlockHeader *current = reinterpret_cast<HistoryBlockHeader *>(block_);
+ HistoryBlockHeader *next = reinterpret_cast<HistoryBlockHeader *>(stagingBlock(other));
+ next->rows.store(0, std::memory_order_relaxed);
+ next->sequence.store(current->sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+ if (!seal(block_))
+ {
+  // Stay on the full block, so the next sample tries again
+  return false;
+ }
+ block_index_ = other;
+ block_ = stagingBlock(other);
+ return true;
+}
+
+bool HistoryWriter::mapBlock(size_t index)
+{
+ if (block_)
+ {
+  munmap(block_, BLOCK_BYTES);
+  block_ = nullptr;
+ }
+
+ struct stat info;
+ off_t end = static_cast<off_t>(blockOffset(index + 1));
+ if (fstat(fd_, &info) < 0 || (info.st_size < end && ftruncate(fd_, end) < 0))
+ {
+  return false;
+ }
+
+ void *memory = mmap(nullptr, BLOCK_BYTES, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, static_cast<off_t>(blockOffset(index)));
+ if (memory == MAP_FAILED)
+ {
+  return false;
+ }
+ block_ = static_cast<uint8_t *>(memory);
+ block_index_ = index;
+ return true;
+}
+
+bool HistoryWriter::append(int64_t timestampMs, const std::vector<PoEPortStats> &stats)
+{
+ if (!block_)
+ {
+  return false;
+ }
+
+ HistoryBlockHeader *header = reinterpret_cast<HistoryBlockHeader *>(block_);
+ uint32_t row = header->rows.load(std::memory_order_relaxed);
+ if (row == HISTORY_BLOCK_ROWS)
+ {
+  if (!nextBlock())
+  {
+   return false;
+  }
+  header = reinterpret_cast<HistoryBlockHeader *>(block_);
+  row = 0;
+ }
+
+ // Blocks are searched by time, so a clock step backwards must not reorder rows
+ if (row > 0)
+ {
+  timestampMs = std::max(timestampMs, header->lastMs);
+ }
+
+ reinterpret_cast<int64_t *>(block_ + TIMESTAMPS_OFFSET)[row] = timestampMs;
+ for (int port = 0; port < HISTORY_PORTS; port++)
+ {
+  reinterpret_cast<float *>(block_ + columnOffset(HISTORY_POWER, port))[row] = 0.0f;
+  reinterpret_cast<float *>(block_ + columnOffset(HISTORY_CURRENT, port))[row] = 0.0f;
+  reinterpret_cast<float *>(block_ + columnOffset(HISTORY_VOLTAGE, port))[row] = 0.0f;
+  reinterpret_cast<float *>(block_ + columnOffset(HISTORY_TEMPERATURE, port))[row] = 0.0f;
+  block_[ENABLED_OFFSET + port * HISTORY_BLOCK_ROWS + row] = 0;
+ }
+ for (const auto &port : stats)
+ {
+  if (port.port < 1 || port.port > HISTORY_PORTS)
+  {
+   continue;
+  }
+  int index = port.port - 1;
+  reinterpret_cast<float *>(block_ + columnOffset(HISTORY_POWER, index))[row] = port.power;
+  reinterpret_cast<float *>(block_ + columnOffset(HISTORY_CURRENT, index))[row] = port.current;
+  reinterpret_cast<float *>(block_ + columnOffset(HISTORY_VOLTAGE, index))[row] = port.voltage;
+  reinterpret_cast<float *>(block_ + columnOffset(HISTORY_TEMPERATURE, index))[row] = port.temperature;
+  block_[ENABLED_OFFSET + index * HISTORY_BLOCK_ROWS + row] = port.enabled ? 1 : 0;
+ }
+
+ if (row == 0)
+ {
+  header->firstMs = timestampMs;
+ }
+ header->lastMs = timestampMs;
+ header->rows.store(row + 1, std::memory_order_release);
+ return true;
+}
+
+HistoryFile::HistoryFile()
+    : data_(nullptr), size_(0), interval_ms_(0)
+{
+}
+
+HistoryFile::~HistoryFile()
+{
+ if (data_)
+ {
+  munmap(const_cast<uint8_t *>(data_), size_);
+ }
+}
+
+bool HistoryFile::open(const std::string &path, std::string &error)
+{
+ int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+ if (fd < 0)
+ {
+  error = "Cannot open " + path + ": " + std::strerror(errno);
+  return false;
+ }
+
+ struct stat info;
+ if (fstat(fd, &info) < 0 || static_cast<size_t>(info.st_size) < HEADER_BYTES)
+ {
+  close(fd);
+  error = path + " is not a history file";
+  return false;
+ }
+
+ size_ = static_cast<size_t>(info.st_size);
+ void *memory = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+ close(fd);
+ if (memory == MAP_FAILED)
+ {
+  error = "Cannot map " + path + ": " + std::strerror(errno);
+  return false;
+ }
+ data_ = static_cast<const uint8_t *>(memory);
+
+ HistoryFileHeader header;
+ std::memcpy(&header, data_, sizeof(header));
+ if (!validHeader(header))
+ {
+  error = path + " is not a history file";
+  return false;
+ }
+ header.host[sizeof(header.host) - 1] = '\0';
+ host_ = header.host;
+ interval_ms_ = header.intervalMs;
+
+ // Queries scan each column front to back
+ madvise(memory, size_, MADV_SEQUENTIAL);
+
+ if (header.version == HISTORY_VERSION_RAW)
+ {
+  for (size_t index = 0; index < (size_ - HEADER_BYTES) / BLOCK_BYTES; index++)
+  {
+   blocks_.push_back(index);
+  }
+  return true;
+ }
+ if (size_ < SEGMENTS_OFFSET)
+ {
+  // Still being created
+  return true;
+ }
+
+ // Segments written after the file was mapped are read from their raw blocks instead
+ const HistorySegmentIndex *index = reinterpret_cast<const HistorySegmentIndex *>(data_ + INDEX_OFFSET);
+ uint32_t published = index->segments.load(std::memory_order_acquire);
+ size_t offset = SEGMENTS_OFFSET;
+ HistorySegment segment;
+ while (segments_.size() < published && segment.open(data_ + offset, size_ - offset))
+ {
+  segments_.push_back(offset);
+  offset += segment.bytes();
+ }
+
+ uint32_t sealed = static_cast<uint32_t>(segments_.size());
+ std::vector<std::pair<uint32_t, size_t>> unsealed;
+ for (size_t block = 0; block < STAGING_BLOCKS; block++)
+ {
+  const HistoryBlockHeader *staging = reinterpret_cast<const HistoryBlockHeader *>(data_ + blockOffset(block));
+  uint32_t sequence = staging->sequence.load(std::memory_order_acquire);
+  if (sequence >= sealed && staging->rows.load(std::memory_order_acquire) > 0)
+  {
+   unsealed.push_back(std::make_pair(sequence, block));
+  }
+ }
+ std::sort(unsealed.begin(), unsealed.end());
+ for (const auto &block : unsealed)
+ {
+  blocks_.push_back(block.second);
+ }
+ return true;
+}
+
+HistorySegment HistoryFile::segment(size_t index) const
+{
+ HistorySegment segment;
+ segment.open(data_ + segments_[index], size_ - segments_[index]);
+ return segment;
+}
+
+HistoryBlock HistoryFile::block(size_t index) const
+{
+ return blockView(data_ + blockOffset(blocks_[index]));
+}
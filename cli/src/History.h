@@ -0,0 +1,149 @@
+/**
+ * @file History.h
+ * @brief Columnar on-disk history of polled statistics
+ *
+ * A history file holds one switch's samples in fixed-size blocks of
+ * HISTORY_BLOCK_ROWS rows. Inside a block every reading is a contiguous
+ * column (timestamps, then power, current, voltage and temperature per port,
+ * then the enabled flags), so a query over one metric touches only that
+ * metric's pages and its inner loops run over plain float arrays. Each block
+ * header carries its time range, which lets readers skip blocks outside a
+ * query window without touching their columns.
+ *
+ * Raw blocks cost about 136 bytes a row, so version 2 files keep only two of
+ * them, for the rows still being recorded. When one fills, recording moves
+ * to the other and the full one is sealed into a compressed segment
+ * (HistorySegment.h) appended to the file, which stores the same rows in a
+ * tenth of the space or less. Version 1 files, where every block stays raw,
+ * are still read and appended to.
+ *
+ * The writer and readers both use mmap. A block's row count is published
+ * with release ordering after the row is written, and the segment count once
+ * a segment is written, so a file can be queried while it is being recorded.
+ */
+
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "GS308EP_CLI.h"
+
+static const uint32_t HISTORY_BLOCK_ROWS = 3600;
+static const int HISTORY_PORTS = 8;
+
+enum HistoryColumn
+{
+ HISTORY_POWER,
+ HISTORY_CURRENT,
+ HISTORY_VOLTAGE,
+ HISTORY_TEMPERATURE,
+ HISTORY_COLUMNS
+};
+
+struct HistoryFileHeader
+{
+ char magic[4];
+ uint32_t version;
+ uint32_t blockRows;
+ uint32_t ports;
+ int32_t intervalMs;
+ uint32_t reserved;
+ char host[104];
+};
+
+// Follows the file header in version 2 files
+struct HistorySegmentIndex
+{
+ std::atomic<uint32_t> segments;
+ uint32_t reserved[3];
+};
+
+struct HistoryBlockHeader
+{
+ int64_t firstMs;
+ int64_t lastMs;
+ std::atomic<uint32_t> rows;
+ std::atomic<uint32_t> sequence; // Version 2: the segment this block becomes once full
+ uint32_t reserved[10];
+};
+
+// Read-only view of one block's columns
+struct HistoryBlock
+{
+ uint32_t rows;
+ int64_t firstMs;
+ int64_t lastMs;
+ const int64_t *timestamps;
+ const float *columns[HISTORY_COLUMNS][HISTORY_PORTS];
+ const uint8_t *enabled[HISTORY_PORTS];
+};
+
+// Gaps between samples longer than this count as missing data, not energy
+int64_t historyGapMs(int intervalMs);
+
+class HistorySegment;
+
+class HistoryWriter
+{
+public:
+ HistoryWriter();
+ ~HistoryWriter();
+
+ // Create or append to a history file; an existing file must be for the same host
+ bool open(const std::string &path, const std::string &host, int intervalMs, std::string &error);
+
+ bool append(int64_t timestampMs, const std::vector<PoEPortStats> &stats);
+
+private:
+ int fd_;
+ uint32_t version_;
+ int64_t gap_ms_;
+ size_t block_index_;
+ uint8_t *block_;
+ // Version 2: the header page and both staging blocks, mapped together
+ uint8_t *staging_;
+ int64_t segment_end_;
+ std::vector<uint8_t> encoded_;
+
+ bool mapBlock(size_t index);
+ bool nextBlock();
+ bool openSegmented(const std::string &path, std::string &error);
+ bool seal(uint8_t *block);
+ uint8_t *stagingBlock(size_t index) const;
+ HistorySegmentIndex *segmentIndex() const;
+};
+
+class HistoryFile
+{
+public:
+ HistoryFile();
+ ~HistoryFile();
+
+ bool open(const std::string &path, std::string &error);
+
+ const std::string &host() const { return host_; }
+ int intervalMs() const { return interval_ms_; }
+
+ // Sealed segments come first in time, then the raw blocks
+ size_t segmentCount() const { return segments_.size(); }
+ HistorySegment segment(size_t index) const;
+ size_t blockCount() const { return blocks_.size(); }
+ HistoryBlock block(size_t index) const;
+
+private:
+ const uint8_t *data_;
+ size_t size_;
+ std::vector<size_t> segments_; // Offsets
+ std::vector<size_t> blocks_; // Raw blocks in time order
+ std::string host_;
+ int interval_ms_;
+
+ HistoryFile(const HistoryFile &) = delete;
+ HistoryFile &operator=(const HistoryFile &) = delete;
+};
+
+#endif // HISTORY_H
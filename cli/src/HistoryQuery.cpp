@@ -0,0 +1,470 @@
+/**
+ * @file HistoryQuery.cpp
+ * @brief Implementation of history aggregations
+ */
+
+#include "HistoryQuery.h"
+#include "HistorySegment.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <memory>
+
+// Independent accumulator lanes; the compiler maps them onto SIMD registers
+// without needing -ffast-math to reorder a single floating-point reduction
+static const size_t LANES = 8;
+
+namespace
+{
+struct Accumulator
+{
+ uint64_t samples;
+ float min;
+ float max;
+ double sum;
+ double energyWattMs;
+ double aboveMs;
+ int64_t previousMs;
+ std::vector<float> values;
+
+ Accumulator()
+     : samples(0), min(INFINITY), max(-INFINITY), sum(0.0), energyWattMs(0.0), aboveMs(0.0), previousMs(-1)
+ {
+ }
+};
+
+struct ScanParams
+{
+ int64_t gapMs; // Longer gaps between samples count as missing data
+ bool keepValues;
+ bool hasThreshold;
+ float threshold;
+};
+} // namespace
+
+static void scanRange(const float *values, const float *power, const int64_t *timestamps, size_t count,
+                      const ScanParams &params, Accumulator &acc)
+{
+ if (count == 0)
+ {
+  return;
+ }
+
+ float lo[LANES];
+ float hi[LANES];
+ double sum[LANES];
+ for (size_t lane = 0; lane < LANES; lane++)
+ {
+  lo[lane] = acc.min;
+  hi[lane] = acc.max;
+  sum[lane] = 0.0;
+ }
+
+ size_t i = 0;
+ for (; i + LANES <= count; i += LANES)
+ {
+  for (size_t lane = 0; lane < LANES; lane++)
+  {
+   float v = values[i + lane];
+   lo[lane] = v < lo[lane] ? v : lo[lane];
+   hi[lane] = v > hi[lane] ? v : hi[lane];
+   sum[lane] += v;
+  }
+ }
+ for (; i < count; i++)
+ {
+  lo[0] = values[i] < lo[0] ? values[i] : lo[0];
+  hi[0] = values[i] > hi[0] ? values[i] : hi[0];
+  sum[0] += values[i];
+ }
+ for (size_t lane = 0; lane < LANES; lane++)
+ {
+  acc.min = std::min(acc.min, lo[lane]);
+  acc.max = std::max(acc.max, hi[lane]);
+  acc.sum += sum[lane];
+ }
+ acc.samples += count;
+
+ // Each sample stands for the time since the previous one
+ double energy = 0.0;
+ double above = 0.0;
+ int64_t previous = acc.previousMs;
+ for (i = 0; i < count; i++)
+ {
+  int64_t dt = previous < 0 ? 0 : timestamps[i] - previous;
+  dt = dt > params.gapMs ? 0 : dt;
+  previous = timestamps[i];
+  energy += static_cast<double>(power[i]) * static_cast<double>(dt);
+  if (params.hasThreshold && values[i] > params.threshold)
+  {
+   above += static_cast<double>(dt);
+  }
+ }
+ acc.energyWattMs += energy;
+ acc.aboveMs += above;
+ acc.previousMs = previous;
+
+ if (params.keepValues)
+ {
+  acc.values.insert(acc.values.end(), values, values + count);
+ }
+}
+
+static HistorySeries finish(const std::string &host, int port, Accumulator &acc, const HistoryQuery &query)
+{
+ HistorySeries series;
+ series.host = host;
+ series.port = port;
+ series.samples = acc.samples;
+ series.min = acc.samples ? acc.min : 0.0f;
+ series.max = acc.samples ? acc.max : 0.0f;
+ series.mean = acc.samples ? acc.sum / static_cast<double>(acc.samples) : 0.0;
+ series.energyWh = acc.energyWattMs / 3600000.0;
+ series.secondsAbove = acc.aboveMs / 1000.0;
+
+ // Nearest-rank percentiles by selection, not a full sort
+ for (double percentile : query.percentiles)
+ {
+  if (acc.values.empty())
+  {
+   series.percentiles.push_back(0.0f);
+   continue;
+  }
+  size_t rank = static_cast<size_t>(std::ceil(percentile / 100.0 * static_cast<double>(acc.values.size())));
+  size_t index = rank ? std::min(rank, acc.values.size()) - 1 : 0;
+  std::nth_element(acc.values.begin(), acc.values.begin() + static_cast<std::ptrdiff_t>(index), acc.values.end());
+  series.percentiles.push_back(acc.values[index]);
+ }
+ return series;
+}
+
+namespace
+{
+// The state of one file's query, carried from block to block
+struct FileScan
+{
+ const HistoryQuery &query;
+ ScanParams params;
+ std::vector<int> ports;
+ bool summed;
+ std::unique_ptr<float[]> totals;
+ std::unique_ptr<float[]> totalPower;
+ std::vector<Accumulator> accumulators;
+
+ // Decoded segment columns, allocated on first use
+ std::unique_ptr<int64_t[]> timestamps;
+ std::unique_ptr<float[]> decoded;
+
+ FileScan(const HistoryFile &file, const HistoryQuery &query)
+     : query(query), summed(query.metric == HISTORY_POWER || query.metric == HISTORY_CURRENT),
+       totals(new float[HISTORY_BLOCK_ROWS]), totalPower(new float[HISTORY_BLOCK_ROWS])
+ {
+  params.gapMs = historyGapMs(file.intervalMs());
+  params.keepValues = !query.percentiles.empty();
+  params.hasThreshold = query.hasThreshold;
+  params.threshold = query.threshold;
+
+  for (int port = 0; port < HISTORY_PORTS; port++)
+  {
+   if (!query.portMask || (query.portMask & (1u << port)))
+   {
+    ports.push_back(port);
+   }
+  }
+  accumulators.resize(query.perSwitch ? 1 : ports.size());
+ }
+};
+} // namespace
+
+static void scanBlock(const HistoryBlock &block, FileScan &scan)
+{
+ const HistoryQuery &query = scan.query;
+ if (block.rows == 0 || block.lastMs < query.fromMs || block.firstMs >= query.toMs)
+ {
+  return;
+ }
+
+ const int64_t *begin = std::lower_bound(block.timestamps, block.timestamps + block.rows, query.fromMs);
+ const int64_t *end = std::lower_bound(begin, block.timestamps + block.rows, query.toMs);
+ size_t first = static_cast<size_t>(begin - block.timestamps);
+ size_t count = static_cast<size_t>(end - begin);
+ if (count == 0)
+ {
+  return;
+ }
+
+ if (!query.perSwitch)
+ {
+  for (size_t i = 0; i < scan.ports.size(); i++)
+  {
+   int port = scan.ports[i];
+   scanRange(block.columns[query.metric][port] + first, block.columns[HISTORY_POWER][port] + first, begin, count,
+             scan.params, scan.accumulators[i]);
+  }
+  return;
+ }
+
+ // A switch series is built row-wise from the selected port columns
+ float *totals = scan.totals.get();
+ float *totalPower = scan.totalPower.get();
+ std::fill(totals, totals + count, 0.0f);
+ std::fill(totalPower, totalPower + count, 0.0f);
+ for (int port : scan.ports)
+ {
+  const float *values = block.columns[query.metric][port] + first;
+  const float *power = block.columns[HISTORY_POWER][port] + first;
+  for (size_t i = 0; i < count; i++)
+  {
+   totals[i] += values[i];
+   totalPower[i] += power[i];
+  }
+ }
+ if (!scan.summed && !scan.ports.empty())
+ {
+  float scale = 1.0f / static_cast<float>(scan.ports.size());
+  for (size_t i = 0; i < count; i++)
+  {
+   totals[i] *= scale;
+  }
+ }
+ scanRange(totals, totalPower, begin, count, scan.params, scan.accumulators[0]);
+}
+
+// Add a whole segment's port from its header alone, as scanRange would from
+// its rows. Not possible when a threshold splits the segment's values.
+static bool summariseSegment(const HistorySegmentHeader &header, HistoryColumn metric, int port,
+                             const ScanParams &params, Accumulator &acc)
+{
+ float lo = header.min[metric][port];
+ float hi = header.max[metric][port];
+ bool above = params.hasThreshold && lo > params.threshold;
+ if (params.hasThreshold && !above && hi > params.threshold)
+ {
+  return false;
+ }
+
+ int64_t dt = acc.previousMs < 0 ? 0 : header.firstMs - acc.previousMs;
+ dt = dt > params.gapMs ? 0 : dt;
+ acc.samples += header.rows;
+ acc.min = std::min(acc.min, lo);
+ acc.max = std::max(acc.max, hi);
+ acc.sum += header.sum[metric][port];
+ acc.energyWattMs += static_cast<double>(header.firstPower[port]) * static_cast<double>(dt) + header.energyWattMs[port];
+ if (above)
+ {
+  acc.aboveMs += static_cast<double>(dt + header.coveredMs);
+ }
+ acc.previousMs = header.lastMs;
+ return true;
+}
+
+static void scanSegment(const HistorySegment &segment, FileScan &scan)
+{
+ const HistoryQuery &query = scan.query;
+ if (segment.lastMs() < query.fromMs || segment.firstMs() >= query.toMs)
+ {
+  return;
+ }
+
+ // A segment wholly inside the range often needs no decoding at all. The
+ // switch series is a row-wise sum, which the header's totals cannot give.
+ bool whole = query.fromMs <= segment.firstMs() && segment.lastMs() < query.toMs;
+ std::vector<int> pending;
+ if (whole && !query.perSwitch && !scan.params.keepValues)
+ {
+  for (size_t i = 0; i < scan.ports.size(); i++)
+  {
+   if (!summariseSegment(segment.header(), query.metric, scan.ports[i], scan.params, scan.accumulators[i]))
+   {
+    pending.push_back(scan.ports[i]);
+   }
+  }
+  if (pending.empty())
+  {
+   return;
+  }
+ }
+ else
+ {
+  pending = scan.ports;
+ }
+
+ // Decode only the columns the query reads into a block view
+ if (!scan.timestamps)
+ {
+  scan.timestamps.reset(new int64_t[HISTORY_BLOCK_ROWS]);
+  scan.decoded.reset(new float[2 * HISTORY_PORTS * HISTORY_BLOCK_ROWS]);
+ }
+ HistoryBlock block;
+ std::memset(&block, 0, sizeof(block));
+ block.rows = segment.rows();
+ block.firstMs = segment.firstMs();
+ block.lastMs = segment.lastMs();
+ block.timestamps = scan.timestamps.get();
+ segment.decodeTimestamps(scan.timestamps.get());
+ for (int port : pending)
+ {
+  float *values = scan.decoded.get() + static_cast<size_t>(port) * 2 * HISTORY_BLOCK_ROWS;
+  segment.decodeColumn(query.metric, port, values);
+  block.columns[query.metric][port] = values;
+  if (query.metric != HISTORY_POWER)
+  {
+   segment.decodeColumn(HISTORY_POWER, port, values + HISTORY_BLOCK_ROWS);
+   block.columns[HISTORY_POWER][port] = values + HISTORY_BLOCK_ROWS;
+  }
+ }
+
+ if (pending.size() == scan.ports.size())
+ {
+  scanBlock(block, scan);
+  return;
+ }
+ for (size_t i = 0; i < scan.ports.size(); i++)
+ {
+  int port = scan.ports[i];
+  if (std::find(pending.begin(), pending.end(), port) != pending.end())
+  {
+   scanRange(block.columns[query.metric][port], block.columns[HISTORY_POWER][port], block.timestamps, block.rows,
+             scan.params, scan.accumulators[i]);
+  }
+ }
+}
+
+// Query one file: either eight port series or a single switch series
+static void queryFile(const HistoryFile &file, const HistoryQuery &query, std::vector<HistorySeries> &out)
+{
+ FileScan scan(file, query);
+ for (size_t index = 0; index < file.segmentCount(); index++)
+ {
+  scanSegment(file.segment(index), scan);
+ }
+ for (size_t index = 0; index < file.blockCount(); index++)
+ {
+  scanBlock(file.block(index), scan);
+ }
+
+ if (query.perSwitch)
+ {
+  out.push_back(finish(file.host(), 0, scan.accumulators[0], query));
+  return;
+ }
+ for (size_t i = 0; i < scan.ports.size(); i++)
+ {
+  out.push_back(finish(file.host(), scan.ports[i] + 1, scan.accumulators[i], query));
+ }
+}
+
+bool queryHistory(const std::vector<std::string> &paths, const HistoryQuery &query, std::vector<HistorySeries> &series,
+                  std::string &error)
+{
+ series.clear();
+ for (const auto &path : paths)
+ {
+  HistoryFile file;
+  if (!file.open(path, error))
+  {
+   return false;
+  }
+  queryFile(file, query, series);
+ }
+
+ if (query.top)
+ {
+  std::sort(series.begin(), series.end(),
+            [](const HistorySeries &a, const HistorySeries &b) { return a.energyWh > b.energyWh; });
+  if (series.size() > query.top)
+  {
+   series.resize(query.top);
+  }
+ }
+ return true;
+}
+
+bool parseHistoryTime(const std::string &text, int64_t &ms)
+{
+ int64_t nowMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+                     std::chrono::system_clock::now().time_since_epoch())
+                     .count();
+ if (text == "now")
+ {
+  ms = nowMs;
+  return true;
+ }
+
+ char *end = nullptr;
+ if (text.size() > 1 && text[0] == '-')
+ {
+  long amount = std::strtol(text.c_str() + 1, &end, 10);
+  int64_t unit = 0;
+  if (std::strcmp(end, "s") == 0)
+  {
+   unit = 1000;
+  }
+  else if (std::strcmp(end, "m") == 0)
+  {
+   unit = 60000;
+  }
+  else if (std::strcmp(end, "h") == 0)
+  {
+   unit = 3600000;
+  }
+  else if (std::strcmp(end, "d") == 0)
+  {
+   unit = 86400000;
+  }
+  if (!unit || amount < 0)
+  {
+   return false;
+  }
+  ms = nowMs - amount * unit;
+  return true;
+ }
+
+ long long seconds = std::strtoll(text.c_str(), &end, 10);
+ if (!text.empty() && *end == '\0')
+ {
+  ms = static_cast<int64_t>(seconds) * 1000;
+  return true;
+ }
+
+ struct tm local;
+ std::memset(&local, 0, sizeof(local));
+ const char *rest = strptime(text.c_str(), "%Y-%m-%d", &local);
+ if (!rest)
+ {
+  return false;
+ }
+ if (*rest == 'T' || *rest == ' ')
+ {
+  const char *clock = strptime(rest + 1, "%H:%M:%S", &local);
+  rest = clock ? clock : strptime(rest + 1, "%H:%M", &local);
+  if (!rest)
+  {
+   return false;
+  }
+ }
+ if (*rest != '\0')
+ {
+  return false;
+ }
+ local.tm_isdst = -1;
+ ms = static_cast<int64_t>(mktime(&local)) * 1000;
+ return true;
+}
+
+bool parseHistoryMetric(const std::string &name, HistoryColumn &metric)
+{
+ static const char *NAMES[HISTORY_COLUMNS] = {"power", "current", "voltage", "temperature"};
+ for (int column = 0; column < HISTORY_COLUMNS; column++)
+ {
+  if (name == NAMES[column])
+  {
+   metric = static_cast<HistoryColumn>(column);
+   return true;
+  }
+ }
+ return false;
+}
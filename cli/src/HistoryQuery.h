@@ -0,0 +1,64 @@
+/**
+ * @file HistoryQuery.h
+ * @brief Aggregations over recorded history files
+ *
+ * Each series (one port, or one switch's total) is computed by scanning a
+ * single column of the mapped blocks that overlap the time range. Blocks
+ * outside the range are skipped by their header, and the range edges inside
+ * a block are found by binary search on the timestamp column.
+ *
+ * Compressed segments are skipped the same way. A port series over a whole
+ * segment is totalled from the segment header's minimum, maximum, sum and
+ * energy unless it needs percentiles or its values straddle the threshold;
+ * otherwise only the timestamps and the columns read are decoded.
+ */
+
+#ifndef HISTORY_QUERY_H
+#define HISTORY_QUERY_H
+
+#include <climits>
+#include <string>
+#include <vector>
+#include "History.h"
+
+struct HistoryQuery
+{
+ int64_t fromMs; // Inclusive
+ int64_t toMs;   // Exclusive
+ uint8_t portMask; // Bit (port - 1); zero selects every port
+ HistoryColumn metric;
+ bool perSwitch;  // One series per switch (sum of power/current, mean of voltage/temperature)
+ std::vector<double> percentiles;
+ bool hasThreshold;
+ float threshold;
+ size_t top; // Keep only the K series with the most energy; zero keeps all
+
+ HistoryQuery()
+     : fromMs(LLONG_MIN), toMs(LLONG_MAX), portMask(0), metric(HISTORY_POWER), perSwitch(false), hasThreshold(false),
+       threshold(0.0f), top(0)
+ {
+ }
+};
+
+struct HistorySeries
+{
+ std::string host;
+ int port; // Zero for a whole switch
+ uint64_t samples;
+ float min;
+ float max;
+ double mean;
+ std::vector<float> percentiles; // In the order requested
+ double energyWh;
+ double secondsAbove;
+};
+
+bool queryHistory(const std::vector<std::string> &paths, const HistoryQuery &query, std::vector<HistorySeries> &series,
+                  std::string &error);
+
+// Parse "now", "-7d", "-12h", "-30m", epoch seconds or "YYYY-MM-DD[THH:MM[:SS]]" (local time)
+bool parseHistoryTime(const std::string &text, int64_t &ms);
+
+bool parseHistoryMetric(const std::string &name, HistoryColumn &metric);
+
+#endif // HISTORY_QUERY_H
@@ -0,0 +1,524 @@
+/**
+ * @file HistorySegment.cpp
+ * @brief Implementation of compressed history segments
+ */
+
+#include "HistorySegment.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+static const char SEGMENT_MAGIC[4] = {'G', 'S', '8', 'S'};
+
+static_assert(sizeof(HistorySegmentHeader) == 880, "history segment header layout");
+
+// Fixed-point scales tried in turn; the smallest exact one wins. Decoding
+// multiplies by the inverse, and a column is only stored this way if that
+// gives back every value exactly.
+static const int MAX_EXPONENT = 3;
+static const double SCALES[MAX_EXPONENT + 1] = {1.0, 10.0, 100.0, 1000.0};
+static const double INVERSE_SCALES[MAX_EXPONENT + 1] = {1.0, 0.1, 0.01, 0.001};
+
+namespace
+{
+// Writes bits most significant first into whole bytes
+class BitWriter
+{
+public:
+ explicit BitWriter(std::vector<uint8_t> &out) : out_(out), bits_(0), filled_(0) {}
+
+ void write(uint64_t value, int count)
+ {
+  while (count > 0)
+  {
+   int take = std::min(64 - filled_, count);
+   uint64_t chunk = (value >> (count - take)) & mask(take);
+   bits_ = take == 64 ? chunk : (bits_ << take) | chunk;
+   filled_ += take;
+   count -= take;
+   if (filled_ == 64)
+   {
+    flush(8);
+   }
+  }
+ }
+
+ // Pad the last byte with zeros
+ void finish()
+ {
+  if (filled_)
+  {
+   bits_ <<= 64 - filled_;
+   flush((filled_ + 7) / 8);
+  }
+ }
+
+private:
+ std::vector<uint8_t> &out_;
+ uint64_t bits_;
+ int filled_;
+
+ static uint64_t mask(int count) { return count == 64 ? ~0ull : (1ull << count) - 1; }
+
+ void flush(int bytes)
+ {
+  for (int i = 0; i < bytes; i++)
+  {
+   out_.push_back(static_cast<uint8_t>(bits_ >> (56 - 8 * i)));
+  }
+  bits_ = 0;
+  filled_ = 0;
+ }
+};
+
+// Reads what BitWriter wrote; past the end it reads zeros
+class BitReader
+{
+public:
+ BitReader(const uint8_t *data, size_t length) : next_(data), end_(data + length), bits_(0), available_(0) {}
+
+ // At most 32 bits at a time
+ uint64_t read(int count)
+ {
+  if (available_ < count)
+  {
+   refill();
+  }
+  uint64_t value = bits_ >> (64 - count);
+  bits_ <<= count;
+  available_ -= count;
+  return value;
+ }
+
+ bool bit() { return read(1) != 0; }
+
+ // The next count bits (at most 57), without consuming them
+ uint64_t peek(int count)
+ {
+  if (available_ < count)
+  {
+   refill();
+  }
+  return bits_ >> (64 - count);
+ }
+
+ void skip(int count)
+ {
+  bits_ <<= count;
+  available_ -= count;
+ }
+
+private:
+ const uint8_t *next_;
+ const uint8_t *end_;
+ uint64_t bits_; // Left-aligned
+ int available_;
+
+ void refill()
+ {
+  if (end_ - next_ >= 8)
+  {
+   // A whole word at once; the bits past the bytes counted are loaded again next time
+   uint64_t word = 0;
+   for (int i = 0; i < 8; i++)
+   {
+    word = word << 8 | next_[i];
+   }
+   bits_ |= word >> available_;
+   int bytes = (63 - available_) >> 3;
+   next_ += bytes;
+   available_ += bytes * 8;
+   return;
+  }
+  while (available_ <= 56)
+  {
+   uint64_t byte = next_ < end_ ? *next_++ : 0;
+   bits_ |= byte << (56 - available_);
+   available_ += 8;
+  }
+ }
+};
+} // namespace
+
+static uint64_t zigzag(int64_t value)
+{
+ return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+static int64_t unzigzag(uint64_t value)
+{
+ return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+static void writeSigned(BitWriter &out, int64_t value)
+{
+ uint64_t z = zigzag(value);
+ if (z == 0)
+ {
+  out.write(0, 1);
+ }
+ else if (z < (1u << 3))
+ {
+  out.write(0x2, 2);
+  out.write(z, 3);
+ }
+ else if (z < (1u << 7))
+ {
+  out.write(0x6, 3);
+  out.write(z, 7);
+ }
+ else if (z < (1u << 15))
+ {
+  out.write(0xE, 4);
+  out.write(z, 15);
+ }
+ else
+ {
+  out.write(0xF, 4);
+  out.write(z, 64);
+ }
+}
+
+// Decoded from the next four bits by table rather than bit by bit, since
+// noisy readings would make every branch a coin toss
+static int64_t readSigned(BitReader &in)
+{
+ static const uint8_t PREFIX_BITS[16] = {1, 1, 1, 1, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 4, 4};
+ static const uint8_t PAYLOAD_BITS[16] = {0, 0, 0, 0, 0, 0, 0, 0, 3, 3, 3, 3, 7, 7, 15, 64};
+
+ uint64_t window = in.peek(19);
+ unsigned code = static_cast<unsigned>(window >> 15);
+ if (code == 15)
+ {
+  in.skip(4);
+  uint64_t high = in.read(32);
+  return unzigzag(high << 32 | in.read(32));
+ }
+ int width = PREFIX_BITS[code] + PAYLOAD_BITS[code];
+ uint64_t value = (window >> (19 - width)) & ((1u << PAYLOAD_BITS[code]) - 1);
+ in.skip(width);
+ return unzigzag(value);
+}
+
+static uint32_t floatBits(float value)
+{
+ uint32_t bits;
+ std::memcpy(&bits, &value, sizeof(bits));
+ return bits;
+}
+
+static float bitsFloat(uint32_t bits)
+{
+ float value;
+ std::memcpy(&value, &bits, sizeof(value));
+ return value;
+}
+
+static float fromFixed(int64_t value, int exponent)
+{
+ return static_cast<float>(static_cast<double>(value) * INVERSE_SCALES[exponent]);
+}
+
+// The smallest exponent at which every value round-trips exactly, or -1.
+// Bits are compared rather than values, since -0.0 == 0.0 but decodes as 0.0.
+static int fixedExponent(const float *values, uint32_t rows)
+{
+ for (int exponent = 0; exponent <= MAX_EXPONENT; exponent++)
+ {
+  bool exact = true;
+  for (uint32_t i = 0; i < rows && exact; i++)
+  {
+   double scaled = static_cast<double>(values[i]) * SCALES[exponent];
+   exact = std::fabs(scaled) < 1e15 && floatBits(fromFixed(std::llround(scaled), exponent)) == floatBits(values[i]);
+  }
+  if (exact)
+  {
+   return exponent;
+  }
+ }
+ return -1;
+}
+
+static void encodeFixed(BitWriter &out, const float *values, uint32_t rows, int exponent)
+{
+ int64_t previous = 0;
+ for (uint32_t i = 0; i < rows; i++)
+ {
+  int64_t value = std::llround(static_cast<double>(values[i]) * SCALES[exponent]);
+  writeSigned(out, value - previous);
+  previous = value;
+ }
+}
+
+// Gorilla's float compression: the XOR with the previous value, as its meaningful bits only
+static void encodeXor(BitWriter &out, const float *values, uint32_t rows)
+{
+ uint32_t previous = floatBits(values[0]);
+ out.write(previous, 32);
+ int leading = -1;
+ int trailing = 0;
+ for (uint32_t i = 1; i < rows; i++)
+ {
+  uint32_t bits = floatBits(values[i]);
+  uint32_t difference = bits ^ previous;
+  previous = bits;
+  if (difference == 0)
+  {
+   out.write(0, 1);
+   continue;
+  }
+  int lead = __builtin_clz(difference);
+  int trail = __builtin_ctz(difference);
+  if (leading >= 0 && lead >= leading && trail >= trailing)
+  {
+   // Fits the previous window
+   out.write(0x2, 2);
+   out.write(difference >> trailing, 32 - leading - trailing);
+   continue;
+  }
+  out.write(0x3, 2);
+  out.write(static_cast<uint64_t>(lead), 5);
+  out.write(static_cast<uint64_t>(32 - lead - trail - 1), 5);
+  out.write(difference >> trail, 32 - lead - trail);
+  leading = lead;
+  trailing = trail;
+ }
+}
+
+static uint32_t fnv1a(const uint8_t *data, size_t length)
+{
+ uint32_t hash = 2166136261u;
+ for (size_t i = 0; i < length; i++)
+ {
+  hash = (hash ^ data[i]) * 16777619u;
+ }
+ return hash;
+}
+
+void encodeHistorySegment(const HistoryBlock &block, int64_t gapMs, std::vector<uint8_t> &out)
+{
+ HistorySegmentHeader header;
+ std::memset(&header, 0, sizeof(header));
+ std::memcpy(header.magic, SEGMENT_MAGIC, sizeof(SEGMENT_MAGIC));
+ header.rows = block.rows;
+ header.firstMs = block.timestamps[0];
+ header.lastMs = block.timestamps[block.rows - 1];
+
+ out.assign(sizeof(header), 0);
+ int stream = 0;
+
+ // Timestamps: the first in full, then each interval's change from the one before
+ header.streamOffset[stream++] = static_cast<uint32_t>(out.size());
+ {
+  BitWriter bits(out);
+  bits.write(static_cast<uint64_t>(header.firstMs), 64);
+  int64_t previousDelta = 0;
+  for (uint32_t i = 1; i < block.rows; i++)
+  {
+   int64_t delta = block.timestamps[i] - block.timestamps[i - 1];
+   writeSigned(bits, delta - previousDelta);
+   previousDelta = delta;
+   header.coveredMs += delta > gapMs ? 0 : delta;
+  }
+  bits.finish();
+ }
+
+ for (int column = 0; column < HISTORY_COLUMNS; column++)
+ {
+  for (int port = 0; port < HISTORY_PORTS; port++)
+  {
+   const float *values = block.columns[column][port];
+   float lo = values[0];
+   float hi = values[0];
+   double sum = 0.0;
+   for (uint32_t i = 0; i < block.rows; i++)
+   {
+    lo = std::min(lo, values[i]);
+    hi = std::max(hi, values[i]);
+    sum += values[i];
+   }
+   header.min[column][port] = lo;
+   header.max[column][port] = hi;
+   header.sum[column][port] = sum;
+
+   header.streamOffset[stream++] = static_cast<uint32_t>(out.size());
+   BitWriter bits(out);
+   int exponent = fixedExponent(values, block.rows);
+   if (exponent >= 0)
+   {
+    header.encoding[column][port] = SEGMENT_FIXED;
+    header.exponent[column][port] = static_cast<uint8_t>(exponent);
+    encodeFixed(bits, values, lo == hi ? 1 : block.rows, exponent);
+   }
+   else
+   {
+    header.encoding[column][port] = SEGMENT_XOR;
+    encodeXor(bits, values, block.rows);
+   }
+   bits.finish();
+  }
+ }
+
+ for (int port = 0; port < HISTORY_PORTS; port++)
+ {
+  header.streamOffset[stream++] = static_cast<uint32_t>(out.size());
+  BitWriter bits(out);
+  uint32_t changes = 0;
+  for (uint32_t i = 1; i < block.rows; i++)
+  {
+   changes += (block.enabled[port][i] != 0) != (block.enabled[port][i - 1] != 0);
+  }
+  for (uint32_t i = 0; i < (changes || block.rows <= 8 ? block.rows : 1); i++)
+  {
+   bits.write(block.enabled[port][i] ? 1 : 0, 1);
+  }
+  bits.finish();
+
+  // The same sum as a query scan, so whole segments can be totalled from here
+  const float *power = block.columns[HISTORY_POWER][port];
+  header.firstPower[port] = power[0];
+  double energy = 0.0;
+  for (uint32_t i = 1; i < block.rows; i++)
+  {
+   int64_t dt = block.timestamps[i] - block.timestamps[i - 1];
+   dt = dt > gapMs ? 0 : dt;
+   energy += static_cast<double>(power[i]) * static_cast<double>(dt);
+  }
+  header.energyWattMs[port] = energy;
+ }
+
+ // Segments are laid end to end, so keep the next header aligned
+ header.streamOffset[stream] = static_cast<uint32_t>(out.size());
+ out.resize((out.size() + 7) / 8 * 8, 0);
+ header.bytes = static_cast<uint32_t>(out.size());
+ header.check = fnv1a(out.data() + sizeof(header), out.size() - sizeof(header));
+ std::memcpy(out.data(), &header, sizeof(header));
+}
+
+HistorySegment::HistorySegment()
+    : data_(nullptr), header_(nullptr)
+{
+}
+
+bool HistorySegment::open(const uint8_t *data, size_t available, bool verify)
+{
+ if (available < sizeof(HistorySegmentHeader))
+ {
+  return false;
+ }
+ const HistorySegmentHeader *header = reinterpret_cast<const HistorySegmentHeader *>(data);
+ if (std::memcmp(header->magic, SEGMENT_MAGIC, sizeof(SEGMENT_MAGIC)) != 0 || header->bytes > available ||
+     header->bytes < sizeof(HistorySegmentHeader) || header->rows == 0 || header->rows > HISTORY_BLOCK_ROWS)
+ {
+  return false;
+ }
+ uint32_t previous = sizeof(HistorySegmentHeader);
+ for (int stream = 0; stream <= SEGMENT_STREAMS; stream++)
+ {
+  if (header->streamOffset[stream] < previous || header->streamOffset[stream] > header->bytes)
+  {
+   return false;
+  }
+  previous = header->streamOffset[stream];
+ }
+ for (int column = 0; column < HISTORY_COLUMNS; column++)
+ {
+  for (int port = 0; port < HISTORY_PORTS; port++)
+  {
+   if (header->encoding[column][port] > SEGMENT_XOR || header->exponent[column][port] > MAX_EXPONENT)
+   {
+    return false;
+   }
+  }
+ }
+ if (verify && fnv1a(data + sizeof(HistorySegmentHeader), header->bytes - sizeof(HistorySegmentHeader)) != header->check)
+ {
+  return false;
+ }
+ data_ = data;
+ header_ = header;
+ return true;
+}
+
+const uint8_t *HistorySegment::stream(int index, size_t &length) const
+{
+ length = header_->streamOffset[index + 1] - header_->streamOffset[index];
+ return data_ + header_->streamOffset[index];
+}
+
+void HistorySegment::decodeTimestamps(int64_t *out) const
+{
+ size_t length;
+ const uint8_t *data = stream(0, length);
+ BitReader bits(data, length);
+ uint64_t high = bits.read(32);
+ int64_t timestamp = static_cast<int64_t>(high << 32 | bits.read(32));
+ int64_t delta = 0;
+ out[0] = timestamp;
+ for (uint32_t i = 1; i < header_->rows; i++)
+ {
+  delta += readSigned(bits);
+  timestamp += delta;
+  out[i] = timestamp;
+ }
+}
+
+void HistorySegment::decodeColumn(int column, int port, float *out) const
+{
+ size_t length;
+ const uint8_t *data = stream(1 + column * HISTORY_PORTS + port, length);
+ BitReader bits(data, length);
+ uint32_t rows = header_->rows;
+
+ if (header_->encoding[column][port] == SEGMENT_FIXED)
+ {
+  int exponent = header_->exponent[column][port];
+  int64_t value = 0;
+  if (header_->min[column][port] == header_->max[column][port])
+  {
+   std::fill(out, out + rows, fromFixed(readSigned(bits), exponent));
+   return;
+  }
+  for (uint32_t i = 0; i < rows; i++)
+  {
+   value += readSigned(bits);
+   out[i] = fromFixed(value, exponent);
+  }
+  return;
+ }
+
+ uint32_t previous = static_cast<uint32_t>(bits.read(32));
+ out[0] = bitsFloat(previous);
+ int leading = 0;
+ int meaningful = 0;
+ for (uint32_t i = 1; i < rows; i++)
+ {
+  if (bits.bit())
+  {
+   if (bits.bit())
+   {
+    leading = static_cast<int>(bits.read(5));
+    meaningful = static_cast<int>(bits.read(5)) + 1;
+   }
+   previous ^= static_cast<uint32_t>(bits.read(meaningful)) << (32 - leading - meaningful);
+  }
+  out[i] = bitsFloat(previous);
+ }
+}
+
+void HistorySegment::decodeEnabled(int port, uint8_t *out) const
+{
+ size_t length;
+ const uint8_t *data = stream(1 + HISTORY_COLUMNS * HISTORY_PORTS + port, length);
+ BitReader bits(data, length);
+ if (length < (header_->rows + 7) / 8)
+ {
+  uint8_t flag = bits.bit() ? 1 : 0;
+  std::fill(out, out + header_->rows, flag);
+  return;
+ }
+ for (uint32_t i = 0; i < header_->rows; i++)
+ {
+  out[i] = bits.bit() ? 1 : 0;
+ }
+}
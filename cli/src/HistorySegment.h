@@ -0,0 +1,97 @@
+/**
+ * @file HistorySegment.h
+ * @brief Compressed encoding of one history block
+ *
+ * Once a history block is full it is sealed into a segment: the same rows,
+ * column by column, in a fraction of the space. Every column is a bit stream
+ * of its own, so a query decodes only the columns it reads.
+ *
+ * - Timestamps are stored as deltas of deltas. A steady poll interval costs
+ *   one bit per row, and a few milliseconds of jitter about ten.
+ * - Readings are stored as fixed-point deltas where the whole column is
+ *   exact at a power-of-ten scale. The switch reports whole milliamps, whole
+ *   degrees and tenths of watts and volts, so this is the usual case. A
+ *   column that never changes, such as any reading of a port that is off,
+ *   stores its first value only. Any other column falls back to XOR-ing each
+ *   float with the previous one, which is also lossless.
+ * - Enabled flags are packed one bit per row, or stored once if they never
+ *   change.
+ *
+ * Signed deltas use a small prefix code: 0 for no change, then 3, 7, 15 and
+ * 64 bit payloads behind the prefixes 10, 110, 1110 and 1111.
+ *
+ * The segment header keeps each column's minimum, maximum and sum and each
+ * port's energy. A query that covers a whole segment and needs no
+ * percentiles takes its aggregates from the header without decoding.
+ */
+
+#ifndef HISTORY_SEGMENT_H
+#define HISTORY_SEGMENT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "History.h"
+
+// Stream order within a segment: timestamps, each column's ports, then each port's enabled flags
+static const int SEGMENT_STREAMS = 1 + (HISTORY_COLUMNS + 1) * HISTORY_PORTS;
+
+enum SegmentEncoding : uint8_t
+{
+ SEGMENT_FIXED = 0, // Fixed-point deltas; the scale is 10^exponent
+ SEGMENT_XOR = 1    // Float XOR with the previous value
+};
+
+// On-disk layout; the stream bytes follow it
+struct HistorySegmentHeader
+{
+ char magic[4];
+ uint32_t bytes; // Of the whole segment, header included
+ uint32_t rows;
+ uint32_t check; // FNV-1a of everything after the header
+ int64_t firstMs;
+ int64_t lastMs;
+ int64_t coveredMs;                  // Sum of the intervals after the first row, gaps left out
+ double sum[HISTORY_COLUMNS][HISTORY_PORTS];
+ double energyWattMs[HISTORY_PORTS]; // Integrated over the rows after the first
+ float min[HISTORY_COLUMNS][HISTORY_PORTS];
+ float max[HISTORY_COLUMNS][HISTORY_PORTS];
+ float firstPower[HISTORY_PORTS];
+ uint32_t streamOffset[SEGMENT_STREAMS + 1]; // From the segment start; the last entry is the end
+ uint8_t encoding[HISTORY_COLUMNS][HISTORY_PORTS];
+ uint8_t exponent[HISTORY_COLUMNS][HISTORY_PORTS];
+};
+
+// Encode a block's rows; gapMs is the file's missing-data gap, for the energy totals
+void encodeHistorySegment(const HistoryBlock &block, int64_t gapMs, std::vector<uint8_t> &out);
+
+// Read-only view of a mapped segment
+class HistorySegment
+{
+public:
+ HistorySegment();
+
+ // Check the layout of a segment of at most available bytes. Verifying the
+ // checksum as well reads every byte, so only the writer does it, on the
+ // segment most likely to be torn.
+ bool open(const uint8_t *data, size_t available, bool verify = false);
+
+ const HistorySegmentHeader &header() const { return *header_; }
+ uint32_t rows() const { return header_->rows; }
+ int64_t firstMs() const { return header_->firstMs; }
+ int64_t lastMs() const { return header_->lastMs; }
+ size_t bytes() const { return header_->bytes; }
+
+ // Decode every row into out, which must hold rows() values
+ void decodeTimestamps(int64_t *out) const;
+ void decodeColumn(int column, int port, float *out) const;
+ void decodeEnabled(int port, uint8_t *out) const;
+
+private:
+ const uint8_t *data_;
+ const HistorySegmentHeader *header_;
+
+ const uint8_t *stream(int index, size_t &length) const;
+};
+
+#endif // HISTORY_SEGMENT_H
@@ -0,0 +1,128 @@
+/**
+ * @file InternTable.cpp
+ * @brief Implementation of the text intern table
+ */
+
+#include "InternTable.h"
+#include <atomic>
+#include <cstring>
+#include <deque>
+#include <mutex>
+
+// Open addressing at no more than half load
+static const size_t SLOT_COUNT = MAX_INTERNED_TEXTS * 2;
+
+static const char *KNOWN_TEXTS[KNOWN_TEXT_COUNT] = {
+    "Unknown", "",        "Delivering Power", "Disabled", "Searching", "No Error",
+    "Class 0", "Class 1", "Class 2",          "Class 3",  "Class 4",
+};
+
+namespace
+{
+// Readers probe slots and texts without locking. A writer publishes the text
+// before the slot that points at it, both with release ordering.
+struct Table
+{
+ std::atomic<const std::string *> texts[MAX_INTERNED_TEXTS];
+ std::atomic<uint32_t> slots[SLOT_COUNT]; // Id + 1; zero is empty
+ std::mutex mutex;
+ std::deque<std::string> storage; // Stable addresses for the lifetime of the process
+ size_t count;
+
+ Table() : count(0)
+ {
+  for (auto &text : texts)
+  {
+   text.store(nullptr, std::memory_order_relaxed);
+  }
+  for (auto &slot : slots)
+  {
+   slot.store(0, std::memory_order_relaxed);
+  }
+  for (const char *text : KNOWN_TEXTS)
+  {
+   add(text, std::strlen(text), hash(text, std::strlen(text)));
+  }
+ }
+
+ static uint32_t hash(const char *text, size_t length)
+ {
+  uint32_t value = 2166136261u;
+  for (size_t i = 0; i < length; i++)
+  {
+   value = (value ^ static_cast<uint8_t>(text[i])) * 16777619u;
+  }
+  return value;
+ }
+
+ // Id of the text, or MAX_INTERNED_TEXTS if it is not in the table
+ size_t find(const char *text, size_t length, uint32_t hashed) const
+ {
+  for (size_t slot = hashed % SLOT_COUNT;; slot = (slot + 1) % SLOT_COUNT)
+  {
+   uint32_t entry = slots[slot].load(std::memory_order_acquire);
+   if (entry == 0)
+   {
+    return MAX_INTERNED_TEXTS;
+   }
+   const std::string *candidate = texts[entry - 1].load(std::memory_order_acquire);
+   if (candidate->size() == length && std::memcmp(candidate->data(), text, length) == 0)
+   {
+    return entry - 1;
+   }
+  }
+ }
+
+ // Caller holds the mutex (or is the constructor)
+ TextId add(const char *text, size_t length, uint32_t hashed)
+ {
+  if (count == MAX_INTERNED_TEXTS)
+  {
+   return TEXT_UNKNOWN;
+  }
+  size_t id = count++;
+  storage.emplace_back(text, length);
+  texts[id].store(&storage.back(), std::memory_order_release);
+
+  size_t slot = hashed % SLOT_COUNT;
+  while (slots[slot].load(std::memory_order_relaxed) != 0)
+  {
+   slot = (slot + 1) % SLOT_COUNT;
+  }
+  slots[slot].store(static_cast<uint32_t>(id + 1), std::memory_order_release);
+  return static_cast<TextId>(id);
+ }
+};
+
+Table &table()
+{
+ static Table instance;
+ return instance;
+}
+} // namespace
+
+TextId internText(const char *text, size_t length)
+{
+ Table &interned = table();
+ uint32_t hashed = Table::hash(text, length);
+ size_t id = interned.find(text, length, hashed);
+ if (id != MAX_INTERNED_TEXTS)
+ {
+  return static_cast<TextId>(id);
+ }
+
+ std::lock_guard<std::mutex> lock(interned.mutex);
+ id = interned.find(text, length, hashed);
+ if (id != MAX_INTERNED_TEXTS)
+ {
+  return static_cast<TextId>(id);
+ }
+ return interned.add(text, length, hashed);
+}
+
+const std::string &internedText(TextId id)
+{
+ Table &interned = table();
+ const std::string *text = id < MAX_INTERNED_TEXTS ? interned.texts[id].load(std::memory_order_acquire) : nullptr;
+ return text ? *text : *interned.texts[TEXT_UNKNOWN].load(std::memory_order_relaxed);
+}
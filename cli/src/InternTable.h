@@ -0,0 +1,49 @@
+/**
+ * @file InternTable.h
+ * @brief Process-wide table of the short texts a switch reports
+ *
+ * Port status, fault and class take only a handful of distinct values, so
+ * PoEPortStats stores them as small ids and output code looks the text up
+ * when it writes it. The common values have fixed ids, the same in every
+ * process; anything else the switch reports is added on first sight.
+ * Lookups of known text are lock-free and never allocate.
+ */
+
+#ifndef INTERN_TABLE_H
+#define INTERN_TABLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+typedef uint16_t TextId;
+
+enum KnownText : TextId
+{
+ TEXT_UNKNOWN,
+ TEXT_EMPTY,
+ TEXT_DELIVERING_POWER,
+ TEXT_DISABLED,
+ TEXT_SEARCHING,
+ TEXT_NO_ERROR,
+ TEXT_CLASS_0,
+ TEXT_CLASS_1,
+ TEXT_CLASS_2,
+ TEXT_CLASS_3,
+ TEXT_CLASS_4,
+ KNOWN_TEXT_COUNT
+};
+
+// Once this many distinct texts exist, further new ones intern as "Unknown"
+static const size_t MAX_INTERNED_TEXTS = 4096;
+
+TextId internText(const char *text, size_t length);
+
+inline TextId internText(const std::string &text)
+{
+ return internText(text.data(), text.size());
+}
+
+const std::string &internedText(TextId id);
+
+#endif // INTERN_TABLE_H
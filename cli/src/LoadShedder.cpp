@@ -0,0 +1,194 @@
+/**
+ * @file LoadShedder.cpp
+ * @brief Implementation of automatic PoE load shedding
+ */
+
+#include "LoadShedder.h"
+#include "AuditLog.h"
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <unistd.h>
+
+bool parseShedOrder(const std::string &text, std::vector<int> &order)
+{
+ order.clear();
+ std::istringstream in(text);
+ std::string item;
+ while (std::getline(in, item, ','))
+ {
+  int port = std::atoi(item.c_str());
+  if (port < 1 || port > 8 || std::find(order.begin(), order.end(), port) != order.end())
+  {
+   return false;
+  }
+  order.push_back(port);
+ }
+ return !order.empty();
+}
+
+static std::string joinPorts(const std::vector<int> &ports)
+{
+ std::string text;
+ for (size_t i = 0; i < ports.size(); i++)
+ {
+  text += (i ? "," : "") + std::to_string(ports[i]);
+ }
+ return text;
+}
+
+LoadShedder::LoadShedder(const LoadShedConfig &config)
+    : config_(config), headroom_samples_(0)
+{
+ if (config_.shedOrder.empty())
+ {
+  for (int port = 8; port >= 1; port--)
+  {
+   config_.shedOrder.push_back(port);
+  }
+ }
+ if (config_.restorePercent <= 0.0f || config_.restorePercent >= config_.shedPercent)
+ {
+  config_.restorePercent = config_.shedPercent * 0.85f;
+ }
+}
+
+bool LoadShedder::isShed(int port) const
+{
+ return std::find(shed_.begin(), shed_.end(), port) != shed_.end();
+}
+
+LoadShedder::Decision LoadShedder::evaluate(const std::vector<PoEPortStats> &stats)
+{
+ Decision decision;
+ decision.totalWatts = 0.0f;
+
+ float portWatts[9] = {0};
+ bool delivering[9] = {false};
+ for (const auto &s : stats)
+ {
+  if (s.port >= 1 && s.port <= 8)
+  {
+   portWatts[s.port] = s.power;
+   delivering[s.port] = s.enabled && s.power > 0.0f;
+   decision.totalWatts += s.power;
+  }
+ }
+
+ if (decision.totalWatts >= shedWatts())
+ {
+  // Shed just enough, lowest priority first, to drop below the threshold
+  float remaining = decision.totalWatts;
+  for (int port : config_.shedOrder)
+  {
+   if (remaining < shedWatts())
+   {
+    break;
+   }
+   if (delivering[port] && !isShed(port))
+   {
+    decision.shed.push_back(port);
+    remaining -= portWatts[port];
+   }
+  }
+  headroom_samples_ = 0;
+  return decision;
+ }
+
+ if (shed_.empty())
+ {
+  return decision;
+ }
+
+ // Restore the most important shed port once its old draw fits with margin
+ int candidate = shed_.back();
+ if (decision.totalWatts + shed_watts_[candidate] <= restoreWatts())
+ {
+  if (++headroom_samples_ >= config_.restoreHoldSamples)
+  {
+   decision.restore.push_back(candidate);
+  }
+ }
+ else
+ {
+  headroom_samples_ = 0;
+ }
+ return decision;
+}
+
+void LoadShedder::commit(const Decision &decision, const std::vector<PoEPortStats> &stats)
+{
+ for (int port : decision.shed)
+ {
+  shed_.push_back(port);
+  for (const auto &s : stats)
+  {
+   if (s.port == port)
+   {
+    shed_watts_[port] = s.power;
+   }
+  }
+ }
+
+ for (int port : decision.restore)
+ {
+  shed_.erase(std::remove(shed_.begin(), shed_.end(), port), shed_.end());
+  shed_watts_.erase(port);
+  headroom_samples_ = 0;
+ }
+
+ // Someone else re-enabled a shed port; stop tracking it
+ for (const auto &s : stats)
+ {
+  if (s.enabled && isShed(s.port) &&
+      std::find(decision.shed.begin(), decision.shed.end(), s.port) == decision.shed.end())
+  {
+   shed_.erase(std::remove(shed_.begin(), shed_.end(), static_cast<int>(s.port)), shed_.end());
+   shed_watts_.erase(s.port);
+  }
+ }
+}
+
+void LoadShedder::enforce(GS308EP_CLI &controller, const std::vector<PoEPortStats> &stats)
+{
+ if (stats.empty())
+ {
+  return;
+ }
+
+ Decision decision = evaluate(stats);
+ AuditScope scope(AuditActor(AUDIT_SHEDDER, getuid()));
+ std::ostringstream total;
+ total << std::fixed << std::setprecision(1) << decision.totalWatts << " W";
+
+ if (!decision.shed.empty())
+ {
+  if (!controller.setPortStates(decision.shed, false))
+  {
+   std::cerr << "[ERROR] Load shed of ports " << joinPorts(decision.shed) << " failed" << std::endl;
+   decision.shed.clear();
+  }
+  else
+  {
+   std::cerr << "[WARN] Load shed: ports " << joinPorts(decision.shed) << " off at " << total.str()
+             << " (threshold " << std::fixed << std::setprecision(1) << shedWatts() << " W)" << std::endl;
+  }
+ }
+
+ if (!decision.restore.empty())
+ {
+  if (!controller.setPortStates(decision.restore, true))
+  {
+   std::cerr << "[ERROR] Load restore of ports " << joinPorts(decision.restore) << " failed" << std::endl;
+   decision.restore.clear();
+  }
+  else
+  {
+   std::cerr << "[WARN] Load restore: ports " << joinPorts(decision.restore) << " on at " << total.str() << std::endl;
+  }
+ }
+
+ commit(decision, stats);
+}
@@ -0,0 +1,70 @@
+/**
+ * @file LoadShedder.h
+ * @brief Automatic PoE load shedding against the switch power budget
+ *
+ * Each poll is evaluated locally as soon as it is parsed. When total draw
+ * reaches the shed threshold, the lowest-priority delivering ports are
+ * switched off in one batch. Shed ports come back one at a time, highest
+ * priority first, once the restored draw would stay under the lower restore
+ * threshold for several consecutive samples.
+ */
+
+#ifndef LOAD_SHEDDER_H
+#define LOAD_SHEDDER_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include "GS308EP_CLI.h"
+
+struct LoadShedConfig
+{
+ float budgetWatts;
+ float shedPercent;
+ float restorePercent;
+ int restoreHoldSamples;
+ std::vector<int> shedOrder; // Ports in the order they may be shed (lowest priority first)
+
+ LoadShedConfig() : budgetWatts(65.0f), shedPercent(0.0f), restorePercent(0.0f), restoreHoldSamples(3) {}
+
+ bool enabled() const { return shedPercent > 0.0f; }
+};
+
+// Parse "8,7,6" into a shed order; ports not listed are never shed
+bool parseShedOrder(const std::string &text, std::vector<int> &order);
+
+class LoadShedder
+{
+public:
+ struct Decision
+ {
+  std::vector<int> shed;
+  std::vector<int> restore;
+  float totalWatts;
+ };
+
+ explicit LoadShedder(const LoadShedConfig &config);
+
+ // Decide what to switch for one sample; does not change the shed set
+ Decision evaluate(const std::vector<PoEPortStats> &stats);
+
+ // Record that a decision was applied
+ void commit(const Decision &decision, const std::vector<PoEPortStats> &stats);
+
+ // Evaluate, apply through the controller in one batch per direction, and commit
+ void enforce(GS308EP_CLI &controller, const std::vector<PoEPortStats> &stats);
+
+ const std::vector<int> &shedPorts() const { return shed_; }
+
+private:
+ LoadShedConfig config_;
+ std::vector<int> shed_;           // Shed ports, in shed order
+ std::map<int, float> shed_watts_; // Draw of each port when it was shed
+ int headroom_samples_;
+
+ float shedWatts() const { return config_.budgetWatts * config_.shedPercent / 100.0f; }
+ float restoreWatts() const { return config_.budgetWatts * config_.restorePercent / 100.0f; }
+ bool isShed(int port) const;
+};
+
+#endif // LOAD_SHEDDER_H
@@ -0,0 +1,113 @@
+/**
+ * @file PollSchedule.cpp
+ * @brief Implementation of the spread poll schedule
+ */
+
+#include "PollSchedule.h"
+#include "Shard.h"
+#include <algorithm>
+
+PollSchedule::PollSchedule(const std::vector<FleetSwitch> &switches, const PollScheduleOptions &options)
+    : options_(options), phases_(switches.size()), sync_(switches.size(), 0), budget_(0), synchronised_(0)
+{
+ uint64_t intervalMs = static_cast<uint64_t>(std::max<int64_t>(1, options.interval.count()));
+ // Salted so phases do not follow the shard ring's hash of the same names
+ uint64_t seed = hashSeed("phase:");
+ for (size_t index = 0; index < switches.size(); index++)
+ {
+  phases_[index] = static_cast<uint32_t>(seededHash(switches[index].host, seed) % intervalMs);
+  for (const auto &tag : switches[index].tags)
+  {
+   if (std::find(options.syncTags.begin(), options.syncTags.end(), tag) != options.syncTags.end())
+   {
+    sync_[index] = 1;
+   }
+  }
+  order_.push_back(static_cast<uint32_t>(index));
+ }
+ std::stable_sort(order_.begin(), order_.end(),
+                  [this](uint32_t a, uint32_t b) { return phases_[a] < phases_[b]; });
+
+ int64_t tickMs = std::max<int64_t>(1, options.tick.count());
+ due_.resize(static_cast<size_t>(std::max<int64_t>(1, options.interval.count() / tickMs)));
+}
+
+size_t PollSchedule::tickOf(uint32_t index) const
+{
+ return std::min(due_.size() - 1, static_cast<size_t>(phases_[index] / std::max<int64_t>(1, options_.tick.count())));
+}
+
+void PollSchedule::plan(const std::vector<uint8_t> *owned)
+{
+ for (auto &list : due_)
+ {
+  list.clear();
+ }
+ queue_.clear();
+ synchronised_ = 0;
+ for (uint32_t index : order_)
+ {
+  if (owned && !(*owned)[index])
+  {
+   continue;
+  }
+  if (sync_[index])
+  {
+   due_[0].push_back(index);
+   synchronised_++;
+  }
+  else
+  {
+   queue_.push_back(index);
+  }
+ }
+
+ size_t ticks = due_.size();
+ budget_ = static_cast<uint32_t>(std::max<size_t>(1, (queue_.size() + ticks - 1) / ticks));
+
+ // A first lap finds how many switches the last ticks leave over. In steady
+ // state that many of the latest phases are still waiting when an interval
+ // starts, so the real lap serves them first and leaves the same number over.
+ size_t arrived = 0;
+ size_t backlog = 0;
+ for (size_t tick = 0; tick < ticks; tick++)
+ {
+  while (arrived < queue_.size() && tickOf(queue_[arrived]) == tick)
+  {
+   arrived++;
+   backlog++;
+  }
+  backlog -= std::min<size_t>(backlog, budget_);
+ }
+
+ size_t carried = backlog;
+ size_t fresh = queue_.size() - carried;
+ size_t served = 0;
+ arrived = 0;
+ for (size_t tick = 0; tick < ticks; tick++)
+ {
+  while (arrived < fresh && tickOf(queue_[arrived]) <= tick)
+  {
+   arrived++;
+  }
+  // Carried switches go first, then fresh ones in phase order once their phase has come
+  for (uint32_t started = 0; started < budget_; started++)
+  {
+   size_t position;
+   if (served < carried)
+   {
+    position = fresh + served;
+   }
+   else if (served - carried < arrived)
+   {
+    position = served - carried;
+   }
+   else
+   {
+    break;
+   }
+   due_[tick].push_back(queue_[position]);
+   served++;
+  }
+ }
+}
@@ -0,0 +1,79 @@
+/**
+ * @file PollSchedule.h
+ * @brief Spreading a fleet's polls evenly over the poll interval
+ *
+ * Starting every switch of a fleet at the top of the interval makes a burst
+ * of logins, sockets, parsing and output, then idles until the next one. A
+ * spread schedule instead gives each switch a phase within the interval,
+ * hashed from its host name. The phase does not depend on the rest of the
+ * fleet or on which collector polls the switch, so a switch is sampled at
+ * the same offset every interval and never moves when others come or go.
+ *
+ * Intervals are cut into ticks. Each tick may start a fixed budget of
+ * switches, the fleet's size over the tick count rounded up, so the load
+ * per tick stays at the average even where the hashed phases happen to
+ * bunch up. Switches a tick has no room for start in the following ticks;
+ * the schedule wraps around, so the last ticks' overflow starts at the top
+ * of the next interval.
+ *
+ * Switches carrying a synchronised tag are exempt. They all start together
+ * at the first tick, the interval's epoch, so readings that are compared
+ * across switches are taken at the same moment.
+ */
+
+#ifndef POLL_SCHEDULE_H
+#define POLL_SCHEDULE_H
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Fleet.h"
+
+struct PollScheduleOptions
+{
+ std::chrono::milliseconds interval;
+ std::chrono::milliseconds tick;
+ std::vector<std::string> syncTags; // Switches with any of these tags start together at each epoch
+
+ PollScheduleOptions() : interval(10000), tick(100) {}
+};
+
+class PollSchedule
+{
+public:
+ PollSchedule(const std::vector<FleetSwitch> &switches, const PollScheduleOptions &options);
+
+ // Lay out one interval for the switches flagged in owned, or for all of them.
+ // Reuses the tick lists, so replanning an unchanged fleet does not allocate.
+ void plan(const std::vector<uint8_t> *owned = nullptr);
+
+ size_t ticks() const { return due_.size(); }
+ std::chrono::milliseconds tick() const { return options_.tick; }
+ std::chrono::milliseconds interval() const { return options_.interval; }
+
+ // Switches to start at the given tick; the synchronised ones lead the first tick
+ const std::vector<uint32_t> &due(size_t tick) const { return due_[tick]; }
+
+ // The hashed offset of a switch within the interval
+ std::chrono::milliseconds phase(size_t index) const { return std::chrono::milliseconds(phases_[index]); }
+ bool synchronised(size_t index) const { return sync_[index] != 0; }
+
+ // Of the last plan: most spread switches started in one tick, and the synchronised switches
+ uint32_t budget() const { return budget_; }
+ uint32_t synchronisedCount() const { return synchronised_; }
+
+private:
+ PollScheduleOptions options_;
+ std::vector<uint32_t> phases_; // Milliseconds into the interval
+ std::vector<uint8_t> sync_;
+ std::vector<uint32_t> order_;  // Every switch, by phase
+ std::vector<uint32_t> queue_;  // Spread switches of the plan, by phase
+ std::vector<std::vector<uint32_t>> due_;
+ uint32_t budget_;
+ uint32_t synchronised_;
+
+ size_t tickOf(uint32_t index) const;
+};
+
+#endif // POLL_SCHEDULE_H
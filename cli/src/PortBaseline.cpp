@@ -0,0 +1,197 @@
+/**
+ * @file PortBaseline.cpp
+ * @brief Implementation of streaming per-port baselines
+ */
+
+#include "PortBaseline.h"
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+// Samples that look anomalous still move the baseline, but slowly, so a
+// lasting change becomes the new normal without one spike skewing it
+static const float ANOMALY_ADAPT_FACTOR = 0.25f;
+
+// Below this mean draw the relative checks are dominated by measurement noise
+static const float MIN_BASELINE_WATTS = 0.5f;
+static const float MIN_BASELINE_MILLIAMPS = 10.0f;
+
+void BaselineConfig::setWindow(uint32_t samples)
+{
+ if (samples < 1)
+ {
+  samples = 1;
+ }
+ alpha = 2.0f / (static_cast<float>(samples) + 1.0f);
+ warmupSamples = samples / 2;
+}
+
+void EwmaStat::reset(float value)
+{
+ mean = value;
+ variance = 0.0f;
+}
+
+void EwmaStat::update(float value, float alpha)
+{
+ float diff = value - mean;
+ float increment = alpha * diff;
+ mean += increment;
+ variance = (1.0f - alpha) * (variance + diff * increment);
+}
+
+float EwmaStat::stddev() const
+{
+ return std::sqrt(variance);
+}
+
+PortBaseline::PortBaseline()
+    : samples_(0)
+{
+ power_.reset(0.0f);
+ current_.reset(0.0f);
+ temperature_.reset(0.0f);
+}
+
+static uint8_t scoreDeviation(float value, const EwmaStat &stat, const BaselineConfig &config,
+                              uint8_t highFlag, uint8_t lowFlag)
+{
+ float deviation = value - stat.mean;
+ float margin = stat.mean * config.relativeThreshold;
+ float spread = config.sigmaThreshold * stat.stddev();
+
+ if (deviation > margin && deviation > spread)
+ {
+  return highFlag;
+ }
+ if (-deviation > margin && -deviation > spread)
+ {
+  return lowFlag;
+ }
+ return ANOMALY_NONE;
+}
+
+uint8_t PortBaseline::update(const PoEPortStats &stats, const BaselineConfig &config)
+{
+ // A port that is not delivering has no draw to learn from
+ if (!stats.enabled)
+ {
+  return ANOMALY_NONE;
+ }
+
+ if (samples_ == 0)
+ {
+  power_.reset(stats.power);
+  current_.reset(stats.current);
+  temperature_.reset(stats.temperature);
+  samples_ = 1;
+  return ANOMALY_NONE;
+ }
+
+ uint8_t flags = ANOMALY_NONE;
+ if (samples_ >= config.warmupSamples)
+ {
+  if (power_.mean >= MIN_BASELINE_WATTS)
+  {
+   if (stats.power <= power_.mean * config.idleFraction)
+   {
+    flags |= ANOMALY_IDLE_DROP;
+   }
+   else
+   {
+    flags |= scoreDeviation(stats.power, power_, config, ANOMALY_POWER_HIGH, ANOMALY_POWER_LOW);
+   }
+  }
+
+  if (current_.mean >= MIN_BASELINE_MILLIAMPS)
+  {
+   flags |= scoreDeviation(stats.current, current_, config, ANOMALY_CURRENT_HIGH, ANOMALY_CURRENT_LOW);
+  }
+
+  if (stats.temperature > temperature_.mean + config.temperatureDelta)
+  {
+   flags |= ANOMALY_TEMPERATURE_HIGH;
+  }
+ }
+
+ float alpha = flags ? config.alpha * ANOMALY_ADAPT_FACTOR : config.alpha;
+ power_.update(stats.power, alpha);
+ current_.update(stats.current, alpha);
+ temperature_.update(stats.temperature, alpha);
+ samples_++;
+
+ return flags;
+}
+
+BaselineTracker::BaselineTracker(const BaselineConfig &config)
+    : config_(config)
+{
+ for (int i = 0; i < 8; i++)
+ {
+  flags_[i] = ANOMALY_NONE;
+ }
+}
+
+std::string BaselineTracker::describe(uint8_t flags)
+{
+ static const struct
+ {
+  uint8_t flag;
+  const char *name;
+ } NAMES[] = {
+     {ANOMALY_POWER_HIGH, "power-high"},
+     {ANOMALY_POWER_LOW, "power-low"},
+     {ANOMALY_IDLE_DROP, "idle-drop"},
+     {ANOMALY_CURRENT_HIGH, "current-high"},
+     {ANOMALY_CURRENT_LOW, "current-low"},
+     {ANOMALY_TEMPERATURE_HIGH, "temperature-high"},
+ };
+
+ std::string text;
+ for (const auto &entry : NAMES)
+ {
+  if (flags & entry.flag)
+  {
+   text += (text.empty() ? "" : ",") + std::string(entry.name);
+  }
+ }
+ return text.empty() ? "normal" : text;
+}
+
+void BaselineTracker::observe(const std::string &host, const std::vector<PoEPortStats> &stats)
+{
+ for (const auto &s : stats)
+ {
+  if (s.port < 1 || s.port > 8)
+  {
+   continue;
+  }
+
+  int index = s.port - 1;
+  const EwmaStat before = ports_[index].power();
+  uint8_t flags = ports_[index].update(s, config_);
+  if (flags == flags_[index])
+  {
+   continue;
+  }
+
+  // Report transitions only, so a persistent anomaly is one line, not one per poll
+  std::ostringstream message;
+  message << std::fixed << std::setprecision(1);
+  if (flags)
+  {
+   float percent = (before.mean > 0.0f) ? (s.power - before.mean) / before.mean * 100.0f : 0.0f;
+   message << "[WARN] Anomaly " << host << " port " << (int)s.port << ": " << describe(flags)
+           << " (power " << s.power << " W vs baseline " << before.mean << " W, "
+           << std::showpos << percent << std::noshowpos << "%; current " << s.current << " mA; "
+           << "temperature " << s.temperature << " C)";
+  }
+  else
+  {
+   message << "[INFO] Anomaly cleared " << host << " port " << (int)s.port << " (power " << s.power << " W)";
+  }
+  std::cerr << message.str() << std::endl;
+  flags_[index] = flags;
+ }
+}
@@ -0,0 +1,102 @@
+/**
+ * @file PortBaseline.h
+ * @brief Streaming per-port baselines and anomaly flags
+ *
+ * Each port keeps an exponentially weighted mean and variance of power and
+ * current plus a typical temperature, updated in O(1) time and memory per
+ * sample. A sample is anomalous when it departs from the baseline by both a
+ * relative margin and a number of standard deviations.
+ */
+
+#ifndef PORT_BASELINE_H
+#define PORT_BASELINE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "GS308EP_CLI.h"
+
+enum AnomalyFlag : uint8_t
+{
+ ANOMALY_NONE = 0,
+ ANOMALY_POWER_HIGH = 1 << 0,
+ ANOMALY_POWER_LOW = 1 << 1,
+ ANOMALY_IDLE_DROP = 1 << 2, // Delivering, but drawing only a fraction of normal
+ ANOMALY_CURRENT_HIGH = 1 << 3,
+ ANOMALY_CURRENT_LOW = 1 << 4,
+ ANOMALY_TEMPERATURE_HIGH = 1 << 5
+};
+
+struct BaselineConfig
+{
+ float alpha;             // EWMA weight of the newest sample
+ float relativeThreshold; // Fractional deviation, e.g. 0.4 for 40%
+ float sigmaThreshold;    // Minimum deviation in standard deviations
+ float idleFraction;      // Below this fraction of normal power counts as idle
+ float temperatureDelta;  // Degrees above typical temperature
+ uint32_t warmupSamples;  // Samples before flags are raised
+
+ BaselineConfig()
+     : alpha(2.0f / 61.0f), relativeThreshold(0.4f), sigmaThreshold(3.0f), idleFraction(0.25f),
+       temperatureDelta(10.0f), warmupSamples(30)
+ {
+ }
+
+ // Configure the EWMA span in samples (alpha = 2 / (N + 1))
+ void setWindow(uint32_t samples);
+};
+
+// Exponentially weighted mean and variance (West's incremental form)
+struct EwmaStat
+{
+ float mean;
+ float variance;
+
+ void reset(float value);
+ void update(float value, float alpha);
+ float stddev() const;
+};
+
+class PortBaseline
+{
+public:
+ PortBaseline();
+
+ // Score a sample against the baseline, then fold it in; returns AnomalyFlag bits
+ uint8_t update(const PoEPortStats &stats, const BaselineConfig &config);
+
+ uint32_t samples() const { return samples_; }
+ const EwmaStat &power() const { return power_; }
+ const EwmaStat &current() const { return current_; }
+ float typicalTemperature() const { return temperature_.mean; }
+
+private:
+ EwmaStat power_;
+ EwmaStat current_;
+ EwmaStat temperature_;
+ uint32_t samples_;
+};
+
+/**
+ * Baselines for every port of one switch, reporting flag transitions
+ */
+class BaselineTracker
+{
+public:
+ explicit BaselineTracker(const BaselineConfig &config);
+
+ // Update all ports; logs to stderr when a port enters or leaves an anomaly
+ void observe(const std::string &host, const std::vector<PoEPortStats> &stats);
+
+ uint8_t flags(int port) const { return (port >= 1 && port <= 8) ? flags_[port - 1] : 0; }
+ const PortBaseline &baseline(int port) const { return ports_[port - 1]; }
+
+ static std::string describe(uint8_t flags);
+
+private:
+ BaselineConfig config_;
+ PortBaseline ports_[8];
+ uint8_t flags_[8];
+};
+
+#endif // PORT_BASELINE_H
@@ -0,0 +1,135 @@
+/**
+ * @file RetryPolicy.cpp
+ * @brief Implementation of the retry policy and its budget
+ */
+
+#include "RetryPolicy.h"
+#include "Deadline.h"
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <curl/curl.h>
+
+static const char *REQUEST_KIND_NAMES[REQUEST_KINDS] = {"login page", "login", "config fetch", "port change",
+                                                        "status fetch"};
+
+const char *requestKindName(RequestKind kind)
+{
+ return kind < REQUEST_KINDS ? REQUEST_KIND_NAMES[kind] : "request";
+}
+
+RetryPolicy::RetryPolicy(const RetryOptions &options, bool verbose)
+    : options_(options), verbose_(verbose), capacity_(static_cast<int64_t>(options.budgetBurst) * 1000),
+      deposit_(static_cast<int64_t>(options.budgetRatio * 1000)), tokens_(capacity_), requests_(0), retries_(0),
+      saved_(0), exhausted_(0), denied_(0)
+{
+}
+
+RetryPolicy::~RetryPolicy()
+{
+ if (verbose_)
+ {
+  RetryStats totals = stats();
+  std::cerr << "[INFO] Retries: " << totals.retries << " sent for " << totals.requests << " requests, "
+            << totals.saved << " saved, " << totals.exhausted << " exhausted, " << totals.denied
+            << " denied by the budget" << std::endl;
+ }
+}
+
+bool RetryPolicy::transient(int result, long status)
+{
+ switch (result)
+ {
+ case CURLE_OK:
+  // An overloaded server sheds load with 503 or 429; 500 and the gateway errors come and go
+  return status == 429 || status == 500 || status == 502 || status == 503 || status == 504;
+ case CURLE_COULDNT_CONNECT:
+ case CURLE_OPERATION_TIMEDOUT:
+ case CURLE_SEND_ERROR:
+ case CURLE_RECV_ERROR:
+ case CURLE_GOT_NOTHING:
+ case CURLE_PARTIAL_FILE:
+  return true;
+ default:
+  return false;
+ }
+}
+
+bool RetryPolicy::idempotent(RequestKind kind)
+{
+ return kind != REQUEST_LOGIN;
+}
+
+void RetryPolicy::noteRequest()
+{
+ requests_.fetch_add(1, std::memory_order_relaxed);
+ int64_t tokens = tokens_.load(std::memory_order_relaxed);
+ while (tokens < capacity_ &&
+        !tokens_.compare_exchange_weak(tokens, std::min(capacity_, tokens + deposit_), std::memory_order_relaxed))
+ {
+ }
+}
+
+bool RetryPolicy::withdraw()
+{
+ int64_t tokens = tokens_.load(std::memory_order_relaxed);
+ while (tokens >= 1000)
+ {
+  if (tokens_.compare_exchange_weak(tokens, tokens - 1000, std::memory_order_relaxed))
+  {
+   return true;
+  }
+ }
+ return false;
+}
+
+bool RetryPolicy::shouldRetry(int retry, int result, long status, std::chrono::milliseconds &delay)
+{
+ if (!transient(result, status))
+ {
+  return false;
+ }
+ if (retry > options_.retries)
+ {
+  exhausted_.fetch_add(1, std::memory_order_relaxed);
+  return false;
+ }
+
+ // Full jitter: anywhere up to the exponential bound, so synchronised failures spread out
+ thread_local std::mt19937_64 rng(std::random_device{}());
+ int64_t bound = options_.backoff.count() << std::min(retry - 1, 20);
+ bound = std::min<int64_t>(bound, options_.maxBackoff.count());
+ delay = std::chrono::milliseconds(std::uniform_int_distribution<int64_t>(0, std::max<int64_t>(bound, 0))(rng));
+
+ // Sleeping past the deadline would only turn a failure into a later failure
+ Deadline *deadline = DeadlineScope::current();
+ if (deadline && deadline->remaining() <= delay)
+ {
+  exhausted_.fetch_add(1, std::memory_order_relaxed);
+  return false;
+ }
+
+ if (!withdraw())
+ {
+  denied_.fetch_add(1, std::memory_order_relaxed);
+  return false;
+ }
+ retries_.fetch_add(1, std::memory_order_relaxed);
+ return true;
+}
+
+void RetryPolicy::noteSaved()
+{
+ saved_.fetch_add(1, std::memory_order_relaxed);
+}
+
+RetryStats RetryPolicy::stats() const
+{
+ RetryStats stats;
+ stats.requests = requests_.load(std::memory_order_relaxed);
+ stats.retries = retries_.load(std::memory_order_relaxed);
+ stats.saved = saved_.load(std::memory_order_relaxed);
+ stats.exhausted = exhausted_.load(std::memory_order_relaxed);
+ stats.denied = denied_.load(std::memory_order_relaxed);
+ return stats;
+}
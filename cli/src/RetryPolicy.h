@@ -0,0 +1,110 @@
+/**
+ * @file RetryPolicy.h
+ * @brief Retries of transient request failures, within a shared budget
+ *
+ * The switch's small web server resets connections, times out and answers
+ * 5xx when it is busy. A request that fails this way is sent again after an
+ * exponential backoff with full jitter, so that clients which failed together
+ * do not retry together. Only requests that are safe to repeat are retried:
+ * page fetches, and port changes, which set an absolute state and so do the
+ * same thing however often they arrive. The login POST is never repeated on
+ * its own, because its rand token is spent by the first attempt; a failed
+ * login starts over from a fresh login page instead.
+ *
+ * One policy is shared by every controller of a process. Retries draw on a
+ * token bucket that first attempts refill, so retries stay a bounded share of
+ * the traffic. When many switches fail at once, the budget runs dry instead
+ * of multiplying the load on switches that are already struggling. Backoffs
+ * never outlast the calling thread's deadline.
+ */
+
+#ifndef RETRY_POLICY_H
+#define RETRY_POLICY_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// The requests a controller makes, which differ in whether they may be repeated
+enum RequestKind : uint8_t
+{
+ REQUEST_LOGIN_PAGE = 0,
+ REQUEST_LOGIN = 1,  // Not idempotent
+ REQUEST_CONFIG = 2, // The PoE config form, for its hash
+ REQUEST_APPLY = 3,  // A port change
+ REQUEST_STATUS = 4,
+ REQUEST_KINDS
+};
+
+// Step name used in logs and deadline reports
+const char *requestKindName(RequestKind kind);
+
+struct RetryOptions
+{
+ int retries;                       // Retries after the first attempt of a repeatable request
+ std::chrono::milliseconds backoff; // Before the first retry; doubled for each one after
+ std::chrono::milliseconds maxBackoff;
+ double budgetRatio; // Retries earned per first attempt
+ int budgetBurst;    // Retries the bucket holds; a quiet process starts full
+
+ RetryOptions()
+     : retries(2), backoff(200), maxBackoff(3000), budgetRatio(0.2), budgetBurst(20)
+ {
+ }
+};
+
+struct RetryStats
+{
+ uint64_t requests;  // First attempts
+ uint64_t retries;   // Attempts sent again
+ uint64_t saved;     // Requests that failed at first and then succeeded
+ uint64_t exhausted; // Requests still failing after every retry they were allowed
+ uint64_t denied;    // Retries refused because the budget was spent
+};
+
+class RetryPolicy
+{
+public:
+ // Verbose mode reports the totals on destruction
+ explicit RetryPolicy(const RetryOptions &options, bool verbose = false);
+ ~RetryPolicy();
+
+ // A CURLcode and HTTP status that another attempt might fix
+ static bool transient(int result, long status);
+ static bool idempotent(RequestKind kind);
+
+ // Count a first attempt, which adds to the budget
+ void noteRequest();
+
+ // Whether to send retry number 'retry' (from 1) after a failed attempt, and
+ // after what delay. Refuses failures that are not transient, used-up
+ // retries, an empty budget and a delay that would outlast the calling
+ // thread's deadline. Callers repeat only idempotent() requests, or restart
+ // the exchange a request belongs to.
+ bool shouldRetry(int retry, int result, long status, std::chrono::milliseconds &delay);
+
+ // Count a request that failed at first and succeeded on a retry
+ void noteSaved();
+
+ RetryStats stats() const;
+ const RetryOptions &options() const { return options_; }
+
+private:
+ RetryOptions options_;
+ bool verbose_;
+ int64_t capacity_; // Thousandths of a retry
+ int64_t deposit_;
+ std::atomic<int64_t> tokens_;
+ std::atomic<uint64_t> requests_;
+ std::atomic<uint64_t> retries_;
+ std::atomic<uint64_t> saved_;
+ std::atomic<uint64_t> exhausted_;
+ std::atomic<uint64_t> denied_;
+
+ bool withdraw();
+
+ RetryPolicy(const RetryPolicy &) = delete;
+ RetryPolicy &operator=(const RetryPolicy &) = delete;
+};
+
+#endif // RETRY_POLICY_H
@@ -0,0 +1,392 @@
+/**
+ * @file Shard.cpp
+ * @brief Implementation of collector membership and consistent-hash sharding
+ */
+
+#include "Shard.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static const char *MEMBERSHIP_MAGIC = "GS8M1";
+static const size_t MAX_DATAGRAM = 1400;
+
+static uint64_t fnvExtend(uint64_t value, const std::string &text)
+{
+ for (char c : text)
+ {
+  value = (value ^ static_cast<uint8_t>(c)) * 1099511628211ull;
+ }
+ return value;
+}
+
+uint64_t hashSeed(const std::string &salt)
+{
+ return fnvExtend(HASH_BASIS, salt);
+}
+
+uint64_t seededHash(const std::string &text, uint64_t seed)
+{
+ uint64_t value = fnvExtend(seed, text);
+ value ^= value >> 30;
+ value *= 0xbf58476d1ce4e5b9ull;
+ value ^= value >> 27;
+ value *= 0x94d049bb133111ebull;
+ value ^= value >> 31;
+ return value;
+}
+
+void HashRing::assign(const std::vector<std::string> &members)
+{
+ members_ = members;
+ points_.clear();
+ points_.reserve(members.size() * VIRTUAL_NODES);
+ for (size_t member = 0; member < members.size(); member++)
+ {
+  for (int node = 0; node < VIRTUAL_NODES; node++)
+  {
+   points_.emplace_back(seededHash(members[member] + "#" + std::to_string(node)), static_cast<int>(member));
+  }
+ }
+ std::sort(points_.begin(), points_.end());
+}
+
+int HashRing::owner(const std::string &key) const
+{
+ if (points_.empty())
+ {
+  return -1;
+ }
+ auto it = std::lower_bound(points_.begin(), points_.end(), std::make_pair(seededHash(key), -1));
+ return it == points_.end() ? points_.front().second : it->second;
+}
+
+// Split HOST:PORT; the host may be a name or an IPv4 address
+static bool resolve(const std::string &address, sockaddr_in &out)
+{
+ size_t colon = address.rfind(':');
+ if (colon == std::string::npos || colon == 0 || colon + 1 == address.size())
+ {
+  return false;
+ }
+ std::string host = address.substr(0, colon);
+ std::string port = address.substr(colon + 1);
+
+ addrinfo hints;
+ std::memset(&hints, 0, sizeof(hints));
+ hints.ai_family = AF_INET;
+ hints.ai_socktype = SOCK_DGRAM;
+ addrinfo *found = nullptr;
+ if (getaddrinfo(host.c_str(), port.c_str(), &hints, &found) != 0 || !found)
+ {
+  return false;
+ }
+ std::memcpy(&out, found->ai_addr, sizeof(out));
+ freeaddrinfo(found);
+ return true;
+}
+
+ShardMembership::ShardMembership()
+    : incarnation_(0), fd_(-1), version_(0), stop_(false)
+{
+}
+
+ShardMembership::~ShardMembership()
+{
+ if (thread_.joinable())
+ {
+  stop_ = true;
+  thread_.join();
+  // Peers drop this collector at once instead of waiting for the timeout
+  broadcast("LEAVE");
+ }
+ if (fd_ >= 0)
+ {
+  close(fd_);
+ }
+}
+
+bool ShardMembership::start(const ShardOptions &options, std::string &error)
+{
+ options_ = options;
+ sockaddr_in address;
+ if (!resolve(options.self, address))
+ {
+  error = "Invalid collector address '" + options.self + "' (expected HOST:PORT)";
+  return false;
+ }
+ for (const auto &seed : options.seeds)
+ {
+  sockaddr_in ignored;
+  if (!resolve(seed, ignored))
+  {
+   error = "Invalid peer address '" + seed + "' (expected HOST:PORT)";
+   return false;
+  }
+ }
+
+ fd_ = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+ if (fd_ < 0 || bind(fd_, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0)
+ {
+  error = "Cannot bind collector address " + options.self + ": " + std::strerror(errno);
+  return false;
+ }
+
+ // A restarted collector is told apart from its previous run by its start time
+ incarnation_ = static_cast<uint64_t>(
+     std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch())
+         .count());
+ started_ = Clock::now();
+ for (const auto &seed : options.seeds)
+ {
+  if (seed != options.self)
+  {
+   peers_[seed] = Peer{false, 0, started_};
+  }
+ }
+
+ thread_ = std::thread(&ShardMembership::run, this);
+ return true;
+}
+
+void ShardMembership::awaitJoin(volatile sig_atomic_t &stop)
+{
+ Clock::time_point until = started_ + std::chrono::milliseconds(options_.graceMs());
+ while (!stop && Clock::now() < until)
+ {
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+ }
+}
+
+std::vector<std::string> ShardMembership::live(uint64_t *version) const
+{
+ std::lock_guard<std::mutex> lock(mutex_);
+ std::vector<std::string> members(1, options_.self);
+ for (const auto &entry : peers_)
+ {
+  if (entry.second.live)
+  {
+   members.push_back(entry.first);
+  }
+ }
+ std::sort(members.begin(), members.end());
+ if (version)
+ {
+  *version = version_;
+ }
+ return members;
+}
+
+void ShardMembership::run()
+{
+ std::chrono::milliseconds interval(options_.heartbeatMs());
+ Clock::time_point next = Clock::now();
+ while (!stop_)
+ {
+  Clock::time_point now = Clock::now();
+  if (now >= next)
+  {
+   expire(now);
+   broadcast("HB");
+   next = now + interval;
+  }
+
+  pollfd fd = {fd_, POLLIN, 0};
+  int waitMs = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(next - now).count());
+  // Short waits keep shutdown prompt
+  if (::poll(&fd, 1, std::max(1, std::min(waitMs, 100))) > 0)
+  {
+   receive();
+  }
+ }
+}
+
+// Heartbeats carry every collector this one knows, so a single seed is enough to join
+void ShardMembership::broadcast(const char *kind)
+{
+ std::vector<std::string> targets;
+ std::string message = std::string(MEMBERSHIP_MAGIC) + " " + kind + " " + std::to_string(incarnation_) + " " +
+                       options_.self;
+ {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (const auto &entry : peers_)
+  {
+   targets.push_back(entry.first);
+   if (message.size() + entry.first.size() + 1 < MAX_DATAGRAM)
+   {
+    message += " " + entry.first;
+   }
+  }
+ }
+ for (const auto &target : targets)
+ {
+  send(target, message);
+ }
+}
+
+void ShardMembership::send(const std::string &peer, const std::string &message)
+{
+ auto found = addresses_.find(peer);
+ if (found == addresses_.end())
+ {
+  sockaddr_in address;
+  if (!resolve(peer, address))
+  {
+   return;
+  }
+  found = addresses_.insert(std::make_pair(peer, address)).first;
+ }
+ sendto(fd_, message.data(), message.size(), MSG_DONTWAIT, reinterpret_cast<const sockaddr *>(&found->second),
+        sizeof(found->second));
+}
+
+void ShardMembership::receive()
+{
+ char buffer[MAX_DATAGRAM + 1];
+ ssize_t length;
+ while ((length = recv(fd_, buffer, MAX_DATAGRAM, MSG_DONTWAIT)) > 0)
+ {
+  buffer[length] = '\0';
+  std::istringstream in(buffer);
+  std::string magic, kind, sender;
+  uint64_t incarnation = 0;
+  if (!(in >> magic >> kind >> incarnation >> sender) || magic != MEMBERSHIP_MAGIC || sender == options_.self)
+  {
+   continue;
+  }
+
+  Clock::time_point now = Clock::now();
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto inserted = peers_.insert(std::make_pair(sender, Peer{false, 0, now}));
+  Peer &peer = inserted.first->second;
+  if (incarnation < peer.incarnation)
+  {
+   continue; // Delayed datagram from an earlier run
+  }
+
+  if (kind == "LEAVE")
+  {
+   if (peer.live)
+   {
+    peer.live = false;
+    version_++;
+    log("Collector " + sender + " left");
+   }
+   // Heartbeats of the run that left arrive late sometimes; they are stale now
+   peer.incarnation = incarnation + 1;
+   continue;
+  }
+  if (kind != "HB")
+  {
+   continue;
+  }
+
+  peer.incarnation = incarnation;
+  peer.lastHeard = now;
+  if (!peer.live)
+  {
+   peer.live = true;
+   version_++;
+   log("Collector " + sender + " joined");
+  }
+
+  // Learn the collectors the sender knows; they count as live once they are heard from
+  std::string known;
+  while (in >> known)
+  {
+   if (known != options_.self)
+   {
+    peers_.insert(std::make_pair(known, Peer{false, 0, now}));
+   }
+  }
+ }
+}
+
+void ShardMembership::expire(Clock::time_point now)
+{
+ std::lock_guard<std::mutex> lock(mutex_);
+ for (auto &entry : peers_)
+ {
+  Peer &peer = entry.second;
+  if (peer.live && now - peer.lastHeard > std::chrono::milliseconds(options_.timeoutMs))
+  {
+   peer.live = false;
+   version_++;
+   std::cerr << "[WARN] Collector " << entry.first << " stopped answering; taking over its switches" << std::endl;
+  }
+ }
+}
+
+void ShardMembership::log(const std::string &message) const
+{
+ if (options_.verbose)
+ {
+  std::cerr << "[INFO] " << message << std::endl;
+ }
+}
+
+ShardPlanner::ShardPlanner(const std::string &self, const std::vector<std::string> &keys,
+                           std::chrono::milliseconds grace)
+    : self_(self), keys_(keys), grace_(grace), planned_(false), previous_owner_(keys.size()),
+      claim_at_(keys.size())
+{
+}
+
+size_t ShardPlanner::plan(const std::vector<std::string> &live, std::vector<uint8_t> &owned)
+{
+ Clock::time_point now = Clock::now();
+ std::set<std::string> alive(live.begin(), live.end());
+
+ // Before the first plan, every key belongs to whoever owns it without this collector
+ if (!planned_)
+ {
+  std::vector<std::string> others;
+  for (const auto &member : live)
+  {
+   if (member != self_)
+   {
+    others.push_back(member);
+   }
+  }
+  ring_.assign(others);
+  for (size_t i = 0; i < keys_.size(); i++)
+  {
+   int owner = ring_.owner(keys_[i]);
+   previous_owner_[i] = owner < 0 ? std::string() : others[owner];
+  }
+  planned_ = true;
+ }
+
+ ring_.assign(live);
+ owned.assign(keys_.size(), 0);
+ size_t count = 0;
+ for (size_t i = 0; i < keys_.size(); i++)
+ {
+  const std::string &owner = ring_.members()[ring_.owner(keys_[i])];
+  if (owner != self_)
+  {
+   previous_owner_[i] = owner;
+   continue;
+  }
+
+  // A key gained from a collector that is still alive waits until that
+  // collector has seen the new membership and stopped polling it
+  if (previous_owner_[i] != self_)
+  {
+   bool handedOver = !previous_owner_[i].empty() && alive.count(previous_owner_[i]);
+   claim_at_[i] = handedOver ? now + grace_ : now;
+   previous_owner_[i] = self_;
+  }
+  owned[i] = now >= claim_at_[i] ? 1 : 0;
+  count++;
+ }
+ return count;
+}
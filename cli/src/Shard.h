@@ -0,0 +1,147 @@
+/**
+ * @file Shard.h
+ * @brief Sharding fleet polling across several collector processes
+ *
+ * Collectors find each other with a small UDP heartbeat protocol. Every
+ * collector sends a heartbeat to every collector it knows about, listing
+ * the collectors it knows, so one seed address is enough to join. A peer
+ * whose heartbeats stop for the timeout is dropped. A collector that shuts
+ * down cleanly says so, and is dropped at once.
+ *
+ * Each collector places the live collectors on a consistent-hash ring and
+ * polls only the switches that hash to itself. When the membership changes,
+ * only the switches of the collector that joined or left move.
+ *
+ * A switch is never handed from one live collector to another without a
+ * grace period. The collector gaining it waits until the one losing it has
+ * seen the same membership, so a switch is not polled by both. Switches of
+ * a collector that died are taken over at once.
+ */
+
+#ifndef SHARD_H
+#define SHARD_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <netinet/in.h>
+
+// Hash of a name for spreading switches, in space or in time: FNV-1a with a
+// final avalanche, so nearby names land far apart. Different users salt it
+// with a seed from hashSeed() so their hashes of the same name are unrelated.
+static const uint64_t HASH_BASIS = 14695981039346656037ull;
+uint64_t hashSeed(const std::string &salt);
+uint64_t seededHash(const std::string &text, uint64_t seed = HASH_BASIS);
+
+// Consistent-hash ring of collector names, with virtual nodes for balance
+class HashRing
+{
+public:
+ static const int VIRTUAL_NODES = 128;
+
+ void assign(const std::vector<std::string> &members);
+
+ // Index into the members given to assign(); -1 while the ring is empty
+ int owner(const std::string &key) const;
+
+ const std::vector<std::string> &members() const { return members_; }
+
+private:
+ std::vector<std::string> members_;
+ std::vector<std::pair<uint64_t, int>> points_; // Sorted by hash
+};
+
+struct ShardOptions
+{
+ std::string self;               // This collector's HOST:PORT, which is also its name
+ std::vector<std::string> seeds; // Other collectors' HOST:PORT
+ int timeoutMs;                  // Silence after which a peer is dropped
+ bool verbose;
+
+ ShardOptions() : timeoutMs(3000), verbose(false) {}
+
+ int heartbeatMs() const { return std::max(50, timeoutMs / 6); }
+ // How long a collector waits for the losing collector to see a handoff
+ int graceMs() const { return 2 * heartbeatMs(); }
+};
+
+class ShardMembership
+{
+public:
+ ShardMembership();
+ // Leaves the group if start() succeeded
+ ~ShardMembership();
+
+ // Bind the membership socket and start heartbeating
+ bool start(const ShardOptions &options, std::string &error);
+
+ // Wait until peers have had time to answer, so the first view is not just this collector
+ void awaitJoin(volatile sig_atomic_t &stop);
+
+ // Live collectors, sorted, including this one; version grows with every change
+ std::vector<std::string> live(uint64_t *version = nullptr) const;
+
+ const ShardOptions &options() const { return options_; }
+
+private:
+ typedef std::chrono::steady_clock Clock;
+
+ struct Peer
+ {
+  bool live;
+  uint64_t incarnation;
+  Clock::time_point lastHeard;
+ };
+
+ ShardOptions options_;
+ uint64_t incarnation_;
+ int fd_;
+ Clock::time_point started_;
+ std::map<std::string, Peer> peers_; // Every collector ever heard of, except this one
+ std::map<std::string, sockaddr_in> addresses_; // Resolved peers; used by the heartbeat thread only
+ uint64_t version_;
+ mutable std::mutex mutex_;
+ std::atomic<bool> stop_;
+ std::thread thread_;
+
+ void run();
+ void broadcast(const char *kind);
+ void receive();
+ void expire(Clock::time_point now);
+ void send(const std::string &peer, const std::string &message);
+ void log(const std::string &message) const;
+
+ ShardMembership(const ShardMembership &) = delete;
+ ShardMembership &operator=(const ShardMembership &) = delete;
+};
+
+// Decides which switches this collector polls in each sweep
+class ShardPlanner
+{
+public:
+ ShardPlanner(const std::string &self, const std::vector<std::string> &keys, std::chrono::milliseconds grace);
+
+ // Recompute ownership for a membership view; owned[i] says whether to poll keys[i] now.
+ // Returns the number of keys this collector owns, including ones still in their grace period.
+ size_t plan(const std::vector<std::string> &live, std::vector<uint8_t> &owned);
+
+private:
+ typedef std::chrono::steady_clock Clock;
+
+ std::string self_;
+ std::vector<std::string> keys_;
+ std::chrono::milliseconds grace_;
+ bool planned_;
+ HashRing ring_;
+ std::vector<std::string> previous_owner_;
+ std::vector<Clock::time_point> claim_at_; // When a gained key may first be polled
+};
+
+#endif // SHARD_H
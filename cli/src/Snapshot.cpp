@@ -0,0 +1,323 @@
+/**
+ * @file Snapshot.cpp
+ * @brief Implementation of the shared-memory statistics snapshot
+ */
+
+#include "Snapshot.h"
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const uint32_t SNAPSHOT_MAGIC = 0x47533850; // "GS8P"
+static const uint32_t SNAPSHOT_VERSION = 2;
+static const int READ_ATTEMPTS = 10000;
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "seqlock needs a lock-free 32-bit atomic");
+
+std::string snapshotName(const std::string &host)
+{
+ std::string name = host;
+ std::replace(name.begin(), name.end(), ':', '_');
+ std::replace(name.begin(), name.end(), '/', '_');
+ return "gs308ep-" + name;
+}
+
+static void copyText(char *dest, size_t size, const std::string &text)
+{
+ size_t length = std::min(text.size(), size - 1);
+ std::memcpy(dest, text.data(), length);
+ dest[length] = '\0';
+}
+
+static std::string readText(const char *text, size_t size)
+{
+ return std::string(text, strnlen(text, size));
+}
+
+static TextId readTextId(const char (*texts)[32], uint32_t textCount, uint8_t index)
+{
+ if (index >= std::min<size_t>(textCount, SNAPSHOT_TEXTS))
+ {
+  return TEXT_UNKNOWN;
+ }
+ return internText(texts[index], strnlen(texts[index], sizeof(texts[index])));
+}
+
+SnapshotPublisher::SnapshotPublisher(const std::string &host, int intervalMs)
+    : host_(host), name_("/" + snapshotName(host)), interval_ms_(intervalMs), fd_(-1), segment_(nullptr), text_count_(0)
+{
+}
+
+SnapshotPublisher::~SnapshotPublisher()
+{
+ if (segment_)
+ {
+  // Unlink before the lock goes with fd_, so a publisher that starts next
+  // creates a fresh segment instead of locking the one being removed
+  munmap(segment_, sizeof(SnapshotSegment));
+  shm_unlink(name_.c_str());
+ }
+ if (fd_ >= 0)
+ {
+  close(fd_);
+ }
+}
+
+// Whether a publisher other than this process is running. Only used where
+// the segment cannot be locked; the pid can be reused, so this is a fallback.
+static bool otherWriterAlive(int fd)
+{
+ struct stat info;
+ if (fstat(fd, &info) < 0 || static_cast<size_t>(info.st_size) < sizeof(SnapshotSegment))
+ {
+  return false;
+ }
+ SnapshotSegment segment;
+ if (pread(fd, &segment, sizeof(segment), 0) != static_cast<ssize_t>(sizeof(segment)))
+ {
+  return false;
+ }
+ pid_t pid = segment.writerPid;
+ return segment.magic == SNAPSHOT_MAGIC && pid > 0 && pid != getpid() && (kill(pid, 0) == 0 || errno == EPERM);
+}
+
+bool SnapshotPublisher::open(std::string &error)
+{
+ // Two pollers for one switch would interleave their samples, and the first
+ // to exit would unlink the segment under the other. The lock is held until
+ // the publisher is destroyed. Where shared memory cannot be locked, fall
+ // back to asking whether the recorded writer is still running.
+ int fd = -1;
+ for (int attempt = 0; attempt < 3 && fd < 0; attempt++)
+ {
+  fd = shm_open(name_.c_str(), O_RDWR | O_CREAT, 0644);
+  if (fd < 0)
+  {
+   error = "Cannot open shared memory: " + std::string(std::strerror(errno));
+   return false;
+  }
+
+  int locked = flock(fd, LOCK_EX | LOCK_NB);
+  if ((locked < 0 && errno == EWOULDBLOCK) || (locked < 0 && otherWriterAlive(fd)))
+  {
+   close(fd);
+   error = "Another poller is already publishing a snapshot for " + host_;
+   return false;
+  }
+
+  // The previous publisher may have unlinked the segment between our open
+  // and our lock; start again on the name's new segment
+  struct stat info;
+  if (locked == 0 && fstat(fd, &info) == 0 && info.st_nlink == 0)
+  {
+   close(fd);
+   fd = -1;
+  }
+ }
+ if (fd < 0)
+ {
+  error = "Shared memory for " + host_ + " keeps being replaced";
+  return false;
+ }
+
+ if (ftruncate(fd, sizeof(SnapshotSegment)) < 0)
+ {
+  error = "Cannot size shared memory: " + std::string(std::strerror(errno));
+  close(fd);
+  return false;
+ }
+
+ void *memory = mmap(nullptr, sizeof(SnapshotSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+ if (memory == MAP_FAILED)
+ {
+  error = "Cannot map shared memory: " + std::string(std::strerror(errno));
+  close(fd);
+  return false;
+ }
+ fd_ = fd;
+ segment_ = static_cast<SnapshotSegment *>(memory);
+
+ // Start as an empty snapshot, keeping the sequence moving forward so a
+ // reader of the previous publisher's data notices the change
+ uint32_t sequence = segment_->sequence.load(std::memory_order_relaxed) | 1u;
+ segment_->sequence.store(sequence, std::memory_order_relaxed);
+ std::atomic_thread_fence(std::memory_order_release);
+ segment_->magic = SNAPSHOT_MAGIC;
+ segment_->version = SNAPSHOT_VERSION;
+ segment_->portCount = 0;
+ segment_->timestampNs = 0;
+ segment_->writerPid = static_cast<int32_t>(getpid());
+ segment_->intervalMs = interval_ms_;
+ copyText(segment_->host, sizeof(segment_->host), host_);
+ segment_->textCount = 0;
+ text_count_ = 0;
+ segment_->sequence.store(sequence + 1, std::memory_order_release);
+ return true;
+}
+
+// Dictionary index for a text, adding it to the segment if it is new. Called
+// inside the write window, after publish() has made sure there is room.
+uint8_t SnapshotPublisher::textIndex(TextId id)
+{
+ for (size_t i = 0; i < text_count_; i++)
+ {
+  if (texts_[i] == id)
+  {
+   return static_cast<uint8_t>(i);
+  }
+ }
+ texts_[text_count_] = id;
+ copyText(segment_->texts[text_count_], sizeof(segment_->texts[text_count_]), internedText(id));
+ segment_->textCount = static_cast<uint32_t>(text_count_ + 1);
+ return static_cast<uint8_t>(text_count_++);
+}
+
+void SnapshotPublisher::publish(int64_t timestampNs, const std::vector<PoEPortStats> &stats)
+{
+ if (!segment_)
+ {
+  return;
+ }
+
+ uint32_t sequence = segment_->sequence.load(std::memory_order_relaxed);
+ segment_->sequence.store(sequence + 1, std::memory_order_relaxed);
+ std::atomic_thread_fence(std::memory_order_release);
+
+ uint32_t count = static_cast<uint32_t>(std::min<size_t>(stats.size(), 8));
+
+ // Start the dictionary over if this sample's new texts would not fit
+ size_t added = 0;
+ for (uint32_t i = 0; i < count; i++)
+ {
+  for (TextId id : {stats[i].status, stats[i].fault, stats[i].powerClass})
+  {
+   added += std::find(texts_, texts_ + text_count_, id) == texts_ + text_count_ ? 1 : 0;
+  }
+ }
+ if (text_count_ + added > SNAPSHOT_TEXTS)
+ {
+  text_count_ = 0;
+ }
+
+ for (uint32_t i = 0; i < count; i++)
+ {
+  SnapshotPort &port = segment_->ports[i];
+  port.port = stats[i].port;
+  port.enabled = stats[i].enabled ? 1 : 0;
+  port.status = textIndex(stats[i].status);
+  port.fault = textIndex(stats[i].fault);
+  port.powerClass = textIndex(stats[i].powerClass);
+  port.voltage = stats[i].voltage;
+  port.current = stats[i].current;
+  port.power = stats[i].power;
+  port.temperature = stats[i].temperature;
+ }
+ segment_->portCount = count;
+ segment_->timestampNs = timestampNs;
+
+ segment_->sequence.store(sequence + 2, std::memory_order_release);
+}
+
+bool readSnapshot(const std::string &host, Snapshot &snapshot, std::string &error)
+{
+ std::string name = "/" + snapshotName(host);
+ int fd = shm_open(name.c_str(), O_RDONLY, 0);
+ if (fd < 0)
+ {
+  error = "No snapshot for " + host + " (is a --watch or --daemon poller running?)";
+  return false;
+ }
+
+ struct stat info;
+ if (fstat(fd, &info) < 0 || static_cast<size_t>(info.st_size) < sizeof(SnapshotSegment))
+ {
+  close(fd);
+  error = "Snapshot segment for " + host + " is incomplete";
+  return false;
+ }
+
+ void *memory = mmap(nullptr, sizeof(SnapshotSegment), PROT_READ, MAP_SHARED, fd, 0);
+ close(fd);
+ if (memory == MAP_FAILED)
+ {
+  error = "Cannot map snapshot: " + std::string(std::strerror(errno));
+  return false;
+ }
+ const SnapshotSegment *segment = static_cast<const SnapshotSegment *>(memory);
+
+ SnapshotPort ports[8];
+ char texts[SNAPSHOT_TEXTS][32];
+ uint32_t textCount = 0;
+ uint32_t count = 0;
+ int64_t timestampNs = 0;
+ int32_t writerPid = 0;
+ int32_t intervalMs = 0;
+ char hostName[sizeof(segment->host)];
+ bool consistent = false;
+
+ for (int attempt = 0; attempt < READ_ATTEMPTS && !consistent; attempt++)
+ {
+  uint32_t before = segment->sequence.load(std::memory_order_acquire);
+  if (before & 1u)
+  {
+   sched_yield();
+   continue;
+  }
+
+  if (segment->magic != SNAPSHOT_MAGIC || segment->version != SNAPSHOT_VERSION)
+  {
+   break;
+  }
+  count = std::min<uint32_t>(segment->portCount, 8);
+  std::memcpy(ports, segment->ports, sizeof(ports));
+  textCount = segment->textCount;
+  std::memcpy(texts, segment->texts, sizeof(texts));
+  timestampNs = segment->timestampNs;
+  writerPid = segment->writerPid;
+  intervalMs = segment->intervalMs;
+  std::memcpy(hostName, segment->host, sizeof(hostName));
+
+  std::atomic_thread_fence(std::memory_order_acquire);
+  consistent = segment->sequence.load(std::memory_order_relaxed) == before;
+ }
+ munmap(memory, sizeof(SnapshotSegment));
+
+ if (!consistent)
+ {
+  error = "Could not read a consistent snapshot for " + host;
+  return false;
+ }
+ if (count == 0)
+ {
+  error = "Snapshot for " + host + " has no sample yet";
+  return false;
+ }
+
+ snapshot.host = readText(hostName, sizeof(hostName));
+ snapshot.timestampNs = timestampNs;
+ snapshot.intervalMs = intervalMs;
+ snapshot.writerAlive = writerPid > 0 && (kill(writerPid, 0) == 0 || errno == EPERM);
+ snapshot.stats.clear();
+ for (uint32_t i = 0; i < count; i++)
+ {
+  PoEPortStats stats;
+  stats.port = ports[i].port;
+  stats.enabled = ports[i].enabled != 0;
+  stats.status = readTextId(texts, textCount, ports[i].status);
+  stats.fault = readTextId(texts, textCount, ports[i].fault);
+  stats.powerClass = readTextId(texts, textCount, ports[i].powerClass);
+  stats.voltage = ports[i].voltage;
+  stats.current = ports[i].current;
+  stats.power = ports[i].power;
+  stats.temperature = ports[i].temperature;
+  snapshot.stats.push_back(stats);
+ }
+ return true;
+}
@@ -0,0 +1,96 @@
+/**
+ * @file Snapshot.h
+ * @brief Latest per-switch statistics published in shared memory
+ *
+ * A poller (watch mode or the daemon) writes every sample into a fixed-size
+ * segment at /dev/shm/gs308ep-HOST. The segment is guarded by a seqlock: the
+ * writer makes the sequence odd, updates the data and makes it even again,
+ * and readers copy the data and retry if the sequence moved. Readers never
+ * block the writer and need no IPC round trip, so `--cached` queries cost a
+ * few microseconds and put no load on the switch.
+ *
+ * Intern ids are private to a process, so ports refer to status, fault and
+ * class text by index into a small dictionary carried in the segment. The
+ * writer only adds an entry when a text first appears, which in practice
+ * means the dictionary is written once and each sample is numbers only.
+ */
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include "GS308EP_CLI.h"
+
+// Shared-memory name for a switch (also used for other per-host paths)
+std::string snapshotName(const std::string &host);
+
+// Enough for every port to show a distinct status, fault and class
+static const size_t SNAPSHOT_TEXTS = 24;
+
+struct SnapshotPort
+{
+ uint8_t port;
+ uint8_t enabled;
+ uint8_t status; // Indexes into SnapshotSegment::texts
+ uint8_t fault;
+ uint8_t powerClass;
+ float voltage;
+ float current;
+ float power;
+ float temperature;
+};
+
+struct SnapshotSegment
+{
+ uint32_t magic;
+ uint32_t version;
+ std::atomic<uint32_t> sequence; // Odd while a write is in progress
+ uint32_t portCount;
+ int64_t timestampNs;
+ int32_t writerPid;
+ int32_t intervalMs;
+ char host[64];
+ uint32_t textCount;
+ char texts[SNAPSHOT_TEXTS][32];
+ SnapshotPort ports[8];
+};
+
+class SnapshotPublisher
+{
+public:
+ SnapshotPublisher(const std::string &host, int intervalMs);
+ ~SnapshotPublisher();
+
+ // Create (or take over) the segment; false with error set if shared
+ // memory is unavailable or another live publisher owns the segment
+ bool open(std::string &error);
+
+ void publish(int64_t timestampNs, const std::vector<PoEPortStats> &stats);
+
+private:
+ std::string host_;
+ std::string name_;
+ int interval_ms_;
+ int fd_; // Kept open so the publisher lock lasts as long as the publisher
+ SnapshotSegment *segment_;
+ TextId texts_[SNAPSHOT_TEXTS]; // Mirror of the segment's dictionary
+ size_t text_count_;
+
+ uint8_t textIndex(TextId id);
+};
+
+struct Snapshot
+{
+ std::string host;
+ int64_t timestampNs;
+ int intervalMs;
+ bool writerAlive;
+ std::vector<PoEPortStats> stats;
+};
+
+// Read a consistent copy of the latest snapshot; false with error set if there is none
+bool readSnapshot(const std::string &host, Snapshot &snapshot, std::string &error);
+
+#endif // SNAPSHOT_H
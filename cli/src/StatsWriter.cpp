@@ -0,0 +1,299 @@
+/**
+ * @file StatsWriter.cpp
+ * @brief Implementation of streaming line-protocol and CSV writers
+ */
+
+#include "StatsWriter.h"
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <unistd.h>
+
+static const int64_t POW10[] = {1, 10, 100, 1000, 10000, 100000, 1000000};
+
+OutputBuffer::OutputBuffer(int fd)
+    : fd_(fd), length_(0), failed_(false)
+{
+}
+
+void OutputBuffer::put(char c)
+{
+ if (length_ == CAPACITY)
+ {
+  flush();
+ }
+ data_[length_++] = c;
+}
+
+void OutputBuffer::append(const char *text)
+{
+ append(text, std::strlen(text));
+}
+
+void OutputBuffer::append(const char *text, size_t length)
+{
+ while (length > 0)
+ {
+  if (length_ == CAPACITY)
+  {
+   flush();
+  }
+  size_t chunk = std::min(length, CAPACITY - length_);
+  std::memcpy(data_ + length_, text, chunk);
+  length_ += chunk;
+  text += chunk;
+  length -= chunk;
+ }
+}
+
+void OutputBuffer::appendInt(int64_t value)
+{
+ char digits[20];
+ int count = 0;
+ uint64_t magnitude = (value < 0) ? (0 - static_cast<uint64_t>(value)) : static_cast<uint64_t>(value);
+
+ do
+ {
+  digits[count++] = static_cast<char>('0' + (magnitude % 10));
+  magnitude /= 10;
+ } while (magnitude > 0);
+
+ if (value < 0)
+ {
+  put('-');
+ }
+ while (count > 0)
+ {
+  put(digits[--count]);
+ }
+}
+
+// Largest scaled magnitude written; beyond it llround overflows, and a double no longer holds every integer
+static const double MAX_SCALED = 9e15;
+
+static int clampDecimals(int decimals)
+{
+ return std::max(0, std::min(6, decimals));
+}
+
+bool OutputBuffer::fitsFixed(float value, int decimals)
+{
+ // Writing 0 for a reading the switch did not give would store a false one
+ double product = static_cast<double>(value) * POW10[clampDecimals(decimals)];
+ return std::isfinite(product) && std::fabs(product) <= MAX_SCALED;
+}
+
+bool OutputBuffer::appendFixed(float value, int decimals)
+{
+ if (!fitsFixed(value, decimals))
+ {
+  return false;
+ }
+ decimals = clampDecimals(decimals);
+ double product = static_cast<double>(value) * POW10[decimals];
+ int64_t scaled = std::llround(product);
+ if (scaled < 0)
+ {
+  put('-');
+  scaled = -scaled;
+ }
+
+ appendInt(scaled / POW10[decimals]);
+ if (decimals > 0)
+ {
+  put('.');
+  int64_t fraction = scaled % POW10[decimals];
+  for (int i = decimals - 1; i >= 0; i--)
+  {
+   put(static_cast<char>('0' + (fraction / POW10[i]) % 10));
+  }
+ }
+ return true;
+}
+
+bool OutputBuffer::flush()
+{
+ size_t written = 0;
+ while (written < length_)
+ {
+  ssize_t n = ::write(fd_, data_ + written, length_ - written);
+  if (n < 0)
+  {
+   if (errno == EINTR)
+   {
+    continue;
+   }
+   failed_ = true;
+   break;
+  }
+  written += static_cast<size_t>(n);
+ }
+
+ // Drop unwritten data rather than growing; the stream is best-effort on a dead fd
+ length_ = 0;
+ return !failed_;
+}
+
+StatsWriter::StatsWriter(int fd, FlushPolicy policy)
+    : out_(fd), policy_(policy)
+{
+}
+
+StatsWriter::~StatsWriter()
+{
+ out_.flush();
+}
+
+bool StatsWriter::writeSample(const std::string &host, int64_t timestampNs, const std::vector<PoEPortStats> &stats)
+{
+ for (const auto &port : stats)
+ {
+  writePort(host, timestampNs, port);
+ }
+
+ if (policy_ == FlushPolicy::Sample)
+ {
+  out_.flush();
+ }
+ return !out_.failed();
+}
+
+bool StatsWriter::finish()
+{
+ return out_.flush();
+}
+
+void StatsWriter::endLine()
+{
+ out_.put('\n');
+ if (policy_ == FlushPolicy::Line)
+ {
+  out_.flush();
+ }
+}
+
+InfluxWriter::InfluxWriter(int fd, FlushPolicy policy, const std::string &measurement)
+    : StatsWriter(fd, policy), measurement_(measurement)
+{
+}
+
+// Tag values escape commas, spaces and equals signs with a backslash
+void InfluxWriter::appendTag(const std::string &value)
+{
+ for (char c : value)
+ {
+  if (c == '\n' || c == '\r')
+  {
+   out_.append("\\ ");
+   continue;
+  }
+  if (c == ',' || c == ' ' || c == '=' || c == '\\')
+  {
+   out_.put('\\');
+  }
+  out_.put(c);
+ }
+}
+
+void InfluxWriter::appendReading(char &separator, const char *key, float value, int decimals)
+{
+ if (!OutputBuffer::fitsFixed(value, decimals))
+ {
+  return;
+ }
+ out_.put(separator);
+ out_.append(key);
+ out_.appendFixed(value, decimals);
+ separator = ',';
+}
+
+void InfluxWriter::writePort(const std::string &host, int64_t timestampNs, const PoEPortStats &port)
+{
+ out_.append(measurement_.data(), measurement_.size());
+ out_.append(",host=");
+ appendTag(host);
+ out_.append(",port=");
+ out_.appendInt(port.port);
+ // Influx rejects a tag with an empty value, so a port without a class has no class tag
+ const std::string &powerClass = internedText(port.powerClass);
+ if (!powerClass.empty())
+ {
+  out_.append(",class=");
+  appendTag(powerClass);
+ }
+
+ // A reading that cannot be written is left out of the line rather than stored as a number
+ char separator = ' ';
+ appendReading(separator, "voltage=", port.voltage, 1);
+ appendReading(separator, "current=", port.current, 0);
+ appendReading(separator, "power=", port.power, 1);
+ appendReading(separator, "temperature=", port.temperature, 0);
+ out_.put(separator);
+ out_.append("enabled=");
+ out_.append(port.enabled ? "true" : "false");
+
+ out_.put(' ');
+ out_.appendInt(timestampNs);
+ endLine();
+}
+
+CsvWriter::CsvWriter(int fd, FlushPolicy policy)
+    : StatsWriter(fd, policy), header_written_(false)
+{
+}
+
+// Quote fields containing separators, quotes or line breaks (RFC 4180)
+void CsvWriter::appendField(const std::string &value)
+{
+ if (value.find_first_of(",\"\r\n") == std::string::npos)
+ {
+  out_.append(value.data(), value.size());
+  return;
+ }
+
+ out_.put('"');
+ for (char c : value)
+ {
+  if (c == '"')
+  {
+   out_.put('"');
+  }
+  out_.put(c);
+ }
+ out_.put('"');
+}
+
+void CsvWriter::writePort(const std::string &host, int64_t timestampNs, const PoEPortStats &port)
+{
+ if (!header_written_)
+ {
+  out_.append("timestamp_ms,host,port,class,status,enabled,voltage,current,power,temperature,fault");
+  endLine();
+  header_written_ = true;
+ }
+
+ out_.appendInt(timestampNs / 1000000);
+ out_.put(',');
+ appendField(host);
+ out_.put(',');
+ out_.appendInt(port.port);
+ out_.put(',');
+ appendField(internedText(port.powerClass));
+ out_.put(',');
+ appendField(internedText(port.status));
+ out_.put(',');
+ out_.put(port.enabled ? '1' : '0');
+ // A reading that cannot be written leaves its cell empty
+ out_.put(',');
+ out_.appendFixed(port.voltage, 1);
+ out_.put(',');
+ out_.appendFixed(port.current, 0);
+ out_.put(',');
+ out_.appendFixed(port.power, 1);
+ out_.put(',');
+ out_.appendFixed(port.temperature, 0);
+ out_.put(',');
+ appendField(internedText(port.fault));
+ endLine();
+}
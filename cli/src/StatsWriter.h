@@ -0,0 +1,117 @@
+/**
+ * @file StatsWriter.h
+ * @brief Streaming line-protocol and CSV writers for PoE port statistics
+ *
+ * Writers format samples into a fixed-size buffer without heap allocation
+ * and write it to a file descriptor according to an explicit flush policy.
+ */
+
+#ifndef STATS_WRITER_H
+#define STATS_WRITER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "GS308EP_CLI.h"
+
+// When buffered output is handed to the operating system
+enum class FlushPolicy
+{
+ Line,   // After every output line
+ Sample, // After every complete sample (all ports of one poll)
+ Buffer  // Only when the buffer fills, and on finish()
+};
+
+/**
+ * Fixed-capacity output buffer with non-allocating number formatting
+ */
+class OutputBuffer
+{
+public:
+ static const size_t CAPACITY = 64 * 1024;
+
+ explicit OutputBuffer(int fd);
+
+ void put(char c);
+ void append(const char *text);
+ void append(const char *text, size_t length);
+ void appendInt(int64_t value);
+ // False, with nothing written, for NaN, infinities and values too large to scale exactly
+ bool appendFixed(float value, int decimals);
+ static bool fitsFixed(float value, int decimals);
+
+ bool flush();
+ size_t size() const { return length_; }
+ bool failed() const { return failed_; }
+
+private:
+ int fd_;
+ size_t length_;
+ bool failed_;
+ char data_[CAPACITY];
+};
+
+/**
+ * Base class for streaming sample writers
+ */
+class StatsWriter
+{
+public:
+ StatsWriter(int fd, FlushPolicy policy);
+ virtual ~StatsWriter();
+
+ // Write one poll result; timestamp is nanoseconds since the Unix epoch
+ bool writeSample(const std::string &host, int64_t timestampNs, const std::vector<PoEPortStats> &stats);
+
+ // Flush any buffered output
+ bool finish();
+
+protected:
+ virtual void writePort(const std::string &host, int64_t timestampNs, const PoEPortStats &port) = 0;
+
+ void endLine();
+
+ OutputBuffer out_;
+ FlushPolicy policy_;
+};
+
+/**
+ * InfluxDB line protocol: one line per port per sample
+ *
+ * poe,host=<host>,port=<n>,class=<class> voltage=..,current=..,power=..,temperature=..,enabled=.. <ns>
+ */
+class InfluxWriter : public StatsWriter
+{
+public:
+ InfluxWriter(int fd, FlushPolicy policy, const std::string &measurement = "poe");
+
+protected:
+ void writePort(const std::string &host, int64_t timestampNs, const PoEPortStats &port) override;
+
+private:
+ void appendTag(const std::string &value);
+ // Write ",key=value", or leave the field out if the value cannot be written
+ void appendReading(char &separator, const char *key, float value, int decimals);
+
+ std::string measurement_;
+};
+
+/**
+ * CSV with a single header row, one row per port per sample
+ */
+class CsvWriter : public StatsWriter
+{
+public:
+ CsvWriter(int fd, FlushPolicy policy);
+
+protected:
+ void writePort(const std::string &host, int64_t timestampNs, const PoEPortStats &port) override;
+
+private:
+ void appendField(const std::string &value);
+
+ bool header_written_;
+};
+
+#endif // STATS_WRITER_H
@@ -0,0 +1,361 @@
+/**
+ * @file StatusPage.cpp
+ * @brief Implementation of the lazy status page view
+ */
+
+#include "StatusPage.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string_view>
+
+// Status and class lie within this many bytes before a port's marker,
+// the readings within this many after it
+static const size_t HEAD_WINDOW = 500;
+static const size_t READING_WINDOW = 2000;
+static const size_t FLAG_WINDOW = 1000;
+
+static const char *READING_FIELDS[4] = {"ml570", "ml572", "ml574", "ml575"};
+
+// The number between spanStart and spanEnd, or fallback if there is none
+static float spanFloat(const std::string &html, size_t spanStart, size_t spanEnd, float fallback)
+{
+ const char *begin = html.c_str() + spanStart;
+ char *end = nullptr;
+ float value = std::strtof(begin, &end);
+ if (end == begin || end > html.c_str() + spanEnd)
+ {
+  return fallback;
+ }
+ return value;
+}
+
+// Last occurrence of needle lying wholly inside [from, to)
+static size_t findLastWithin(const std::string &html, const char *needle, size_t from, size_t to)
+{
+ size_t length = std::strlen(needle);
+ if (to < from + length)
+ {
+  return std::string::npos;
+ }
+ size_t pos = html.rfind(needle, to - length);
+ return pos != std::string::npos && pos >= from ? pos : std::string::npos;
+}
+
+// First occurrence of needle lying wholly inside [from, to)
+static size_t findWithin(const std::string &html, const char *needle, size_t from, size_t to)
+{
+ size_t length = std::strlen(needle);
+ if (from >= to || to - from < length)
+ {
+  return std::string::npos;
+ }
+ size_t pos = std::string_view(html).substr(from, to - from).find(needle);
+ return pos == std::string_view::npos ? std::string::npos : from + pos;
+}
+
+// First occurrence of needle starting before limit; it may run past it
+static size_t findStartingBefore(const std::string &html, const char *needle, size_t from, size_t limit)
+{
+ return findWithin(html, needle, from, std::min(html.size(), limit + std::strlen(needle) - 1));
+}
+
+StatusPageView::StatusPageView(const std::string &html) : html_(html), scanned_(0)
+{
+ for (Block &block : blocks_)
+ {
+  block.marker = std::string::npos;
+  block.decoded = 0;
+ }
+}
+
+// Markers are value="N" for a single digit N. The scan resumes where the
+// last lookup stopped and records the first marker of each port it passes.
+size_t StatusPageView::marker(int port) const
+{
+ if (port < 1 || port > PORTS)
+ {
+  return std::string::npos;
+ }
+ while (blocks_[port].marker == std::string::npos && scanned_ < html_.size())
+ {
+  size_t pos = html_.find("value=\"", scanned_);
+  if (pos == std::string::npos)
+  {
+   scanned_ = html_.size();
+   break;
+  }
+  scanned_ = pos + 1;
+  char digit = pos + 8 < html_.size() ? html_[pos + 7] : 0;
+  if (digit >= '1' && digit <= '0' + PORTS && html_[pos + 8] == '"' && blocks_[digit - '0'].marker == std::string::npos)
+  {
+   blocks_[digit - '0'].marker = pos;
+  }
+ }
+ return blocks_[port].marker;
+}
+
+bool StatusPageView::hasPort(int port) const
+{
+ return marker(port) != std::string::npos;
+}
+
+bool StatusPageView::decoded(Block &block, Field field) const
+{
+ bool done = block.decoded & (1u << field);
+ block.decoded |= static_cast<uint8_t>(1u << field);
+ return done;
+}
+
+void StatusPageView::decodeText(Block &block, Field field) const
+{
+ TextId &text = block.texts[field - FIELD_STATUS];
+ text = TEXT_UNKNOWN;
+ size_t portPos = block.marker;
+
+ if (field == FIELD_FAULT)
+ {
+  size_t faultPos = findStartingBefore(html_, "ml581", portPos, portPos + READING_WINDOW);
+  if (faultPos == std::string::npos)
+  {
+   return;
+  }
+  size_t spanStart = html_.find("<span>", faultPos + 5);
+  if (spanStart == std::string::npos)
+  {
+   return;
+  }
+  spanStart += 6;
+  size_t spanEnd = html_.find("</span>", spanStart);
+  if (spanEnd != std::string::npos)
+  {
+   text = internText(html_.data() + spanStart, spanEnd - spanStart);
+  }
+  return;
+ }
+
+ size_t searchStart = portPos > HEAD_WINDOW ? portPos - HEAD_WINDOW : 0;
+ if (field == FIELD_STATUS)
+ {
+  size_t modePos = findLastWithin(html_, "poe-power-mode", searchStart, portPos);
+  size_t spanStart = modePos == std::string::npos ? modePos : findWithin(html_, "<span>", modePos, portPos);
+  if (spanStart == std::string::npos)
+  {
+   return;
+  }
+  spanStart += 6;
+  size_t spanEnd = findWithin(html_, "</span>", spanStart, portPos);
+  if (spanEnd != std::string::npos)
+  {
+   text = internText(html_.data() + spanStart, spanEnd - spanStart);
+  }
+  return;
+ }
+
+ // Class is either plain text or the firmware's "ml003@N@" code for "Class N"
+ size_t classPos = findLastWithin(html_, "powClassShow", searchStart, portPos);
+ size_t spanStart = classPos == std::string::npos ? classPos : findWithin(html_, ">", classPos, portPos);
+ if (spanStart == std::string::npos)
+ {
+  return;
+ }
+ spanStart++;
+ size_t spanEnd = findWithin(html_, "</span>", spanStart, portPos);
+ if (spanEnd == std::string::npos)
+ {
+  return;
+ }
+ size_t length = spanEnd - spanStart;
+ if (html_.compare(spanStart, 6, "ml003@") != 0 || length <= 7)
+ {
+  text = internText(html_.data() + spanStart, length);
+  return;
+ }
+ size_t atPos = findWithin(html_, "@", spanStart + 6, spanEnd);
+ if (atPos != std::string::npos)
+ {
+  char classText[32];
+  int written = std::snprintf(classText, sizeof(classText), "Class %.*s", static_cast<int>(atPos - spanStart - 6),
+                              html_.data() + spanStart + 6);
+  text = internText(classText, std::min(static_cast<size_t>(written), sizeof(classText) - 1));
+ }
+}
+
+void StatusPageView::decodeReading(Block &block, Field field) const
+{
+ int index = field - FIELD_VOLTAGE;
+ float fallback = field == FIELD_POWER ? -1.0f : 0.0f;
+ float &reading = block.readings[index];
+ reading = fallback;
+
+ size_t fieldPos = findStartingBefore(html_, READING_FIELDS[index], block.marker, block.marker + READING_WINDOW);
+ if (fieldPos == std::string::npos)
+ {
+  return;
+ }
+ size_t spanStart = html_.find("<span>", fieldPos + 5);
+ if (spanStart == std::string::npos)
+ {
+  return;
+ }
+ spanStart += 6;
+ size_t spanEnd = html_.find("</span>", spanStart);
+ if (spanEnd != std::string::npos)
+ {
+  reading = spanFloat(html_, spanStart, spanEnd, fallback);
+ }
+}
+
+// hidPortPwr carries 1 when PoE is switched on for the port
+void StatusPageView::decodePowerFlag(Block &block) const
+{
+ block.powerFlag = false;
+ size_t end = std::min(block.marker + FLAG_WINDOW, html_.size());
+ size_t flagPos = findWithin(html_, "hidPortPwr", block.marker, end);
+ size_t valuePos = flagPos == std::string::npos ? flagPos : findWithin(html_, "value", flagPos, end);
+ size_t quotePos = valuePos == std::string::npos ? valuePos : findWithin(html_, "\"", valuePos, end);
+ if (quotePos != std::string::npos && quotePos + 1 < end)
+ {
+  block.powerFlag = html_[quotePos + 1] == '1';
+ }
+}
+
+TextId StatusPageView::status(int port) const
+{
+ if (marker(port) == std::string::npos)
+ {
+  return TEXT_UNKNOWN;
+ }
+ Block &block = blocks_[port];
+ if (!decoded(block, FIELD_STATUS))
+ {
+  decodeText(block, FIELD_STATUS);
+ }
+ return block.texts[FIELD_STATUS];
+}
+
+TextId StatusPageView::powerClass(int port) const
+{
+ if (marker(port) == std::string::npos)
+ {
+  return TEXT_UNKNOWN;
+ }
+ Block &block = blocks_[port];
+ if (!decoded(block, FIELD_CLASS))
+ {
+  decodeText(block, FIELD_CLASS);
+ }
+ return block.texts[FIELD_CLASS];
+}
+
+TextId StatusPageView::fault(int port) const
+{
+ if (marker(port) == std::string::npos)
+ {
+  return TEXT_UNKNOWN;
+ }
+ Block &block = blocks_[port];
+ if (!decoded(block, FIELD_FAULT))
+ {
+  decodeText(block, FIELD_FAULT);
+ }
+ return block.texts[FIELD_FAULT];
+}
+
+float StatusPageView::voltage(int port) const
+{
+ if (marker(port) == std::string::npos)
+ {
+  return 0.0f;
+ }
+ Block &block = blocks_[port];
+ if (!decoded(block, FIELD_VOLTAGE))
+ {
+  decodeReading(block, FIELD_VOLTAGE);
+ }
+ return block.readings[FIELD_VOLTAGE - FIELD_VOLTAGE];
+}
+
+float StatusPageView::current(int port) const
+{
+ if (marker(port) == std::string::npos)
+ {
+  return 0.0f;
+ }
+ Block &block = blocks_[port];
+ if (!decoded(block, FIELD_CURRENT))
+ {
+  decodeReading(block, FIELD_CURRENT);
+ }
+ return block.readings[FIELD_CURRENT - FIELD_VOLTAGE];
+}
+
+float StatusPageView::power(int port) const
+{
+ if (marker(port) == std::string::npos)
+ {
+  return -1.0f;
+ }
+ Block &block = blocks_[port];
+ if (!decoded(block, FIELD_POWER))
+ {
+  decodeReading(block, FIELD_POWER);
+ }
+ return block.readings[FIELD_POWER - FIELD_VOLTAGE];
+}
+
+float StatusPageView::temperature(int port) const
+{
+ if (marker(port) == std::string::npos)
+ {
+  return 0.0f;
+ }
+ Block &block = blocks_[port];
+ if (!decoded(block, FIELD_TEMPERATURE))
+ {
+  decodeReading(block, FIELD_TEMPERATURE);
+ }
+ return block.readings[FIELD_TEMPERATURE - FIELD_VOLTAGE];
+}
+
+bool StatusPageView::powerFlag(int port) const
+{
+ if (marker(port) == std::string::npos)
+ {
+  return false;
+ }
+ Block &block = blocks_[port];
+ if (!decoded(block, FIELD_POWER_FLAG))
+ {
+  decodePowerFlag(block);
+ }
+ return block.powerFlag;
+}
+
+bool StatusPageView::stats(int port, PoEPortStats &stats) const
+{
+ stats.port = static_cast<uint8_t>(port);
+ if (!hasPort(port))
+ {
+  stats.enabled = false;
+  stats.status = TEXT_UNKNOWN;
+  stats.voltage = 0.0f;
+  stats.current = 0.0f;
+  stats.power = 0.0f;
+  stats.temperature = 0.0f;
+  stats.fault = TEXT_UNKNOWN;
+  stats.powerClass = TEXT_UNKNOWN;
+  return false;
+ }
+
+ stats.status = status(port);
+ stats.enabled = stats.status == TEXT_DELIVERING_POWER;
+ stats.powerClass = powerClass(port);
+ stats.voltage = voltage(port);
+ stats.current = current(port);
+ stats.power = power(port);
+ stats.temperature = temperature(port);
+ stats.fault = fault(port);
+ return true;
+}
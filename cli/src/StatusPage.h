@@ -0,0 +1,79 @@
+/**
+ * @file StatusPage.h
+ * @brief Lazy, port-indexed view over a fetched PoE status page
+ *
+ * The status page repeats one block per port, each anchored on the hidden
+ * input holding the port number. Status and class sit just before that
+ * marker, and the readings follow it. The view finds markers in a single
+ * forward scan, and only as far as the port being asked for. A lookup of
+ * port 2 stops scanning at port 2's block. Each field is decoded the first
+ * time it is read and then kept, so reading it again costs nothing.
+ *
+ * The view holds offsets into the page and copies nothing out of it. It
+ * never allocates, and the page must outlive it and not change meanwhile.
+ * Decoding gives the same results as scanning the page once per field.
+ */
+
+#ifndef STATUS_PAGE_H
+#define STATUS_PAGE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "GS308EP_CLI.h"
+
+class StatusPageView
+{
+public:
+ explicit StatusPageView(const std::string &html);
+
+ bool hasPort(int port) const;
+
+ TextId status(int port) const; // TEXT_UNKNOWN if absent
+ TextId powerClass(int port) const;
+ TextId fault(int port) const;
+ float voltage(int port) const; // 0 if absent
+ float current(int port) const;
+ float temperature(int port) const;
+ float power(int port) const;   // -1 if the port or its reading is absent
+ bool powerFlag(int port) const; // The page's hidPortPwr flag; false if absent
+
+ // Decode every field of a port. False, with stats cleared, if the port is absent.
+ bool stats(int port, PoEPortStats &stats) const;
+
+private:
+ enum Field
+ {
+  FIELD_STATUS,
+  FIELD_CLASS,
+  FIELD_FAULT,
+  FIELD_VOLTAGE,
+  FIELD_CURRENT,
+  FIELD_POWER,
+  FIELD_TEMPERATURE,
+  FIELD_POWER_FLAG
+ };
+
+ struct Block
+ {
+  size_t marker; // Offset of the port's marker, npos until found or if absent
+  uint8_t decoded; // Bit per Field
+  bool powerFlag;
+  TextId texts[3];
+  float readings[4];
+ };
+
+ static const int PORTS = 8;
+
+ const std::string &html_;
+ mutable size_t scanned_; // Markers before this offset have been recorded
+ mutable Block blocks_[PORTS + 1];
+
+ size_t marker(int port) const;
+ bool decoded(Block &block, Field field) const;
+ void decodeText(Block &block, Field field) const;
+ void decodeReading(Block &block, Field field) const;
+ void decodePowerFlag(Block &block) const;
+};
+
+#endif // STATUS_PAGE_H
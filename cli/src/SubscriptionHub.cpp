@@ -0,0 +1,391 @@
+/**
+ * @file SubscriptionHub.cpp
+ * @brief Implementation of the daemon's statistics fan-out
+ */
+
+#include "SubscriptionHub.h"
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <sys/uio.h>
+
+static const int MAX_IOVECS = 64;
+
+static const struct
+{
+ const char *name;
+ uint32_t bit;
+} FIELD_NAMES[] = {
+    {"enabled", FIELD_ENABLED}, {"status", FIELD_STATUS},   {"class", FIELD_CLASS},
+    {"voltage", FIELD_VOLTAGE}, {"current", FIELD_CURRENT}, {"power", FIELD_POWER},
+    {"temperature", FIELD_TEMPERATURE}, {"fault", FIELD_FAULT},
+};
+
+static std::vector<std::string> splitList(const std::string &text)
+{
+ std::vector<std::string> items;
+ std::istringstream in(text);
+ std::string item;
+ while (std::getline(in, item, ','))
+ {
+  if (!item.empty())
+  {
+   items.push_back(item);
+  }
+ }
+ return items;
+}
+
+bool parseSubscriptionFilter(const std::string &text, SubscriptionFilter &filter, std::string &error)
+{
+ std::istringstream in(text);
+ std::string token;
+ while (in >> token)
+ {
+  size_t equals = token.find('=');
+  if (equals == std::string::npos)
+  {
+   error = "expected key=value, got '" + token + "'";
+   return false;
+  }
+  std::string key = token.substr(0, equals);
+  std::string value = token.substr(equals + 1);
+
+  if (key == "switch")
+  {
+   filter.switches = splitList(value);
+  }
+  else if (key == "ports")
+  {
+   filter.portMask = 0;
+   for (const auto &item : splitList(value))
+   {
+    int port = std::atoi(item.c_str());
+    if (port < 1 || port > 8)
+    {
+     error = "invalid port '" + item + "'";
+     return false;
+    }
+    filter.portMask |= static_cast<uint8_t>(1u << (port - 1));
+   }
+  }
+  else if (key == "fields")
+  {
+   filter.fields = 0;
+   for (const auto &item : splitList(value))
+   {
+    uint32_t bit = 0;
+    for (const auto &field : FIELD_NAMES)
+    {
+     if (item == field.name)
+     {
+      bit = field.bit;
+     }
+    }
+    if (!bit)
+    {
+     error = "unknown field '" + item + "'";
+     return false;
+    }
+    filter.fields |= bit;
+   }
+  }
+  else if (key == "min-change")
+  {
+   filter.minChange = std::strtof(value.c_str(), nullptr);
+   if (filter.minChange < 0.0f)
+   {
+    error = "min-change must not be negative";
+    return false;
+   }
+  }
+  else
+  {
+   error = "unknown filter '" + key + "'";
+   return false;
+  }
+ }
+
+ if (filter.fields == 0)
+ {
+  error = "no fields selected";
+  return false;
+ }
+ return true;
+}
+
+SubscriptionHub::SubscriptionHub()
+    : next_id_(1)
+{
+}
+
+uint32_t SubscriptionHub::subscribe(const SubscriptionFilter &filter)
+{
+ uint32_t id = next_id_++;
+ Subscriber &subscriber = subscribers_[id];
+ subscriber.filter = filter;
+ subscriber.lineIndex = 0;
+ subscriber.offset = 0;
+ subscriber.dropped = 0;
+ for (auto &last : subscriber.last)
+ {
+  last.valid = false;
+ }
+ return id;
+}
+
+void SubscriptionHub::unsubscribe(uint32_t id)
+{
+ subscribers_.erase(id);
+}
+
+bool SubscriptionHub::pending(uint32_t id) const
+{
+ auto it = subscribers_.find(id);
+ return it != subscribers_.end() && !it->second.queue.empty();
+}
+
+static void appendString(std::string &out, const char *key, const std::string &value)
+{
+ out += ",\"";
+ out += key;
+ out += "\":\"";
+ for (char c : value)
+ {
+  if (c == '"' || c == '\\')
+  {
+   out += '\\';
+  }
+  if (static_cast<unsigned char>(c) >= 0x20)
+  {
+   out += c;
+  }
+ }
+ out += '"';
+}
+
+static void appendNumber(std::string &out, const char *key, float value, int decimals)
+{
+ char number[32];
+ std::snprintf(number, sizeof(number), ",\"%s\":%.*f", key, decimals, static_cast<double>(value));
+ out += number;
+}
+
+std::string SubscriptionHub::serialize(const std::string &host, int64_t timestampNs, const PoEPortStats &stats,
+                                       uint32_t fields)
+{
+ std::string out = "{\"time\":" + std::to_string(timestampNs);
+ appendString(out, "host", host);
+ out += ",\"port\":" + std::to_string(stats.port);
+ if (fields & FIELD_ENABLED)
+ {
+  out += stats.enabled ? ",\"enabled\":true" : ",\"enabled\":false";
+ }
+ if (fields & FIELD_STATUS)
+ {
+  appendString(out, "status", internedText(stats.status));
+ }
+ if (fields & FIELD_CLASS)
+ {
+  appendString(out, "class", internedText(stats.powerClass));
+ }
+ if (fields & FIELD_VOLTAGE)
+ {
+  appendNumber(out, "voltage", stats.voltage, 1);
+ }
+ if (fields & FIELD_CURRENT)
+ {
+  appendNumber(out, "current", stats.current, 0);
+ }
+ if (fields & FIELD_POWER)
+ {
+  appendNumber(out, "power", stats.power, 1);
+ }
+ if (fields & FIELD_TEMPERATURE)
+ {
+  appendNumber(out, "temperature", stats.temperature, 0);
+ }
+ if (fields & FIELD_FAULT)
+ {
+  appendString(out, "fault", internedText(stats.fault));
+ }
+ out += "}\n";
+ return out;
+}
+
+// Decide whether a port's reading is worth sending, and remember it if so
+bool SubscriptionHub::wanted(Subscriber &subscriber, const PoEPortStats &stats)
+{
+ const SubscriptionFilter &filter = subscriber.filter;
+ if (stats.port < 1 || stats.port > 8)
+ {
+  return false;
+ }
+ if (filter.portMask && !(filter.portMask & (1u << (stats.port - 1))))
+ {
+  return false;
+ }
+
+ static const uint32_t READING_FIELDS[4] = {FIELD_VOLTAGE, FIELD_CURRENT, FIELD_POWER, FIELD_TEMPERATURE};
+ float readings[4] = {stats.voltage, stats.current, stats.power, stats.temperature};
+
+ LastSent &last = subscriber.last[stats.port - 1];
+ bool send = !last.valid || filter.minChange <= 0.0f;
+ if (!send && (filter.fields & FIELD_ENABLED) && stats.enabled != last.enabled)
+ {
+  send = true;
+ }
+ if (!send && (filter.fields & FIELD_STATUS) && stats.status != last.status)
+ {
+  send = true;
+ }
+ if (!send && (filter.fields & FIELD_FAULT) && stats.fault != last.fault)
+ {
+  send = true;
+ }
+ if (!send && (filter.fields & FIELD_CLASS) && stats.powerClass != last.powerClass)
+ {
+  send = true;
+ }
+ for (int i = 0; i < 4 && !send; i++)
+ {
+  send = (filter.fields & READING_FIELDS[i]) && std::fabs(readings[i] - last.readings[i]) >= filter.minChange;
+ }
+
+ if (send)
+ {
+  last.valid = true;
+  last.enabled = stats.enabled;
+  last.status = stats.status;
+  last.fault = stats.fault;
+  last.powerClass = stats.powerClass;
+  std::copy(readings, readings + 4, last.readings);
+ }
+ return send;
+}
+
+void SubscriptionHub::enqueue(Subscriber &subscriber, Sample &sample)
+{
+ // Drop the oldest whole sample; a partly written one has to finish first
+ if (subscriber.queue.size() >= MAX_QUEUED_SAMPLES)
+ {
+  bool started = subscriber.lineIndex > 0 || subscriber.offset > 0;
+  subscriber.queue.erase(subscriber.queue.begin() + (started ? 1 : 0));
+  subscriber.dropped++;
+ }
+
+ subscriber.queue.push_back(std::move(sample));
+}
+
+void SubscriptionHub::publish(const std::string &host, int64_t timestampNs, const std::vector<PoEPortStats> &stats)
+{
+ // One serialization per (field selection, port), shared by every subscriber
+ std::map<uint32_t, std::vector<Line>> serialized;
+
+ for (auto &entry : subscribers_)
+ {
+  Subscriber &subscriber = entry.second;
+  const std::vector<std::string> &switches = subscriber.filter.switches;
+  if (!switches.empty() && std::find(switches.begin(), switches.end(), host) == switches.end())
+  {
+   continue;
+  }
+
+  std::vector<Line> &lines = serialized[subscriber.filter.fields];
+  lines.resize(stats.size());
+
+  Sample sample;
+  for (size_t i = 0; i < stats.size(); i++)
+  {
+   if (!wanted(subscriber, stats[i]))
+   {
+    continue;
+   }
+   if (!lines[i])
+   {
+    lines[i] = std::make_shared<const std::string>(serialize(host, timestampNs, stats[i], subscriber.filter.fields));
+   }
+   sample.push_back(lines[i]);
+  }
+
+  if (!sample.empty())
+  {
+   enqueue(subscriber, sample);
+  }
+ }
+}
+
+bool SubscriptionHub::flush(uint32_t id, int fd)
+{
+ auto it = subscribers_.find(id);
+ if (it == subscribers_.end())
+ {
+  return true;
+ }
+ Subscriber &subscriber = it->second;
+
+ while (!subscriber.queue.empty())
+ {
+  // Tell the reader where the gap is, just before the first sample after it
+  if (subscriber.dropped && subscriber.lineIndex == 0 && subscriber.offset == 0)
+  {
+   Sample &front = subscriber.queue.front();
+   front.insert(front.begin(),
+                std::make_shared<const std::string>("{\"dropped\":" + std::to_string(subscriber.dropped) + "}\n"));
+   subscriber.dropped = 0;
+  }
+
+  // Gather queued lines without copying them
+  struct iovec vectors[MAX_IOVECS];
+  int count = 0;
+  size_t lineIndex = subscriber.lineIndex;
+  size_t offset = subscriber.offset;
+  for (auto sample = subscriber.queue.begin(); sample != subscriber.queue.end() && count < MAX_IOVECS; ++sample)
+  {
+   for (; lineIndex < sample->size() && count < MAX_IOVECS; lineIndex++)
+   {
+    const std::string &line = *(*sample)[lineIndex];
+    vectors[count].iov_base = const_cast<char *>(line.data() + offset);
+    vectors[count].iov_len = line.size() - offset;
+    count++;
+    offset = 0;
+   }
+   lineIndex = 0;
+  }
+
+  ssize_t written = writev(fd, vectors, count);
+  if (written < 0)
+  {
+   return errno == EAGAIN || errno == EINTR;
+  }
+
+  // Advance past what the socket took
+  size_t remaining = static_cast<size_t>(written);
+  while (remaining > 0 && !subscriber.queue.empty())
+  {
+   Sample &front = subscriber.queue.front();
+   size_t left = front[subscriber.lineIndex]->size() - subscriber.offset;
+   if (remaining < left)
+   {
+    subscriber.offset += remaining;
+    break;
+   }
+   remaining -= left;
+   subscriber.offset = 0;
+   if (++subscriber.lineIndex == front.size())
+   {
+    subscriber.queue.pop_front();
+    subscriber.lineIndex = 0;
+   }
+  }
+
+  if (static_cast<size_t>(written) == 0)
+  {
+   break;
+  }
+ }
+ return true;
+}
@@ -0,0 +1,103 @@
+/**
+ * @file SubscriptionHub.h
+ * @brief Fan-out of polled statistics to daemon socket subscribers
+ *
+ * Each poll is serialized once per distinct field selection and the same
+ * immutable lines are queued to every matching subscriber, so the switch is
+ * polled once however many consumers attach. A subscriber that reads too
+ * slowly loses its oldest queued samples, never the newest.
+ */
+
+#ifndef SUBSCRIPTION_HUB_H
+#define SUBSCRIPTION_HUB_H
+
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "GS308EP_CLI.h"
+
+// Field bits selectable with fields=...
+enum SubscriptionField : uint32_t
+{
+ FIELD_ENABLED = 1u << 0,
+ FIELD_STATUS = 1u << 1,
+ FIELD_CLASS = 1u << 2,
+ FIELD_VOLTAGE = 1u << 3,
+ FIELD_CURRENT = 1u << 4,
+ FIELD_POWER = 1u << 5,
+ FIELD_TEMPERATURE = 1u << 6,
+ FIELD_FAULT = 1u << 7,
+ FIELD_ALL = 0xffu
+};
+
+struct SubscriptionFilter
+{
+ std::vector<std::string> switches; // Empty matches every switch
+ uint8_t portMask;                  // Bit (port - 1); zero matches every port
+ uint32_t fields;
+ float minChange; // Smallest change of a selected reading worth sending; 0 sends every sample
+
+ SubscriptionFilter() : portMask(0), fields(FIELD_ALL), minChange(0.0f) {}
+};
+
+// Parse "switch=H1,H2 ports=1,3 fields=power,current min-change=0.5"
+bool parseSubscriptionFilter(const std::string &text, SubscriptionFilter &filter, std::string &error);
+
+class SubscriptionHub
+{
+public:
+ static const size_t MAX_QUEUED_SAMPLES = 32;
+
+ SubscriptionHub();
+
+ uint32_t subscribe(const SubscriptionFilter &filter);
+ void unsubscribe(uint32_t id);
+
+ // Serialize one poll and queue it to every matching subscriber
+ void publish(const std::string &host, int64_t timestampNs, const std::vector<PoEPortStats> &stats);
+
+ bool pending(uint32_t id) const;
+
+ // Write as much of the subscriber's queue as the socket accepts; false on a write error
+ bool flush(uint32_t id, int fd);
+
+ size_t size() const { return subscribers_.size(); }
+
+private:
+ typedef std::shared_ptr<const std::string> Line;
+
+ // Lines of one poll for one subscriber
+ typedef std::vector<Line> Sample;
+
+ struct LastSent
+ {
+  bool valid;
+  bool enabled;
+  TextId status;
+  TextId fault;
+  TextId powerClass;
+  float readings[4]; // voltage, current, power, temperature
+ };
+
+ struct Subscriber
+ {
+  SubscriptionFilter filter;
+  std::deque<Sample> queue;
+  size_t lineIndex; // Position of the next unwritten byte in queue.front()
+  size_t offset;
+  uint64_t dropped; // Samples dropped since the last notice
+  LastSent last[8];
+ };
+
+ std::map<uint32_t, Subscriber> subscribers_;
+ uint32_t next_id_;
+
+ bool wanted(Subscriber &subscriber, const PoEPortStats &stats);
+ void enqueue(Subscriber &subscriber, Sample &sample);
+ static std::string serialize(const std::string &host, int64_t timestampNs, const PoEPortStats &stats,
+                              uint32_t fields);
+};
+
+#endif // SUBSCRIPTION_HUB_H
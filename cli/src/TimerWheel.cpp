@@ -0,0 +1,193 @@
+/**
+ * @file TimerWheel.cpp
+ * @brief Implementation of the hierarchical timer wheel
+ */
+
+#include "TimerWheel.h"
+
+TimerWheel::TimerWheel(uint64_t startTick)
+    : current_(startTick), pending_(0), free_(NIL)
+{
+ for (uint32_t i = 0; i < SLOT_COUNT; i++)
+ {
+  slots_[i] = NIL;
+ }
+}
+
+// Map an expiry to its slot: level 0 holds the next 256 ticks exactly,
+// each higher level holds 64 coarser buckets of the level below
+uint32_t TimerWheel::slotFor(uint64_t expires) const
+{
+ if (expires < current_)
+ {
+  expires = current_;
+ }
+
+ uint64_t delta = expires - current_;
+ if (delta < LEVEL0_SLOTS)
+ {
+  return static_cast<uint32_t>(expires & (LEVEL0_SLOTS - 1));
+ }
+
+ for (int level = 1; level < LEVELS; level++)
+ {
+  int shift = LEVEL0_BITS + level * LEVELN_BITS;
+  if (delta < (1ull << shift) || level == LEVELS - 1)
+  {
+   if (delta >= (1ull << shift))
+   {
+    // Beyond the wheel's horizon: park in the furthest top-level bucket
+    expires = current_ + (1ull << shift) - 1;
+   }
+   int levelShift = shift - LEVELN_BITS;
+   uint32_t index = static_cast<uint32_t>((expires >> levelShift) & (LEVELN_SLOTS - 1));
+   return LEVEL0_SLOTS + (level - 1) * LEVELN_SLOTS + index;
+  }
+ }
+
+ return 0;
+}
+
+void TimerWheel::link(int32_t index)
+{
+ Node &node = nodes_[index];
+ uint32_t slot = slotFor(node.expires);
+
+ node.slot = static_cast<int32_t>(slot);
+ node.prev = NIL;
+ node.next = slots_[slot];
+ if (node.next != NIL)
+ {
+  nodes_[node.next].prev = index;
+ }
+ slots_[slot] = index;
+}
+
+void TimerWheel::unlink(int32_t index)
+{
+ Node &node = nodes_[index];
+ if (node.prev != NIL)
+ {
+  nodes_[node.prev].next = node.next;
+ }
+ else
+ {
+  slots_[node.slot] = node.next;
+ }
+ if (node.next != NIL)
+ {
+  nodes_[node.next].prev = node.prev;
+ }
+ node.slot = NIL;
+}
+
+// Re-file every timer in the current bucket of a higher level
+void TimerWheel::cascade(int level)
+{
+ int levelShift = LEVEL0_BITS + (level - 1) * LEVELN_BITS;
+ uint32_t index = static_cast<uint32_t>((current_ >> levelShift) & (LEVELN_SLOTS - 1));
+ uint32_t slot = LEVEL0_SLOTS + (level - 1) * LEVELN_SLOTS + index;
+
+ int32_t head = slots_[slot];
+ slots_[slot] = NIL;
+ while (head != NIL)
+ {
+  int32_t next = nodes_[head].next;
+  link(head);
+  head = next;
+ }
+}
+
+// Advance one tick and return the detached list of timers that expire on it
+int32_t TimerWheel::step()
+{
+ uint32_t index = static_cast<uint32_t>(current_ & (LEVEL0_SLOTS - 1));
+ if (index == 0)
+ {
+  for (int level = 1; level < LEVELS; level++)
+  {
+   cascade(level);
+   int shift = LEVEL0_BITS + level * LEVELN_BITS;
+   if (((current_ >> (shift - LEVELN_BITS)) & (LEVELN_SLOTS - 1)) != 0)
+   {
+    break;
+   }
+  }
+ }
+
+ int32_t head = slots_[index];
+ slots_[index] = NIL;
+ for (int32_t i = head; i != NIL; i = nodes_[i].next)
+ {
+  nodes_[i].slot = FIRING;
+ }
+
+ // Timers scheduled from inside the callbacks land on the following tick
+ current_++;
+ return head;
+}
+
+int32_t TimerWheel::allocate()
+{
+ if (free_ != NIL)
+ {
+  int32_t index = free_;
+  free_ = nodes_[index].next;
+  return index;
+ }
+
+ Node node = {};
+ node.generation = 1;
+ node.slot = NIL;
+ nodes_.push_back(node);
+ return static_cast<int32_t>(nodes_.size() - 1);
+}
+
+void TimerWheel::release(int32_t index)
+{
+ Node &node = nodes_[index];
+ node.slot = NIL;
+ node.generation++;
+ node.next = free_;
+ free_ = index;
+ pending_--;
+}
+
+TimerWheel::TimerId TimerWheel::schedule(uint64_t expiryTick, uint64_t payload)
+{
+ int32_t index = allocate();
+ Node &node = nodes_[index];
+ node.expires = expiryTick;
+ node.payload = payload;
+ link(index);
+ pending_++;
+
+ return (static_cast<uint64_t>(node.generation) << 32) | static_cast<uint32_t>(index);
+}
+
+bool TimerWheel::cancel(TimerId id)
+{
+ uint32_t index = static_cast<uint32_t>(id & 0xffffffffu);
+ uint32_t generation = static_cast<uint32_t>(id >> 32);
+ if (index >= nodes_.size())
+ {
+  return false;
+ }
+
+ Node &node = nodes_[index];
+ if (node.generation != generation || node.slot == NIL || node.slot == CANCELLED)
+ {
+  return false;
+ }
+
+ if (node.slot == FIRING)
+ {
+  // Already detached by advance(); it is released there without firing
+  node.slot = CANCELLED;
+  return true;
+ }
+
+ unlink(static_cast<int32_t>(index));
+ release(static_cast<int32_t>(index));
+ return true;
+}
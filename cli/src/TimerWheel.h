@@ -0,0 +1,95 @@
+/**
+ * @file TimerWheel.h
+ * @brief Hierarchical timer wheel with O(1) insert, cancel and per-tick expiry
+ *
+ * Four levels of slots (256, 64, 64, 64) cover roughly 2^26 ticks; timers
+ * further out are parked in the top level and re-cascaded until due.
+ * Timers live in a pooled array linked through intrusive list indices, so
+ * scheduling and cancelling never walks other pending timers.
+ */
+
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class TimerWheel
+{
+public:
+ typedef uint64_t TimerId;
+ static const TimerId INVALID_TIMER = 0;
+
+ explicit TimerWheel(uint64_t startTick = 0);
+
+ // Schedule payload to fire at an absolute tick; past ticks fire on the next advance
+ TimerId schedule(uint64_t expiryTick, uint64_t payload);
+
+ // Cancel a pending timer; returns false if it already fired or was cancelled
+ bool cancel(TimerId id);
+
+ // Fire every timer due up to and including nowTick, in tick order.
+ // The callback may schedule or cancel timers.
+ template <typename Fire>
+ void advance(uint64_t nowTick, Fire &&fire)
+ {
+  while (current_ <= nowTick)
+  {
+   int32_t head = step();
+   while (head != NIL)
+   {
+    Node &node = nodes_[head];
+    int32_t next = node.next;
+    uint64_t payload = node.payload;
+    bool live = (node.slot == FIRING);
+    release(head);
+    head = next;
+    if (live)
+    {
+     fire(payload);
+    }
+   }
+  }
+ }
+
+ uint64_t currentTick() const { return current_; }
+ size_t size() const { return pending_; }
+
+private:
+ static const int32_t NIL = -1;
+ static const int32_t FIRING = -2;    // Detached for the current tick
+ static const int32_t CANCELLED = -3; // Cancelled while detached
+ static const int LEVEL0_BITS = 8;
+ static const int LEVELN_BITS = 6;
+ static const int LEVELS = 4;
+ static const uint32_t LEVEL0_SLOTS = 1u << LEVEL0_BITS;
+ static const uint32_t LEVELN_SLOTS = 1u << LEVELN_BITS;
+ static const uint32_t SLOT_COUNT = LEVEL0_SLOTS + (LEVELS - 1) * LEVELN_SLOTS;
+
+ struct Node
+ {
+  uint64_t expires;
+  uint64_t payload;
+  int32_t prev;
+  int32_t next;
+  int32_t slot;
+  uint32_t generation;
+ };
+
+ uint32_t slotFor(uint64_t expires) const;
+ void link(int32_t index);
+ void unlink(int32_t index);
+ void cascade(int level);
+ int32_t step();
+ int32_t allocate();
+ void release(int32_t index);
+
+ uint64_t current_;
+ size_t pending_;
+ int32_t free_;
+ std::vector<Node> nodes_;
+ int32_t slots_[SLOT_COUNT];
+};
+
+#endif // TIMER_WHEEL_H
@@ -10,14 +10,51 @@
 #include <iostream>
 #include <string>
 #include <vector>
+#include <map>
 #include <getopt.h>
 #include <cstdlib>
 #include <iomanip>
+#include <memory>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <csignal>
+#include <unistd.h>
+#include <fcntl.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <pwd.h>
+#include <ctime>
 #include "GS308EP_CLI.h"
+#include "StatsWriter.h"
+#include "Daemon.h"
+#include "LoadShedder.h"
+#include "PortBaseline.h"
+#include "Snapshot.h"
+#include "History.h"
+#include "HistoryQuery.h"
+#include "Fleet.h"
+#include "Capture.h"
+#include "AuditLog.h"
+#include "Deadline.h"
+#include "RetryPolicy.h"
+#include "Shard.h"
+#include "PollSchedule.h"
 
 const char *VERSION = "0.5.0";
 const char *PROGRAM_NAME = "gs308ep";
 
+// Exit status of a command that ran out of its --deadline, as timeout(1) uses
+static const int DEADLINE_EXIT_STATUS = 124;
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void handle_stop_signal(int)
+{
+ stop_requested = 1;
+}
+
 void print_version()
 {
  std::cout << PROGRAM_NAME << " version " << VERSION << std::endl;
@@ -40,6 +77,8 @@ void print_usage()
  std::cout << "  -f, --off              Turn port OFF" << std::endl;
  std::cout << "  -c, --cycle[=DELAY]    Power cycle port (optional delay in ms, default 2000)" << std::endl;
  std::cout << "  -s, --status           Show port status" << std::endl;
+ std::cout << "      --deadline=MS      Total time the command may take, login and retries included;" << std::endl;
+ std::cout << "                         with --daemon, each action's (exit status 124 when it runs out)" << std::endl;
  std::cout << std::endl;
  std::cout << "Power monitoring:" << std::endl;
  std::cout << "  -w, --power            Show power consumption for specified port" << std::endl;
@@ -48,9 +87,70 @@ void print_usage()
  std::cout << std::endl;
  std::cout << "Output format:" << std::endl;
  std::cout << "  -j, --json             Output in JSON format" << std::endl;
+ std::cout << "      --format=FMT       Output format: text, json, influx, csv (default text)" << std::endl;
+ std::cout << "      --flush=POLICY     Streaming flush policy: line, sample, buffer (default sample)" << std::endl;
  std::cout << "  -q, --quiet            Suppress non-essential output" << std::endl;
  std::cout << "  -v, --verbose          Enable verbose output" << std::endl;
  std::cout << std::endl;
+ std::cout << "Streaming:" << std::endl;
+ std::cout << "      --watch[=SECS]     Repeat --stats every SECS seconds (default 10) until interrupted" << std::endl;
+ std::cout << "      --count=N          Stop watching after N samples" << std::endl;
+ std::cout << std::endl;
+ std::cout << "Load shedding (with --watch or --daemon):" << std::endl;
+ std::cout << "      --shed-at=PCT      Turn off low-priority ports when draw reaches PCT of the budget" << std::endl;
+ std::cout << "      --restore-at=PCT   Restore shed ports once draw would stay below PCT (default 85% of --shed-at)" << std::endl;
+ std::cout << "      --shed-order=LIST  Ports in shedding order, lowest priority first (default 8,7,...,1)" << std::endl;
+ std::cout << "      --budget=WATTS     Switch PoE budget (default 65.0)" << std::endl;
+ std::cout << std::endl;
+ std::cout << "Anomaly detection (with --watch or --daemon):" << std::endl;
+ std::cout << "      --anomaly[=PCT]    Flag ports deviating PCT from their baseline (default 40)" << std::endl;
+ std::cout << "      --baseline-window=N  EWMA span of the per-port baseline in samples (default 60)" << std::endl;
+ std::cout << std::endl;
+ std::cout << "History (with --watch or --daemon):" << std::endl;
+ std::cout << "      --record=FILE      Append every sample to a columnar history file" << std::endl;
+ std::cout << "                         (analyse with '" << PROGRAM_NAME << " query --help')" << std::endl;
+ std::cout << std::endl;
+ std::cout << "Fleet (with --stats):" << std::endl;
+ std::cout << "      --fleet=FILE       Poll every switch listed in FILE and report totals per site, rack and tag" << std::endl;
+ std::cout << "                         (one 'HOST [password=P] [site=S] [rack=R] [tags=a,b]' per line)" << std::endl;
+ std::cout << "      --workers=N        Switches fetched concurrently by the I/O stage (default 16)" << std::endl;
+ std::cout << "      --parsers=N        Threads parsing fetched pages (default 2)" << std::endl;
+ std::cout << "      --hottest=K        Hottest ports listed per group (default 3)" << std::endl;
+ std::cout << "      --output=FILE      Append reports to FILE, one write per report, instead of stdout" << std::endl;
+ std::cout << "      --collector=ADDR   Share the fleet with other collectors; ADDR is this one's UDP HOST:PORT" << std::endl;
+ std::cout << "      --peers=LIST       Other collectors' HOST:PORT; one live collector is enough to join" << std::endl;
+ std::cout << "      --collector-timeout=MS  Silence after which a collector's switches move (default 3000)" << std::endl;
+ std::cout << "      --spread[=MS]      Start each switch at its own hashed point of the --watch interval," << std::endl;
+ std::cout << "                         at most an even share per MS tick (default 100)" << std::endl;
+ std::cout << "      --sync-tag=LIST    With --spread, start switches with these tags together at each interval" << std::endl;
+ std::cout << std::endl;
+ std::cout << "Burst capture (with --port):" << std::endl;
+ std::cout << "      --capture[=SECS]   Turn the port on and sample it back-to-back for SECS seconds (default 10)," << std::endl;
+ std::cout << "                         printing its power curve and the sample rate achieved" << std::endl;
+ std::cout << "      --precycle=MS      Hold the port off for MS before turning it on (default: turn it on as it is)" << std::endl;
+ std::cout << std::endl;
+ std::cout << "Audit (with --on, --off, --cycle, --capture, --shed-at or --daemon):" << std::endl;
+ std::cout << "      --audit=FILE       Append every port change to a binary audit log" << std::endl;
+ std::cout << "                         (read it with '" << PROGRAM_NAME << " audit --help')" << std::endl;
+ std::cout << "      --audit-delay=MS   Longest a change waits to be committed to the log (default 100)" << std::endl;
+ std::cout << std::endl;
+ std::cout << "Cached queries:" << std::endl;
+ std::cout << "      --cached           Answer --status, --power, --total-power or --stats from the" << std::endl;
+ std::cout << "                         snapshot published by a running --watch or --daemon poller" << std::endl;
+ std::cout << "                         (no network I/O; no password needed)" << std::endl;
+ std::cout << std::endl;
+ std::cout << "Daemon:" << std::endl;
+ std::cout << "      --daemon           Run continuously, executing scheduled actions" << std::endl;
+ std::cout << "      --schedule=FILE    Load scheduled actions from FILE (one per line)" << std::endl;
+ std::cout << "      --socket=PATH      Control socket (default /tmp/gs308ep-HOST.sock)" << std::endl;
+ std::cout << "      --session-timeout=SECS  Idle time after which the switch drops a session (default 300)" << std::endl;
+ std::cout << "                         With --daemon, --watch sets the statistics poll interval" << std::endl;
+ std::cout << std::endl;
+ std::cout << "Retries:" << std::endl;
+ std::cout << "      --retries=N        Resend a request up to N times after a reset, timeout or 5xx (default 2)" << std::endl;
+ std::cout << "      --retry-backoff=MS Longest wait before the first retry, doubled for each after (default 200)" << std::endl;
+ std::cout << "      --retry-budget=PCT Retries allowed as a share of requests, process-wide (default 20)" << std::endl;
+ std::cout << std::endl;
  std::cout << "Other options:" << std::endl;
  std::cout << "      --help             Display this help and exit" << std::endl;
  std::cout << "      --version          Output version information and exit" << std::endl;
@@ -71,10 +171,789 @@ void print_usage()
  std::cout << std::endl;
  std::cout << "  " << PROGRAM_NAME << " -h 192.168.1.1 -p admin -W" << std::endl;
  std::cout << "    Show total power consumption" << std::endl;
+ std::cout << std::endl;
+ std::cout << "  " << PROGRAM_NAME << " -h 192.168.1.1 -p admin -S --watch=5 --format=influx" << std::endl;
+ std::cout << "    Stream InfluxDB line protocol every 5 seconds" << std::endl;
+ std::cout << std::endl;
+ std::cout << "  " << PROGRAM_NAME << " -h 192.168.1.1 -p admin -P 4 --capture=5 --precycle=3000 --format=csv" << std::endl;
+ std::cout << "    Record port 4's power curve for 5 seconds after powering it up from off" << std::endl;
+ std::cout << std::endl;
+ std::cout << "  " << PROGRAM_NAME << " -h 192.168.1.1 -p admin --daemon --schedule=/etc/gs308ep.schedule" << std::endl;
+ std::cout << "    Run scheduled actions such as 'daily 22:00 off 5' or 'weekly sun 03:00 cycle 2'" << std::endl;
+}
+
+static bool parse_flush_policy(const std::string &name, FlushPolicy &policy)
+{
+ if (name == "line")
+ {
+  policy = FlushPolicy::Line;
+ }
+ else if (name == "sample")
+ {
+  policy = FlushPolicy::Sample;
+ }
+ else if (name == "buffer")
+ {
+  policy = FlushPolicy::Buffer;
+ }
+ else
+ {
+  return false;
+ }
+ return true;
+}
+
+// Quote a string for JSON output
+static std::string json_string(const std::string &value)
+{
+ std::string out = "\"";
+ for (char c : value)
+ {
+  if (c == '"' || c == '\\')
+  {
+   out += '\\';
+  }
+  if (static_cast<unsigned char>(c) >= 0x20)
+  {
+   out += c;
+  }
+ }
+ out += '"';
+ return out;
+}
+
+// A percentile as the user gave it, so 99.9 stays "99.9" rather than rounding to 100
+static std::string percentile_label(double percentile)
+{
+ char label[32];
+ std::snprintf(label, sizeof(label), "%g", percentile);
+ return label;
+}
+
+// Optional consumers of every polled sample
+struct PollHooks
+{
+ StatsWriter *writer;
+ LoadShedder *shedder;
+ BaselineTracker *baselines;
+ SnapshotPublisher *snapshot;
+ HistoryWriter *history;
+};
+
+// Poll statistics repeatedly, writing each sample in the selected format.
+// A count of zero means run until SIGINT/SIGTERM.
+static bool run_stats_stream(GS308EP_CLI &controller, const PollHooks &hooks, bool json, bool quiet,
+                             int intervalSec, long count)
+{
+ std::vector<PoEPortStats> stats;
+ auto next = std::chrono::steady_clock::now();
+ bool success = false;
+ HistoryWriter *history = hooks.history;
+
+ for (long sample = 0; !stop_requested && (count == 0 || sample < count); sample++)
+ {
+  int64_t timestampNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            std::chrono::system_clock::now().time_since_epoch())
+                            .count();
+  success = controller.pollAllStats(stats);
+
+  // React to the sample before spending time on output
+  if (success && hooks.shedder)
+  {
+   hooks.shedder->enforce(controller, stats);
+  }
+
+  if (success && hooks.snapshot)
+  {
+   hooks.snapshot->publish(timestampNs, stats);
+  }
+
+  if (success && history && !history->append(timestampNs / 1000000, stats))
+  {
+   std::cerr << "Error: Failed to append to the history file" << std::endl;
+   history = nullptr;
+  }
+
+  if (success && hooks.baselines)
+  {
+   hooks.baselines->observe(controller.host(), stats);
+  }
+
+  if (success && hooks.writer)
+  {
+   if (!hooks.writer->writeSample(controller.host(), timestampNs, stats))
+   {
+    // Downstream consumer went away
+    break;
+   }
+  }
+  else if (success)
+  {
+   controller.outputAllStats(stats, json, quiet);
+  }
+
+  if (intervalSec <= 0 || (count != 0 && sample + 1 >= count))
+  {
+   break;
+  }
+
+  // Schedule against a fixed cadence so slow polls do not accumulate drift.
+  // A poll that overran the interval restarts the cadence from now, rather
+  // than firing the missed samples back-to-back.
+  next += std::chrono::seconds(intervalSec);
+  auto now = std::chrono::steady_clock::now();
+  if (next < now)
+  {
+   next = now;
+  }
+  while (!stop_requested && std::chrono::steady_clock::now() < next)
+  {
+   std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  }
+ }
+
+ if (hooks.writer)
+ {
+  hooks.writer->finish();
+ }
+ return success;
+}
+
+// Answer a read-only query from the shared-memory snapshot, without contacting the switch
+static bool run_cached_query(const std::string &host, bool showStatus, bool showPower, bool showTotalPower, int port,
+                             const std::string &format, FlushPolicy flushPolicy, bool json, bool quiet)
+{
+ Snapshot snapshot;
+ std::string message;
+ if (!readSnapshot(host, snapshot, message))
+ {
+  std::cerr << "Error: " << message << std::endl;
+  return false;
+ }
+
+ if (!snapshot.writerAlive && !quiet)
+ {
+  std::cerr << "[WARN] Snapshot for " << host << " is stale: its poller is no longer running" << std::endl;
+ }
+
+ const PoEPortStats *portStats = nullptr;
+ for (const auto &stats : snapshot.stats)
+ {
+  if (stats.port == port)
+  {
+   portStats = &stats;
+  }
+ }
+
+ if (showStatus || showPower)
+ {
+  if (!portStats)
+  {
+   std::cerr << "Error: Port " << port << " is not in the snapshot" << std::endl;
+   return false;
+  }
+  if (showStatus)
+  {
+   GS308EP_CLI::outputPortStatus(port, portStats->enabled, json, quiet);
+  }
+  else
+  {
+   GS308EP_CLI::outputPortPower(port, portStats->power, json, quiet);
+  }
+  return true;
+ }
+
+ if (showTotalPower)
+ {
+  float total = 0.0f;
+  for (const auto &stats : snapshot.stats)
+  {
+   total += stats.power;
+  }
+  GS308EP_CLI::outputTotalPower(total, json, quiet);
+  return true;
+ }
+
+ std::unique_ptr<StatsWriter> writer;
+ if (format == "influx")
+ {
+  writer.reset(new InfluxWriter(STDOUT_FILENO, flushPolicy));
+ }
+ else if (format == "csv")
+ {
+  writer.reset(new CsvWriter(STDOUT_FILENO, flushPolicy));
+ }
+
+ if (writer)
+ {
+  bool written = writer->writeSample(snapshot.host, snapshot.timestampNs, snapshot.stats);
+  return writer->finish() && written;
+ }
+ GS308EP_CLI::outputAllStats(snapshot.stats, json, quiet);
+ return true;
+}
+
+// Write a whole report with one call, so reports of several collectors appending to one file do not interleave
+static bool write_report(int fd, const std::string &output)
+{
+ size_t written = 0;
+ while (written < output.size())
+ {
+  ssize_t n = write(fd, output.data() + written, output.size() - written);
+  if (n < 0 && errno == EINTR)
+  {
+   continue;
+  }
+  if (n <= 0)
+  {
+   return false;
+  }
+  written += static_cast<size_t>(n);
+ }
+ return true;
+}
+
+// Sweep a fleet of switches, reporting group aggregates after every sweep.
+// With a membership, only the switches this collector owns are polled.
+static bool run_fleet(const std::vector<FleetSwitch> &switches, const std::string &format, size_t workers,
+                      size_t parsers, size_t hottest, int intervalSec, long count, bool verbose,
+                      ShardMembership *shard, const PollScheduleOptions *spread, int outputFd, RetryPolicy &retry)
+{
+ FleetAggregator aggregator(switches, hottest);
+ FleetPoller poller(switches, workers, parsers, verbose);
+ poller.setRetryPolicy(&retry);
+ FleetReport report;
+ report.switches = static_cast<uint32_t>(switches.size());
+ std::string output;
+ bool success = false;
+
+ std::unique_ptr<ShardPlanner> planner;
+ std::vector<uint8_t> owned;
+ uint64_t seenVersion = UINT64_MAX;
+ if (shard)
+ {
+  std::vector<std::string> hosts;
+  for (const auto &entry : switches)
+  {
+   hosts.push_back(entry.host);
+  }
+  planner.reset(new ShardPlanner(shard->options().self, hosts, std::chrono::milliseconds(shard->options().graceMs())));
+  report.collector = shard->options().self;
+  shard->awaitJoin(stop_requested);
+ }
+ auto next = std::chrono::steady_clock::now();
+
+ std::unique_ptr<PollSchedule> schedule;
+ uint32_t plannedBudget = 0;
+ if (spread)
+ {
+  schedule.reset(new PollSchedule(switches, *spread));
+
+  // Intervals start on wall-clock multiples, so every collector's phases and epochs line up
+  auto sinceEpoch = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::system_clock::now().time_since_epoch());
+  next += spread->interval - sinceEpoch % spread->interval;
+  while (!stop_requested && std::chrono::steady_clock::now() < next)
+  {
+   std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  }
+ }
+
+ for (long sweep = 0; !stop_requested && (count == 0 || sweep < count); sweep++)
+ {
+  if (planner)
+  {
+   uint64_t version = 0;
+   std::vector<std::string> live = shard->live(&version);
+   size_t mine = planner->plan(live, owned);
+   report.switches = 0;
+   for (size_t i = 0; i < owned.size(); i++)
+   {
+    aggregator.setActive(i, owned[i] != 0);
+    report.switches += owned[i];
+   }
+   if (verbose && version != seenVersion)
+   {
+    std::cerr << "[INFO] " << live.size() << " collectors live; this one owns " << mine << " of "
+              << switches.size() << " switches" << std::endl;
+   }
+   seenVersion = version;
+  }
+  if (schedule)
+  {
+   schedule->plan(planner ? &owned : nullptr);
+   if (verbose && schedule->budget() != plannedBudget)
+   {
+    std::cerr << "[INFO] Spreading polls over " << schedule->ticks() << " ticks of " << schedule->tick().count()
+              << " ms, at most " << schedule->budget() << " per tick; " << schedule->synchronisedCount()
+              << " synchronised" << std::endl;
+   }
+   plannedBudget = schedule->budget();
+  }
+
+  report.timestampNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                           std::chrono::system_clock::now().time_since_epoch())
+                           .count();
+  auto started = std::chrono::steady_clock::now();
+  AllocationCounts before = allocationCounts();
+  if (schedule)
+  {
+   poller.sweep(aggregator, report, *schedule, next, stop_requested);
+  }
+  else
+  {
+   poller.sweep(aggregator, report, planner ? &owned : nullptr);
+  }
+  report.sweepMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count();
+  // A collector may own nothing while others cover the fleet
+  success = report.reporting > 0 || (planner && report.switches == 0);
+
+  aggregator.snapshot(report.groups);
+  AllocationCounts after = allocationCounts();
+  report.allocations.heap = after.heap - before.heap;
+  report.allocations.curl = after.curl - before.curl;
+
+  formatFleetReport(report, format, output);
+  if (outputFd >= 0)
+  {
+   if (!write_report(outputFd, output))
+   {
+    std::cerr << "Error: Cannot write report: " << std::strerror(errno) << std::endl;
+    return false;
+   }
+  }
+  else
+  {
+   std::cout << output << std::flush;
+   if (!std::cout)
+   {
+    break;
+   }
+  }
+
+  if (intervalSec <= 0 || (count != 0 && sweep + 1 >= count))
+  {
+   break;
+  }
+
+  // A sweep that overran skips the intervals it missed instead of starting
+  // the next sweeps back-to-back; whole intervals keep --spread's alignment
+  auto interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::seconds(intervalSec));
+  next += interval;
+  auto now = std::chrono::steady_clock::now();
+  if (next < now)
+  {
+   next += (now - next) / interval * interval + interval;
+  }
+  while (!stop_requested && std::chrono::steady_clock::now() < next)
+  {
+   std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  }
+ }
+ return success;
+}
+
+void print_query_usage()
+{
+ std::cout << "Usage: " << PROGRAM_NAME << " query [OPTIONS] FILE..." << std::endl;
+ std::cout << std::endl;
+ std::cout << "Aggregate history files written with --record, one series per port (or per switch)." << std::endl;
+ std::cout << std::endl;
+ std::cout << "      --from=TIME        Start of the range, inclusive (default: beginning)" << std::endl;
+ std::cout << "      --to=TIME          End of the range, exclusive (default: end)" << std::endl;
+ std::cout << "                         TIME is now, -30m, -12h, -7d, epoch seconds or YYYY-MM-DD[THH:MM[:SS]]" << std::endl;
+ std::cout << "      --ports=LIST       Only these ports, e.g. 1,2,5 (default all)" << std::endl;
+ std::cout << "      --metric=NAME      power, current, voltage or temperature (default power)" << std::endl;
+ std::cout << "      --per=port|switch  One series per port (default) or per switch" << std::endl;
+ std::cout << "      --percentiles=LIST Also report percentiles, e.g. 50,95,99" << std::endl;
+ std::cout << "      --above=VALUE      Report time spent above VALUE" << std::endl;
+ std::cout << "      --top=K            Keep the K series with the most energy" << std::endl;
+ std::cout << "  -j, --json             Output in JSON format" << std::endl;
+ std::cout << "      --help             Display this help and exit" << std::endl;
+}
+
+// gs308ep query: answer aggregations from mapped history files
+static int run_query_command(int argc, char *argv[])
+{
+ HistoryQuery query;
+ bool json = false;
+
+ static struct option query_options[] = {
+     {"from", required_argument, 0, 1},
+     {"to", required_argument, 0, 2},
+     {"ports", required_argument, 0, 3},
+     {"metric", required_argument, 0, 4},
+     {"per", required_argument, 0, 5},
+     {"percentiles", required_argument, 0, 6},
+     {"above", required_argument, 0, 7},
+     {"top", required_argument, 0, 8},
+     {"json", no_argument, 0, 'j'},
+     {"help", no_argument, 0, 9},
+     {0, 0, 0, 0}};
+
+ int c;
+ while ((c = getopt_long(argc, argv, "j", query_options, nullptr)) != -1)
+ {
+  switch (c)
+  {
+  case 1: // --from
+  case 2: // --to
+   if (!parseHistoryTime(optarg, c == 1 ? query.fromMs : query.toMs))
+   {
+    std::cerr << "Error: Invalid time '" << optarg << "'" << std::endl;
+    return 1;
+   }
+   break;
+  case 3: // --ports
+  {
+   std::vector<int> ports;
+   if (!parseShedOrder(optarg, ports))
+   {
+    std::cerr << "Error: Invalid port list '" << optarg << "'" << std::endl;
+    return 1;
+   }
+   for (int port : ports)
+   {
+    query.portMask |= static_cast<uint8_t>(1u << (port - 1));
+   }
+   break;
+  }
+  case 4: // --metric
+   if (!parseHistoryMetric(optarg, query.metric))
+   {
+    std::cerr << "Error: Unknown metric '" << optarg << "'" << std::endl;
+    return 1;
+   }
+   break;
+  case 5: // --per
+   if (std::string(optarg) != "port" && std::string(optarg) != "switch")
+   {
+    std::cerr << "Error: --per must be port or switch" << std::endl;
+    return 1;
+   }
+   query.perSwitch = std::string(optarg) == "switch";
+   break;
+  case 6: // --percentiles
+  {
+   std::string list = optarg;
+   size_t start = 0;
+   while (start <= list.size())
+   {
+    size_t comma = list.find(',', start);
+    std::string item = list.substr(start, comma == std::string::npos ? std::string::npos : comma - start);
+    double percentile = std::atof(item.c_str());
+    if (item.empty() || percentile <= 0.0 || percentile > 100.0)
+    {
+     std::cerr << "Error: Percentiles must be between 0 and 100" << std::endl;
+     return 1;
+    }
+    query.percentiles.push_back(percentile);
+    if (comma == std::string::npos)
+    {
+     break;
+    }
+    start = comma + 1;
+   }
+   break;
+  }
+  case 7: // --above
+   query.hasThreshold = true;
+   query.threshold = static_cast<float>(std::atof(optarg));
+   break;
+  case 8: // --top
+   query.top = static_cast<size_t>(std::max(0, std::atoi(optarg)));
+   break;
+  case 'j':
+   json = true;
+   break;
+  case 9:
+   print_query_usage();
+   return 0;
+  default:
+   std::cerr << "Try '" << PROGRAM_NAME << " query --help' for more information." << std::endl;
+   return 1;
+  }
+ }
+
+ std::vector<std::string> paths(argv + optind, argv + argc);
+ if (paths.empty())
+ {
+  std::cerr << "Error: No history files given" << std::endl;
+  return 1;
+ }
+
+ std::vector<HistorySeries> results;
+ std::string message;
+ if (!queryHistory(paths, query, results, message))
+ {
+  std::cerr << "Error: " << message << std::endl;
+  return 1;
+ }
+
+ std::cout << std::fixed;
+ if (json)
+ {
+  std::cout << "{\"series\":[";
+  for (size_t i = 0; i < results.size(); i++)
+  {
+   const HistorySeries &series = results[i];
+   std::cout << (i ? "," : "") << "{\"host\":" << json_string(series.host);
+   if (series.port)
+   {
+    std::cout << ",\"port\":" << series.port;
+   }
+   std::cout << std::setprecision(2) << ",\"samples\":" << series.samples << ",\"min\":" << series.min
+             << ",\"avg\":" << series.mean << ",\"max\":" << series.max;
+   for (size_t p = 0; p < query.percentiles.size(); p++)
+   {
+    std::cout << ",\"p" << percentile_label(query.percentiles[p]) << "\":" << std::setprecision(2)
+              << series.percentiles[p];
+   }
+   std::cout << std::setprecision(3) << ",\"energy_wh\":" << series.energyWh;
+   if (query.hasThreshold)
+   {
+    std::cout << std::setprecision(0) << ",\"seconds_above\":" << series.secondsAbove;
+   }
+   std::cout << "}";
+  }
+  std::cout << "]}" << std::endl;
+  return 0;
+ }
+
+ std::cout << std::left << std::setw(22) << "HOST" << std::right << std::setw(5) << "PORT" << std::setw(10)
+           << "SAMPLES" << std::setw(9) << "MIN" << std::setw(9) << "AVG" << std::setw(9) << "MAX";
+ for (double percentile : query.percentiles)
+ {
+  std::cout << std::setw(8) << ("P" + percentile_label(percentile));
+ }
+ std::cout << std::setw(12) << "ENERGY_WH";
+ if (query.hasThreshold)
+ {
+  std::cout << std::setw(10) << "ABOVE_S";
+ }
+ std::cout << std::endl;
+
+ for (const auto &series : results)
+ {
+  std::cout << std::left << std::setw(22) << series.host << std::right << std::setw(5)
+            << (series.port ? std::to_string(series.port) : "all") << std::setw(10) << series.samples
+            << std::setprecision(2) << std::setw(9) << series.min << std::setw(9) << series.mean << std::setw(9)
+            << series.max;
+  for (float value : series.percentiles)
+  {
+   std::cout << std::setw(8) << value;
+  }
+  std::cout << std::setprecision(3) << std::setw(12) << series.energyWh;
+  if (query.hasThreshold)
+  {
+   std::cout << std::setprecision(0) << std::setw(10) << series.secondsAbove;
+  }
+  std::cout << std::endl;
+ }
+ return 0;
+}
+
+void print_audit_usage()
+{
+ std::cout << "Usage: " << PROGRAM_NAME << " audit [OPTIONS] FILE..." << std::endl;
+ std::cout << std::endl;
+ std::cout << "List the port changes recorded in audit logs written with --audit, oldest first." << std::endl;
+ std::cout << std::endl;
+ std::cout << "      --from=TIME        Start of the range, inclusive (default: beginning)" << std::endl;
+ std::cout << "      --to=TIME          End of the range, exclusive (default: end)" << std::endl;
+ std::cout << "                         TIME is now, -30m, -12h, -7d, epoch seconds or YYYY-MM-DD[THH:MM[:SS]]" << std::endl;
+ std::cout << "      --host=LIST        Only these switches, e.g. 10.0.0.2,10.0.0.3 (default all)" << std::endl;
+ std::cout << "      --ports=LIST       Only these ports, e.g. 1,2,5 (default all)" << std::endl;
+ std::cout << "  -j, --json             Output in JSON format" << std::endl;
+ std::cout << "      --help             Display this help and exit" << std::endl;
+}
+
+static const char *audit_state_name(uint8_t state)
+{
+ return state == AUDIT_STATE_ON ? "on" : state == AUDIT_STATE_OFF ? "off" : "unknown";
+}
+
+static const char *audit_source_name(uint8_t source)
+{
+ static const char *names[] = {"command", "schedule", "socket", "shedder", "capture"};
+ return source < sizeof(names) / sizeof(names[0]) ? names[source] : "unknown";
+}
+
+static std::string audit_user_name(uint32_t uid)
+{
+ struct passwd entry;
+ struct passwd *found = nullptr;
+ char buffer[1024];
+ if (getpwuid_r(static_cast<uid_t>(uid), &entry, buffer, sizeof(buffer), &found) == 0 && found)
+ {
+  return found->pw_name;
+ }
+ return std::to_string(uid);
+}
+
+// gs308ep audit: filter mapped audit logs by switch, port and time
+static int run_audit_command(int argc, char *argv[])
+{
+ AuditFilter filter;
+ bool json = false;
+
+ static struct option audit_options[] = {
+     {"from", required_argument, 0, 1},
+     {"to", required_argument, 0, 2},
+     {"host", required_argument, 0, 3},
+     {"ports", required_argument, 0, 4},
+     {"json", no_argument, 0, 'j'},
+     {"help", no_argument, 0, 5},
+     {0, 0, 0, 0}};
+
+ int c;
+ while ((c = getopt_long(argc, argv, "j", audit_options, nullptr)) != -1)
+ {
+  switch (c)
+  {
+  case 1: // --from
+  case 2: // --to
+   if (!parseHistoryTime(optarg, c == 1 ? filter.fromMs : filter.toMs))
+   {
+    std::cerr << "Error: Invalid time '" << optarg << "'" << std::endl;
+    return 1;
+   }
+   break;
+  case 3: // --host
+  {
+   std::string list = optarg;
+   size_t start = 0;
+   while (start <= list.size())
+   {
+    size_t comma = list.find(',', start);
+    std::string host = list.substr(start, comma == std::string::npos ? std::string::npos : comma - start);
+    if (host.empty())
+    {
+     std::cerr << "Error: Invalid host list '" << optarg << "'" << std::endl;
+     return 1;
+    }
+    filter.hosts.push_back(host);
+    if (comma == std::string::npos)
+    {
+     break;
+    }
+    start = comma + 1;
+   }
+   break;
+  }
+  case 4: // --ports
+  {
+   std::vector<int> ports;
+   if (!parseShedOrder(optarg, ports))
+   {
+    std::cerr << "Error: Invalid port list '" << optarg << "'" << std::endl;
+    return 1;
+   }
+   for (int port : ports)
+   {
+    filter.portMask |= static_cast<uint8_t>(1u << (port - 1));
+   }
+   break;
+  }
+  case 'j':
+   json = true;
+   break;
+  case 5:
+   print_audit_usage();
+   return 0;
+  default:
+   std::cerr << "Try '" << PROGRAM_NAME << " audit --help' for more information." << std::endl;
+   return 1;
+  }
+ }
+
+ std::vector<std::string> paths(argv + optind, argv + argc);
+ if (paths.empty())
+ {
+  std::cerr << "Error: No audit logs given" << std::endl;
+  return 1;
+ }
+
+ std::vector<AuditRecord> records;
+ size_t corrupt = 0;
+ std::string message;
+ if (!queryAudit(paths, filter, records, corrupt, message))
+ {
+  std::cerr << "Error: " << message << std::endl;
+  return 1;
+ }
+ if (corrupt)
+ {
+  std::cerr << "[WARN] Skipped " << corrupt << " records that failed their checksum" << std::endl;
+ }
+
+ std::cout << std::fixed << std::setprecision(1);
+ if (json)
+ {
+  std::cout << "{\"actions\":[";
+  for (size_t i = 0; i < records.size(); i++)
+  {
+   const AuditRecord &record = records[i];
+   std::cout << (i ? "," : "") << "{\"timestamp_ms\":" << record.timestampMs << ",\"host\":" << json_string(record.host)
+             << ",\"port\":" << static_cast<int>(record.port) << ",\"action\":\""
+             << (record.enable ? "on" : "off") << "\",\"before\":\"" << audit_state_name(record.before)
+             << "\",\"after\":\"" << audit_state_name(record.after)
+             << "\",\"success\":" << (record.success ? "true" : "false")
+             << ",\"latency_ms\":" << record.latencyUs / 1000.0 << ",\"source\":\""
+             << audit_source_name(record.source) << "\",\"uid\":" << record.uid << ",\"pid\":" << record.pid;
+   if (record.actionId)
+   {
+    std::cout << ",\"action_id\":" << record.actionId;
+   }
+   std::cout << "}";
+  }
+  std::cout << "]}" << std::endl;
+  return 0;
+ }
+
+ std::cout << std::left << std::setw(24) << "TIME" << std::setw(22) << "HOST" << std::right << std::setw(5) << "PORT"
+           << std::setw(7) << "ACTION" << std::setw(9) << "BEFORE" << std::setw(9) << "AFTER" << std::setw(8)
+           << "RESULT" << std::setw(12) << "LATENCY_MS" << "  " << std::left << std::setw(10) << "SOURCE"
+           << std::setw(12) << "USER" << std::right << std::setw(8) << "PID" << std::setw(6) << "ID" << std::endl;
+
+ std::map<uint32_t, std::string> users;
+ for (const auto &record : records)
+ {
+  time_t seconds = static_cast<time_t>(record.timestampMs / 1000);
+  struct tm local;
+  localtime_r(&seconds, &local);
+  char when[32];
+  size_t length = strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", &local);
+  std::snprintf(when + length, sizeof(when) - length, ".%03d", static_cast<int>(record.timestampMs % 1000));
+
+  auto user = users.find(record.uid);
+  if (user == users.end())
+  {
+   user = users.emplace(record.uid, audit_user_name(record.uid)).first;
+  }
+
+  std::cout << std::left << std::setw(24) << when << std::setw(22) << record.host << std::right << std::setw(5)
+            << static_cast<int>(record.port) << std::setw(7) << (record.enable ? "on" : "off") << std::setw(9)
+            << audit_state_name(record.before) << std::setw(9) << audit_state_name(record.after) << std::setw(8)
+            << (record.success ? "ok" : "FAILED") << std::setw(12) << record.latencyUs / 1000.0 << "  "
+            << std::left << std::setw(10) << audit_source_name(record.source) << std::setw(12) << user->second
+            << std::right << std::setw(8) << record.pid << std::setw(6)
+            << (record.actionId ? std::to_string(record.actionId) : "-") << std::endl;
+ }
+ return 0;
 }
 
 int main(int argc, char *argv[])
 {
+ if (argc > 1 && std::string(argv[1]) == "query")
+ {
+  return run_query_command(argc - 1, argv + 1);
+ }
+ if (argc > 1 && std::string(argv[1]) == "audit")
+ {
+  return run_audit_command(argc - 1, argv + 1);
+ }
+
  std::string host;
  std::string password;
  int port = -1;
@@ -86,7 +965,34 @@ int main(int argc, char *argv[])
  bool show_power = false;
  bool show_total_power = false;
  bool show_stats = false;
+ bool capture = false;
+ CaptureOptions capture_options = {-1, 10000, -1};
  bool json_output = false;
+ std::string format = "text";
+ FlushPolicy flush_policy = FlushPolicy::Sample;
+ int watch_interval = 0;
+ long watch_count = 0;
+ bool daemon_mode = false;
+ std::string schedule_path;
+ std::string socket_path;
+ int session_timeout = 0;
+ bool cached = false;
+ std::string record_path;
+ std::string audit_path;
+ int audit_delay_ms = 100;
+ int deadline_ms = 0;
+ RetryOptions retry_options;
+ std::string fleet_path;
+ int fleet_workers = 16;
+ int fleet_parsers = 2;
+ int fleet_hottest = 3;
+ std::string fleet_output;
+ ShardOptions shard_options;
+ bool fleet_spread = false;
+ PollScheduleOptions schedule_options;
+ LoadShedConfig shed_config;
+ BaselineConfig baseline_config;
+ bool detect_anomalies = false;
  bool quiet = false;
  bool verbose = false;
 
@@ -119,6 +1025,40 @@ int main(int argc, char *argv[])
      {"verbose", no_argument, 0, 'v'},
      {"help", no_argument, 0, 0},
      {"version", no_argument, 0, 1},
+     {"format", required_argument, 0, 2},
+     {"watch", optional_argument, 0, 3},
+     {"count", required_argument, 0, 4},
+     {"flush", required_argument, 0, 5},
+     {"daemon", no_argument, 0, 6},
+     {"schedule", required_argument, 0, 7},
+     {"socket", required_argument, 0, 8},
+     {"shed-at", required_argument, 0, 9},
+     {"restore-at", required_argument, 0, 10},
+     {"shed-order", required_argument, 0, 11},
+     {"budget", required_argument, 0, 12},
+     {"anomaly", optional_argument, 0, 13},
+     {"baseline-window", required_argument, 0, 14},
+     {"session-timeout", required_argument, 0, 15},
+     {"cached", no_argument, 0, 16},
+     {"record", required_argument, 0, 17},
+     {"fleet", required_argument, 0, 18},
+     {"workers", required_argument, 0, 19},
+     {"hottest", required_argument, 0, 20},
+     {"parsers", required_argument, 0, 21},
+     {"capture", optional_argument, 0, 22},
+     {"precycle", required_argument, 0, 23},
+     {"audit", required_argument, 0, 24},
+     {"audit-delay", required_argument, 0, 25},
+     {"output", required_argument, 0, 26},
+     {"collector", required_argument, 0, 27},
+     {"peers", required_argument, 0, 28},
+     {"collector-timeout", required_argument, 0, 29},
+     {"deadline", required_argument, 0, 30},
+     {"retries", required_argument, 0, 31},
+     {"retry-backoff", required_argument, 0, 32},
+     {"retry-budget", required_argument, 0, 33},
+     {"spread", optional_argument, 0, 34},
+     {"sync-tag", required_argument, 0, 35},
      {0, 0, 0, 0}};
 
  int option_index = 0;
@@ -128,12 +1068,285 @@ int main(int argc, char *argv[])
  {
   switch (c)
   {
-  case 0: // --help
-   print_usage();
-   return 0;
-  case 1: // --version
-   print_version();
-   return 0;
+  case 0: // --help
+   print_usage();
+   return 0;
+  case 1: // --version
+   print_version();
+   return 0;
+  case 2: // --format
+   format = optarg;
+   if (format != "text" && format != "json" && format != "influx" && format != "csv")
+   {
+    std::cerr << "Error: Unknown format '" << format << "' (expected text, json, influx or csv)" << std::endl;
+    return 1;
+   }
+   // Whichever of -j and --format comes last decides
+   json_output = format == "json";
+   break;
+  case 3: // --watch
+   watch_interval = optarg ? std::atoi(optarg) : 10;
+   if (watch_interval <= 0)
+   {
+    std::cerr << "Error: Watch interval must be positive" << std::endl;
+    return 1;
+   }
+   break;
+  case 4: // --count
+   watch_count = std::atol(optarg);
+   if (watch_count <= 0)
+   {
+    std::cerr << "Error: Count must be positive" << std::endl;
+    return 1;
+   }
+   break;
+  case 5: // --flush
+   if (!parse_flush_policy(optarg, flush_policy))
+   {
+    std::cerr << "Error: Unknown flush policy '" << optarg << "' (expected line, sample or buffer)" << std::endl;
+    return 1;
+   }
+   break;
+  case 6: // --daemon
+   daemon_mode = true;
+   break;
+  case 7: // --schedule
+   schedule_path = optarg;
+   break;
+  case 8: // --socket
+   socket_path = optarg;
+   break;
+  case 16: // --cached
+   cached = true;
+   break;
+  case 17: // --record
+   record_path = optarg;
+   break;
+  case 18: // --fleet
+   fleet_path = optarg;
+   break;
+  case 19: // --workers
+   fleet_workers = std::atoi(optarg);
+   if (fleet_workers < 1)
+   {
+    std::cerr << "Error: --workers must be at least 1" << std::endl;
+    return 1;
+   }
+   break;
+  case 21: // --parsers
+   fleet_parsers = std::atoi(optarg);
+   if (fleet_parsers < 1)
+   {
+    std::cerr << "Error: --parsers must be at least 1" << std::endl;
+    return 1;
+   }
+   break;
+  case 22: // --capture
+   capture = true;
+   if (optarg)
+   {
+    double seconds = std::atof(optarg);
+    if (seconds <= 0.0 || seconds > 3600.0)
+    {
+     std::cerr << "Error: Capture duration must be between 0 and 3600 seconds" << std::endl;
+     return 1;
+    }
+    capture_options.durationMs = static_cast<int>(seconds * 1000.0);
+   }
+   break;
+  case 23: // --precycle
+   capture_options.precycleMs = std::atoi(optarg);
+   if (capture_options.precycleMs < 0)
+   {
+    std::cerr << "Error: --precycle must be non-negative" << std::endl;
+    return 1;
+   }
+   break;
+  case 24: // --audit
+   audit_path = optarg;
+   break;
+  case 25: // --audit-delay
+   audit_delay_ms = std::atoi(optarg);
+   if (audit_delay_ms < 0)
+   {
+    std::cerr << "Error: --audit-delay must be non-negative" << std::endl;
+    return 1;
+   }
+   break;
+  case 30: // --deadline
+   deadline_ms = std::atoi(optarg);
+   if (deadline_ms <= 0)
+   {
+    std::cerr << "Error: --deadline must be positive" << std::endl;
+    return 1;
+   }
+   break;
+  case 31: // --retries
+   retry_options.retries = std::atoi(optarg);
+   if (retry_options.retries < 0 || retry_options.retries > 10)
+   {
+    std::cerr << "Error: --retries must be between 0 and 10" << std::endl;
+    return 1;
+   }
+   break;
+  case 32: // --retry-backoff
+   retry_options.backoff = std::chrono::milliseconds(std::atoi(optarg));
+   if (retry_options.backoff.count() <= 0)
+   {
+    std::cerr << "Error: --retry-backoff must be positive" << std::endl;
+    return 1;
+   }
+   retry_options.maxBackoff = std::max(retry_options.maxBackoff, retry_options.backoff);
+   break;
+  case 33: // --retry-budget
+   retry_options.budgetRatio = std::atof(optarg) / 100.0;
+   if (retry_options.budgetRatio < 0 || retry_options.budgetRatio > 1)
+   {
+    std::cerr << "Error: --retry-budget must be between 0 and 100" << std::endl;
+    return 1;
+   }
+   break;
+  case 34: // --spread
+   fleet_spread = true;
+   if (optarg)
+   {
+    schedule_options.tick = std::chrono::milliseconds(std::atoi(optarg));
+    if (schedule_options.tick.count() < 10)
+    {
+     std::cerr << "Error: --spread tick must be at least 10 ms" << std::endl;
+     return 1;
+    }
+   }
+   break;
+  case 35: // --sync-tag
+  {
+   std::string list = optarg;
+   size_t start = 0;
+   while (start < list.size())
+   {
+    size_t comma = list.find(',', start);
+    std::string tag = list.substr(start, comma == std::string::npos ? std::string::npos : comma - start);
+    if (!tag.empty())
+    {
+     schedule_options.syncTags.push_back(tag);
+    }
+    if (comma == std::string::npos)
+    {
+     break;
+    }
+    start = comma + 1;
+   }
+   break;
+  }
+  case 26: // --output
+   fleet_output = optarg;
+   break;
+  case 27: // --collector
+   shard_options.self = optarg;
+   break;
+  case 28: // --peers
+  {
+   std::string list = optarg;
+   size_t start = 0;
+   while (start < list.size())
+   {
+    size_t comma = list.find(',', start);
+    std::string peer = list.substr(start, comma == std::string::npos ? std::string::npos : comma - start);
+    if (!peer.empty())
+    {
+     shard_options.seeds.push_back(peer);
+    }
+    if (comma == std::string::npos)
+    {
+     break;
+    }
+    start = comma + 1;
+   }
+   break;
+  }
+  case 29: // --collector-timeout
+   shard_options.timeoutMs = std::atoi(optarg);
+   if (shard_options.timeoutMs < 300)
+   {
+    std::cerr << "Error: --collector-timeout must be at least 300 ms" << std::endl;
+    return 1;
+   }
+   break;
+  case 20: // --hottest
+   fleet_hottest = std::atoi(optarg);
+   if (fleet_hottest < 0)
+   {
+    std::cerr << "Error: --hottest must not be negative" << std::endl;
+    return 1;
+   }
+   break;
+  case 15: // --session-timeout
+   session_timeout = std::atoi(optarg);
+   if (session_timeout < 10)
+   {
+    std::cerr << "Error: --session-timeout must be at least 10 seconds" << std::endl;
+    return 1;
+   }
+   break;
+  case 9: // --shed-at
+   shed_config.shedPercent = std::atof(optarg);
+   if (shed_config.shedPercent <= 0.0f || shed_config.shedPercent > 100.0f)
+   {
+    std::cerr << "Error: --shed-at must be between 0 and 100" << std::endl;
+    return 1;
+   }
+   break;
+  case 10: // --restore-at
+  {
+   // Zero would mean "use the default", so it is rejected along with anything that is not a number
+   char *end = nullptr;
+   shed_config.restorePercent = std::strtof(optarg, &end);
+   if (end == optarg || *end != '\0' || !(shed_config.restorePercent > 0.0f))
+   {
+    std::cerr << "Error: --restore-at must be a percentage above 0 and below --shed-at" << std::endl;
+    return 1;
+   }
+   break;
+  }
+  case 11: // --shed-order
+   if (!parseShedOrder(optarg, shed_config.shedOrder))
+   {
+    std::cerr << "Error: --shed-order must be a comma-separated list of distinct ports 1-8" << std::endl;
+    return 1;
+   }
+   break;
+  case 12: // --budget
+   shed_config.budgetWatts = std::atof(optarg);
+   if (shed_config.budgetWatts <= 0.0f)
+   {
+    std::cerr << "Error: --budget must be positive" << std::endl;
+    return 1;
+   }
+   break;
+  case 13: // --anomaly
+   detect_anomalies = true;
+   if (optarg)
+   {
+    float percent = std::atof(optarg);
+    if (percent <= 0.0f)
+    {
+     std::cerr << "Error: --anomaly threshold must be positive" << std::endl;
+     return 1;
+    }
+    baseline_config.relativeThreshold = percent / 100.0f;
+   }
+   break;
+  case 14: // --baseline-window
+  {
+   int samples = std::atoi(optarg);
+   if (samples < 2)
+   {
+    std::cerr << "Error: --baseline-window must be at least 2 samples" << std::endl;
+    return 1;
+   }
+   baseline_config.setWindow(static_cast<uint32_t>(samples));
+   break;
+  }
   case 'h':
    host = optarg;
    break;
@@ -180,6 +1393,7 @@ int main(int argc, char *argv[])
    break;
   case 'j':
    json_output = true;
+   format = "json";
    break;
   case 'q':
    quiet = true;
@@ -195,6 +1409,102 @@ int main(int argc, char *argv[])
   }
  }
 
+ if (!fleet_path.empty())
+ {
+  if (!show_stats || turn_on || turn_off || cycle || show_status || show_power || show_total_power || daemon_mode)
+  {
+   std::cerr << "Error: --fleet works with --stats only" << std::endl;
+   return 1;
+  }
+  if (cached || !record_path.empty() || !audit_path.empty() || shed_config.enabled() || detect_anomalies)
+  {
+   std::cerr << "Error: --fleet cannot be combined with --cached, --record, --audit, --shed-at or --anomaly"
+             << std::endl;
+   return 1;
+  }
+  if (format == "csv")
+  {
+   std::cerr << "Error: --fleet supports text, json and influx output" << std::endl;
+   return 1;
+  }
+
+  std::vector<FleetSwitch> switches;
+  std::string message;
+  if (!loadFleet(fleet_path, password, switches, message))
+  {
+   std::cerr << "Error: " << message << std::endl;
+   return 1;
+  }
+
+  if (!shard_options.seeds.empty() && shard_options.self.empty())
+  {
+   std::cerr << "Error: --peers requires --collector" << std::endl;
+   return 1;
+  }
+  if (!schedule_options.syncTags.empty() && !fleet_spread)
+  {
+   std::cerr << "Error: --sync-tag requires --spread" << std::endl;
+   return 1;
+  }
+  if (fleet_spread)
+  {
+   if (watch_interval <= 0)
+   {
+    std::cerr << "Error: --spread requires --watch" << std::endl;
+    return 1;
+   }
+   schedule_options.interval = std::chrono::seconds(watch_interval);
+   if (schedule_options.tick > schedule_options.interval)
+   {
+    std::cerr << "Error: --spread tick must not exceed the --watch interval" << std::endl;
+    return 1;
+   }
+  }
+
+  int output_fd = -1;
+  if (!fleet_output.empty())
+  {
+   output_fd = open(fleet_output.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+   if (output_fd < 0)
+   {
+    std::cerr << "Error: Cannot open " << fleet_output << ": " << std::strerror(errno) << std::endl;
+    return 1;
+   }
+  }
+
+  std::unique_ptr<ShardMembership> shard;
+  if (!shard_options.self.empty())
+  {
+   shard_options.verbose = verbose;
+   shard.reset(new ShardMembership());
+   if (!shard->start(shard_options, message))
+   {
+    std::cerr << "Error: " << message << std::endl;
+    return 1;
+   }
+  }
+
+  std::signal(SIGINT, handle_stop_signal);
+  std::signal(SIGTERM, handle_stop_signal);
+  std::signal(SIGPIPE, SIG_IGN);
+  RetryPolicy retry(retry_options, verbose);
+  bool swept = run_fleet(switches, format, static_cast<size_t>(fleet_workers), static_cast<size_t>(fleet_parsers),
+                         static_cast<size_t>(fleet_hottest), watch_interval, watch_count, verbose, shard.get(),
+                         fleet_spread ? &schedule_options : nullptr, output_fd, retry);
+  if (output_fd >= 0)
+  {
+   close(output_fd);
+  }
+  return swept ? 0 : 1;
+ }
+
+ if (!fleet_output.empty() || !shard_options.self.empty() || !shard_options.seeds.empty() || fleet_spread ||
+     !schedule_options.syncTags.empty())
+ {
+  std::cerr << "Error: --output, --collector, --peers, --spread and --sync-tag require --fleet" << std::endl;
+  return 1;
+ }
+
  // Validate required arguments
  if (host.empty())
  {
@@ -203,7 +1513,7 @@ int main(int argc, char *argv[])
   return 1;
  }
 
- if (password.empty())
+ if (password.empty() && !cached)
  {
   std::cerr << "Error: Switch password is required (use --password or GS308EP_PASSWORD)" << std::endl;
   std::cerr << "Try '" << PROGRAM_NAME << " --help' for more information." << std::endl;
@@ -211,7 +1521,8 @@ int main(int argc, char *argv[])
  }
 
  // Validate action combinations
- int action_count = turn_on + turn_off + cycle + show_status + show_power + show_total_power + show_stats;
+ int action_count =
+     turn_on + turn_off + cycle + show_status + show_power + show_total_power + show_stats + daemon_mode + capture;
  if (action_count == 0)
  {
   std::cerr << "Error: No action specified" << std::endl;
@@ -226,34 +1537,272 @@ int main(int argc, char *argv[])
  }
 
  // Port-specific actions require port number
- if ((turn_on || turn_off || cycle || show_status || show_power) && port == -1)
+ if ((turn_on || turn_off || cycle || show_status || show_power || capture) && port == -1)
  {
   std::cerr << "Error: Port number required for this action (use --port)" << std::endl;
   return 1;
  }
 
+ bool streaming_format = (format == "influx" || format == "csv");
+ if (capture && (format == "influx" || watch_interval > 0 || cached))
+ {
+  std::cerr << "Error: --capture supports text, json and csv output and cannot be combined with --watch or --cached"
+            << std::endl;
+  return 1;
+ }
+ if (capture_options.precycleMs >= 0 && !capture)
+ {
+  std::cerr << "Error: --precycle requires --capture" << std::endl;
+  return 1;
+ }
+
+ if ((streaming_format || watch_interval > 0) && !show_stats && !daemon_mode && !capture)
+ {
+  std::cerr << "Error: --watch and --format=" << format << " require --stats or --daemon" << std::endl;
+  return 1;
+ }
+
+ if (shed_config.enabled() && watch_interval <= 0)
+ {
+  std::cerr << "Error: --shed-at requires --watch" << std::endl;
+  return 1;
+ }
+
+ if (detect_anomalies && watch_interval <= 0)
+ {
+  std::cerr << "Error: --anomaly requires --watch" << std::endl;
+  return 1;
+ }
+
+ if (shed_config.restorePercent > 0.0f && !shed_config.enabled())
+ {
+  std::cerr << "Error: --restore-at requires --shed-at" << std::endl;
+  return 1;
+ }
+
+ if (shed_config.enabled() && shed_config.restorePercent >= shed_config.shedPercent)
+ {
+  std::cerr << "Error: --restore-at must be below --shed-at" << std::endl;
+  return 1;
+ }
+
+ if (!schedule_path.empty() && !daemon_mode)
+ {
+  std::cerr << "Error: --schedule requires --daemon" << std::endl;
+  return 1;
+ }
+
+ if (cached && !(show_status || show_power || show_total_power || show_stats))
+ {
+  std::cerr << "Error: --cached works with --status, --power, --total-power and --stats" << std::endl;
+  return 1;
+ }
+
+ if (!record_path.empty() && watch_interval <= 0)
+ {
+  std::cerr << "Error: --record requires --watch" << std::endl;
+  return 1;
+ }
+
+ if (cached && watch_interval > 0)
+ {
+  std::cerr << "Error: --cached cannot be combined with --watch" << std::endl;
+  return 1;
+ }
+
+ bool one_shot = turn_on || turn_off || cycle || show_status || show_power || show_total_power ||
+                 (show_stats && !streaming_format && watch_interval == 0);
+ if (deadline_ms > 0 && (cached || capture || !(one_shot || daemon_mode)))
+ {
+  std::cerr << "Error: --deadline bounds a single command or each --daemon action" << std::endl;
+  return 1;
+ }
+
+ if (!audit_path.empty() && !(turn_on || turn_off || cycle || capture || daemon_mode || shed_config.enabled()))
+ {
+  std::cerr << "Error: --audit records --on, --off, --cycle, --capture, --shed-at and --daemon actions" << std::endl;
+  return 1;
+ }
+
+ // Machine-readable formats keep progress chatter off stdout
+ bool machine_output = json_output || streaming_format;
+
+ if (cached)
+ {
+  return run_cached_query(host, show_status, show_power, show_total_power, port, format, flush_policy,
+                          json_output, quiet)
+             ? 0
+             : 1;
+ }
+
+ // The log outlives the controller and commits what is still queued on exit
+ std::unique_ptr<AuditLog> audit;
+ if (!audit_path.empty())
+ {
+  std::string message;
+  audit.reset(new AuditLog());
+  if (!audit->open(audit_path, std::chrono::milliseconds(audit_delay_ms), message))
+  {
+   std::cerr << "Error: " << message << std::endl;
+   return 1;
+  }
+ }
+
+ // Shared by every request of the process, and outlives the controller
+ RetryPolicy retry(retry_options, verbose);
+
  // Create CLI controller
  GS308EP_CLI controller(host, password, verbose);
+ controller.setRetryPolicy(&retry);
+ if (session_timeout > 0)
+ {
+  controller.setSessionTimeout(std::chrono::seconds(session_timeout));
+ }
+ controller.setAuditLog(audit.get());
 
  // Connect and authenticate
- if (!quiet && !json_output)
+ if (!quiet && !machine_output)
  {
   std::cout << "Connecting to " << host << "..." << std::endl;
  }
 
- if (!controller.login())
+ // A command's deadline starts before its login; a daemon's login gets a budget of its own
+ std::unique_ptr<Deadline> deadline;
+ if (deadline_ms > 0)
+ {
+  deadline.reset(new Deadline(std::chrono::milliseconds(deadline_ms)));
+ }
+
+ bool authenticated;
+ {
+  DeadlineScope bounded(deadline.get());
+  authenticated = controller.login();
+ }
+ if (!authenticated)
  {
+  if (deadline && deadline->exceeded())
+  {
+   std::cerr << "Error: Deadline of " << deadline_ms << " ms expired during " << deadline->stage() << std::endl;
+   return DEADLINE_EXIT_STATUS;
+  }
   std::cerr << "Error: Authentication failed" << std::endl;
   return 1;
  }
 
- if (!quiet && !json_output)
+ if (!quiet && !machine_output)
  {
   std::cout << "Authenticated successfully" << std::endl;
  }
 
+ if ((show_stats && (streaming_format || watch_interval > 0)) || daemon_mode)
+ {
+  std::unique_ptr<StatsWriter> writer;
+  if (format == "influx")
+  {
+   writer.reset(new InfluxWriter(STDOUT_FILENO, flush_policy));
+  }
+  else if (format == "csv")
+  {
+   writer.reset(new CsvWriter(STDOUT_FILENO, flush_policy));
+  }
+
+  // Stop cleanly on interrupt and let a closed pipe surface as a write error
+  std::signal(SIGINT, handle_stop_signal);
+  std::signal(SIGTERM, handle_stop_signal);
+  std::signal(SIGPIPE, SIG_IGN);
+
+  std::unique_ptr<LoadShedder> shedder;
+  if (shed_config.enabled())
+  {
+   shedder.reset(new LoadShedder(shed_config));
+  }
+
+  std::unique_ptr<BaselineTracker> baselines;
+  if (detect_anomalies)
+  {
+   baselines.reset(new BaselineTracker(baseline_config));
+  }
+
+  std::unique_ptr<HistoryWriter> history;
+  if (!record_path.empty())
+  {
+   std::string message;
+   history.reset(new HistoryWriter());
+   if (!history->open(record_path, host, watch_interval * 1000, message))
+   {
+    std::cerr << "Error: " << message << std::endl;
+    return 1;
+   }
+  }
+
+  // Only pollers publish; a daemon without --watch has nothing to share
+  std::unique_ptr<SnapshotPublisher> snapshot;
+  if (watch_interval > 0)
+  {
+   snapshot.reset(new SnapshotPublisher(host, watch_interval * 1000));
+   std::string message;
+   if (!snapshot->open(message))
+   {
+    std::cerr << "[WARN] " << message << "; --cached queries will not see this poller" << std::endl;
+    snapshot.reset();
+   }
+  }
+
+  if (daemon_mode)
+  {
+   DaemonOptions options;
+   options.socketPath = socket_path;
+   if (options.socketPath.empty())
+   {
+    options.socketPath = "/tmp/" + snapshotName(host) + ".sock";
+   }
+   options.schedulePath = schedule_path;
+   options.pollIntervalSec = watch_interval;
+   options.actionDeadlineMs = deadline_ms;
+   options.verbose = verbose;
+
+   Daemon daemon(controller, options, writer.get());
+   daemon.setLoadShedder(shedder.get());
+   daemon.setBaselineTracker(baselines.get());
+   daemon.setSnapshotPublisher(snapshot.get());
+   daemon.setHistoryWriter(history.get());
+   if (!daemon.start())
+   {
+    return 1;
+   }
+   return daemon.run(stop_requested);
+  }
+
+  PollHooks hooks = {writer.get(), shedder.get(), baselines.get(), snapshot.get(), history.get()};
+  bool streamed = run_stats_stream(controller, hooks, json_output, quiet, watch_interval, watch_count);
+  return streamed ? 0 : 1;
+ }
+
+ if (capture)
+ {
+  std::signal(SIGINT, handle_stop_signal);
+  std::signal(SIGTERM, handle_stop_signal);
+
+  capture_options.port = port;
+  CaptureResult result;
+  std::string message;
+  bool captured = runCapture(controller, capture_options, stop_requested, result, message);
+  // A capture cut short by the switch still writes what it sampled
+  if (captured || !result.samples.empty())
+  {
+   writeCapture(result, format, quiet, std::cout);
+  }
+  if (!captured)
+  {
+   std::cerr << "Error: " << message << std::endl;
+   return 1;
+  }
+  return result.samples.empty() ? 1 : 0;
+ }
+
  // Execute action
  bool success = false;
+ DeadlineScope bounded(deadline.get());
 
  if (turn_on)
  {
@@ -284,5 +1833,10 @@ int main(int argc, char *argv[])
   success = controller.showAllStats(json_output, quiet);
  }
 
+ if (!success && deadline && deadline->exceeded())
+ {
+  std::cerr << "Error: Deadline of " << deadline_ms << " ms expired during " << deadline->stage() << std::endl;
+  return DEADLINE_EXIT_STATUS;
+ }
  return success ? 0 : 1;
 }
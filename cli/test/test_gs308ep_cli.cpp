@@ -0,0 +1,2823 @@
+/**
+ * @file test_gs308ep_cli.cpp
+ * @brief Unit tests for the GS308EP CLI
+ *
+ * Covers the page parsers and the self-contained cores: everything whose
+ * behaviour can be checked without a real switch or a network.
+ */
+
+#include "../src/AuditLog.h"
+#include "../src/BoundedQueue.h"
+#include "../src/Deadline.h"
+#include "../src/Fleet.h"
+#include "../src/GS308EP_CLI.h"
+#include "../src/History.h"
+#include "../src/HistoryQuery.h"
+#include "../src/HistorySegment.h"
+#include "../src/InternTable.h"
+#include "../src/LoadShedder.h"
+#include "../src/PollSchedule.h"
+#include "../src/PortBaseline.h"
+#include "../src/RetryPolicy.h"
+#include "../src/Shard.h"
+#include "../src/Snapshot.h"
+#include "../src/StatsWriter.h"
+#include "../src/StatusPage.h"
+#include "../src/SubscriptionHub.h"
+#include "../src/TimerWheel.h"
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <curl/curl.h>
+#include <fcntl.h>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <netinet/in.h>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+static int tests_passed = 0;
+static int tests_failed = 0;
+
+#define TEST(name)                                                                 \
+    static void test_##name();                                                     \
+    static void run_test_##name() {                                                \
+        std::cout << "Running test: " #name "... ";                                \
+        try {                                                                      \
+            test_##name();                                                         \
+            std::cout << "PASSED" << std::endl;                                    \
+            tests_passed++;                                                        \
+        } catch (const std::exception &e) {                                        \
+            std::cout << "FAILED: " << e.what() << std::endl;                      \
+            tests_failed++;                                                        \
+        }                                                                          \
+    }                                                                              \
+    static void test_##name()
+
+#define ASSERT_EQ(expected, actual)                                                \
+    do {                                                                           \
+        if (!((expected) == (actual))) {                                           \
+            std::ostringstream message;                                            \
+            message << "Expected " << (expected) << " but got " << (actual)        \
+                    << " (line " << __LINE__ << ")";                               \
+            throw std::runtime_error(message.str());                               \
+        }                                                                          \
+    } while (0)
+
+#define ASSERT_TRUE(condition)                                                     \
+    do {                                                                           \
+        if (!(condition)) {                                                        \
+            std::ostringstream message;                                            \
+            message << "Assertion failed: " #condition " (line " << __LINE__ << ")"; \
+            throw std::runtime_error(message.str());                               \
+        }                                                                          \
+    } while (0)
+
+#define ASSERT_FALSE(condition) ASSERT_TRUE(!(condition))
+
+#define ASSERT_NEAR(expected, actual, epsilon)                                     \
+    do {                                                                           \
+        if (std::fabs((expected) - (actual)) > (epsilon)) {                        \
+            std::ostringstream message;                                            \
+            message << "Expected " << (expected) << " but got " << (actual)        \
+                    << " (line " << __LINE__ << ")";                               \
+            throw std::runtime_error(message.str());                               \
+        }                                                                          \
+    } while (0)
+
+#define ASSERT_CONTAINS(haystack, needle)                                          \
+    do {                                                                           \
+        if (std::string(haystack).find(needle) == std::string::npos) {             \
+            std::ostringstream message;                                            \
+            message << "Expected \"" << (haystack) << "\" to contain \""          \
+                    << (needle) << "\" (line " << __LINE__ << ")";                 \
+            throw std::runtime_error(message.str());                               \
+        }                                                                          \
+    } while (0)
+
+// ---------------------------------------------------------------------------
+// Page parsers
+// ---------------------------------------------------------------------------
+
+// Reaches the controller's private parsers; GS308EP_CLI names it a friend
+class GS308EP_CLI_Testable {
+public:
+    GS308EP_CLI_Testable() : cli_("127.0.0.1", "") {}
+
+    std::string extractRand(const std::string &html) { return cli_.extractRand(html); }
+    std::string extractCookie(const std::string &headers) { return cli_.extractCookie(headers); }
+    bool extractClientHash(const std::string &html) { return cli_.extractClientHash(html); }
+    std::string clientHash() const { return cli_.clientHash(); }
+    bool isValidPort(int port) const { return cli_.isValidPort(port); }
+
+private:
+    GS308EP_CLI cli_;
+};
+
+// One port's block, laid out as the switch's status page does
+static std::string statusBlock(int port, const char *status, const char *power, const char *extra = "") {
+    std::ostringstream out;
+    out << "<li class=\"poePortStatusListItem\">\n"
+        << "<span class=\"pull-right poe-power-mode\"><span>" << status << "</span></span>\n"
+        << "<span class=\"powClassShow\">ml003@4@</span>\n"
+        << "<input type=\"hidden\" class=\"port\" value=\"" << port << "\">\n"
+        << "<input type=\"hidden\" class=\"hidPortPwr\" id=\"hidPortPwr\" value=\"1\">\n"
+        << "<div><span class='hid-txt wid-full'>ml570</span></div><div><span>53.2</span></div>\n"
+        << "<div><span class='hid-txt wid-full'>ml572</span></div><div><span>120</span></div>\n"
+        << "<div><span class='hid-txt wid-full'>ml574</span></div><div><span>" << power << "</span></div>\n"
+        << extra
+        << "<div><span class='hid-txt wid-full'>ml575</span></div><div><span>41</span></div>\n"
+        << "<div><span class='hid-txt wid-full'>ml581</span></div><div><span>No Error</span></div>\n"
+        << "</li>\n";
+    return out.str();
+}
+
+static std::string statusPage(const std::string &blocks) {
+    return "<html><body><ul>\n" + blocks + "</ul></body></html>";
+}
+
+static float portPower(const std::string &html, int port) {
+    return StatusPageView(html).power(port);
+}
+
+TEST(extract_rand_double_quotes) {
+    GS308EP_CLI_Testable cli;
+    ASSERT_EQ(std::string("1735414426"),
+              cli.extractRand("<input type=\"hidden\" name=\"rand\" value=\"1735414426\">"));
+}
+
+TEST(extract_rand_single_quotes) {
+    GS308EP_CLI_Testable cli;
+    ASSERT_EQ(std::string("1735414426"), cli.extractRand("<input type='hidden' name='rand' value='1735414426'>"));
+}
+
+TEST(extract_rand_mixed_quotes) {
+    GS308EP_CLI_Testable cli;
+    ASSERT_EQ(std::string("98765"), cli.extractRand("<input name=\"rand\" value='98765'>"));
+    ASSERT_EQ(std::string("43210"), cli.extractRand("<input name='rand' value=\"43210\">"));
+}
+
+TEST(extract_rand_missing) {
+    GS308EP_CLI_Testable cli;
+    ASSERT_EQ(std::string(""), cli.extractRand("<input name=\"password\" value=\"x\">"));
+    ASSERT_EQ(std::string(""), cli.extractRand(""));
+}
+
+TEST(extract_rand_without_value) {
+    GS308EP_CLI_Testable cli;
+    ASSERT_EQ(std::string(""), cli.extractRand("<input name=\"rand\">"));
+    ASSERT_EQ(std::string(""), cli.extractRand("<input name=\"rand\" value=1735414426>"));
+}
+
+TEST(extract_cookie_sid) {
+    GS308EP_CLI_Testable cli;
+    std::string headers = "HTTP/1.1 200 OK\r\nSet-Cookie: SID=abcDEF123; path=/; HttpOnly\r\n\r\n";
+    ASSERT_EQ(std::string("abcDEF123"), cli.extractCookie(headers));
+}
+
+TEST(extract_cookie_missing) {
+    GS308EP_CLI_Testable cli;
+    ASSERT_EQ(std::string(""), cli.extractCookie("HTTP/1.1 200 OK\r\nContent-Type: text/html\r\n\r\n"));
+}
+
+TEST(extract_cookie_line_endings) {
+    GS308EP_CLI_Testable cli;
+    ASSERT_EQ(std::string("token1"), cli.extractCookie("Set-Cookie: SID=token1\r\nServer: x\r\n"));
+    ASSERT_EQ(std::string("token2"), cli.extractCookie("Set-Cookie: SID=token2\nServer: x\n"));
+    ASSERT_EQ(std::string("token3"), cli.extractCookie("Set-Cookie: SID=token3"));
+}
+
+TEST(extract_client_hash) {
+    GS308EP_CLI_Testable cli;
+    ASSERT_TRUE(cli.extractClientHash("<form><input type=\"hidden\" name=\"hash\" value=\"5f4dcc3b5aa765d6\"></form>"));
+    ASSERT_EQ(std::string("5f4dcc3b5aa765d6"), cli.clientHash());
+    ASSERT_TRUE(cli.extractClientHash("<input name='hash' value='0a1b2c'>"));
+    ASSERT_EQ(std::string("0a1b2c"), cli.clientHash());
+}
+
+TEST(extract_client_hash_missing) {
+    GS308EP_CLI_Testable cli;
+    ASSERT_FALSE(cli.extractClientHash("<form><input name=\"rand\" value=\"1\"></form>"));
+    ASSERT_FALSE(cli.extractClientHash("<input name=\"hash\">"));
+    ASSERT_EQ(std::string(""), cli.clientHash());
+}
+
+TEST(port_power_single_port) {
+    ASSERT_NEAR(4.5f, portPower(statusPage(statusBlock(1, "Delivering Power", "4.5")), 1), 0.001f);
+}
+
+TEST(port_power_multiple_ports) {
+    std::string html = statusPage(statusBlock(1, "Delivering Power", "4.5") + statusBlock(2, "Disabled", "0.0") +
+                                  statusBlock(3, "Delivering Power", "12.3"));
+    StatusPageView view(html);
+    ASSERT_NEAR(4.5f, view.power(1), 0.001f);
+    ASSERT_NEAR(0.0f, view.power(2), 0.001f);
+    ASSERT_NEAR(12.3f, view.power(3), 0.001f);
+}
+
+TEST(port_power_integer_value) {
+    ASSERT_NEAR(7.0f, portPower(statusPage(statusBlock(3, "Delivering Power", "7")), 3), 0.001f);
+}
+
+TEST(port_power_zero) {
+    ASSERT_NEAR(0.0f, portPower(statusPage(statusBlock(5, "Searching", "0")), 5), 0.001f);
+}
+
+TEST(port_power_high_value) {
+    ASSERT_NEAR(30.0f, portPower(statusPage(statusBlock(8, "Delivering Power", "30.0")), 8), 0.001f);
+}
+
+TEST(port_power_missing_port) {
+    std::string html = statusPage(statusBlock(1, "Delivering Power", "4.5"));
+    ASSERT_NEAR(-1.0f, portPower(html, 2), 0.001f);
+    ASSERT_NEAR(-1.0f, portPower("", 1), 0.001f);
+}
+
+TEST(port_power_invalid_value) {
+    ASSERT_NEAR(-1.0f, portPower(statusPage(statusBlock(1, "Delivering Power", "N/A")), 1), 0.001f);
+    ASSERT_NEAR(-1.0f, portPower(statusPage(statusBlock(1, "Delivering Power", "")), 1), 0.001f);
+}
+
+TEST(port_validation_valid) {
+    GS308EP_CLI_Testable cli;
+    for (int port = 1; port <= 8; port++) {
+        ASSERT_TRUE(cli.isValidPort(port));
+    }
+}
+
+TEST(port_validation_zero) {
+    GS308EP_CLI_Testable cli;
+    ASSERT_FALSE(cli.isValidPort(0));
+}
+
+TEST(port_validation_negative) {
+    GS308EP_CLI_Testable cli;
+    ASSERT_FALSE(cli.isValidPort(-1));
+    ASSERT_FALSE(cli.isValidPort(-8));
+}
+
+TEST(port_validation_too_high) {
+    GS308EP_CLI_Testable cli;
+    ASSERT_FALSE(cli.isValidPort(9));
+    ASSERT_FALSE(cli.isValidPort(100));
+}
+
+TEST(extract_rand_in_full_login_page) {
+    GS308EP_CLI_Testable cli;
+    std::string html = "<html><head><title>Login</title></head><body>"
+                       "<form method=\"post\" action=\"/login.cgi\">"
+                       "<input type=\"password\" name=\"password\" value=\"\">"
+                       "<input type=\"hidden\" id=\"rand\" name=\"rand\" value=\"2837465\" disabled>"
+                       "</form></body></html>";
+    ASSERT_EQ(std::string("2837465"), cli.extractRand(html));
+}
+
+TEST(extract_cookie_among_several) {
+    GS308EP_CLI_Testable cli;
+    std::string headers = "HTTP/1.1 200 OK\r\nSet-Cookie: lang=en; path=/\r\n"
+                          "Set-Cookie: SID=Zq9Xk2; path=/; HttpOnly\r\nSet-Cookie: theme=dark\r\n\r\n";
+    ASSERT_EQ(std::string("Zq9Xk2"), cli.extractCookie(headers));
+}
+
+TEST(extract_rand_whitespace_around_value) {
+    GS308EP_CLI_Testable cli;
+    ASSERT_EQ(std::string("555"), cli.extractRand("<input name=\"rand\"   value = \"555\">"));
+}
+
+TEST(extract_rand_empty_value) {
+    GS308EP_CLI_Testable cli;
+    ASSERT_EQ(std::string(""), cli.extractRand("<input name=\"rand\" value=\"\">"));
+}
+
+TEST(extract_client_hash_empty_value) {
+    GS308EP_CLI_Testable cli;
+    ASSERT_FALSE(cli.extractClientHash("<input name=\"hash\" value=\"\">"));
+}
+
+TEST(extract_rand_unterminated_value) {
+    GS308EP_CLI_Testable cli;
+    ASSERT_EQ(std::string(""), cli.extractRand("<input name=\"rand\" value=\"12345"));
+}
+
+TEST(port_power_decimal_precision) {
+    std::string html = statusPage(statusBlock(2, "Delivering Power", "15.75"));
+    ASSERT_NEAR(15.75f, portPower(html, 2), 0.0001f);
+}
+
+TEST(port_power_whitespace_in_value) {
+    ASSERT_NEAR(6.4f, portPower(statusPage(statusBlock(4, "Delivering Power", " 6.4")), 4), 0.001f);
+}
+
+TEST(port_power_unterminated_span) {
+    std::string html = "<input type=\"hidden\" class=\"port\" value=\"1\">"
+                       "<div><span class='hid-txt wid-full'>ml574</span></div><div><span>4.5";
+    ASSERT_NEAR(-1.0f, portPower(html, 1), 0.001f);
+}
+
+TEST(port_power_reading_outside_port_block) {
+    // A reading more than 2000 bytes past the marker belongs to no port
+    std::string html = "<input type=\"hidden\" class=\"port\" value=\"1\">" + std::string(2100, ' ') +
+                       "<div><span class='hid-txt wid-full'>ml574</span></div><div><span>4.5</span></div>";
+    ASSERT_NEAR(-1.0f, portPower(html, 1), 0.001f);
+}
+
+// ---------------------------------------------------------------------------
+// Streaming writers
+// ---------------------------------------------------------------------------
+
+static PoEPortStats portStats(int port, float voltage, float current, float power, float temperature,
+                              TextId powerClass = TEXT_CLASS_4) {
+    PoEPortStats stats;
+    stats.port = static_cast<uint8_t>(port);
+    stats.enabled = power > 0.0f;
+    stats.status = stats.enabled ? TEXT_DELIVERING_POWER : TEXT_SEARCHING;
+    stats.voltage = voltage;
+    stats.current = current;
+    stats.power = power;
+    stats.temperature = temperature;
+    stats.fault = TEXT_NO_ERROR;
+    stats.powerClass = powerClass;
+    return stats;
+}
+
+// Collects what a writer sends to its file descriptor
+class PipeCapture {
+public:
+    PipeCapture() {
+        if (pipe(fds_) < 0) {
+            throw std::runtime_error("pipe failed");
+        }
+        fcntl(fds_[0], F_SETFL, O_NONBLOCK);
+    }
+    ~PipeCapture() {
+        close(fds_[0]);
+        close(fds_[1]);
+    }
+    int fd() const { return fds_[1]; }
+
+    std::string read() {
+        std::string text;
+        char chunk[4096];
+        ssize_t n;
+        while ((n = ::read(fds_[0], chunk, sizeof(chunk))) > 0) {
+            text.append(chunk, static_cast<size_t>(n));
+        }
+        return text;
+    }
+
+private:
+    int fds_[2];
+};
+
+static std::string fixed(float value, int decimals) {
+    PipeCapture capture;
+    OutputBuffer out(capture.fd());
+    bool written = out.appendFixed(value, decimals);
+    out.flush();
+    std::string text = capture.read();
+    return written ? text : "<" + text + ">";
+}
+
+TEST(fixed_point_formatting) {
+    ASSERT_EQ(std::string("53.2"), fixed(53.2f, 1));
+    ASSERT_EQ(std::string("120"), fixed(120.4f, 0));
+    ASSERT_EQ(std::string("0.125"), fixed(0.125f, 3));
+    ASSERT_EQ(std::string("-0.1"), fixed(-0.05f, 1));
+    ASSERT_EQ(std::string("0.0"), fixed(-0.04f, 1));
+    ASSERT_EQ(std::string("0.000001"), fixed(0.000001f, 9)); // Decimals clamp to 6
+    ASSERT_EQ(std::string("-7"), fixed(-7.0f, -2));
+
+    // Nothing is written for a value that cannot be, rather than a made-up 0
+    float nan = std::numeric_limits<float>::quiet_NaN();
+    float infinity = std::numeric_limits<float>::infinity();
+    ASSERT_EQ(std::string("<>"), fixed(nan, 1));
+    ASSERT_EQ(std::string("<>"), fixed(infinity, 1));
+    ASSERT_EQ(std::string("<>"), fixed(-infinity, 0));
+    ASSERT_EQ(std::string("<>"), fixed(1e20f, 1));
+    ASSERT_EQ(std::string("<>"), fixed(std::numeric_limits<float>::max(), 0));
+    ASSERT_EQ(std::string("562949953421312.0"), fixed(562949953421312.0f, 1));
+}
+
+TEST(influx_line_format_and_escaping) {
+    PipeCapture capture;
+    {
+        InfluxWriter writer(capture.fd(), FlushPolicy::Line);
+        std::vector<PoEPortStats> stats = {portStats(3, 53.2f, 120.0f, 6.4f, 41.0f),
+                                           portStats(4, 0.0f, 0.0f, 0.0f, 30.0f, TEXT_EMPTY)};
+        ASSERT_TRUE(writer.writeSample("sw 1,a=b\\c", 1792000000000000000LL, stats));
+    }
+    std::string lines = capture.read();
+    ASSERT_EQ(std::string("poe,host=sw\\ 1\\,a\\=b\\\\c,port=3,class=Class\\ 4 "
+                          "voltage=53.2,current=120,power=6.4,temperature=41,enabled=true 1792000000000000000\n"
+                          // A port without a class gets no class tag; Influx rejects an empty one
+                          "poe,host=sw\\ 1\\,a\\=b\\\\c,port=4 "
+                          "voltage=0.0,current=0,power=0.0,temperature=30,enabled=false 1792000000000000000\n"),
+              lines);
+}
+
+TEST(influx_leaves_out_unwritable_readings) {
+    float nan = std::numeric_limits<float>::quiet_NaN();
+    float infinity = std::numeric_limits<float>::infinity();
+    PipeCapture capture;
+    {
+        InfluxWriter writer(capture.fd(), FlushPolicy::Sample, "poe_test");
+        writer.writeSample("sw1", 5, {portStats(1, nan, 120.0f, infinity, 41.0f), portStats(2, nan, nan, nan, nan)});
+    }
+    std::string lines = capture.read();
+    ASSERT_EQ(std::string("poe_test,host=sw1,port=1,class=Class\\ 4 current=120,temperature=41,enabled=true 5\n"
+                          "poe_test,host=sw1,port=2,class=Class\\ 4 enabled=false 5\n"),
+              lines);
+}
+
+TEST(csv_header_and_rfc4180_quoting) {
+    PipeCapture capture;
+    {
+        CsvWriter writer(capture.fd(), FlushPolicy::Buffer);
+        PoEPortStats quoted = portStats(2, 53.2f, 120.0f, 6.4f, 41.0f, internText("Class \"4\", high"));
+        quoted.fault = internText("Over\ncurrent");
+        writer.writeSample("sw,1", 1792000000123456789LL, {quoted});
+        PoEPortStats missing = portStats(5, 53.0f, 80.0f, std::numeric_limits<float>::quiet_NaN(), 40.0f);
+        writer.writeSample("sw2", 1792000001000000000LL, {missing});
+        ASSERT_TRUE(capture.read().empty()); // Buffered until finish()
+        ASSERT_TRUE(writer.finish());
+    }
+    std::string rows = capture.read();
+    ASSERT_EQ(std::string("timestamp_ms,host,port,class,status,enabled,voltage,current,power,temperature,fault\n"
+                          "1792000000123,\"sw,1\",2,\"Class \"\"4\"\", high\",Delivering Power,1,53.2,120,6.4,41,"
+                          "\"Over\ncurrent\"\n"
+                          // An unwritable reading leaves its cell empty
+                          "1792000001000,sw2,5,Class 4,Searching,0,53.0,80,,40,No Error\n"),
+              rows);
+}
+
+// ---------------------------------------------------------------------------
+// Timer wheel
+// ---------------------------------------------------------------------------
+
+TEST(timer_wheel_fires_in_tick_order) {
+    TimerWheel wheel(5);
+    std::vector<uint64_t> expiries = {5, 6, 260, 261, 256 + 5, 16383, 16384, 16390, 100000, 1048576 + 3, 2000000};
+    std::mt19937_64 rng(3);
+    for (int i = 0; i < 500; i++) {
+        expiries.push_back(5 + rng() % 2000000);
+    }
+    for (uint64_t expiry : expiries) {
+        ASSERT_TRUE(wheel.schedule(expiry, expiry) != TimerWheel::INVALID_TIMER);
+    }
+    ASSERT_EQ(expiries.size(), wheel.size());
+
+    // Advance in uneven steps; each timer fires in the step that reaches its tick
+    std::vector<uint64_t> fired;
+    uint64_t previous = 4;
+    uint64_t now = 5;
+    while (previous < 2000000) {
+        wheel.advance(now, [&](uint64_t payload) {
+            ASSERT_TRUE(payload > previous && payload <= now);
+            fired.push_back(payload);
+        });
+        previous = now;
+        now = std::min<uint64_t>(now + 1 + rng() % 5000, 2000000);
+    }
+    std::sort(expiries.begin(), expiries.end());
+    ASSERT_EQ(expiries.size(), fired.size());
+    ASSERT_TRUE(std::is_sorted(fired.begin(), fired.end()));
+    ASSERT_TRUE(fired == expiries);
+    ASSERT_EQ(size_t(0), wheel.size());
+}
+
+TEST(timer_wheel_cancel) {
+    TimerWheel wheel;
+    std::vector<TimerWheel::TimerId> ids;
+    for (uint64_t i = 0; i < 1000; i++) {
+        ids.push_back(wheel.schedule(1 + i * 37, i));
+    }
+    for (size_t i = 0; i < ids.size(); i += 2) {
+        ASSERT_TRUE(wheel.cancel(ids[i]));
+        ASSERT_FALSE(wheel.cancel(ids[i]));
+    }
+    ASSERT_EQ(size_t(500), wheel.size());
+
+    std::vector<uint64_t> fired;
+    wheel.advance(1000 * 37, [&](uint64_t payload) { fired.push_back(payload); });
+    ASSERT_EQ(size_t(500), fired.size());
+    for (uint64_t payload : fired) {
+        ASSERT_EQ(uint64_t(1), payload % 2);
+    }
+    // Ids of fired timers are stale, even once their nodes are reused
+    wheel.schedule(50000, 0);
+    ASSERT_FALSE(wheel.cancel(ids[1]));
+}
+
+TEST(timer_wheel_callbacks_reschedule_and_cancel) {
+    TimerWheel wheel(100);
+    // Scheduled in the past: fires on the next advance
+    wheel.schedule(10, 1);
+    TimerWheel::TimerId sibling = wheel.schedule(101, 2);
+    wheel.schedule(101, 3);
+
+    std::vector<uint64_t> fired;
+    int repeats = 0;
+    wheel.advance(101, [&](uint64_t payload) {
+        fired.push_back(payload);
+        // Whichever of 2 and 3 fires first cancels the other
+        if (payload == 3 || payload == 2) {
+            wheel.cancel(sibling);
+        }
+    });
+    ASSERT_EQ(size_t(2), fired.size());
+    ASSERT_EQ(uint64_t(1), fired[0]);
+
+    wheel.schedule(102, 9);
+    wheel.advance(2000, [&](uint64_t payload) {
+        // A repeating timer that reschedules itself 300 ticks on
+        if (payload == 9 && ++repeats < 5) {
+            wheel.schedule(wheel.currentTick() + 300, 9);
+        }
+    });
+    ASSERT_EQ(5, repeats);
+    ASSERT_EQ(size_t(0), wheel.size());
+}
+
+// ---------------------------------------------------------------------------
+// Load shedding
+// ---------------------------------------------------------------------------
+
+// One poll with the given draw per port; a port drawing nothing is not delivering
+static std::vector<PoEPortStats> drawSample(std::vector<float> watts) {
+    std::vector<PoEPortStats> stats;
+    for (size_t i = 0; i < watts.size(); i++) {
+        stats.push_back(portStats(static_cast<int>(i + 1), 53.0f, watts[i] * 18.8f, watts[i], 40.0f));
+    }
+    return stats;
+}
+
+// Evaluate and commit one sample as enforce() would, without a switch
+static LoadShedder::Decision step(LoadShedder &shedder, const std::vector<PoEPortStats> &stats) {
+    LoadShedder::Decision decision = shedder.evaluate(stats);
+    shedder.commit(decision, stats);
+    return decision;
+}
+
+TEST(parse_shed_order) {
+    std::vector<int> order;
+    ASSERT_TRUE(parseShedOrder("8,7,6", order));
+    ASSERT_TRUE(order == std::vector<int>({8, 7, 6}));
+    ASSERT_FALSE(parseShedOrder("", order));
+    ASSERT_FALSE(parseShedOrder("0", order));
+    ASSERT_FALSE(parseShedOrder("9", order));
+    ASSERT_FALSE(parseShedOrder("3,3", order));
+    ASSERT_FALSE(parseShedOrder("2,x", order));
+}
+
+TEST(load_shedder_sheds_just_enough) {
+    LoadShedConfig config;
+    config.budgetWatts = 65.0f;
+    config.shedPercent = 80.0f; // 52 W
+    config.shedOrder = {8, 2, 3, 1};
+    LoadShedder shedder(config);
+
+    // Under the threshold nothing happens
+    ASSERT_TRUE(step(shedder, drawSample({15, 15, 15, 5})).shed.empty());
+
+    // 55 W: port 8 is not delivering, port 2 frees enough, port 4 is never shed
+    std::vector<PoEPortStats> over = drawSample({15, 15, 15, 10});
+    LoadShedder::Decision decision = shedder.evaluate(over);
+    ASSERT_NEAR(55.0f, decision.totalWatts, 0.01f);
+    ASSERT_TRUE(decision.shed == std::vector<int>({2}));
+    ASSERT_TRUE(shedder.shedPorts().empty()); // evaluate() alone changes nothing
+    shedder.commit(decision, over);
+    ASSERT_TRUE(shedder.shedPorts() == std::vector<int>({2}));
+
+    // Still over without port 2: the next in order goes, and port 2 is not shed twice
+    decision = step(shedder, drawSample({30, 0, 15, 10}));
+    ASSERT_TRUE(decision.shed == std::vector<int>({3}));
+    ASSERT_TRUE(shedder.shedPorts() == std::vector<int>({2, 3}));
+}
+
+TEST(load_shedder_restore_hysteresis) {
+    LoadShedConfig config;
+    config.budgetWatts = 100.0f;
+    config.shedPercent = 80.0f;    // 80 W
+    config.restorePercent = 60.0f; // 60 W
+    config.restoreHoldSamples = 3;
+    config.shedOrder = {4, 3};
+    LoadShedder shedder(config);
+
+    ASSERT_TRUE(step(shedder, drawSample({30, 20, 10, 25})).shed == std::vector<int>({4}));
+
+    // 60 W plus port 4's 25 W is above the restore level though below the shed level: hold
+    for (int i = 0; i < 5; i++) {
+        LoadShedder::Decision decision = step(shedder, drawSample({30, 20, 10, 0}));
+        ASSERT_TRUE(decision.shed.empty() && decision.restore.empty());
+    }
+
+    // Room for port 4 must last restoreHoldSamples samples in a row
+    ASSERT_TRUE(step(shedder, drawSample({20, 10, 5, 0})).restore.empty());
+    ASSERT_TRUE(step(shedder, drawSample({20, 10, 5, 0})).restore.empty());
+    ASSERT_TRUE(step(shedder, drawSample({30, 20, 10, 0})).restore.empty()); // Resets the count
+    ASSERT_TRUE(step(shedder, drawSample({20, 10, 5, 0})).restore.empty());
+    ASSERT_TRUE(step(shedder, drawSample({20, 10, 5, 0})).restore.empty());
+    ASSERT_TRUE(step(shedder, drawSample({20, 10, 5, 0})).restore == std::vector<int>({4}));
+    ASSERT_TRUE(shedder.shedPorts().empty());
+}
+
+TEST(load_shedder_restores_in_priority_order) {
+    LoadShedConfig config;
+    config.budgetWatts = 100.0f;
+    config.shedPercent = 50.0f;
+    config.restorePercent = 90.0f; // Not below the shed level, so 85% of it: 42.5 W
+    config.restoreHoldSamples = 1;
+    config.shedOrder = {4, 3, 2};
+    LoadShedder shedder(config);
+
+    ASSERT_TRUE(step(shedder, drawSample({30, 10, 10, 10})).shed == std::vector<int>({4, 3}));
+    ASSERT_TRUE(step(shedder, drawSample({25, 10, 0, 0})).restore.empty()); // 35 + 10 > 42.5
+    ASSERT_TRUE(step(shedder, drawSample({20, 10, 0, 0})).restore == std::vector<int>({3}));
+    ASSERT_TRUE(step(shedder, drawSample({20, 10, 12, 0})).restore.empty());   // 42 + 10 > 42.5
+
+    // A shed port someone switched back on by hand is no longer tracked
+    step(shedder, drawSample({20, 5, 5, 8}));
+    ASSERT_TRUE(shedder.shedPorts().empty());
+}
+
+// ---------------------------------------------------------------------------
+// Port baselines
+// ---------------------------------------------------------------------------
+
+// Keeps what the code under test logs to stderr out of the test report
+class QuietStderr {
+public:
+    QuietStderr() : saved_(std::cerr.rdbuf(sink_.rdbuf())) {}
+    ~QuietStderr() { std::cerr.rdbuf(saved_); }
+    std::string text() const { return sink_.str(); }
+
+private:
+    std::ostringstream sink_;
+    std::streambuf *saved_;
+};
+
+static PoEPortStats baselineSample(float power, float current = 188.0f, float temperature = 40.0f) {
+    PoEPortStats stats = portStats(1, 53.0f, current, power, temperature);
+    stats.enabled = true;
+    return stats;
+}
+
+// A port that has settled at about 10 W, 188 mA and 40 C
+static PortBaseline settledBaseline(const BaselineConfig &config) {
+    PortBaseline baseline;
+    for (int i = 0; i < 60; i++) {
+        float wobble = (i % 2) ? 0.2f : -0.2f;
+        ASSERT_EQ(0, static_cast<int>(baseline.update(baselineSample(10.0f + wobble, 188.0f + 20 * wobble), config)));
+    }
+    return baseline;
+}
+
+TEST(baseline_window_and_ewma) {
+    BaselineConfig config;
+    config.setWindow(59);
+    ASSERT_NEAR(2.0f / 60.0f, config.alpha, 1e-6f);
+    ASSERT_EQ(29u, config.warmupSamples);
+    config.setWindow(0);
+    ASSERT_NEAR(1.0f, config.alpha, 1e-6f);
+
+    EwmaStat stat;
+    stat.reset(5.0f);
+    for (int i = 0; i < 200; i++) {
+        stat.update(5.0f, 0.1f);
+    }
+    ASSERT_NEAR(5.0f, stat.mean, 1e-5f);
+    ASSERT_NEAR(0.0f, stat.stddev(), 1e-5f);
+    for (int i = 0; i < 2000; i++) {
+        stat.update((i % 2) ? 6.0f : 4.0f, 0.01f);
+    }
+    ASSERT_NEAR(5.0f, stat.mean, 0.02f);
+    ASSERT_NEAR(1.0f, stat.stddev(), 0.02f);
+}
+
+TEST(baseline_warmup_raises_no_flags) {
+    BaselineConfig config;
+    config.warmupSamples = 10;
+    PortBaseline baseline;
+    ASSERT_EQ(0, static_cast<int>(baseline.update(baselineSample(10.0f), config)));
+    for (uint32_t i = 1; i < config.warmupSamples; i++) {
+        ASSERT_EQ(0, static_cast<int>(baseline.update(baselineSample(i % 2 ? 30.0f : 1.0f, 600.0f, 80.0f), config)));
+    }
+    ASSERT_EQ(config.warmupSamples, baseline.samples());
+
+    // A port that is not delivering teaches the baseline nothing
+    PoEPortStats off = baselineSample(0.0f);
+    off.enabled = false;
+    ASSERT_EQ(0, static_cast<int>(baseline.update(off, config)));
+    ASSERT_EQ(config.warmupSamples, baseline.samples());
+}
+
+TEST(baseline_high_low_and_idle_flags) {
+    BaselineConfig config;
+    config.setWindow(30);
+    PortBaseline baseline = settledBaseline(config);
+    ASSERT_NEAR(10.0f, baseline.power().mean, 0.1f);
+
+    // Within 40% of normal is not an anomaly, however many deviations it is
+    ASSERT_EQ(0, static_cast<int>(baseline.update(baselineSample(13.0f), config)));
+    ASSERT_EQ(int(ANOMALY_POWER_HIGH), static_cast<int>(baseline.update(baselineSample(16.0f), config)));
+    ASSERT_EQ(int(ANOMALY_POWER_LOW), static_cast<int>(baseline.update(baselineSample(5.0f), config)));
+    // Under a quarter of normal is an idle drop, not merely low
+    ASSERT_EQ(int(ANOMALY_IDLE_DROP), static_cast<int>(baseline.update(baselineSample(2.0f), config)));
+    ASSERT_EQ(int(ANOMALY_CURRENT_HIGH), static_cast<int>(baseline.update(baselineSample(10.0f, 300.0f), config)));
+    ASSERT_EQ(int(ANOMALY_CURRENT_LOW), static_cast<int>(baseline.update(baselineSample(10.0f, 90.0f), config)));
+    ASSERT_EQ(int(ANOMALY_TEMPERATURE_HIGH),
+              static_cast<int>(baseline.update(baselineSample(10.0f, 188.0f, 55.0f), config)));
+    ASSERT_EQ(int(ANOMALY_POWER_HIGH | ANOMALY_CURRENT_HIGH),
+              static_cast<int>(baseline.update(baselineSample(20.0f, 376.0f), config)));
+
+    // Anomalies move the baseline only slowly
+    ASSERT_NEAR(10.0f, baseline.power().mean, 0.5f);
+}
+
+TEST(baseline_ignores_tiny_draws) {
+    BaselineConfig config;
+    config.setWindow(10);
+    PortBaseline baseline;
+    for (int i = 0; i < 20; i++) {
+        baseline.update(baselineSample(0.2f, 4.0f), config);
+    }
+    // Relative checks on a near-zero baseline would only measure noise
+    ASSERT_EQ(0, static_cast<int>(baseline.update(baselineSample(5.0f, 8.0f), config)));
+}
+
+TEST(baseline_tracker_reports_transitions) {
+    BaselineConfig config;
+    config.setWindow(30);
+    BaselineTracker tracker(config);
+    QuietStderr quiet;
+    for (int i = 0; i < 40; i++) {
+        tracker.observe("sw1", {baselineSample(10.0f)});
+    }
+    ASSERT_EQ(std::string(""), quiet.text());
+    tracker.observe("sw1", {baselineSample(2.0f)});
+    ASSERT_EQ(int(ANOMALY_IDLE_DROP), static_cast<int>(tracker.flags(1)));
+    ASSERT_CONTAINS(quiet.text(), "Anomaly sw1 port 1: idle-drop");
+    tracker.observe("sw1", {baselineSample(10.0f)});
+    ASSERT_EQ(0, static_cast<int>(tracker.flags(1)));
+    ASSERT_CONTAINS(quiet.text(), "Anomaly cleared sw1 port 1");
+    ASSERT_EQ(0, static_cast<int>(tracker.flags(9)));
+
+    ASSERT_EQ(std::string("normal"), BaselineTracker::describe(ANOMALY_NONE));
+    ASSERT_EQ(std::string("power-high,temperature-high"),
+              BaselineTracker::describe(ANOMALY_POWER_HIGH | ANOMALY_TEMPERATURE_HIGH));
+}
+
+// ---------------------------------------------------------------------------
+// Single-flight login
+// ---------------------------------------------------------------------------
+
+// A loopback port that accepts connections into its backlog and never
+// answers, or, once closed, refuses them
+class LoopbackListener {
+public:
+    LoopbackListener() : fd_(socket(AF_INET, SOCK_STREAM, 0)), port_(0) {
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t length = sizeof(address);
+        if (fd_ < 0 || bind(fd_, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0 ||
+            listen(fd_, 16) < 0 || getsockname(fd_, reinterpret_cast<sockaddr *>(&address), &length) < 0) {
+            throw std::runtime_error("cannot listen on loopback");
+        }
+        port_ = ntohs(address.sin_port);
+    }
+    ~LoopbackListener() { stop(); }
+
+    void stop() {
+        if (fd_ >= 0) {
+            close(fd_);
+            fd_ = -1;
+        }
+    }
+    std::string host() const { return "127.0.0.1:" + std::to_string(port_); }
+
+private:
+    int fd_;
+    int port_;
+};
+
+TEST(login_single_flight_shares_one_attempt) {
+    QuietStderr quiet;
+    LoopbackListener stalled;
+    GS308EP_CLI cli(stalled.host(), "password");
+    cli.setLoginInterval(std::chrono::milliseconds(0));
+
+    // The first caller's login page request hangs until its deadline
+    bool leaderResult = true;
+    std::thread leader([&] {
+        Deadline deadline(std::chrono::milliseconds(400));
+        DeadlineScope scope(&deadline);
+        leaderResult = cli.login();
+    });
+    auto start = std::chrono::steady_clock::now();
+    while (cli.loginStats().attempts == 0 && std::chrono::steady_clock::now() - start < std::chrono::seconds(2)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    ASSERT_EQ(uint64_t(1), cli.loginStats().attempts);
+
+    // Everyone who asks meanwhile waits for that attempt and shares its result
+    const int followers = 6;
+    std::vector<int> results(followers, 1);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < followers; i++) {
+        threads.emplace_back([&, i] {
+            Deadline deadline(std::chrono::seconds(5));
+            DeadlineScope scope(&deadline);
+            results[i] = cli.login() ? 1 : 0;
+        });
+    }
+    leader.join();
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    GS308EP_CLI::LoginStats stats = cli.loginStats();
+    ASSERT_FALSE(leaderResult);
+    ASSERT_TRUE(results == std::vector<int>(followers, 0));
+    ASSERT_EQ(uint64_t(1), stats.attempts);
+    ASSERT_EQ(uint64_t(followers), stats.coalesced);
+    ASSERT_EQ(uint64_t(0), stats.successes);
+    ASSERT_TRUE(std::chrono::steady_clock::now() - start < std::chrono::seconds(2));
+}
+
+TEST(login_attempts_are_spaced) {
+    QuietStderr quiet;
+    LoopbackListener refused;
+    refused.stop();
+    GS308EP_CLI cli(refused.host(), "password");
+    cli.setLoginInterval(std::chrono::milliseconds(150));
+
+    ASSERT_FALSE(cli.login());
+    auto first = std::chrono::steady_clock::now();
+    ASSERT_FALSE(cli.login());
+    ASSERT_TRUE(std::chrono::steady_clock::now() - first >= std::chrono::milliseconds(140));
+    GS308EP_CLI::LoginStats stats = cli.loginStats();
+    ASSERT_EQ(uint64_t(2), stats.attempts);
+    ASSERT_EQ(uint64_t(1), stats.throttled);
+
+    // A deadline that ends inside the interval fails at once instead of waiting it out
+    Deadline deadline(std::chrono::milliseconds(50));
+    DeadlineScope scope(&deadline);
+    auto before = std::chrono::steady_clock::now();
+    ASSERT_FALSE(cli.login());
+    ASSERT_TRUE(std::chrono::steady_clock::now() - before < std::chrono::milliseconds(40));
+    ASSERT_EQ(std::string("login interval"), std::string(deadline.stage() ? deadline.stage() : ""));
+    ASSERT_EQ(uint64_t(2), cli.loginStats().attempts);
+}
+
+// ---------------------------------------------------------------------------
+// Shared-memory snapshot
+// ---------------------------------------------------------------------------
+
+static std::string snapshotHost(const char *name) {
+    return std::string(name) + "-" + std::to_string(getpid()) + ":80";
+}
+
+static void assertSameStats(const PoEPortStats &expected, const PoEPortStats &actual) {
+    ASSERT_EQ(int(expected.port), int(actual.port));
+    ASSERT_EQ(expected.enabled, actual.enabled);
+    ASSERT_EQ(internedText(expected.status), internedText(actual.status));
+    ASSERT_EQ(internedText(expected.fault), internedText(actual.fault));
+    ASSERT_EQ(internedText(expected.powerClass), internedText(actual.powerClass));
+    ASSERT_EQ(expected.voltage, actual.voltage);
+    ASSERT_EQ(expected.current, actual.current);
+    ASSERT_EQ(expected.power, actual.power);
+    ASSERT_EQ(expected.temperature, actual.temperature);
+}
+
+TEST(snapshot_round_trip) {
+    std::string host = snapshotHost("snapshot-round-trip");
+    Snapshot snapshot;
+    std::string error;
+    {
+        SnapshotPublisher publisher(host, 5000);
+        ASSERT_TRUE(publisher.open(error));
+        ASSERT_FALSE(readSnapshot(host, snapshot, error));
+        ASSERT_CONTAINS(error, "no sample yet");
+
+        std::vector<PoEPortStats> stats;
+        for (int port = 1; port <= 8; port++) {
+            stats.push_back(portStats(port, 53.2f, 20.0f * port, 1.5f * port, 30.0f + port));
+        }
+        stats[2].fault = internText("Overload");
+        stats[5].powerClass = TEXT_CLASS_0;
+        publisher.publish(1792000000000000000LL, stats);
+
+        ASSERT_TRUE(readSnapshot(host, snapshot, error));
+        ASSERT_EQ(host, snapshot.host);
+        ASSERT_EQ(int64_t(1792000000000000000LL), snapshot.timestampNs);
+        ASSERT_EQ(5000, snapshot.intervalMs);
+        ASSERT_TRUE(snapshot.writerAlive);
+        ASSERT_EQ(stats.size(), snapshot.stats.size());
+        for (size_t i = 0; i < stats.size(); i++) {
+            assertSameStats(stats[i], snapshot.stats[i]);
+        }
+
+        // A later sample replaces the earlier one
+        stats.resize(3);
+        stats[0].power = 0.0f;
+        stats[0].enabled = false;
+        publisher.publish(1792000001000000000LL, stats);
+        ASSERT_TRUE(readSnapshot(host, snapshot, error));
+        ASSERT_EQ(size_t(3), snapshot.stats.size());
+        assertSameStats(stats[0], snapshot.stats[0]);
+    }
+
+    // The segment goes with its publisher
+    ASSERT_FALSE(readSnapshot(host, snapshot, error));
+    ASSERT_CONTAINS(error, "No snapshot");
+}
+
+TEST(snapshot_dictionary_starts_over_when_full) {
+    std::string host = snapshotHost("snapshot-dictionary");
+    SnapshotPublisher publisher(host, 1000);
+    std::string error;
+    ASSERT_TRUE(publisher.open(error));
+
+    // Every sample brings new fault texts, far more than the dictionary holds in total
+    for (int sample = 0; sample < 3 * static_cast<int>(SNAPSHOT_TEXTS); sample++) {
+        std::vector<PoEPortStats> stats;
+        for (int port = 1; port <= 8; port++) {
+            stats.push_back(portStats(port, 53.0f, 100.0f, 5.0f, 40.0f));
+            stats.back().fault = internText("Fault " + std::to_string(sample) + "/" + std::to_string(port));
+        }
+        publisher.publish(sample, stats);
+
+        Snapshot snapshot;
+        ASSERT_TRUE(readSnapshot(host, snapshot, error));
+        for (size_t i = 0; i < stats.size(); i++) {
+            assertSameStats(stats[i], snapshot.stats[i]);
+        }
+    }
+}
+
+TEST(snapshot_allows_one_publisher) {
+    std::string host = snapshotHost("snapshot-exclusive");
+    std::string error;
+    {
+        SnapshotPublisher first(host, 1000);
+        ASSERT_TRUE(first.open(error));
+        first.publish(1, {portStats(1, 53.0f, 100.0f, 5.0f, 40.0f)});
+
+        SnapshotPublisher second(host, 1000);
+        ASSERT_FALSE(second.open(error));
+        ASSERT_CONTAINS(error, "Another poller");
+
+        // The refused publisher leaves the first one's segment alone
+        Snapshot snapshot;
+        ASSERT_TRUE(readSnapshot(host, snapshot, error));
+        ASSERT_EQ(size_t(1), snapshot.stats.size());
+    }
+    Snapshot snapshot;
+    ASSERT_FALSE(readSnapshot(host, snapshot, error));
+
+    SnapshotPublisher next(host, 1000);
+    ASSERT_TRUE(next.open(error));
+}
+
+// ---------------------------------------------------------------------------
+// Subscription fan-out
+// ---------------------------------------------------------------------------
+
+static std::string drain(SubscriptionHub &hub, uint32_t id) {
+    PipeCapture capture;
+    ASSERT_TRUE(hub.flush(id, capture.fd()));
+    ASSERT_FALSE(hub.pending(id));
+    return capture.read();
+}
+
+static SubscriptionFilter filterOf(const std::string &text) {
+    SubscriptionFilter filter;
+    std::string error;
+    if (!parseSubscriptionFilter(text, filter, error)) {
+        throw std::runtime_error("filter '" + text + "': " + error);
+    }
+    return filter;
+}
+
+TEST(subscription_filter_parsing) {
+    SubscriptionFilter filter = filterOf("switch=sw1,sw2 ports=1,3 fields=power,fault min-change=0.5");
+    ASSERT_TRUE(filter.switches == std::vector<std::string>({"sw1", "sw2"}));
+    ASSERT_EQ(0x05, int(filter.portMask));
+    ASSERT_EQ(uint32_t(FIELD_POWER | FIELD_FAULT), filter.fields);
+    ASSERT_NEAR(0.5f, filter.minChange, 1e-6f);
+
+    const char *invalid[] = {"ports", "ports=9", "ports=0", "fields=power,watts", "fields=", "min-change=-1",
+                             "colour=red"};
+    for (const char *text : invalid) {
+        SubscriptionFilter rejected;
+        std::string error;
+        ASSERT_FALSE(parseSubscriptionFilter(text, rejected, error));
+        ASSERT_FALSE(error.empty());
+    }
+}
+
+TEST(subscription_filters_switch_port_and_fields) {
+    SubscriptionHub hub;
+    uint32_t narrow = hub.subscribe(filterOf("switch=sw1 ports=2 fields=power,status"));
+    uint32_t everything = hub.subscribe(SubscriptionFilter());
+
+    hub.publish("sw1", 5, drawSample({1.0f, 6.4f}));
+    hub.publish("sw2", 6, drawSample({2.0f}));
+
+    ASSERT_EQ(std::string("{\"time\":5,\"host\":\"sw1\",\"port\":2,\"status\":\"Delivering Power\",\"power\":6.4}\n"),
+              drain(hub, narrow));
+    std::string all = drain(hub, everything);
+    ASSERT_CONTAINS(all, "{\"time\":5,\"host\":\"sw1\",\"port\":1,\"enabled\":true,\"status\":\"Delivering Power\","
+                         "\"class\":\"Class 4\",\"voltage\":53.0,\"current\":19,\"power\":1.0,\"temperature\":40,"
+                         "\"fault\":\"No Error\"}\n");
+    ASSERT_CONTAINS(all, "\"time\":5,\"host\":\"sw1\",\"port\":2,");
+    ASSERT_CONTAINS(all, "\"time\":6,\"host\":\"sw2\",\"port\":1,");
+
+    hub.unsubscribe(narrow);
+    hub.publish("sw1", 7, drawSample({1.0f, 6.4f}));
+    ASSERT_FALSE(hub.pending(narrow));
+    ASSERT_EQ(size_t(1), hub.size());
+}
+
+TEST(subscription_min_change) {
+    SubscriptionHub hub;
+    uint32_t power = hub.subscribe(filterOf("ports=1 fields=power min-change=1"));
+    uint32_t fault = hub.subscribe(filterOf("ports=1 fields=power,fault min-change=1"));
+    uint32_t powerClass = hub.subscribe(filterOf("ports=1 fields=class min-change=1"));
+
+    std::vector<PoEPortStats> sample = drawSample({10.0f});
+    hub.publish("sw1", 1, sample); // The first reading is always sent
+    sample[0].power = 10.5f;
+    hub.publish("sw1", 2, sample);
+    sample[0].power = 11.2f; // Compared with the last one sent, 10.0
+    hub.publish("sw1", 3, sample);
+    sample[0].fault = internText("Overload");
+    hub.publish("sw1", 4, sample);
+    sample[0].powerClass = TEXT_CLASS_2;
+    hub.publish("sw1", 5, sample);
+    sample[0].status = TEXT_SEARCHING; // Not selected by any of them
+    hub.publish("sw1", 6, sample);
+
+    std::string lines = drain(hub, power);
+    ASSERT_EQ(std::string("{\"time\":1,\"host\":\"sw1\",\"port\":1,\"power\":10.0}\n"
+                          "{\"time\":3,\"host\":\"sw1\",\"port\":1,\"power\":11.2}\n"),
+              lines);
+    lines = drain(hub, fault);
+    ASSERT_CONTAINS(lines, "\"time\":3,");
+    ASSERT_CONTAINS(lines, "{\"time\":4,\"host\":\"sw1\",\"port\":1,\"power\":11.2,\"fault\":\"Overload\"}\n");
+    ASSERT_EQ(size_t(3), static_cast<size_t>(std::count(lines.begin(), lines.end(), '\n')));
+    lines = drain(hub, powerClass);
+    ASSERT_EQ(std::string("{\"time\":1,\"host\":\"sw1\",\"port\":1,\"class\":\"Class 4\"}\n"
+                          "{\"time\":5,\"host\":\"sw1\",\"port\":1,\"class\":\"Class 2\"}\n"),
+              lines);
+}
+
+TEST(subscription_slow_reader_loses_oldest) {
+    SubscriptionHub hub;
+    uint32_t slow = hub.subscribe(filterOf("ports=1 fields=power"));
+    const int samples = static_cast<int>(SubscriptionHub::MAX_QUEUED_SAMPLES) + 8;
+    for (int i = 0; i < samples; i++) {
+        hub.publish("sw1", i, drawSample({static_cast<float>(i)}));
+    }
+
+    // A notice of the gap, then the newest samples in order
+    std::istringstream lines(drain(hub, slow));
+    std::string line;
+    std::getline(lines, line);
+    ASSERT_EQ(std::string("{\"dropped\":8}"), line);
+    for (int i = 8; i < samples; i++) {
+        std::getline(lines, line);
+        ASSERT_CONTAINS(line, "{\"time\":" + std::to_string(i) + ",");
+    }
+    ASSERT_FALSE(std::getline(lines, line));
+}
+
+// ---------------------------------------------------------------------------
+// History queries
+// ---------------------------------------------------------------------------
+
+// A history file in /tmp, removed when the test ends
+class TempHistory {
+public:
+    explicit TempHistory(const char *name)
+        : path_("/tmp/gs308ep-test-" + std::to_string(getpid()) + "-" + name + ".ghist") {
+        unlink(path_.c_str());
+    }
+    ~TempHistory() { unlink(path_.c_str()); }
+    const std::string &path() const { return path_; }
+
+    // Record rows one interval apart, with each port's power given by watts(row)
+    void record(const std::string &host, uint32_t rows, const std::function<std::vector<float>(uint32_t)> &watts,
+                int64_t startMs = 1792000000000LL, int intervalMs = 1000) {
+        HistoryWriter writer;
+        std::string error;
+        if (!writer.open(path_, host, intervalMs, error)) {
+            throw std::runtime_error(error);
+        }
+        for (uint32_t row = 0; row < rows; row++) {
+            ASSERT_TRUE(writer.append(startMs + static_cast<int64_t>(row) * intervalMs, drawSample(watts(row))));
+        }
+    }
+
+private:
+    std::string path_;
+};
+
+static HistorySeries onlySeries(const std::vector<std::string> &paths, const HistoryQuery &query) {
+    std::vector<HistorySeries> series;
+    std::string error;
+    if (!queryHistory(paths, query, series, error)) {
+        throw std::runtime_error(error);
+    }
+    ASSERT_EQ(size_t(1), series.size());
+    return series[0];
+}
+
+TEST(history_query_aggregates_and_percentiles) {
+    TempHistory file("aggregates");
+    file.record("sw1", 100, [](uint32_t row) { return std::vector<float>{static_cast<float>(row), 5.0f}; });
+
+    HistoryQuery query;
+    query.portMask = 0x01;
+    query.percentiles = {0, 50, 99.9, 100};
+    query.hasThreshold = true;
+    query.threshold = 89.5f;
+    HistorySeries series = onlySeries({file.path()}, query);
+    ASSERT_EQ(std::string("sw1"), series.host);
+    ASSERT_EQ(1, series.port);
+    ASSERT_EQ(uint64_t(100), series.samples);
+    ASSERT_EQ(0.0f, series.min);
+    ASSERT_EQ(99.0f, series.max);
+    ASSERT_NEAR(49.5, series.mean, 1e-9);
+    // Each sample stands for the second before it; the first has none
+    ASSERT_NEAR(4950.0 / 3600.0, series.energyWh, 1e-9);
+    ASSERT_NEAR(10.0, series.secondsAbove, 1e-9);
+    // Nearest rank: the smallest value with at least p% of samples at or below it
+    ASSERT_EQ(size_t(4), series.percentiles.size());
+    ASSERT_EQ(0.0f, series.percentiles[0]);
+    ASSERT_EQ(49.0f, series.percentiles[1]);
+    ASSERT_EQ(99.0f, series.percentiles[2]);
+    ASSERT_EQ(99.0f, series.percentiles[3]);
+
+    // Every port is a series unless a mask picks some
+    std::vector<HistorySeries> all;
+    std::string error;
+    ASSERT_TRUE(queryHistory({file.path()}, HistoryQuery(), all, error));
+    ASSERT_EQ(size_t(HISTORY_PORTS), all.size());
+    ASSERT_NEAR(5.0, all[1].mean, 1e-9);
+    ASSERT_EQ(uint64_t(100), all[7].samples);
+}
+
+TEST(history_query_time_range_and_gaps) {
+    TempHistory file("range");
+    {
+        HistoryWriter writer;
+        std::string error;
+        ASSERT_TRUE(writer.open(file.path(), "sw1", 1000, error));
+        for (int64_t second = 0; second < 20; second++) {
+            // Ten seconds missing after second 9, longer than the gap limit
+            int64_t at = 1792000000000LL + (second < 10 ? second : second + 10) * 1000;
+            ASSERT_TRUE(writer.append(at, drawSample({10.0f})));
+        }
+    }
+
+    HistoryQuery query;
+    query.portMask = 0x01;
+    HistorySeries series = onlySeries({file.path()}, query);
+    ASSERT_EQ(uint64_t(20), series.samples);
+    ASSERT_NEAR(10.0 * 18 / 3600.0, series.energyWh, 1e-9); // Nothing across the gap
+
+    // From is inclusive and to exclusive
+    query.fromMs = 1792000000000LL + 5000;
+    query.toMs = 1792000000000LL + 25000;
+    series = onlySeries({file.path()}, query);
+    ASSERT_EQ(uint64_t(10), series.samples); // Seconds 5-9 and 20-24
+    ASSERT_NEAR(10.0 * 8 / 3600.0, series.energyWh, 1e-9);
+
+    query.fromMs = 1792000000000LL + 60000;
+    query.toMs = LLONG_MAX;
+    series = onlySeries({file.path()}, query);
+    ASSERT_EQ(uint64_t(0), series.samples);
+    ASSERT_EQ(0.0f, series.min);
+    ASSERT_NEAR(0.0, series.mean, 1e-12);
+}
+
+TEST(history_query_per_switch_and_top) {
+    TempHistory first("switch-a");
+    TempHistory second("switch-b");
+    first.record("sw-a", 10, [](uint32_t) { return std::vector<float>{2.0f, 3.0f}; });
+    second.record("sw-b", 10, [](uint32_t) { return std::vector<float>{1.0f, 1.0f, 1.0f, 10.0f}; });
+
+    HistoryQuery query;
+    query.perSwitch = true;
+    std::vector<HistorySeries> series;
+    std::string error;
+    ASSERT_TRUE(queryHistory({first.path(), second.path()}, query, series, error));
+    ASSERT_EQ(size_t(2), series.size());
+    ASSERT_EQ(0, series[0].port);
+    ASSERT_NEAR(5.0, series[0].mean, 1e-6);
+    ASSERT_NEAR(13.0, series[1].mean, 1e-6);
+
+    // Top keeps the series with the most energy
+    query.perSwitch = false;
+    query.top = 1;
+    ASSERT_TRUE(queryHistory({first.path(), second.path()}, query, series, error));
+    ASSERT_EQ(size_t(1), series.size());
+    ASSERT_EQ(std::string("sw-b"), series[0].host);
+    ASSERT_EQ(4, series[0].port);
+
+    ASSERT_FALSE(queryHistory({"/nonexistent/gs308ep.ghist"}, query, series, error));
+}
+
+TEST(history_query_sealed_segments_match_raw_rows) {
+    // Enough rows that the first block is sealed into a compressed segment
+    const uint32_t rows = HISTORY_BLOCK_ROWS + 500;
+    TempHistory file("sealed");
+    file.record("sw1", rows, [](uint32_t row) { return std::vector<float>{static_cast<float>(row % 50) / 10.0f}; });
+    {
+        HistoryFile history;
+        std::string error;
+        ASSERT_TRUE(history.open(file.path(), error));
+        ASSERT_EQ(size_t(1), history.segmentCount());
+    }
+
+    // Whole-segment totals from its header, then the same from decoded columns
+    HistoryQuery query;
+    query.portMask = 0x01;
+    query.hasThreshold = true;
+    query.threshold = 10.0f; // Above every value, so the header suffices
+    HistorySeries fromHeader = onlySeries({file.path()}, query);
+    query.percentiles = {50};
+    query.threshold = 2.45f;
+    HistorySeries decoded = onlySeries({file.path()}, query);
+
+    double sum = 0.0;
+    double energy = 0.0;
+    double above = 0.0;
+    for (uint32_t row = 0; row < rows; row++) {
+        float value = static_cast<float>(row % 50) / 10.0f;
+        sum += value;
+        energy += row ? value : 0.0f;
+        above += row && value > 2.45f ? 1.0 : 0.0;
+    }
+    for (const HistorySeries &series : {fromHeader, decoded}) {
+        ASSERT_EQ(uint64_t(rows), series.samples);
+        ASSERT_EQ(0.0f, series.min);
+        ASSERT_EQ(4.9f, series.max);
+        ASSERT_NEAR(sum / rows, series.mean, 1e-6);
+        ASSERT_NEAR(energy / 3600.0, series.energyWh, 1e-6);
+    }
+    ASSERT_NEAR(0.0, fromHeader.secondsAbove, 1e-9);
+    ASSERT_NEAR(above, decoded.secondsAbove, 1e-6);
+    ASSERT_EQ(2.4f, decoded.percentiles[0]);
+}
+
+TEST(history_time_and_metric_parsing) {
+    int64_t ms = 0;
+    ASSERT_TRUE(parseHistoryTime("1700000000", ms));
+    ASSERT_EQ(int64_t(1700000000000LL), ms);
+    int64_t now = 0;
+    int64_t weekAgo = 0;
+    ASSERT_TRUE(parseHistoryTime("now", now));
+    ASSERT_TRUE(parseHistoryTime("-7d", weekAgo));
+    ASSERT_NEAR(7.0 * 86400000.0, static_cast<double>(now - weekAgo), 5000.0);
+    ASSERT_TRUE(parseHistoryTime("2026-10-18T12:30", ms));
+    ASSERT_FALSE(parseHistoryTime("yesterday", ms));
+    ASSERT_FALSE(parseHistoryTime("-7x", ms));
+
+    HistoryColumn metric = HISTORY_POWER;
+    ASSERT_TRUE(parseHistoryMetric("temperature", metric));
+    ASSERT_EQ(int(HISTORY_TEMPERATURE), int(metric));
+    ASSERT_FALSE(parseHistoryMetric("watts", metric));
+}
+
+// ---------------------------------------------------------------------------
+// Fleet aggregation
+// ---------------------------------------------------------------------------
+
+static FleetSwitch fleetSwitch(const std::string &host, const std::string &site, const std::string &rack,
+                               std::vector<std::string> tags = {}) {
+    FleetSwitch entry;
+    entry.host = host;
+    entry.site = site;
+    entry.rack = rack;
+    entry.tags = tags;
+    return entry;
+}
+
+static const GroupAggregate &groupOf(const std::vector<GroupAggregate> &groups, const std::string &kind,
+                                     const std::string &name) {
+    for (const auto &group : groups) {
+        if (group.kind == kind && group.name == name) {
+            return group;
+        }
+    }
+    throw std::runtime_error("no group " + kind + ":" + name);
+}
+
+TEST(fleet_groups_ordered_by_kind_then_name) {
+    std::vector<FleetSwitch> switches = {fleetSwitch("c", "west", "r1", {"poe"}), fleetSwitch("a", "east", "r2"),
+                                         fleetSwitch("b", "east", "r1", {"lab", "poe"})};
+    FleetAggregator aggregator(switches, 0);
+    std::vector<GroupAggregate> groups;
+    aggregator.snapshot(groups);
+
+    std::vector<std::string> names;
+    for (const auto &group : groups) {
+        names.push_back(group.kind + ":" + group.name);
+    }
+    ASSERT_TRUE(names == std::vector<std::string>({"fleet:all", "site:east", "site:west", "rack:east/r1",
+                                                   "rack:east/r2", "rack:west/r1", "tag:lab", "tag:poe"}));
+    ASSERT_EQ(3u, groupOf(groups, "fleet", "all").switches);
+    ASSERT_EQ(2u, groupOf(groups, "site", "east").switches);
+    ASSERT_EQ(2u, groupOf(groups, "tag", "poe").switches);
+    ASSERT_EQ(0u, groupOf(groups, "fleet", "all").reporting);
+}
+
+TEST(fleet_updates_replace_previous_poll) {
+    std::vector<FleetSwitch> switches = {fleetSwitch("a", "east", "r1"), fleetSwitch("b", "east", "r2"),
+                                         fleetSwitch("c", "west", "r1")};
+    FleetAggregator aggregator(switches, 0);
+
+    std::vector<PoEPortStats> first = {portStats(1, 53.0f, 30.0f, 1.5f, 40.0f), portStats(2, 53.0f, 40.0f, 2.25f, 41.0f)};
+    std::vector<PoEPortStats> second = {portStats(1, 53.0f, 75.0f, 4.0f, 39.0f), portStats(2, 0.0f, 0.0f, 0.0f, 30.0f)};
+    second[1].fault = internText("Over Current");
+    aggregator.update(0, &first);
+    aggregator.update(1, &second);
+    aggregator.update(2, nullptr);
+
+    std::vector<GroupAggregate> groups;
+    aggregator.snapshot(groups);
+    const GroupAggregate &fleet = groupOf(groups, "fleet", "all");
+    ASSERT_EQ(2u, fleet.reporting);
+    ASSERT_EQ(3u, fleet.delivering);
+    ASSERT_EQ(1u, fleet.faulted);
+    ASSERT_NEAR(7.75, fleet.powerWatts, 1e-9);
+    ASSERT_NEAR(3.875, fleet.averageWatts, 1e-9);
+    ASSERT_EQ(0u, groupOf(groups, "site", "west").reporting);
+    ASSERT_NEAR(0.0, groupOf(groups, "site", "west").averageWatts, 1e-9);
+
+    // A newer poll replaces the old one rather than adding to it
+    std::vector<PoEPortStats> third = {portStats(1, 53.0f, 20.0f, 1.0f, 40.0f)};
+    aggregator.update(0, &third);
+    aggregator.snapshot(groups);
+    ASSERT_NEAR(5.0, groupOf(groups, "fleet", "all").powerWatts, 1e-9);
+    ASSERT_NEAR(1.0, groupOf(groups, "rack", "east/r1").powerWatts, 1e-9);
+    ASSERT_EQ(2u, groupOf(groups, "site", "east").delivering);
+
+    // An unreachable switch stops reporting and takes its power with it
+    aggregator.update(0, nullptr);
+    aggregator.snapshot(groups);
+    ASSERT_EQ(1u, groupOf(groups, "fleet", "all").reporting);
+    ASSERT_NEAR(4.0, groupOf(groups, "fleet", "all").powerWatts, 1e-9);
+    ASSERT_EQ(3u, groupOf(groups, "fleet", "all").switches);
+}
+
+TEST(fleet_deltas_do_not_drift) {
+    std::vector<FleetSwitch> switches = {fleetSwitch("a", "", ""), fleetSwitch("b", "", ""), fleetSwitch("c", "", "")};
+    FleetAggregator aggregator(switches, 0);
+    std::mt19937 random(7);
+    std::uniform_real_distribution<float> watts(0.0f, 30.0f);
+
+    std::vector<std::vector<PoEPortStats>> latest(switches.size());
+    for (int i = 0; i < 20000; i++) {
+        size_t index = random() % switches.size();
+        std::vector<PoEPortStats> stats;
+        for (int port = 1; port <= 8; port++) {
+            stats.push_back(portStats(port, 53.0f, 100.0f, watts(random), 40.0f));
+        }
+        aggregator.update(index, &stats);
+        latest[index] = stats;
+    }
+
+    int64_t expected = 0;
+    for (const auto &stats : latest) {
+        for (const auto &port : stats) {
+            expected += std::lround(port.power * 1000.0f);
+        }
+    }
+    std::vector<GroupAggregate> groups;
+    aggregator.snapshot(groups);
+    ASSERT_EQ(static_cast<double>(expected) / 1000.0, groups[0].powerWatts);
+}
+
+TEST(fleet_hottest_ports_ranked) {
+    std::vector<FleetSwitch> switches = {fleetSwitch("a", "east", ""), fleetSwitch("b", "east", "")};
+    FleetAggregator aggregator(switches, 3);
+
+    std::vector<PoEPortStats> a = {portStats(1, 0, 0, 0, 40.0f), portStats(2, 0, 0, 0, 55.0f),
+                                   portStats(3, 0, 0, 0, 48.0f)};
+    std::vector<PoEPortStats> b = {portStats(1, 0, 0, 0, 48.0f), portStats(2, 0, 0, 0, 30.0f)};
+    aggregator.update(0, &a);
+    aggregator.update(1, &b);
+
+    std::vector<GroupAggregate> groups;
+    aggregator.snapshot(groups);
+    const std::vector<HotPort> &hottest = groupOf(groups, "site", "east").hottest;
+    ASSERT_EQ(size_t(3), hottest.size());
+    ASSERT_EQ(std::string("a"), hottest[0].host);
+    ASSERT_EQ(2, hottest[0].port);
+    // Equal temperatures rank by switch, then port
+    ASSERT_EQ(std::string("a"), hottest[1].host);
+    ASSERT_EQ(3, hottest[1].port);
+    ASSERT_EQ(std::string("b"), hottest[2].host);
+    ASSERT_EQ(1, hottest[2].port);
+
+    // A cooled port drops out of the ranking, and an unreachable switch leaves it
+    a[1].temperature = 35.0f;
+    aggregator.update(0, &a);
+    aggregator.update(1, nullptr);
+    aggregator.snapshot(groups);
+    const std::vector<HotPort> &cooled = groupOf(groups, "fleet", "all").hottest;
+    ASSERT_EQ(size_t(3), cooled.size());
+    ASSERT_EQ(3, cooled[0].port);
+    ASSERT_EQ(1, cooled[1].port);
+    ASSERT_NEAR(40.0f, cooled[1].temperature, 1e-6f);
+    ASSERT_EQ(2, cooled[2].port);
+    ASSERT_NEAR(35.0f, cooled[2].temperature, 1e-6f);
+}
+
+TEST(fleet_inactive_switches_leave_their_groups) {
+    std::vector<FleetSwitch> switches = {fleetSwitch("a", "east", "r1"), fleetSwitch("b", "east", "r2")};
+    FleetAggregator aggregator(switches, 2);
+    std::vector<PoEPortStats> a = {portStats(1, 53.0f, 50.0f, 2.5f, 40.0f)};
+    std::vector<PoEPortStats> b = {portStats(1, 53.0f, 100.0f, 5.0f, 50.0f)};
+    aggregator.update(0, &a);
+    aggregator.update(1, &b);
+
+    aggregator.setActive(1, false);
+    aggregator.setActive(1, false);
+    std::vector<GroupAggregate> groups;
+    aggregator.snapshot(groups);
+    const GroupAggregate &site = groupOf(groups, "site", "east");
+    ASSERT_EQ(1u, site.switches);
+    ASSERT_EQ(1u, site.reporting);
+    ASSERT_EQ(1u, site.delivering);
+    ASSERT_NEAR(2.5, site.powerWatts, 1e-9);
+    ASSERT_EQ(size_t(1), site.hottest.size());
+    ASSERT_EQ(std::string("a"), site.hottest[0].host);
+    ASSERT_EQ(0u, groupOf(groups, "rack", "east/r2").switches);
+
+    // Reactivated, it counts as a member again but reports only once polled
+    aggregator.setActive(1, true);
+    aggregator.snapshot(groups);
+    ASSERT_EQ(2u, groupOf(groups, "site", "east").switches);
+    ASSERT_EQ(1u, groupOf(groups, "site", "east").reporting);
+    aggregator.update(1, &b);
+    aggregator.snapshot(groups);
+    ASSERT_EQ(2u, groupOf(groups, "site", "east").reporting);
+    ASSERT_NEAR(7.5, groupOf(groups, "site", "east").powerWatts, 1e-9);
+}
+
+// ---------------------------------------------------------------------------
+// Bounded queue
+// ---------------------------------------------------------------------------
+
+TEST(bounded_queue_fifo_and_capacity) {
+    BoundedQueue<int> queue(5);
+    ASSERT_EQ(size_t(8), queue.capacity());
+    int value = 0;
+    ASSERT_FALSE(queue.tryPop(value));
+    for (int i = 0; i < 8; i++) {
+        ASSERT_TRUE(queue.tryPush(int(i)));
+    }
+    ASSERT_FALSE(queue.tryPush(99));
+    ASSERT_EQ(size_t(8), queue.depth());
+    for (int i = 0; i < 8; i++) {
+        ASSERT_TRUE(queue.tryPop(value));
+        ASSERT_EQ(i, value);
+    }
+    ASSERT_FALSE(queue.tryPop(value));
+    ASSERT_EQ(size_t(8), queue.takeHighWater());
+    ASSERT_EQ(size_t(0), queue.takeHighWater());
+}
+
+TEST(bounded_queue_many_producers_and_consumers) {
+    const int producers = 4;
+    const int consumers = 4;
+    const int perProducer = 50000;
+    BoundedQueue<uint32_t> queue(64);
+    std::vector<std::atomic<uint8_t>> seen(producers * perProducer);
+    for (auto &flag : seen) {
+        flag.store(0);
+    }
+    std::atomic<bool> stop(false);
+    std::atomic<int> received(0);
+
+    std::vector<std::thread> threads;
+    for (int c = 0; c < consumers; c++) {
+        threads.emplace_back([&]() {
+            uint32_t value;
+            while (queue.pop(value, stop)) {
+                seen[value].fetch_add(1);
+                received.fetch_add(1);
+            }
+        });
+    }
+    std::vector<std::thread> senders;
+    for (int p = 0; p < producers; p++) {
+        senders.emplace_back([&, p]() {
+            for (int i = 0; i < perProducer; i++) {
+                queue.push(static_cast<uint32_t>(p * perProducer + i));
+            }
+        });
+    }
+    for (auto &thread : senders) {
+        thread.join();
+    }
+    while (received.load() < producers * perProducer) {
+        std::this_thread::yield();
+    }
+    stop.store(true);
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    for (auto &flag : seen) {
+        ASSERT_EQ(1, int(flag.load()));
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Text interning
+// ---------------------------------------------------------------------------
+
+TEST(intern_known_texts_have_fixed_ids) {
+    ASSERT_EQ(TextId(TEXT_UNKNOWN), internText("Unknown"));
+    ASSERT_EQ(TextId(TEXT_EMPTY), internText(""));
+    ASSERT_EQ(TextId(TEXT_DELIVERING_POWER), internText("Delivering Power"));
+    ASSERT_EQ(TextId(TEXT_NO_ERROR), internText("No Error"));
+    ASSERT_EQ(TextId(TEXT_CLASS_4), internText("Class 4"));
+    ASSERT_EQ(std::string("Searching"), internedText(TEXT_SEARCHING));
+    ASSERT_EQ(std::string("Class 0"), internedText(TEXT_CLASS_0));
+}
+
+TEST(intern_new_texts_round_trip) {
+    TextId first = internText("Intern Test Overload");
+    ASSERT_TRUE(first >= KNOWN_TEXT_COUNT);
+    ASSERT_EQ(first, internText(std::string("Intern Test Overload")));
+    ASSERT_EQ(std::string("Intern Test Overload"), internedText(first));
+
+    // Only the given length counts, and embedded NULs are kept
+    const char buffer[] = "Intern Test Overload, truncated";
+    ASSERT_EQ(first, internText(buffer, 20));
+    std::string withNul("Intern\0Test", 11);
+    TextId nul = internText(withNul);
+    ASSERT_TRUE(nul != internText("Intern"));
+    ASSERT_EQ(withNul, internedText(nul));
+
+    // Ids the table never handed out read as "Unknown"
+    ASSERT_EQ(std::string("Unknown"), internedText(TextId(MAX_INTERNED_TEXTS)));
+    ASSERT_EQ(std::string("Unknown"), internedText(TextId(MAX_INTERNED_TEXTS - 1)));
+}
+
+TEST(intern_concurrent_threads_agree) {
+    const int threadCount = 4;
+    const int textCount = 64;
+    std::vector<std::vector<TextId>> ids(threadCount, std::vector<TextId>(textCount));
+    std::vector<std::thread> threads;
+    for (int t = 0; t < threadCount; t++) {
+        threads.emplace_back([t, &ids]() {
+            // Each thread walks the texts in a different order
+            for (int i = 0; i < textCount; i++) {
+                int text = (i * (2 * t + 1)) % textCount;
+                ids[t][text] = internText("Intern Race " + std::to_string(text));
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    for (int text = 0; text < textCount; text++) {
+        for (int t = 1; t < threadCount; t++) {
+            ASSERT_EQ(ids[0][text], ids[t][text]);
+        }
+        ASSERT_EQ("Intern Race " + std::to_string(text), internedText(ids[0][text]));
+        for (int other = 0; other < text; other++) {
+            ASSERT_TRUE(ids[0][other] != ids[0][text]);
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Status page view against the parser it replaced
+// ---------------------------------------------------------------------------
+
+// The page scanners as they were before StatusPageView, kept verbatim as the
+// reference the view must agree with
+namespace baseline {
+
+static float spanFloat(const std::string &html, size_t spanStart, size_t spanEnd, float fallback) {
+    const char *begin = html.c_str() + spanStart;
+    char *end = nullptr;
+    float value = std::strtof(begin, &end);
+    if (end == begin || end > html.c_str() + spanEnd) {
+        return fallback;
+    }
+    return value;
+}
+
+static size_t findPortMarker(const std::string &html, int port) {
+    char marker[24];
+    std::snprintf(marker, sizeof(marker), "value=\"%d\"", port);
+    return html.find(marker);
+}
+
+static size_t findLastWithin(const std::string &html, const char *needle, size_t from, size_t to) {
+    size_t length = std::strlen(needle);
+    if (to < from + length) {
+        return std::string::npos;
+    }
+    size_t pos = html.rfind(needle, to - length);
+    return pos != std::string::npos && pos >= from ? pos : std::string::npos;
+}
+
+static size_t findWithin(const std::string &html, const char *needle, size_t from, size_t to) {
+    size_t pos = html.find(needle, from);
+    return pos != std::string::npos && pos + std::strlen(needle) <= to ? pos : std::string::npos;
+}
+
+static bool portPowerFlag(const std::string &statusPage, int port) {
+    std::string portMarker = "value=\"" + std::to_string(port) + "\"";
+    size_t portPos = statusPage.find(portMarker);
+    if (portPos == std::string::npos) {
+        return false;
+    }
+    size_t searchEnd = std::min(portPos + 1000, statusPage.length());
+    std::string searchArea = statusPage.substr(portPos, searchEnd - portPos);
+    size_t pwrPos = searchArea.find("hidPortPwr");
+    if (pwrPos != std::string::npos) {
+        size_t valuePos = searchArea.find("value", pwrPos);
+        if (valuePos != std::string::npos) {
+            size_t quotePos = searchArea.find("\"", valuePos);
+            if (quotePos != std::string::npos) {
+                return searchArea[quotePos + 1] == '1';
+            }
+        }
+    }
+    return false;
+}
+
+static float extractPortPower(const std::string &html, int port) {
+    size_t portPos = findPortMarker(html, port);
+    if (portPos == std::string::npos) {
+        return -1.0f;
+    }
+    size_t ml574Pos = html.find("ml574", portPos);
+    if (ml574Pos == std::string::npos || ml574Pos > portPos + 2000) {
+        return -1.0f;
+    }
+    size_t spanStart = html.find("<span>", ml574Pos + 5);
+    if (spanStart == std::string::npos) {
+        return -1.0f;
+    }
+    spanStart += 6;
+    size_t spanEnd = html.find("</span>", spanStart);
+    if (spanEnd == std::string::npos) {
+        return -1.0f;
+    }
+    return spanFloat(html, spanStart, spanEnd, -1.0f);
+}
+
+static bool extractPortStats(const std::string &html, int port, PoEPortStats &stats) {
+    stats.port = port;
+    stats.enabled = false;
+    stats.status = TEXT_UNKNOWN;
+    stats.voltage = 0.0f;
+    stats.current = 0.0f;
+    stats.power = 0.0f;
+    stats.temperature = 0.0f;
+    stats.fault = TEXT_UNKNOWN;
+    stats.powerClass = TEXT_UNKNOWN;
+
+    size_t portPos = findPortMarker(html, port);
+    if (portPos == std::string::npos) {
+        return false;
+    }
+    size_t searchStart = (portPos > 500) ? portPos - 500 : 0;
+
+    size_t statusModePos = findLastWithin(html, "poe-power-mode", searchStart, portPos);
+    if (statusModePos != std::string::npos) {
+        size_t spanStart = findWithin(html, "<span>", statusModePos, portPos);
+        if (spanStart != std::string::npos) {
+            spanStart += 6;
+            size_t spanEnd = findWithin(html, "</span>", spanStart, portPos);
+            if (spanEnd != std::string::npos) {
+                stats.status = internText(html.data() + spanStart, spanEnd - spanStart);
+                stats.enabled = (stats.status == TEXT_DELIVERING_POWER);
+            }
+        }
+    }
+
+    size_t classPos = findLastWithin(html, "powClassShow", searchStart, portPos);
+    if (classPos != std::string::npos) {
+        size_t spanStart = findWithin(html, ">", classPos, portPos);
+        if (spanStart != std::string::npos) {
+            spanStart++;
+            size_t spanEnd = findWithin(html, "</span>", spanStart, portPos);
+            if (spanEnd != std::string::npos) {
+                size_t length = spanEnd - spanStart;
+                if (html.compare(spanStart, 6, "ml003@") == 0 && length > 7) {
+                    size_t atPos = findWithin(html, "@", spanStart + 6, spanEnd);
+                    if (atPos != std::string::npos) {
+                        char text[32];
+                        int written = std::snprintf(text, sizeof(text), "Class %.*s",
+                                                    static_cast<int>(atPos - spanStart - 6), html.data() + spanStart + 6);
+                        stats.powerClass = internText(text, std::min(static_cast<size_t>(written), sizeof(text) - 1));
+                    }
+                } else {
+                    stats.powerClass = internText(html.data() + spanStart, length);
+                }
+            }
+        }
+    }
+
+    auto extractValue = [&](const char *field) -> float {
+        size_t fieldPos = html.find(field, portPos);
+        if (fieldPos != std::string::npos && fieldPos < portPos + 2000) {
+            size_t spanStart = html.find("<span>", fieldPos + 5);
+            if (spanStart != std::string::npos) {
+                spanStart += 6;
+                size_t spanEnd = html.find("</span>", spanStart);
+                if (spanEnd != std::string::npos) {
+                    return spanFloat(html, spanStart, spanEnd, 0.0f);
+                }
+            }
+        }
+        return 0.0f;
+    };
+
+    stats.voltage = extractValue("ml570");
+    stats.current = extractValue("ml572");
+    stats.power = extractPortPower(html, port);
+    stats.temperature = extractValue("ml575");
+
+    size_t ml581Pos = html.find("ml581", portPos);
+    if (ml581Pos != std::string::npos && ml581Pos < portPos + 2000) {
+        size_t spanStart = html.find("<span>", ml581Pos + 5);
+        if (spanStart != std::string::npos) {
+            spanStart += 6;
+            size_t spanEnd = html.find("</span>", spanStart);
+            if (spanEnd != std::string::npos) {
+                stats.fault = internText(html.data() + spanStart, spanEnd - spanStart);
+            }
+        }
+    }
+    return true;
+}
+
+} // namespace baseline
+
+static bool sameReading(float expected, float actual) {
+    return (std::isnan(expected) && std::isnan(actual)) || expected == actual;
+}
+
+// Every field and return value of every port the view and the baseline read
+// from the page, each port looked up on a fresh view and on a shared one
+static void assertViewMatchesBaseline(const std::string &html) {
+    StatusPageView shared(html);
+    for (int pass = 0; pass < 2; pass++) {
+        for (int port = 1; port <= 8; port++) {
+            StatusPageView fresh(html);
+            const StatusPageView &view = pass == 0 ? fresh : shared;
+            std::string where = "port " + std::to_string(port) + " of a " + std::to_string(html.size()) + " byte page";
+
+            PoEPortStats expected;
+            PoEPortStats actual;
+            bool expectedFound = baseline::extractPortStats(html, port, expected);
+            bool actualFound = view.stats(port, actual);
+            if (expectedFound != actualFound || expected.port != actual.port ||
+                expected.enabled != actual.enabled || expected.status != actual.status ||
+                expected.powerClass != actual.powerClass || expected.fault != actual.fault ||
+                !sameReading(expected.voltage, actual.voltage) || !sameReading(expected.current, actual.current) ||
+                !sameReading(expected.power, actual.power) ||
+                !sameReading(expected.temperature, actual.temperature)) {
+                throw std::runtime_error("stats differ on " + where);
+            }
+
+            float power = baseline::extractPortPower(html, port);
+            float viewPower = view.power(port);
+            if (!sameReading(power, viewPower)) {
+                throw std::runtime_error("power differs on " + where);
+            }
+            bool flag = baseline::portPowerFlag(html, port);
+            bool viewFlag = view.powerFlag(port);
+            if (flag != viewFlag) {
+                throw std::runtime_error("power flag differs on " + where);
+            }
+            bool present = baseline::findPortMarker(html, port) != std::string::npos;
+            bool viewPresent = view.hasPort(port);
+            if (present != viewPresent) {
+                throw std::runtime_error("presence differs on " + where);
+            }
+        }
+    }
+}
+
+// A page as the mock switch serves it, with per-port variations
+static std::string variedBlock(int port, const char *status, const char *powerClass, int flag, const char *power,
+                               const char *fault) {
+    char block[1024];
+    std::snprintf(block, sizeof(block),
+                  "<li class=\"poePortStatusListItem\">\n"
+                  "<span class=\"pull-right poe-power-mode\"><span>%s</span></span>\n"
+                  "<span class=\"powClassShow\">%s</span>\n"
+                  "<input type=\"hidden\" class=\"port\" value=\"%d\">\n"
+                  "<input type=\"hidden\" class=\"hidPortPwr\" id=\"hidPortPwr\" value=\"%d\">\n"
+                  "<div><span class='hid-txt wid-full'>ml570</span></div><div><span>53.%d</span></div>\n"
+                  "<div><span class='hid-txt wid-full'>ml572</span></div><div><span>%d</span></div>\n"
+                  "<div><span class='hid-txt wid-full'>ml574</span></div><div><span>%s</span></div>\n"
+                  "<div><span class='hid-txt wid-full'>ml575</span></div><div><span>%d</span></div>\n"
+                  "<div><span class='hid-txt wid-full'>ml581</span></div><div><span>%s</span></div>\n"
+                  "</li>\n",
+                  status, powerClass, port, flag, port, 40 * port, power, 30 + port, fault);
+    return block;
+}
+
+static std::string variedPage() {
+    return statusPage(variedBlock(1, "Delivering Power", "ml003@4@", 1, "6.4", "No Error") +
+                      variedBlock(2, "Searching", "ml003@0@", 1, "0.0", "No Error") +
+                      variedBlock(3, "Disabled", "Class 2", 0, "0", "No Error") +
+                      variedBlock(4, "Delivering Power", "ml003@12@", 1, "12.75", "Over Current") +
+                      variedBlock(5, "Fault", "ml003@", 1, "n/a", "Short Circuit") +
+                      variedBlock(6, "Delivering Power", "", 1, "-3.5e1", "") +
+                      variedBlock(7, "Delivering Power", "ml003@3@", 1, "nan", "No Error") +
+                      variedBlock(8, "Searching", "ml003@1@", 0, "inf", "No Error"));
+}
+
+TEST(status_view_matches_baseline_on_full_page) {
+    std::string html = variedPage();
+    assertViewMatchesBaseline(html);
+
+    // Spot-check that the comparison is looking at real values
+    StatusPageView view(html);
+    PoEPortStats stats;
+    ASSERT_TRUE(view.stats(4, stats));
+    ASSERT_EQ(std::string("Class 12"), internedText(stats.powerClass));
+    ASSERT_EQ(std::string("Over Current"), internedText(stats.fault));
+    ASSERT_NEAR(12.75f, stats.power, 1e-6f);
+    ASSERT_NEAR(-1.0f, view.power(5), 1e-6f);
+    ASSERT_FALSE(view.powerFlag(3));
+}
+
+TEST(status_view_matches_baseline_with_missing_ports) {
+    std::string blocks;
+    for (int port : {1, 2, 4, 5, 8}) {
+        blocks += variedBlock(port, "Delivering Power", "ml003@4@", 1, "4.5", "No Error");
+    }
+    std::string html = statusPage(blocks);
+    assertViewMatchesBaseline(html);
+    StatusPageView view(html);
+    ASSERT_FALSE(view.hasPort(3));
+    ASSERT_NEAR(-1.0f, view.power(3), 1e-6f);
+    ASSERT_EQ(TextId(TEXT_UNKNOWN), view.status(7));
+
+    // Blocks out of order, a missing reading, and no page at all
+    std::string reordered = statusPage(variedBlock(6, "Searching", "ml003@2@", 0, "0.0", "No Error") +
+                                       variedBlock(2, "Delivering Power", "ml003@4@", 1, "7.0", "No Error"));
+    assertViewMatchesBaseline(reordered);
+    std::string noPower = variedPage();
+    size_t reading = noPower.find("ml574");
+    noPower.replace(reading, 5, "ml999");
+    assertViewMatchesBaseline(noPower);
+    assertViewMatchesBaseline("");
+    assertViewMatchesBaseline("<html><body>Login required</body></html>");
+}
+
+TEST(status_view_matches_baseline_on_truncated_pages) {
+    std::string html = variedPage();
+    for (size_t length = 0; length < html.size(); length += 7) {
+        assertViewMatchesBaseline(html.substr(0, length));
+    }
+    // Every cut through one block's markup
+    size_t block = html.find("value=\"4\"");
+    for (size_t length = block - 200; length < block + 500; length++) {
+        assertViewMatchesBaseline(html.substr(0, length));
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Audit log
+// ---------------------------------------------------------------------------
+
+class TempAudit {
+public:
+    explicit TempAudit(const char *name)
+        : path_("/tmp/gs308ep-test-" + std::to_string(getpid()) + "-" + name + ".audit") {
+        unlink(path_.c_str());
+    }
+    ~TempAudit() { unlink(path_.c_str()); }
+    const std::string &path() const { return path_; }
+
+    void record(const std::vector<AuditRecord> &records) const {
+        AuditLog log;
+        std::string error;
+        if (!log.open(path_, std::chrono::milliseconds(1), error)) {
+            throw std::runtime_error(error);
+        }
+        for (const auto &record : records) {
+            log.record(record);
+        }
+        log.close();
+    }
+
+    std::vector<AuditRecord> query(const AuditFilter &filter = AuditFilter(), size_t expectedCorrupt = 0) const {
+        std::vector<AuditRecord> records;
+        size_t corrupt = 0;
+        std::string error;
+        if (!queryAudit({path_}, filter, records, corrupt, error)) {
+            throw std::runtime_error(error);
+        }
+        ASSERT_EQ(expectedCorrupt, corrupt);
+        return records;
+    }
+
+private:
+    std::string path_;
+};
+
+static AuditRecord auditRecord(const std::string &host, int port, int64_t timestampMs, bool enable) {
+    AuditRecord record;
+    std::memset(&record, 0, sizeof(record));
+    record.timestampMs = timestampMs;
+    record.latencyUs = static_cast<uint32_t>(1000 + port);
+    record.hostHash = auditHostHash(host);
+    record.uid = 1000;
+    record.pid = static_cast<uint32_t>(getpid());
+    record.actionId = static_cast<uint32_t>(port * 10);
+    record.port = static_cast<uint8_t>(port);
+    record.enable = enable ? 1 : 0;
+    record.source = AUDIT_SCHEDULE;
+    record.success = 1;
+    record.before = enable ? AUDIT_STATE_OFF : AUDIT_STATE_ON;
+    record.after = enable ? AUDIT_STATE_ON : AUDIT_STATE_OFF;
+    std::strncpy(record.host, host.c_str(), sizeof(record.host) - 1);
+    return record;
+}
+
+TEST(audit_log_round_trip_and_filters) {
+    TempAudit file("round-trip");
+    std::vector<AuditRecord> written;
+    for (int i = 0; i < 40; i++) {
+        written.push_back(auditRecord(i % 2 ? "sw2" : "sw1", 1 + i % 8, 1792000000000LL + i * 1000, i % 3 == 0));
+    }
+    // Written slightly out of order, as several writers can be
+    std::swap(written[5], written[6]);
+    file.record(written);
+
+    std::vector<AuditRecord> all = file.query();
+    ASSERT_EQ(size_t(40), all.size());
+    for (size_t i = 0; i < all.size(); i++) {
+        ASSERT_EQ(1792000000000LL + static_cast<int64_t>(i) * 1000, all[i].timestampMs);
+    }
+    const AuditRecord &third = all[3];
+    ASSERT_EQ(std::string("sw2"), std::string(third.host));
+    ASSERT_EQ(4, int(third.port));
+    ASSERT_EQ(1, int(third.enable));
+    ASSERT_EQ(40u, third.actionId);
+    ASSERT_EQ(1004u, third.latencyUs);
+    ASSERT_EQ(int(AUDIT_SCHEDULE), int(third.source));
+    ASSERT_EQ(int(AUDIT_STATE_ON), int(third.after));
+
+    AuditFilter byHost;
+    byHost.hosts = {"sw1"};
+    ASSERT_EQ(size_t(20), file.query(byHost).size());
+
+    AuditFilter byPort;
+    byPort.portMask = 0x81; // Ports 1 and 8
+    ASSERT_EQ(size_t(10), file.query(byPort).size());
+
+    AuditFilter byTime;
+    byTime.fromMs = 1792000010000LL;
+    byTime.toMs = 1792000015000LL;
+    std::vector<AuditRecord> window = file.query(byTime);
+    ASSERT_EQ(size_t(5), window.size());
+    ASSERT_EQ(1792000010000LL, window.front().timestampMs);
+}
+
+TEST(audit_log_appends_across_opens_and_trims_torn_tail) {
+    TempAudit file("torn");
+    file.record({auditRecord("sw1", 1, 1000, true), auditRecord("sw1", 2, 2000, false)});
+
+    // A writer that died mid-commit leaves part of a record behind
+    int fd = open(file.path().c_str(), O_WRONLY | O_APPEND);
+    ASSERT_TRUE(fd >= 0);
+    char partial[20] = {1, 2, 3};
+    ASSERT_EQ(ssize_t(sizeof(partial)), write(fd, partial, sizeof(partial)));
+    close(fd);
+    ASSERT_EQ(size_t(2), file.query().size());
+
+    file.record({auditRecord("sw1", 3, 3000, true)});
+    std::vector<AuditRecord> records = file.query();
+    ASSERT_EQ(size_t(3), records.size());
+    ASSERT_EQ(3, int(records[2].port));
+
+    // A damaged record fails its checksum and is left out
+    fd = open(file.path().c_str(), O_RDWR);
+    ASSERT_TRUE(fd >= 0);
+    struct stat info;
+    ASSERT_EQ(0, fstat(fd, &info));
+    off_t latency = info.st_size - static_cast<off_t>(sizeof(AuditRecord)) + offsetof(AuditRecord, latencyUs);
+    ASSERT_EQ(ssize_t(1), pwrite(fd, "\x7f", 1, latency));
+    close(fd);
+    ASSERT_EQ(size_t(2), file.query(AuditFilter(), 1).size());
+}
+
+TEST(audit_log_concurrent_writers_share_a_file) {
+    TempAudit file("shared");
+    std::vector<std::thread> writers;
+    for (int w = 0; w < 2; w++) {
+        writers.emplace_back([w, &file]() {
+            std::vector<AuditRecord> records;
+            for (int i = 0; i < 500; i++) {
+                records.push_back(auditRecord(w ? "sw2" : "sw1", 1 + i % 8, i, true));
+            }
+            file.record(records);
+        });
+    }
+    for (auto &writer : writers) {
+        writer.join();
+    }
+    AuditFilter byHost;
+    byHost.hosts = {"sw2"};
+    ASSERT_EQ(size_t(1000), file.query().size());
+    ASSERT_EQ(size_t(500), file.query(byHost).size());
+}
+
+TEST(audit_scope_nesting) {
+    const AuditActor &outside = AuditScope::current();
+    ASSERT_EQ(int(AUDIT_COMMAND), int(outside.source));
+    ASSERT_EQ(static_cast<uint32_t>(getuid()), outside.uid);
+    {
+        AuditScope schedule(AuditActor(AUDIT_SCHEDULE, 0, 7));
+        ASSERT_EQ(7u, AuditScope::current().actionId);
+        {
+            AuditScope shedder(AuditActor(AUDIT_SHEDDER, 0));
+            ASSERT_EQ(int(AUDIT_SHEDDER), int(AuditScope::current().source));
+
+            // Scopes belong to the thread that opened them
+            int otherSource = -1;
+            std::thread([&otherSource]() { otherSource = AuditScope::current().source; }).join();
+            ASSERT_EQ(int(AUDIT_COMMAND), otherSource);
+        }
+        ASSERT_EQ(int(AUDIT_SCHEDULE), int(AuditScope::current().source));
+        ASSERT_EQ(7u, AuditScope::current().actionId);
+    }
+    ASSERT_EQ(int(AUDIT_COMMAND), int(AuditScope::current().source));
+    ASSERT_EQ(0u, AuditScope::current().actionId);
+}
+
+// ---------------------------------------------------------------------------
+// Sharding
+// ---------------------------------------------------------------------------
+
+static std::vector<std::string> switchNames(int count) {
+    std::vector<std::string> names;
+    for (int i = 0; i < count; i++) {
+        names.push_back("10." + std::to_string(i / 65536) + "." + std::to_string(i / 256 % 256) + "." +
+                        std::to_string(i % 256));
+    }
+    return names;
+}
+
+TEST(hash_ring_balance_and_minimal_movement) {
+    HashRing ring;
+    ASSERT_EQ(-1, ring.owner("10.0.0.1"));
+
+    std::vector<std::string> keys = switchNames(10000);
+    std::vector<std::string> three = {"a:7308", "b:7308", "c:7308"};
+    std::vector<std::string> four = {"a:7308", "b:7308", "c:7308", "d:7308"};
+    ring.assign(three);
+    std::vector<std::string> before;
+    for (const auto &key : keys) {
+        before.push_back(three[ring.owner(key)]);
+    }
+
+    ring.assign(four);
+    std::map<std::string, int> counts;
+    for (size_t i = 0; i < keys.size(); i++) {
+        const std::string &after = four[ring.owner(keys[i])];
+        counts[after]++;
+        // Only keys taken by the new member move
+        ASSERT_TRUE(after == before[i] || after == "d:7308");
+    }
+    for (const auto &entry : counts) {
+        ASSERT_TRUE(entry.second > 1500 && entry.second < 3500);
+    }
+}
+
+TEST(shard_planner_splits_fleet) {
+    std::vector<std::string> keys = switchNames(1000);
+    std::vector<std::string> live = {"a:7308", "b:7308"};
+    ShardPlanner a("a:7308", keys, std::chrono::milliseconds(0));
+    ShardPlanner b("b:7308", keys, std::chrono::milliseconds(0));
+    std::vector<uint8_t> ownedA;
+    std::vector<uint8_t> ownedB;
+    size_t countA = a.plan(live, ownedA);
+    size_t countB = b.plan(live, ownedB);
+    ASSERT_EQ(keys.size(), countA + countB);
+    for (size_t i = 0; i < keys.size(); i++) {
+        ASSERT_EQ(1, ownedA[i] + ownedB[i]);
+    }
+}
+
+TEST(shard_planner_grace_period) {
+    std::vector<std::string> keys = switchNames(1000);
+    ShardPlanner a("a:7308", keys, std::chrono::hours(1));
+    std::vector<uint8_t> owned;
+
+    // Alone, a collector polls everything at once
+    ASSERT_EQ(keys.size(), a.plan({"a:7308"}, owned));
+    ASSERT_EQ(keys.size(), size_t(std::count(owned.begin(), owned.end(), 1)));
+
+    // A joining collector's keys stop here at once, and it waits before taking them
+    ShardPlanner b("b:7308", keys, std::chrono::hours(1));
+    std::vector<uint8_t> ownedB;
+    size_t kept = a.plan({"a:7308", "b:7308"}, owned);
+    size_t gained = b.plan({"a:7308", "b:7308"}, ownedB);
+    ASSERT_EQ(keys.size(), kept + gained);
+    ASSERT_EQ(kept, size_t(std::count(owned.begin(), owned.end(), 1)));
+    ASSERT_EQ(size_t(0), size_t(std::count(ownedB.begin(), ownedB.end(), 1)));
+
+    // Keys of a collector that died are taken over without waiting
+    ASSERT_EQ(keys.size(), a.plan({"a:7308"}, owned));
+    ASSERT_EQ(keys.size(), size_t(std::count(owned.begin(), owned.end(), 1)));
+}
+
+// ---------------------------------------------------------------------------
+// Operation deadlines
+// ---------------------------------------------------------------------------
+
+TEST(deadline_budget_and_first_stage) {
+    Deadline deadline(std::chrono::milliseconds(500));
+    std::chrono::milliseconds remaining = deadline.remaining();
+    ASSERT_EQ(int64_t(500), int64_t(deadline.budget().count()));
+    ASSERT_TRUE(remaining.count() > 0 && remaining.count() <= 500);
+    ASSERT_FALSE(deadline.exceeded());
+    ASSERT_TRUE(deadline.stage() == nullptr);
+
+    // The stage that ran out first is the one reported
+    deadline.expire("login page");
+    deadline.expire("status fetch");
+    ASSERT_TRUE(deadline.exceeded());
+    ASSERT_EQ(std::string("login page"), std::string(deadline.stage()));
+
+    Deadline spent(std::chrono::milliseconds(-20));
+    ASSERT_EQ(int64_t(0), int64_t(spent.remaining().count()));
+    ASSERT_FALSE(spent.exceeded());
+}
+
+TEST(deadline_scopes_nest) {
+    Deadline outer(std::chrono::seconds(5));
+    Deadline inner(std::chrono::seconds(1));
+    ASSERT_TRUE(DeadlineScope::current() == nullptr);
+    {
+        DeadlineScope outerScope(&outer);
+        ASSERT_TRUE(DeadlineScope::current() == &outer);
+        {
+            // A scope without a deadline keeps the enclosing one
+            DeadlineScope unbounded(nullptr);
+            ASSERT_TRUE(DeadlineScope::current() == &outer);
+            {
+                DeadlineScope innerScope(&inner);
+                ASSERT_TRUE(DeadlineScope::current() == &inner);
+
+                // Scopes belong to the thread that opened them
+                Deadline *other = &inner;
+                std::thread([&other]() { other = DeadlineScope::current(); }).join();
+                ASSERT_TRUE(other == nullptr);
+            }
+            ASSERT_TRUE(DeadlineScope::current() == &outer);
+        }
+        ASSERT_TRUE(DeadlineScope::current() == &outer);
+    }
+    ASSERT_TRUE(DeadlineScope::current() == nullptr);
+}
+
+TEST(deadline_bounds_a_stalled_operation) {
+    QuietStderr quiet;
+    LoopbackListener stalled;
+    GS308EP_CLI cli(stalled.host(), "password");
+    cli.setLoginInterval(std::chrono::milliseconds(0));
+
+    // The login page request would wait its own 5 s timeout without a deadline
+    Deadline deadline(std::chrono::milliseconds(200));
+    DeadlineScope scope(&deadline);
+    auto start = std::chrono::steady_clock::now();
+    ASSERT_FALSE(cli.login());
+    ASSERT_TRUE(std::chrono::steady_clock::now() - start < std::chrono::seconds(2));
+    ASSERT_TRUE(deadline.exceeded());
+    ASSERT_EQ(std::string(requestKindName(REQUEST_LOGIN_PAGE)), std::string(deadline.stage()));
+
+    // Once spent, later steps fail without touching the network
+    auto again = std::chrono::steady_clock::now();
+    ASSERT_FALSE(cli.login());
+    ASSERT_TRUE(std::chrono::steady_clock::now() - again < std::chrono::milliseconds(100));
+    ASSERT_EQ(std::string(requestKindName(REQUEST_LOGIN_PAGE)), std::string(deadline.stage()));
+}
+
+// ---------------------------------------------------------------------------
+// Retry policy
+// ---------------------------------------------------------------------------
+
+static RetryOptions retryOptions(int retries, int backoffMs, int maxBackoffMs, double ratio, int burst) {
+    RetryOptions options;
+    options.retries = retries;
+    options.backoff = std::chrono::milliseconds(backoffMs);
+    options.maxBackoff = std::chrono::milliseconds(maxBackoffMs);
+    options.budgetRatio = ratio;
+    options.budgetBurst = burst;
+    return options;
+}
+
+TEST(retry_transient_and_idempotent) {
+    ASSERT_TRUE(RetryPolicy::transient(CURLE_OPERATION_TIMEDOUT, 0));
+    ASSERT_TRUE(RetryPolicy::transient(CURLE_COULDNT_CONNECT, 0));
+    ASSERT_TRUE(RetryPolicy::transient(CURLE_RECV_ERROR, 0));
+    ASSERT_TRUE(RetryPolicy::transient(CURLE_GOT_NOTHING, 0));
+    ASSERT_TRUE(RetryPolicy::transient(CURLE_OK, 503));
+    ASSERT_TRUE(RetryPolicy::transient(CURLE_OK, 429));
+    ASSERT_FALSE(RetryPolicy::transient(CURLE_OK, 200));
+    ASSERT_FALSE(RetryPolicy::transient(CURLE_OK, 404));
+    ASSERT_FALSE(RetryPolicy::transient(CURLE_OK, 401));
+    ASSERT_FALSE(RetryPolicy::transient(CURLE_COULDNT_RESOLVE_HOST, 0));
+    ASSERT_FALSE(RetryPolicy::transient(CURLE_SSL_CONNECT_ERROR, 0));
+
+    // The login POST spends its rand token, so only the exchange is retried
+    ASSERT_FALSE(RetryPolicy::idempotent(REQUEST_LOGIN));
+    ASSERT_TRUE(RetryPolicy::idempotent(REQUEST_LOGIN_PAGE));
+    ASSERT_TRUE(RetryPolicy::idempotent(REQUEST_CONFIG));
+    ASSERT_TRUE(RetryPolicy::idempotent(REQUEST_APPLY));
+    ASSERT_TRUE(RetryPolicy::idempotent(REQUEST_STATUS));
+}
+
+TEST(retry_backoff_is_bounded_and_counted) {
+    RetryPolicy policy(retryOptions(4, 100, 250, 1.0, 1000));
+    std::chrono::milliseconds bounds[] = {std::chrono::milliseconds(100), std::chrono::milliseconds(200),
+                                          std::chrono::milliseconds(250), std::chrono::milliseconds(250)};
+    for (int trial = 0; trial < 50; trial++) {
+        for (int retry = 1; retry <= 4; retry++) {
+            std::chrono::milliseconds delay(-1);
+            ASSERT_TRUE(policy.shouldRetry(retry, CURLE_OPERATION_TIMEDOUT, 0, delay));
+            ASSERT_TRUE(delay.count() >= 0 && delay <= bounds[retry - 1]);
+        }
+        std::chrono::milliseconds delay(0);
+        ASSERT_FALSE(policy.shouldRetry(5, CURLE_OPERATION_TIMEDOUT, 0, delay));
+    }
+
+    // Failures another attempt cannot fix are not retried, nor counted as exhausted
+    std::chrono::milliseconds delay(0);
+    ASSERT_FALSE(policy.shouldRetry(1, CURLE_OK, 404, delay));
+    policy.noteSaved();
+    RetryStats stats = policy.stats();
+    ASSERT_EQ(uint64_t(200), stats.retries);
+    ASSERT_EQ(uint64_t(50), stats.exhausted);
+    ASSERT_EQ(uint64_t(1), stats.saved);
+    ASSERT_EQ(uint64_t(0), stats.denied);
+}
+
+TEST(retry_budget_runs_dry_and_refills) {
+    // Two retries in the bucket, and one more earned per two first attempts
+    RetryPolicy policy(retryOptions(10, 0, 0, 0.5, 2));
+    std::chrono::milliseconds delay(0);
+    ASSERT_TRUE(policy.shouldRetry(1, CURLE_OK, 503, delay));
+    ASSERT_TRUE(policy.shouldRetry(1, CURLE_OK, 503, delay));
+    ASSERT_FALSE(policy.shouldRetry(1, CURLE_OK, 503, delay));
+    ASSERT_EQ(uint64_t(1), policy.stats().denied);
+
+    policy.noteRequest();
+    ASSERT_FALSE(policy.shouldRetry(1, CURLE_OK, 503, delay));
+    policy.noteRequest();
+    ASSERT_TRUE(policy.shouldRetry(1, CURLE_OK, 503, delay));
+    ASSERT_FALSE(policy.shouldRetry(1, CURLE_OK, 503, delay));
+
+    // A quiet stretch refills the bucket only up to its burst
+    for (int i = 0; i < 100; i++) {
+        policy.noteRequest();
+    }
+    ASSERT_TRUE(policy.shouldRetry(1, CURLE_OK, 503, delay));
+    ASSERT_TRUE(policy.shouldRetry(1, CURLE_OK, 503, delay));
+    ASSERT_FALSE(policy.shouldRetry(1, CURLE_OK, 503, delay));
+
+    RetryStats stats = policy.stats();
+    ASSERT_EQ(uint64_t(102), stats.requests);
+    ASSERT_EQ(uint64_t(5), stats.retries);
+    ASSERT_EQ(uint64_t(4), stats.denied);
+}
+
+TEST(retry_never_outlasts_the_deadline) {
+    RetryPolicy policy(retryOptions(3, 10, 10, 1.0, 10));
+    Deadline deadline(std::chrono::milliseconds(0));
+    DeadlineScope scope(&deadline);
+    std::chrono::milliseconds delay(0);
+    ASSERT_FALSE(policy.shouldRetry(1, CURLE_OPERATION_TIMEDOUT, 0, delay));
+    RetryStats stats = policy.stats();
+    ASSERT_EQ(uint64_t(1), stats.exhausted);
+    ASSERT_EQ(uint64_t(0), stats.retries);
+}
+
+TEST(retry_policy_repeats_failed_requests) {
+    QuietStderr quiet;
+    LoopbackListener refused;
+    refused.stop();
+    RetryPolicy policy(retryOptions(2, 1, 1, 1.0, 10));
+    GS308EP_CLI cli(refused.host(), "password");
+    cli.setRetryPolicy(&policy);
+
+    // A refused login page is fetched again; the whole attempt still fails
+    ASSERT_FALSE(cli.login());
+    RetryStats stats = policy.stats();
+    ASSERT_EQ(uint64_t(1), stats.requests);
+    ASSERT_EQ(uint64_t(2), stats.retries);
+    ASSERT_EQ(uint64_t(1), stats.exhausted);
+}
+
+// ---------------------------------------------------------------------------
+// History segments
+// ---------------------------------------------------------------------------
+
+// Backing arrays for a HistoryBlock view
+struct BlockData {
+    uint32_t rows;
+    std::vector<int64_t> timestamps;
+    std::vector<float> columns[HISTORY_COLUMNS][HISTORY_PORTS];
+    std::vector<uint8_t> enabled[HISTORY_PORTS];
+
+    explicit BlockData(uint32_t count) : rows(count), timestamps(count) {
+        for (int column = 0; column < HISTORY_COLUMNS; column++) {
+            for (int port = 0; port < HISTORY_PORTS; port++) {
+                columns[column][port].assign(count, 0.0f);
+            }
+        }
+        for (int port = 0; port < HISTORY_PORTS; port++) {
+            enabled[port].assign(count, 0);
+        }
+        for (uint32_t i = 0; i < count; i++) {
+            timestamps[i] = 1792000000000LL + static_cast<int64_t>(i) * 1000;
+        }
+    }
+
+    HistoryBlock view() const {
+        HistoryBlock block;
+        block.rows = rows;
+        block.firstMs = timestamps.front();
+        block.lastMs = timestamps.back();
+        block.timestamps = timestamps.data();
+        for (int column = 0; column < HISTORY_COLUMNS; column++) {
+            for (int port = 0; port < HISTORY_PORTS; port++) {
+                block.columns[column][port] = columns[column][port].data();
+            }
+        }
+        for (int port = 0; port < HISTORY_PORTS; port++) {
+            block.enabled[port] = enabled[port].data();
+        }
+        return block;
+    }
+};
+
+static uint32_t bitsOf(float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+// Encode, reopen with the checksum verified, and require every value back bit for bit
+static std::vector<uint8_t> roundTrip(const BlockData &data) {
+    std::vector<uint8_t> encoded;
+    encodeHistorySegment(data.view(), historyGapMs(1000), encoded);
+    ASSERT_EQ(size_t(0), encoded.size() % 8);
+
+    HistorySegment segment;
+    ASSERT_TRUE(segment.open(encoded.data(), encoded.size(), true));
+    ASSERT_EQ(data.rows, segment.rows());
+    ASSERT_EQ(encoded.size(), segment.bytes());
+    ASSERT_EQ(data.timestamps.front(), segment.firstMs());
+    ASSERT_EQ(data.timestamps.back(), segment.lastMs());
+
+    std::vector<int64_t> timestamps(data.rows);
+    segment.decodeTimestamps(timestamps.data());
+    for (uint32_t i = 0; i < data.rows; i++) {
+        ASSERT_EQ(data.timestamps[i], timestamps[i]);
+    }
+
+    std::vector<float> values(data.rows);
+    for (int column = 0; column < HISTORY_COLUMNS; column++) {
+        for (int port = 0; port < HISTORY_PORTS; port++) {
+            segment.decodeColumn(column, port, values.data());
+            for (uint32_t i = 0; i < data.rows; i++) {
+                ASSERT_EQ(bitsOf(data.columns[column][port][i]), bitsOf(values[i]));
+            }
+        }
+    }
+
+    std::vector<uint8_t> flags(data.rows);
+    for (int port = 0; port < HISTORY_PORTS; port++) {
+        segment.decodeEnabled(port, flags.data());
+        for (uint32_t i = 0; i < data.rows; i++) {
+            ASSERT_EQ(data.enabled[port][i] != 0, flags[i] != 0);
+        }
+    }
+    return encoded;
+}
+
+TEST(segment_fixed_point_readings) {
+    BlockData data(600);
+    for (uint32_t i = 0; i < data.rows; i++) {
+        int64_t tenths = 20 + static_cast<int64_t>(i % 37);
+        data.columns[HISTORY_POWER][0][i] = static_cast<float>(tenths * 0.1);
+        data.columns[HISTORY_CURRENT][0][i] = static_cast<float>(100 + i % 11);
+        data.columns[HISTORY_VOLTAGE][0][i] = static_cast<float>(532 * 0.1);
+        data.columns[HISTORY_TEMPERATURE][0][i] = 41.0f;
+        data.enabled[0][i] = 1;
+    }
+    std::vector<uint8_t> encoded = roundTrip(data);
+
+    HistorySegment segment;
+    ASSERT_TRUE(segment.open(encoded.data(), encoded.size()));
+    ASSERT_EQ(int(SEGMENT_FIXED), int(segment.header().encoding[HISTORY_POWER][0]));
+    ASSERT_EQ(1, int(segment.header().exponent[HISTORY_POWER][0]));
+    ASSERT_EQ(0, int(segment.header().exponent[HISTORY_CURRENT][0]));
+    ASSERT_TRUE(segment.header().min[HISTORY_POWER][0] == 2.0f);
+    ASSERT_TRUE(segment.header().max[HISTORY_POWER][0] == static_cast<float>(56 * 0.1));
+    double sum = 0.0;
+    for (float value : data.columns[HISTORY_POWER][0]) {
+        sum += value;
+    }
+    ASSERT_NEAR(sum, segment.header().sum[HISTORY_POWER][0], 1e-9);
+    // A steady interval and slowly changing readings fit in far less than the raw block
+    ASSERT_TRUE(encoded.size() < data.rows * 16);
+}
+
+TEST(segment_nan_and_infinity) {
+    BlockData data(64);
+    const float special[] = {std::numeric_limits<float>::quiet_NaN(), std::numeric_limits<float>::infinity(),
+                             -std::numeric_limits<float>::infinity(), std::numeric_limits<float>::denorm_min(),
+                             std::numeric_limits<float>::max(), 1.5f};
+    for (uint32_t i = 0; i < data.rows; i++) {
+        data.columns[HISTORY_POWER][1][i] = special[i % 6];
+        data.columns[HISTORY_CURRENT][1][i] = i == 10 ? std::numeric_limits<float>::quiet_NaN() : 3.0f;
+        data.columns[HISTORY_VOLTAGE][1][i] = -std::numeric_limits<float>::quiet_NaN();
+    }
+    std::vector<uint8_t> encoded = roundTrip(data);
+
+    HistorySegment segment;
+    ASSERT_TRUE(segment.open(encoded.data(), encoded.size()));
+    ASSERT_EQ(int(SEGMENT_XOR), int(segment.header().encoding[HISTORY_POWER][1]));
+    ASSERT_EQ(int(SEGMENT_XOR), int(segment.header().encoding[HISTORY_CURRENT][1]));
+}
+
+TEST(segment_sign_flips) {
+    BlockData data(200);
+    for (uint32_t i = 0; i < data.rows; i++) {
+        // Whole numbers crossing zero, including negative zero
+        float signs[] = {3.0f, -3.0f, 0.0f, -0.0f, -1.0f};
+        data.columns[HISTORY_POWER][2][i] = signs[i % 5];
+        // Tenths swinging between large positive and negative values
+        data.columns[HISTORY_CURRENT][2][i] = static_cast<float>((i % 2 ? -1 : 1) * 12345 * 0.1);
+        // A column of negative zeros only
+        data.columns[HISTORY_VOLTAGE][2][i] = -0.0f;
+        // Positive zeros with one negative zero
+        data.columns[HISTORY_TEMPERATURE][2][i] = i == 150 ? -0.0f : 0.0f;
+    }
+    roundTrip(data);
+}
+
+TEST(segment_timestamp_gaps) {
+    BlockData data(40);
+    int64_t at = 1792000000000LL;
+    for (uint32_t i = 0; i < data.rows; i++) {
+        if (i == 10) {
+            at += 10LL * 365 * 24 * 3600 * 1000; // A decade without samples
+        } else if (i == 20) {
+            at -= 5000; // The clock stepped back
+        } else if (i == 30) {
+            at += std::numeric_limits<int32_t>::max();
+        } else {
+            at += 1000 + (i % 3);
+        }
+        data.timestamps[i] = at;
+        data.columns[HISTORY_POWER][3][i] = 5.0f;
+    }
+    std::vector<uint8_t> encoded = roundTrip(data);
+
+    // Gaps longer than the missing-data limit count neither as covered time nor as energy
+    HistorySegment segment;
+    ASSERT_TRUE(segment.open(encoded.data(), encoded.size()));
+    ASSERT_TRUE(segment.header().coveredMs < 40 * 1003);
+    ASSERT_TRUE(segment.header().energyWattMs[3] < 5.0 * 40 * 1003);
+}
+
+TEST(segment_single_sample) {
+    BlockData data(1);
+    data.timestamps[0] = -1;
+    data.columns[HISTORY_POWER][4][0] = 7.3f;
+    data.columns[HISTORY_CURRENT][4][0] = std::numeric_limits<float>::quiet_NaN();
+    data.columns[HISTORY_VOLTAGE][4][0] = -0.0f;
+    data.enabled[4][0] = 1;
+    std::vector<uint8_t> encoded = roundTrip(data);
+
+    HistorySegment segment;
+    ASSERT_TRUE(segment.open(encoded.data(), encoded.size()));
+    ASSERT_EQ(int64_t(0), segment.header().coveredMs);
+    ASSERT_TRUE(segment.header().energyWattMs[4] == 0.0);
+}
+
+TEST(segment_enabled_flags) {
+    // Few enough rows that the flags are always stored row by row
+    BlockData small(8);
+    for (uint32_t i = 0; i < small.rows; i++) {
+        small.enabled[0][i] = 1;
+        small.enabled[1][i] = i % 3 == 0;
+    }
+    roundTrip(small);
+
+    // Constant flags stored once, and one change just past the first byte
+    BlockData larger(9);
+    for (uint32_t i = 0; i < larger.rows; i++) {
+        larger.enabled[0][i] = 1;
+        larger.enabled[1][i] = i == 8;
+    }
+    roundTrip(larger);
+}
+
+TEST(segment_full_noisy_block) {
+    BlockData data(HISTORY_BLOCK_ROWS);
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> noise(-50.0f, 50.0f);
+    std::uniform_int_distribution<int> jitter(-40, 40);
+    for (uint32_t i = 1; i < data.rows; i++) {
+        data.timestamps[i] = data.timestamps[i - 1] + 1000 + jitter(rng);
+    }
+    for (uint32_t i = 0; i < data.rows; i++) {
+        for (int column = 0; column < HISTORY_COLUMNS; column++) {
+            for (int port = 0; port < HISTORY_PORTS; port++) {
+                data.columns[column][port][i] = noise(rng);
+            }
+        }
+        for (int port = 0; port < HISTORY_PORTS; port++) {
+            data.enabled[port][i] = rng() % 2;
+        }
+    }
+    roundTrip(data);
+}
+
+TEST(segment_checksum_detects_corruption) {
+    BlockData data(100);
+    for (uint32_t i = 0; i < data.rows; i++) {
+        data.columns[HISTORY_POWER][0][i] = static_cast<float>(i);
+    }
+    std::vector<uint8_t> encoded;
+    encodeHistorySegment(data.view(), historyGapMs(1000), encoded);
+    encoded[encoded.size() - 9] ^= 0x10;
+
+    HistorySegment segment;
+    ASSERT_FALSE(segment.open(encoded.data(), encoded.size(), true));
+    ASSERT_TRUE(segment.open(encoded.data(), encoded.size(), false));
+    ASSERT_FALSE(segment.open(encoded.data(), encoded.size() - 8, false));
+}
+
+// ---------------------------------------------------------------------------
+// Poll schedule
+// ---------------------------------------------------------------------------
+
+static std::vector<FleetSwitch> fleetOf(const std::vector<std::string> &hosts) {
+    std::vector<FleetSwitch> switches(hosts.size());
+    for (size_t i = 0; i < hosts.size(); i++) {
+        switches[i].host = hosts[i];
+    }
+    return switches;
+}
+
+// The tick each switch starts in; -1 if never, -2 if more than once
+static std::vector<int> startTicks(const PollSchedule &schedule, size_t switches) {
+    std::vector<int> starts(switches, -1);
+    for (size_t tick = 0; tick < schedule.ticks(); tick++) {
+        for (uint32_t index : schedule.due(tick)) {
+            starts[index] = starts[index] == -1 ? static_cast<int>(tick) : -2;
+        }
+    }
+    return starts;
+}
+
+TEST(poll_schedule_spreads_every_switch_once) {
+    std::vector<FleetSwitch> switches = fleetOf(switchNames(1000));
+    PollScheduleOptions options;
+    options.interval = std::chrono::milliseconds(10000);
+    options.tick = std::chrono::milliseconds(100);
+    PollSchedule schedule(switches, options);
+    schedule.plan();
+
+    ASSERT_EQ(size_t(100), schedule.ticks());
+    ASSERT_EQ(10u, schedule.budget());
+    std::vector<int> starts = startTicks(schedule, switches.size());
+    for (size_t i = 0; i < switches.size(); i++) {
+        ASSERT_TRUE(starts[i] >= 0);
+        // Started at its phase or a few ticks later, wrapping into the next interval
+        int phaseTick = static_cast<int>(schedule.phase(i).count() / 100);
+        int delay = (starts[i] - phaseTick + 100) % 100;
+        ASSERT_TRUE(delay < 20);
+    }
+    for (size_t tick = 0; tick < schedule.ticks(); tick++) {
+        ASSERT_TRUE(schedule.due(tick).size() <= schedule.budget());
+    }
+}
+
+TEST(poll_schedule_phases_are_stable) {
+    std::vector<std::string> hosts = switchNames(300);
+    PollSchedule whole(fleetOf(hosts), PollScheduleOptions());
+
+    // The same switches in another order, with others added, keep their phases
+    std::vector<std::string> other(hosts.rbegin(), hosts.rend());
+    other.push_back("192.168.1.1");
+    PollSchedule reordered(fleetOf(other), PollScheduleOptions());
+    for (size_t i = 0; i < hosts.size(); i++) {
+        ASSERT_EQ(whole.phase(i).count(), reordered.phase(hosts.size() - 1 - i).count());
+    }
+}
+
+TEST(poll_schedule_owned_subset_and_sync_tags) {
+    std::vector<FleetSwitch> switches = fleetOf(switchNames(500));
+    for (size_t i = 0; i < switches.size(); i += 25) {
+        switches[i].tags.push_back("meters");
+    }
+    PollScheduleOptions options;
+    options.syncTags.push_back("meters");
+    PollSchedule schedule(switches, options);
+
+    std::vector<uint8_t> owned(switches.size(), 0);
+    for (size_t i = 0; i < owned.size(); i += 2) {
+        owned[i] = 1;
+    }
+    schedule.plan(&owned);
+    ASSERT_EQ(10u, schedule.synchronisedCount());
+
+    std::vector<int> starts = startTicks(schedule, switches.size());
+    for (size_t i = 0; i < switches.size(); i++) {
+        if (!owned[i]) {
+            ASSERT_EQ(-1, starts[i]);
+        } else if (schedule.synchronised(i)) {
+            ASSERT_EQ(0, starts[i]);
+        } else {
+            ASSERT_TRUE(starts[i] >= 0);
+        }
+    }
+    // The synchronised switches lead the first tick
+    const std::vector<uint32_t> &epoch = schedule.due(0);
+    for (uint32_t i = 0; i < schedule.synchronisedCount(); i++) {
+        ASSERT_TRUE(schedule.synchronised(epoch[i]));
+    }
+
+    // Replanning gives the same schedule
+    std::vector<int> again = (schedule.plan(&owned), startTicks(schedule, switches.size()));
+    ASSERT_TRUE(again == starts);
+}
+
+int main() {
+    std::cout << "==================================" << std::endl;
+    std::cout << "GS308EP CLI Unit Tests" << std::endl;
+    std::cout << "==================================" << std::endl << std::endl;
+
+    run_test_extract_rand_double_quotes();
+    run_test_extract_rand_single_quotes();
+    run_test_extract_rand_mixed_quotes();
+    run_test_extract_rand_missing();
+    run_test_extract_rand_without_value();
+    run_test_extract_cookie_sid();
+    run_test_extract_cookie_missing();
+    run_test_extract_cookie_line_endings();
+    run_test_extract_client_hash();
+    run_test_extract_client_hash_missing();
+    run_test_port_power_single_port();
+    run_test_port_power_multiple_ports();
+    run_test_port_power_integer_value();
+    run_test_port_power_zero();
+    run_test_port_power_high_value();
+    run_test_port_power_missing_port();
+    run_test_port_power_invalid_value();
+    run_test_port_validation_valid();
+    run_test_port_validation_zero();
+    run_test_port_validation_negative();
+    run_test_port_validation_too_high();
+    run_test_extract_rand_in_full_login_page();
+    run_test_extract_cookie_among_several();
+    run_test_extract_rand_whitespace_around_value();
+    run_test_extract_rand_empty_value();
+    run_test_extract_client_hash_empty_value();
+    run_test_extract_rand_unterminated_value();
+    run_test_port_power_decimal_precision();
+    run_test_port_power_whitespace_in_value();
+    run_test_port_power_unterminated_span();
+    run_test_port_power_reading_outside_port_block();
+
+    run_test_fixed_point_formatting();
+    run_test_influx_line_format_and_escaping();
+    run_test_influx_leaves_out_unwritable_readings();
+    run_test_csv_header_and_rfc4180_quoting();
+
+    run_test_timer_wheel_fires_in_tick_order();
+    run_test_timer_wheel_cancel();
+    run_test_timer_wheel_callbacks_reschedule_and_cancel();
+
+    run_test_parse_shed_order();
+    run_test_load_shedder_sheds_just_enough();
+    run_test_load_shedder_restore_hysteresis();
+    run_test_load_shedder_restores_in_priority_order();
+
+    run_test_baseline_window_and_ewma();
+    run_test_baseline_warmup_raises_no_flags();
+    run_test_baseline_high_low_and_idle_flags();
+    run_test_baseline_ignores_tiny_draws();
+    run_test_baseline_tracker_reports_transitions();
+
+    run_test_login_single_flight_shares_one_attempt();
+    run_test_login_attempts_are_spaced();
+
+    run_test_snapshot_round_trip();
+    run_test_snapshot_dictionary_starts_over_when_full();
+    run_test_snapshot_allows_one_publisher();
+
+    run_test_subscription_filter_parsing();
+    run_test_subscription_filters_switch_port_and_fields();
+    run_test_subscription_min_change();
+    run_test_subscription_slow_reader_loses_oldest();
+
+    run_test_history_query_aggregates_and_percentiles();
+    run_test_history_query_time_range_and_gaps();
+    run_test_history_query_per_switch_and_top();
+    run_test_history_query_sealed_segments_match_raw_rows();
+    run_test_history_time_and_metric_parsing();
+
+    run_test_fleet_groups_ordered_by_kind_then_name();
+    run_test_fleet_updates_replace_previous_poll();
+    run_test_fleet_deltas_do_not_drift();
+    run_test_fleet_hottest_ports_ranked();
+    run_test_fleet_inactive_switches_leave_their_groups();
+
+    run_test_bounded_queue_fifo_and_capacity();
+    run_test_bounded_queue_many_producers_and_consumers();
+
+    run_test_intern_known_texts_have_fixed_ids();
+    run_test_intern_new_texts_round_trip();
+    run_test_intern_concurrent_threads_agree();
+
+    run_test_status_view_matches_baseline_on_full_page();
+    run_test_status_view_matches_baseline_with_missing_ports();
+    run_test_status_view_matches_baseline_on_truncated_pages();
+
+    run_test_audit_log_round_trip_and_filters();
+    run_test_audit_log_appends_across_opens_and_trims_torn_tail();
+    run_test_audit_log_concurrent_writers_share_a_file();
+    run_test_audit_scope_nesting();
+
+    run_test_hash_ring_balance_and_minimal_movement();
+    run_test_shard_planner_splits_fleet();
+    run_test_shard_planner_grace_period();
+
+    run_test_deadline_budget_and_first_stage();
+    run_test_deadline_scopes_nest();
+    run_test_deadline_bounds_a_stalled_operation();
+
+    run_test_retry_transient_and_idempotent();
+    run_test_retry_backoff_is_bounded_and_counted();
+    run_test_retry_budget_runs_dry_and_refills();
+    run_test_retry_never_outlasts_the_deadline();
+    run_test_retry_policy_repeats_failed_requests();
+
+    run_test_segment_fixed_point_readings();
+    run_test_segment_nan_and_infinity();
+    run_test_segment_sign_flips();
+    run_test_segment_timestamp_gaps();
+    run_test_segment_single_sample();
+    run_test_segment_enabled_flags();
+    run_test_segment_full_noisy_block();
+    run_test_segment_checksum_detects_corruption();
+
+    run_test_poll_schedule_spreads_every_switch_once();
+    run_test_poll_schedule_phases_are_stable();
+    run_test_poll_schedule_owned_subset_and_sync_tags();
+
+    std::cout << std::endl << "==================================" << std::endl;
+    std::cout << "Test Results:" << std::endl;
+    std::cout << "  Passed: " << tests_passed << std::endl;
+    std::cout << "  Failed: " << tests_failed << std::endl;
+    std::cout << "  Total:  " << (tests_passed + tests_failed) << std::endl;
+    std::cout << "==================================" << std::endl;
+    return tests_failed == 0 ? 0 : 1;
+}
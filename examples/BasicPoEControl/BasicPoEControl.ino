@@ -160,7 +160,8 @@ void setup()
 
 void loop()
 {
- // Nothing to do in loop for this example
+ // Keep the session warm so later commands never wait for a login
+ poeSwitch.maintainSession();
  delay(1000);
 }
 
@@ -0,0 +1,37 @@
+/**
+ * Footprint sketch
+ *
+ * Builds one client configuration from FootprintConfig.h so its flash and
+ * RAM use can be read off the compiler's summary. Select the configuration
+ * with -DGS308EP_FOOTPRINT=N; "make esp32" in extras/footprint builds all
+ * of them and tabulates the results.
+ */
+
+#include <WiFi.h>
+#include "FootprintConfig.h"
+
+const char *ssid = "YourWiFiSSID";
+const char *password = "YourWiFiPassword";
+
+#if GS308EP_FOOTPRINT != 0
+FootprintSwitch poeSwitch("192.168.1.1", "password");
+#endif
+
+void setup()
+{
+ Serial.begin(115200);
+ WiFi.begin(ssid, password);
+ while (WiFi.status() != WL_CONNECTED)
+ {
+  delay(500);
+ }
+
+#if GS308EP_FOOTPRINT != 0
+ Serial.println(footprintExercise(poeSwitch) ? "ok" : "failed");
+#endif
+ Serial.println(FOOTPRINT_NAME);
+}
+
+void loop()
+{
+}
@@ -0,0 +1,76 @@
+/**
+ * @file FootprintConfig.h
+ * @brief The client configurations that extras/footprint measures
+ *
+ * GS308EP_FOOTPRINT selects one configuration, and footprintExercise()
+ * calls what a sketch with that configuration would call. The same file is
+ * built into Footprint.ino for the ESP32 and into footprint.cpp for the host.
+ *
+ *   0  baseline      no client, for subtracting the sketch and network stack
+ *   1  full          GS308EP: HTTPClient, AllFields, DynamicStrings, BlockingWait
+ *   2  http-control  HTTPClient, ControlFields, DynamicStrings, BlockingWait
+ *   3  raw-power     RawTransport, PowerFields, StaticStrings, BlockingWait
+ *   4  raw-control   RawTransport, ControlFields, StaticStrings, CooperativeWait
+ */
+
+#ifndef FOOTPRINT_CONFIG_H
+#define FOOTPRINT_CONFIG_H
+
+#ifndef GS308EP_FOOTPRINT
+#define GS308EP_FOOTPRINT 1
+#endif
+
+#if GS308EP_FOOTPRINT == 1 || GS308EP_FOOTPRINT == 2
+#include <GS308EP.h>
+#elif GS308EP_FOOTPRINT == 3 || GS308EP_FOOTPRINT == 4
+#include <GS308EPClient.h>
+#include <GS308EPRawTransport.h>
+#include <WiFiClient.h>
+#endif
+
+#if GS308EP_FOOTPRINT == 0
+#define FOOTPRINT_NAME "baseline"
+#elif GS308EP_FOOTPRINT == 1
+#define FOOTPRINT_NAME "full"
+typedef GS308EP FootprintSwitch;
+#elif GS308EP_FOOTPRINT == 2
+#define FOOTPRINT_NAME "http-control"
+typedef BasicGS308EP<HTTPClientTransport, ControlFields, DynamicStrings, BlockingWait> FootprintSwitch;
+#elif GS308EP_FOOTPRINT == 3
+#define FOOTPRINT_NAME "raw-power"
+typedef BasicGS308EP<RawTransport<WiFiClient>, PowerFields, StaticStrings, BlockingWait> FootprintSwitch;
+#elif GS308EP_FOOTPRINT == 4
+#define FOOTPRINT_NAME "raw-control"
+static uint32_t footprintIdleCalls = 0;
+
+static void footprintIdle()
+{
+ footprintIdleCalls++;
+}
+
+typedef BasicGS308EP<RawTransport<WiFiClient>, ControlFields, StaticStrings, CooperativeWait<footprintIdle> >
+    FootprintSwitch;
+#else
+#error "GS308EP_FOOTPRINT must be 0 to 4"
+#endif
+
+#if GS308EP_FOOTPRINT != 0
+/**
+ * @brief Log in, switch a port off and on, and read what the configuration can
+ * @return true if every call succeeded
+ */
+static bool footprintExercise(FootprintSwitch &poe)
+{
+ poe.begin();
+ bool ok = poe.login();
+ ok = ok && poe.turnOffPoEPort(1) && poe.turnOnPoEPort(1);
+ poe.getPoEPortStatus(1);
+#if GS308EP_FOOTPRINT == 1 || GS308EP_FOOTPRINT == 3
+ FootprintSwitch::Stats stats[8];
+ ok = ok && poe.getAllPoEPortStats(stats) && poe.getTotalPoEPower() >= 0.0;
+#endif
+ return ok && poe.maintainSession();
+}
+#endif
+
+#endif // FOOTPRINT_CONFIG_H
@@ -0,0 +1,150 @@
+/**
+ * @file footprint.cpp
+ * @brief gs308ep-footprint: the host-side footprint of one client configuration
+ *
+ * Built once per configuration in Footprint/FootprintConfig.h, against the
+ * soak harness's shims, with unused sections dropped at link time. The code
+ * sizes of the binaries therefore differ by exactly what each configuration
+ * pulls in. Run against a switch (normally gs308ep-mock), the binary also
+ * reports the size of the client object and the heap that the calls of
+ * footprintExercise() needed. The library's malloc, realloc and free are
+ * routed into the soak arena (see the Makefile's --wrap), so String and raw
+ * buffers are counted alike.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <getopt.h>
+#include <iostream>
+#include <string>
+#include "Footprint/FootprintConfig.h"
+#include "SoakHeap.h"
+
+static const char *PROGRAM_NAME = "gs308ep-footprint";
+
+// Allocations are counted only while armed; before that they go to libc
+static bool armed = false;
+
+extern "C"
+{
+ void *__real_malloc(size_t size);
+ void *__real_realloc(void *memory, size_t size);
+ void __real_free(void *memory);
+
+ void *__wrap_malloc(size_t size)
+ {
+  return armed ? soakMalloc(size) : __real_malloc(size);
+ }
+
+ void *__wrap_realloc(void *memory, size_t size)
+ {
+  if (soakHeapContains(memory) || (!memory && armed))
+  {
+   return soakRealloc(memory, size);
+  }
+  return __real_realloc(memory, size);
+ }
+
+ void __wrap_free(void *memory)
+ {
+  if (soakHeapContains(memory))
+  {
+   soakFree(memory);
+  }
+  else
+  {
+   __real_free(memory);
+  }
+ }
+}
+
+void print_usage()
+{
+ std::cout << "Usage: " << PROGRAM_NAME << " [-h <host>] [-p <password>]" << std::endl;
+ std::cout << std::endl;
+ std::cout << "Report the RAM one client configuration (" FOOTPRINT_NAME ") needs." << std::endl;
+ std::cout << std::endl;
+ std::cout << "Options:" << std::endl;
+ std::cout << "  -h, --host=HOST[:PORT]  Switch to exercise, normally gs308ep-mock; without it only" << std::endl;
+ std::cout << "                          the object size is reported" << std::endl;
+ std::cout << "  -p, --password=PASS     Administrator password (default password)" << std::endl;
+ std::cout << "      --header            Print the column names and exit" << std::endl;
+ std::cout << "      --help              Display this help message" << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+ std::string host;
+ std::string password = "password";
+
+ static struct option long_options[] = {{"host", required_argument, 0, 'h'},
+                                        {"password", required_argument, 0, 'p'},
+                                        {"header", no_argument, 0, 2},
+                                        {"help", no_argument, 0, 3},
+                                        {0, 0, 0, 0}};
+
+ int opt;
+ int option_index = 0;
+ while ((opt = getopt_long(argc, argv, "h:p:", long_options, &option_index)) != -1)
+ {
+  switch (opt)
+  {
+  case 'h':
+   host = optarg;
+   break;
+  case 'p':
+   password = optarg;
+   break;
+  case 2:
+   std::printf("%8s %10s %10s %8s  %s\n", "OBJECT", "HEAP_PEAK", "RETAINED", "ALLOCS", "RESULT");
+   return 0;
+  case 3:
+   print_usage();
+   return 0;
+  default:
+   print_usage();
+   return 1;
+  }
+ }
+
+#if GS308EP_FOOTPRINT == 0
+ (void)password;
+ std::printf("%8s %10s %10s %8s  %s\n", "-", "-", "-", "-", host.empty() ? "-" : "ok");
+ return 0;
+#else
+ if (host.empty())
+ {
+  std::printf("%8zu %10s %10s %8s  %s\n", sizeof(FootprintSwitch), "-", "-", "-", "-");
+  return 0;
+ }
+
+ soakHeapInit(1 << 20);
+ SoakHeapStats before = soakHeapStats();
+ soakHeapResetPeak();
+ armed = true;
+
+ bool ok;
+ SoakHeapStats after;
+ {
+  // The object's own heap, such as String credentials, counts too
+  FootprintSwitch poe(host.c_str(), password.c_str());
+  ok = footprintExercise(poe);
+  after = soakHeapStats();
+ }
+ SoakHeapStats released = soakHeapStats();
+ armed = false;
+
+ std::string result = ok ? "ok" : "failed";
+#if GS308EP_FOOTPRINT == 4
+ result += " (" + std::to_string(footprintIdleCalls) + " idle calls)";
+#endif
+ if (released.liveBytes != before.liveBytes)
+ {
+  result += ", leaked " + std::to_string(released.liveBytes - before.liveBytes) + " bytes";
+ }
+ std::printf("%8zu %10zu %10zu %8llu  %s\n", sizeof(FootprintSwitch), after.peakBytes - before.liveBytes,
+             after.liveBytes - before.liveBytes, static_cast<unsigned long long>(after.allocations - before.allocations),
+             result.c_str());
+ return ok ? 0 : 1;
+#endif
+}
@@ -0,0 +1,183 @@
+/**
+ * @file SoakHeap.cpp
+ * @brief Implementation of the soak-test arena
+ */
+
+#include "SoakHeap.h"
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+struct Block
+{
+ uint32_t size; // Including this header
+ uint32_t used;
+};
+
+const size_t HEADER = sizeof(Block);
+const size_t ALIGN = 8;
+const size_t MIN_SPLIT = HEADER + ALIGN; // Smallest remainder worth a block of its own
+
+uint8_t *arena = nullptr;
+size_t arena_size = 0;
+size_t live_bytes = 0;
+size_t peak_bytes = 0;
+uint64_t allocations = 0;
+uint64_t failures = 0;
+
+Block *blockAt(size_t offset)
+{
+ return reinterpret_cast<Block *>(arena + offset);
+}
+
+Block *headerOf(void *memory)
+{
+ return reinterpret_cast<Block *>(static_cast<uint8_t *>(memory) - HEADER);
+}
+
+size_t blockSizeFor(size_t size)
+{
+ return HEADER + (size + ALIGN - 1) / ALIGN * ALIGN;
+}
+
+// Fold every free block that directly follows this one into it
+void mergeFollowing(Block *block)
+{
+ size_t end = static_cast<size_t>(reinterpret_cast<uint8_t *>(block) - arena) + block->size;
+ while (end < arena_size && !blockAt(end)->used)
+ {
+  block->size += blockAt(end)->size;
+  end += blockAt(end)->size;
+ }
+}
+
+// Give back the tail of a block beyond need bytes, if it is big enough to use
+void split(Block *block, size_t need)
+{
+ if (block->size - need >= MIN_SPLIT)
+ {
+  Block *rest = reinterpret_cast<Block *>(reinterpret_cast<uint8_t *>(block) + need);
+  rest->size = static_cast<uint32_t>(block->size - need);
+  rest->used = 0;
+  block->size = static_cast<uint32_t>(need);
+ }
+}
+
+void noteLive(long delta)
+{
+ live_bytes = static_cast<size_t>(static_cast<long>(live_bytes) + delta);
+ if (live_bytes > peak_bytes)
+ {
+  peak_bytes = live_bytes;
+ }
+}
+} // namespace
+
+void soakHeapInit(size_t bytes)
+{
+ arena_size = bytes / ALIGN * ALIGN;
+ arena = static_cast<uint8_t *>(std::malloc(arena_size));
+ blockAt(0)->size = static_cast<uint32_t>(arena_size);
+ blockAt(0)->used = 0;
+}
+
+void *soakMalloc(size_t size)
+{
+ size_t need = blockSizeFor(size);
+ for (size_t offset = 0; offset < arena_size; offset += blockAt(offset)->size)
+ {
+  Block *block = blockAt(offset);
+  if (block->used)
+  {
+   continue;
+  }
+  mergeFollowing(block);
+  if (block->size >= need)
+  {
+   split(block, need);
+   block->used = 1;
+   allocations++;
+   noteLive(static_cast<long>(block->size - HEADER));
+   return reinterpret_cast<uint8_t *>(block) + HEADER;
+  }
+ }
+ failures++;
+ return nullptr;
+}
+
+void soakFree(void *memory)
+{
+ if (!memory)
+ {
+  return;
+ }
+ Block *block = headerOf(memory);
+ block->used = 0;
+ noteLive(-static_cast<long>(block->size - HEADER));
+}
+
+// Grow in place when the following blocks are free, as newlib's realloc does
+void *soakRealloc(void *memory, size_t size)
+{
+ if (!memory)
+ {
+  return soakMalloc(size);
+ }
+
+ Block *block = headerOf(memory);
+ size_t need = blockSizeFor(size);
+ size_t before = block->size;
+ mergeFollowing(block);
+ if (block->size >= need)
+ {
+  split(block, need);
+  noteLive(static_cast<long>(block->size) - static_cast<long>(before));
+  return memory;
+ }
+ split(block, before); // Hand back what mergeFollowing took
+
+ void *moved = soakMalloc(size);
+ if (!moved)
+ {
+  return nullptr;
+ }
+ std::memcpy(moved, memory, before - HEADER);
+ soakFree(memory);
+ return moved;
+}
+
+SoakHeapStats soakHeapStats()
+{
+ SoakHeapStats stats;
+ stats.size = arena_size;
+ stats.liveBytes = live_bytes;
+ stats.peakBytes = peak_bytes;
+ stats.freeBytes = 0;
+ stats.largestFree = 0;
+ stats.allocations = allocations;
+ stats.failures = failures;
+ for (size_t offset = 0; offset < arena_size; offset += blockAt(offset)->size)
+ {
+  Block *block = blockAt(offset);
+  if (!block->used)
+  {
+   mergeFollowing(block);
+   size_t payload = block->size - HEADER;
+   stats.freeBytes += payload;
+   stats.largestFree = payload > stats.largestFree ? payload : stats.largestFree;
+  }
+ }
+ return stats;
+}
+
+void soakHeapResetPeak()
+{
+ peak_bytes = live_bytes;
+}
+
+bool soakHeapContains(const void *memory)
+{
+ const uint8_t *at = static_cast<const uint8_t *>(memory);
+ return arena && at >= arena && at < arena + arena_size;
+}
@@ -0,0 +1,46 @@
+/**
+ * @file SoakHeap.h
+ * @brief Fixed-size first-fit heap standing in for the ESP32's
+ *
+ * The shimmed String and HTTPClient allocate from this arena instead of the
+ * host allocator. That bounds memory as tightly as on the device, and it
+ * makes every statistic exact, including fragmentation: the largest free
+ * block is what the next big allocation (a status page) needs. Blocks carry
+ * an 8-byte header and are 8-byte aligned. Adjacent free blocks are merged
+ * as the allocator walks past them.
+ */
+
+#ifndef SOAK_HEAP_H
+#define SOAK_HEAP_H
+
+#include <cstddef>
+#include <cstdint>
+
+struct SoakHeapStats
+{
+ size_t size;         // Arena bytes
+ size_t liveBytes;    // Payload bytes currently allocated
+ size_t peakBytes;    // Highest liveBytes so far
+ size_t freeBytes;    // Payload bytes available across all free blocks
+ size_t largestFree;  // Largest single allocation that would succeed now
+ uint64_t allocations; // malloc calls, plus reallocs that had to move
+ uint64_t failures;    // Allocations the arena could not satisfy
+};
+
+// Create the arena; call once before any shimmed String is constructed
+void soakHeapInit(size_t bytes);
+
+void *soakMalloc(size_t size);
+void *soakRealloc(void *memory, size_t size);
+void soakFree(void *memory);
+
+// Walks the arena, so cheap enough per sample but not per allocation
+SoakHeapStats soakHeapStats();
+
+// Start peakBytes again from what is live now
+void soakHeapResetPeak();
+
+// Whether memory came from the arena, for callers that mix it with malloc
+bool soakHeapContains(const void *memory);
+
+#endif // SOAK_HEAP_H
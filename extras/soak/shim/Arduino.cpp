@@ -0,0 +1,361 @@
+/**
+ * @file Arduino.cpp
+ * @brief Implementation of the host Arduino core shim
+ */
+
+#include "Arduino.h"
+#include <chrono>
+#include <cstdlib>
+#include <thread>
+#include "../SoakHeap.h"
+
+// Start a minute before millis() wraps
+static const uint32_t MILLIS_START = 0xFFFFFFFFu - 60000u;
+static double time_scale = 1.0;
+
+String::String(const char *text) : buffer_(nullptr), capacity_(0), len_(0)
+{
+ copy(text, static_cast<unsigned int>(std::strlen(text)));
+}
+
+String::String(const String &other) : buffer_(nullptr), capacity_(0), len_(0)
+{
+ copy(other.c_str(), other.len_);
+}
+
+String::String(String &&other) noexcept : buffer_(other.buffer_), capacity_(other.capacity_), len_(other.len_)
+{
+ other.buffer_ = nullptr;
+ other.capacity_ = 0;
+ other.len_ = 0;
+}
+
+String::String(char c) : buffer_(nullptr), capacity_(0), len_(0)
+{
+ char text[2] = {c, 0};
+ copy(text, 1);
+}
+
+static void formatNumber(char *text, size_t size, unsigned long value, unsigned char base, bool negative)
+{
+ char digits[34];
+ int count = 0;
+ do
+ {
+  unsigned long digit = value % base;
+  digits[count++] = static_cast<char>(digit < 10 ? '0' + digit : 'a' + digit - 10);
+  value /= base;
+ } while (value && count < 33);
+
+ size_t pos = 0;
+ if (negative && pos + 1 < size)
+ {
+  text[pos++] = '-';
+ }
+ while (count > 0 && pos + 1 < size)
+ {
+  text[pos++] = digits[--count];
+ }
+ text[pos] = 0;
+}
+
+String::String(unsigned char value, unsigned char base) : String(static_cast<unsigned long>(value), base)
+{
+}
+
+String::String(int value, unsigned char base) : String(static_cast<long>(value), base)
+{
+}
+
+String::String(unsigned int value, unsigned char base) : String(static_cast<unsigned long>(value), base)
+{
+}
+
+String::String(long value, unsigned char base) : buffer_(nullptr), capacity_(0), len_(0)
+{
+ char text[34];
+ bool negative = value < 0 && base == 10;
+ formatNumber(text, sizeof(text), negative ? 0ul - static_cast<unsigned long>(value) : static_cast<unsigned long>(value),
+              base, negative);
+ copy(text, static_cast<unsigned int>(std::strlen(text)));
+}
+
+String::String(unsigned long value, unsigned char base) : buffer_(nullptr), capacity_(0), len_(0)
+{
+ char text[34];
+ formatNumber(text, sizeof(text), value, base, false);
+ copy(text, static_cast<unsigned int>(std::strlen(text)));
+}
+
+String::~String()
+{
+ release();
+}
+
+void String::release()
+{
+ soakFree(buffer_);
+ buffer_ = nullptr;
+ capacity_ = 0;
+ len_ = 0;
+}
+
+// Exactly the requested size, as WString does
+bool String::changeBuffer(unsigned int size)
+{
+ char *grown = static_cast<char *>(soakRealloc(buffer_, size + 1));
+ if (!grown)
+ {
+  return false;
+ }
+ buffer_ = grown;
+ capacity_ = size;
+ return true;
+}
+
+bool String::reserve(unsigned int size)
+{
+ if (buffer_ && capacity_ >= size)
+ {
+  return true;
+ }
+ if (!changeBuffer(size))
+ {
+  return false;
+ }
+ if (len_ == 0)
+ {
+  buffer_[0] = 0;
+ }
+ return true;
+}
+
+void String::copy(const char *text, unsigned int length)
+{
+ if (!reserve(length))
+ {
+  release();
+  return;
+ }
+ len_ = length;
+ std::memmove(buffer_, text, length);
+ buffer_[len_] = 0;
+}
+
+String &String::operator=(const String &other)
+{
+ if (this != &other)
+ {
+  copy(other.c_str(), other.len_);
+ }
+ return *this;
+}
+
+String &String::operator=(String &&other) noexcept
+{
+ if (this != &other)
+ {
+  release();
+  buffer_ = other.buffer_;
+  capacity_ = other.capacity_;
+  len_ = other.len_;
+  other.buffer_ = nullptr;
+  other.capacity_ = 0;
+  other.len_ = 0;
+ }
+ return *this;
+}
+
+String &String::operator=(const char *text)
+{
+ copy(text, static_cast<unsigned int>(std::strlen(text)));
+ return *this;
+}
+
+bool String::concat(const char *text, unsigned int length)
+{
+ if (length == 0)
+ {
+  return true;
+ }
+ if (!reserve(len_ + length))
+ {
+  return false;
+ }
+ std::memmove(buffer_ + len_, text, length);
+ len_ += length;
+ buffer_[len_] = 0;
+ return true;
+}
+
+String &String::operator+=(const String &other)
+{
+ concat(other.c_str(), other.len_);
+ return *this;
+}
+
+String &String::operator+=(const char *text)
+{
+ concat(text, static_cast<unsigned int>(std::strlen(text)));
+ return *this;
+}
+
+String &String::operator+=(char c)
+{
+ concat(&c, 1);
+ return *this;
+}
+
+bool String::operator==(const String &other) const
+{
+ return len_ == other.len_ && std::memcmp(c_str(), other.c_str(), len_) == 0;
+}
+
+bool String::operator==(const char *text) const
+{
+ return std::strcmp(c_str(), text) == 0;
+}
+
+bool String::startsWith(const String &prefix) const
+{
+ return prefix.len_ <= len_ && std::memcmp(c_str(), prefix.c_str(), prefix.len_) == 0;
+}
+
+int String::indexOf(char c, unsigned int from) const
+{
+ if (from >= len_)
+ {
+  return -1;
+ }
+ const char *found = std::strchr(c_str() + from, c);
+ return found ? static_cast<int>(found - c_str()) : -1;
+}
+
+int String::indexOf(const String &text, unsigned int from) const
+{
+ return indexOf(text.c_str(), from);
+}
+
+int String::indexOf(const char *text, unsigned int from) const
+{
+ if (from >= len_)
+ {
+  return -1;
+ }
+ const char *found = std::strstr(c_str() + from, text);
+ return found ? static_cast<int>(found - c_str()) : -1;
+}
+
+int String::lastIndexOf(const String &text) const
+{
+ return lastIndexOf(text.c_str());
+}
+
+int String::lastIndexOf(const char *text) const
+{
+ int last = -1;
+ for (int found = indexOf(text); found != -1; found = indexOf(text, static_cast<unsigned int>(found) + 1))
+ {
+  last = found;
+ }
+ return last;
+}
+
+String String::substring(unsigned int from) const
+{
+ return substring(from, len_);
+}
+
+String String::substring(unsigned int from, unsigned int to) const
+{
+ if (from > to)
+ {
+  unsigned int swap = from;
+  from = to;
+  to = swap;
+ }
+ String out;
+ if (from >= len_)
+ {
+  return out;
+ }
+ to = to > len_ ? len_ : to;
+ out.copy(c_str() + from, to - from);
+ return out;
+}
+
+void String::trim()
+{
+ if (!buffer_ || len_ == 0)
+ {
+  return;
+ }
+ unsigned int begin = 0;
+ while (begin < len_ && (buffer_[begin] == ' ' || (buffer_[begin] >= '\t' && buffer_[begin] <= '\r')))
+ {
+  begin++;
+ }
+ unsigned int end = len_;
+ while (end > begin && (buffer_[end - 1] == ' ' || (buffer_[end - 1] >= '\t' && buffer_[end - 1] <= '\r')))
+ {
+  end--;
+ }
+ len_ = end - begin;
+ std::memmove(buffer_, buffer_ + begin, len_);
+ buffer_[len_] = 0;
+}
+
+float String::toFloat() const
+{
+ return static_cast<float>(std::atof(c_str()));
+}
+
+long String::toInt() const
+{
+ return std::atol(c_str());
+}
+
+// Sums build a temporary reserved to the combined length
+String operator+(const String &left, const String &right)
+{
+ String out(left);
+ out += right;
+ return out;
+}
+
+String operator+(const String &left, const char *right)
+{
+ String out(left);
+ out += right;
+ return out;
+}
+
+String operator+(const char *left, const String &right)
+{
+ String out(left);
+ out += right;
+ return out;
+}
+
+static std::chrono::steady_clock::time_point clock_start = std::chrono::steady_clock::now();
+
+void shimSetTimeScale(double scale)
+{
+ time_scale = scale > 0.0 ? scale : 1.0;
+}
+
+uint32_t millis()
+{
+ double elapsed =
+     std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - clock_start).count() * time_scale;
+ return MILLIS_START + static_cast<uint32_t>(static_cast<uint64_t>(elapsed));
+}
+
+void delay(uint32_t ms)
+{
+ std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(ms / time_scale));
+}
+
+void yield()
+{
+}
@@ -0,0 +1,92 @@
+/**
+ * @file Arduino.h
+ * @brief Host stand-in for the parts of the Arduino core the library uses
+ *
+ * String follows the ESP32 core's WString closely where it matters for the
+ * heap: the buffer is sized to exactly what each operation needs, grown with
+ * realloc, and concatenation builds temporaries. Its memory comes from
+ * SoakHeap, so the allocation pattern the library produces on the device is
+ * reproduced on the host. Small-string optimisation is left out, which
+ * makes the shim a little harsher than recent cores.
+ *
+ * millis() runs from a virtual clock that can run faster than real time and
+ * starts shortly before the 32-bit wrap, so session timing crosses it early
+ * in every run.
+ */
+
+#ifndef ARDUINO_SHIM_H
+#define ARDUINO_SHIM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+class String
+{
+public:
+ String(const char *text = "");
+ String(const String &other);
+ String(String &&other) noexcept;
+ explicit String(char c);
+ explicit String(unsigned char value, unsigned char base = 10);
+ explicit String(int value, unsigned char base = 10);
+ explicit String(unsigned int value, unsigned char base = 10);
+ explicit String(long value, unsigned char base = 10);
+ explicit String(unsigned long value, unsigned char base = 10);
+ ~String();
+
+ String &operator=(const String &other);
+ String &operator=(String &&other) noexcept;
+ String &operator=(const char *text);
+
+ bool reserve(unsigned int size);
+ bool concat(const char *text, unsigned int length);
+ String &operator+=(const String &other);
+ String &operator+=(const char *text);
+ String &operator+=(char c);
+
+ unsigned int length() const { return len_; }
+ bool isEmpty() const { return len_ == 0; }
+ const char *c_str() const { return buffer_ ? buffer_ : ""; }
+ char charAt(unsigned int index) const { return index < len_ ? buffer_[index] : 0; }
+
+ bool operator==(const String &other) const;
+ bool operator==(const char *text) const;
+ bool operator!=(const String &other) const { return !(*this == other); }
+ bool operator!=(const char *text) const { return !(*this == text); }
+ bool startsWith(const String &prefix) const;
+
+ int indexOf(char c, unsigned int from = 0) const;
+ int indexOf(const String &text, unsigned int from = 0) const;
+ int indexOf(const char *text, unsigned int from = 0) const;
+ int lastIndexOf(const String &text) const;
+ int lastIndexOf(const char *text) const;
+ String substring(unsigned int from) const;
+ String substring(unsigned int from, unsigned int to) const;
+ void trim();
+ float toFloat() const;
+ long toInt() const;
+
+private:
+ char *buffer_;
+ unsigned int capacity_;
+ unsigned int len_;
+
+ bool changeBuffer(unsigned int size);
+ void copy(const char *text, unsigned int length);
+ void release();
+};
+
+String operator+(const String &left, const String &right);
+String operator+(const String &left, const char *right);
+String operator+(const char *left, const String &right);
+
+uint32_t millis();
+void delay(uint32_t ms);
+void yield();
+
+// Virtual clock control for the harness
+void shimSetTimeScale(double scale);
+
+#endif // ARDUINO_SHIM_H
@@ -0,0 +1,362 @@
+/**
+ * @file HTTPClient.cpp
+ * @brief Implementation of the HTTPClient shim
+ */
+
+#include "HTTPClient.h"
+#include <arpa/inet.h>
+#include <cerrno>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+HTTPClient::HTTPClient()
+    : socket_(-1), port_(80), connectedPort_(0), collectedCount_(0), timeout_(5000), keepAlive_(false),
+      connections_(0), bufferStart_(0), bufferEnd_(0)
+{
+}
+
+HTTPClient::~HTTPClient()
+{
+ disconnect();
+}
+
+bool HTTPClient::begin(WiFiClient &client, const String &url)
+{
+ (void)client;
+ headers_ = "";
+ body_ = String(); // The device drops the previous payload buffer here
+
+ if (!url.startsWith("http://"))
+ {
+  return false;
+ }
+ int hostStart = 7;
+ int pathStart = url.indexOf('/', hostStart);
+ String authority = pathStart == -1 ? url.substring(hostStart) : url.substring(hostStart, pathStart);
+ uri_ = pathStart == -1 ? String("/") : url.substring(pathStart);
+
+ int colon = authority.indexOf(':');
+ if (colon == -1)
+ {
+  host_ = authority;
+  port_ = 80;
+ }
+ else
+ {
+  host_ = authority.substring(0, colon);
+  port_ = static_cast<uint16_t>(authority.substring(colon + 1).toInt());
+ }
+ return !host_.isEmpty();
+}
+
+// Like the device, keep the connection for the next begin() when allowed
+void HTTPClient::end()
+{
+ if (!keepAlive_)
+ {
+  disconnect();
+ }
+}
+
+void HTTPClient::addHeader(const String &name, const String &value)
+{
+ headers_ += name;
+ headers_ += ": ";
+ headers_ += value;
+ headers_ += "\r\n";
+}
+
+void HTTPClient::collectHeaders(const char *headerKeys[], const size_t headerKeysCount)
+{
+ collectedCount_ = headerKeysCount < MAX_COLLECTED ? headerKeysCount : MAX_COLLECTED;
+ for (size_t i = 0; i < collectedCount_; i++)
+ {
+  collected_[i].key = headerKeys[i];
+  collected_[i].value = "";
+ }
+}
+
+void HTTPClient::setTimeout(uint16_t timeout)
+{
+ timeout_ = timeout;
+}
+
+int HTTPClient::GET()
+{
+ return sendRequest("GET", nullptr, 0);
+}
+
+int HTTPClient::POST(const String &payload)
+{
+ return sendRequest("POST", payload.c_str(), payload.length());
+}
+
+int HTTPClient::POST(uint8_t *payload, size_t size)
+{
+ return sendRequest("POST", reinterpret_cast<const char *>(payload), size);
+}
+
+String HTTPClient::getString()
+{
+ return body_;
+}
+
+String HTTPClient::header(const char *name)
+{
+ for (size_t i = 0; i < collectedCount_; i++)
+ {
+  if (strcasecmp(collected_[i].key.c_str(), name) == 0)
+  {
+   return collected_[i].value;
+  }
+ }
+ return String();
+}
+
+bool HTTPClient::connect()
+{
+ if (socket_ != -1 && connectedHost_ == host_ && connectedPort_ == port_)
+ {
+  return true;
+ }
+ disconnect();
+
+ struct addrinfo hints = {};
+ hints.ai_family = AF_INET;
+ hints.ai_socktype = SOCK_STREAM;
+ struct addrinfo *found = nullptr;
+ char service[8];
+ std::snprintf(service, sizeof(service), "%u", port_);
+ if (getaddrinfo(host_.c_str(), service, &hints, &found) != 0 || !found)
+ {
+  return false;
+ }
+
+ socket_ = ::socket(found->ai_family, found->ai_socktype, found->ai_protocol);
+ if (socket_ != -1)
+ {
+  struct timeval tv;
+  tv.tv_sec = timeout_ / 1000;
+  tv.tv_usec = (timeout_ % 1000) * 1000;
+  setsockopt(socket_, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  setsockopt(socket_, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+  int one = 1;
+  setsockopt(socket_, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  if (::connect(socket_, found->ai_addr, found->ai_addrlen) != 0)
+  {
+   ::close(socket_);
+   socket_ = -1;
+  }
+ }
+ freeaddrinfo(found);
+ if (socket_ == -1)
+ {
+  return false;
+ }
+
+ connectedHost_ = host_;
+ connectedPort_ = port_;
+ connections_++;
+ return true;
+}
+
+void HTTPClient::disconnect()
+{
+ if (socket_ != -1)
+ {
+  ::close(socket_);
+  socket_ = -1;
+ }
+ bufferStart_ = 0;
+ bufferEnd_ = 0;
+ keepAlive_ = false;
+}
+
+bool HTTPClient::fill()
+{
+ if (bufferStart_ < bufferEnd_)
+ {
+  return true;
+ }
+ ssize_t got;
+ errno = 0;
+ do
+ {
+  got = ::recv(socket_, buffer_, sizeof(buffer_), 0);
+ } while (got < 0 && errno == EINTR);
+ if (got <= 0)
+ {
+  return false;
+ }
+ bufferStart_ = 0;
+ bufferEnd_ = static_cast<size_t>(got);
+ return true;
+}
+
+// One character at a time into a String, as readStringUntil('\n') does
+int HTTPClient::readLine(String &line)
+{
+ line = "";
+ while (true)
+ {
+  if (!fill())
+  {
+   return errno == EAGAIN || errno == EWOULDBLOCK ? HTTPC_ERROR_READ_TIMEOUT : HTTPC_ERROR_CONNECTION_LOST;
+  }
+  char c = buffer_[bufferStart_++];
+  if (c == '\n')
+  {
+   line.trim();
+   return 0;
+  }
+  line += c;
+ }
+}
+
+int HTTPClient::sendRequest(const char *method, const char *payload, size_t size)
+{
+ // A reused connection the server has since closed fails on the first
+ // read; retry once on a fresh one, as the device's client does
+ for (int attempt = 0; attempt < 2; attempt++)
+ {
+  bool reused = socket_ != -1;
+  if (!connect())
+  {
+   return HTTPC_ERROR_CONNECTION_REFUSED;
+  }
+
+  String request = method;
+  request += " ";
+  request += uri_;
+  request += " HTTP/1.1\r\nHost: ";
+  request += host_;
+  request += "\r\nUser-Agent: ESP32HTTPClient\r\nConnection: keep-alive\r\n";
+  if (size > 0)
+  {
+   request += "Content-Length: ";
+   request += String(static_cast<unsigned long>(size));
+   request += "\r\n";
+  }
+  request += headers_;
+  request += "\r\n";
+
+  if (::send(socket_, request.c_str(), request.length(), MSG_NOSIGNAL) != static_cast<ssize_t>(request.length()))
+  {
+   disconnect();
+   if (reused)
+   {
+    continue;
+   }
+   return HTTPC_ERROR_SEND_HEADER_FAILED;
+  }
+  if (size > 0 && ::send(socket_, payload, size, MSG_NOSIGNAL) != static_cast<ssize_t>(size))
+  {
+   disconnect();
+   return HTTPC_ERROR_SEND_PAYLOAD_FAILED;
+  }
+
+  int code = readResponse();
+  if (code == HTTPC_ERROR_CONNECTION_LOST && reused)
+  {
+   continue;
+  }
+  return code;
+ }
+ return HTTPC_ERROR_CONNECTION_LOST;
+}
+
+int HTTPClient::readResponse()
+{
+ for (size_t i = 0; i < collectedCount_; i++)
+ {
+  collected_[i].value = "";
+ }
+
+ String line;
+ int result = readLine(line);
+ if (result != 0)
+ {
+  disconnect();
+  return result;
+ }
+ if (!line.startsWith("HTTP/1."))
+ {
+  disconnect();
+  return HTTPC_ERROR_NO_HTTP_SERVER;
+ }
+ int code = static_cast<int>(line.substring(9, 12).toInt());
+ bool http11 = line.charAt(7) == '1';
+
+ long length = -1;
+ keepAlive_ = http11;
+ while (true)
+ {
+  result = readLine(line);
+  if (result != 0)
+  {
+   disconnect();
+   return result;
+  }
+  if (line.isEmpty())
+  {
+   break;
+  }
+  int colon = line.indexOf(':');
+  if (colon == -1)
+  {
+   continue;
+  }
+  String name = line.substring(0, colon);
+  String value = line.substring(colon + 1);
+  value.trim();
+  if (strcasecmp(name.c_str(), "Content-Length") == 0)
+  {
+   length = value.toInt();
+  }
+  else if (strcasecmp(name.c_str(), "Connection") == 0)
+  {
+   keepAlive_ = strcasecmp(value.c_str(), "close") != 0;
+  }
+  for (size_t i = 0; i < collectedCount_; i++)
+  {
+   if (strcasecmp(collected_[i].key.c_str(), name.c_str()) == 0)
+   {
+    collected_[i].value = value;
+   }
+  }
+ }
+
+ if (length < 0)
+ {
+  keepAlive_ = false;
+ }
+ else
+ {
+  body_.reserve(static_cast<unsigned int>(length));
+ }
+ while (length < 0 || body_.length() < static_cast<unsigned long>(length))
+ {
+  if (!fill())
+  {
+   if (length < 0)
+   {
+    break;
+   }
+   disconnect();
+   return HTTPC_ERROR_CONNECTION_LOST;
+  }
+  size_t take = bufferEnd_ - bufferStart_;
+  if (length >= 0 && take > static_cast<size_t>(length) - body_.length())
+  {
+   take = static_cast<size_t>(length) - body_.length();
+  }
+  body_.concat(buffer_ + bufferStart_, static_cast<unsigned int>(take));
+  bufferStart_ += take;
+ }
+ return code;
+}
@@ -0,0 +1,85 @@
+/**
+ * @file HTTPClient.h
+ * @brief Host stand-in for the ESP32 HTTPClient
+ *
+ * Mirrors the parts of the ESP32 client that shape the heap: the URL,
+ * request headers and response are all Strings, header lines are read one
+ * character at a time as readStringUntil() does, the body is reserved to
+ * its Content-Length, and only headers registered with collectHeaders() are
+ * kept. The connection is reused across begin()/end() pairs while the host
+ * stays the same and the server allows it, as the device does by default.
+ */
+
+#ifndef HTTPCLIENT_SHIM_H
+#define HTTPCLIENT_SHIM_H
+
+#include <Arduino.h>
+#include <WiFiClient.h>
+
+#define HTTPC_ERROR_CONNECTION_REFUSED (-1)
+#define HTTPC_ERROR_SEND_HEADER_FAILED (-2)
+#define HTTPC_ERROR_SEND_PAYLOAD_FAILED (-3)
+#define HTTPC_ERROR_NOT_CONNECTED (-4)
+#define HTTPC_ERROR_CONNECTION_LOST (-5)
+#define HTTPC_ERROR_NO_HTTP_SERVER (-7)
+#define HTTPC_ERROR_READ_TIMEOUT (-11)
+
+class HTTPClient
+{
+public:
+ HTTPClient();
+ ~HTTPClient();
+
+ bool begin(WiFiClient &client, const String &url);
+ void end();
+
+ void addHeader(const String &name, const String &value);
+ void collectHeaders(const char *headerKeys[], const size_t headerKeysCount);
+ void setTimeout(uint16_t timeout);
+
+ int GET();
+ int POST(const String &payload);
+ int POST(uint8_t *payload, size_t size);
+ String getString();
+ String header(const char *name);
+
+ // Connections opened so far, to confirm reuse
+ uint32_t connectionsOpened() const { return connections_; }
+
+private:
+ static const size_t MAX_COLLECTED = 4;
+
+ struct Collected
+ {
+  String key;
+  String value;
+ };
+
+ int socket_;
+ String host_;
+ uint16_t port_;
+ String connectedHost_;
+ uint16_t connectedPort_;
+ String uri_;
+ String headers_;
+ String body_;
+ Collected collected_[MAX_COLLECTED];
+ size_t collectedCount_;
+ uint16_t timeout_;
+ bool keepAlive_;
+ uint32_t connections_;
+
+ // Receive buffer, kept off the soak heap like the socket's own buffers
+ char buffer_[1460];
+ size_t bufferStart_;
+ size_t bufferEnd_;
+
+ bool connect();
+ void disconnect();
+ bool fill();
+ int readLine(String &line);
+ int sendRequest(const char *method, const char *payload, size_t size);
+ int readResponse();
+};
+
+#endif // HTTPCLIENT_SHIM_H
@@ -0,0 +1,51 @@
+/**
+ * @file MD5Builder.cpp
+ * @brief Implementation of the MD5Builder shim
+ */
+
+#include "MD5Builder.h"
+#include <openssl/evp.h>
+
+MD5Builder::MD5Builder() : context_(EVP_MD_CTX_new()), digest_{}
+{
+}
+
+MD5Builder::~MD5Builder()
+{
+ EVP_MD_CTX_free(static_cast<EVP_MD_CTX *>(context_));
+}
+
+void MD5Builder::begin()
+{
+ EVP_DigestInit_ex(static_cast<EVP_MD_CTX *>(context_), EVP_md5(), nullptr);
+}
+
+void MD5Builder::add(const String &text)
+{
+ EVP_DigestUpdate(static_cast<EVP_MD_CTX *>(context_), text.c_str(), text.length());
+}
+
+void MD5Builder::add(const char *text)
+{
+ EVP_DigestUpdate(static_cast<EVP_MD_CTX *>(context_), text, std::strlen(text));
+}
+
+void MD5Builder::calculate()
+{
+ EVP_DigestFinal_ex(static_cast<EVP_MD_CTX *>(context_), digest_, nullptr);
+}
+
+void MD5Builder::getChars(char *output) const
+{
+ for (int i = 0; i < 16; i++)
+ {
+  std::snprintf(output + i * 2, 3, "%02x", digest_[i]);
+ }
+}
+
+String MD5Builder::toString() const
+{
+ char hex[33];
+ getChars(hex);
+ return String(hex);
+}
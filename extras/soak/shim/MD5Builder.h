@@ -0,0 +1,29 @@
+/**
+ * @file MD5Builder.h
+ * @brief Host stand-in for the ESP32 MD5Builder, backed by OpenSSL
+ */
+
+#ifndef MD5BUILDER_SHIM_H
+#define MD5BUILDER_SHIM_H
+
+#include <Arduino.h>
+
+class MD5Builder
+{
+public:
+ MD5Builder();
+ ~MD5Builder();
+
+ void begin();
+ void add(const String &text);
+ void add(const char *text);
+ void calculate();
+ void getChars(char *output) const;
+ String toString() const;
+
+private:
+ void *context_;
+ uint8_t digest_[16];
+};
+
+#endif // MD5BUILDER_SHIM_H
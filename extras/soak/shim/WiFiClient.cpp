@@ -0,0 +1,128 @@
+/**
+ * @file WiFiClient.cpp
+ * @brief Implementation of the WiFiClient shim
+ */
+
+#include "WiFiClient.h"
+#include <cerrno>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+WiFiClient::WiFiClient() : socket_(-1), closed_(false), bufferStart_(0), bufferEnd_(0)
+{
+}
+
+WiFiClient::~WiFiClient()
+{
+ stop();
+}
+
+int WiFiClient::connect(const char *host, uint16_t port)
+{
+ stop();
+
+ struct addrinfo hints = {};
+ hints.ai_family = AF_INET;
+ hints.ai_socktype = SOCK_STREAM;
+ struct addrinfo *found = nullptr;
+ char service[8];
+ std::snprintf(service, sizeof(service), "%u", port);
+ if (getaddrinfo(host, service, &hints, &found) != 0 || !found)
+ {
+  return 0;
+ }
+
+ socket_ = ::socket(found->ai_family, found->ai_socktype, found->ai_protocol);
+ if (socket_ != -1)
+ {
+  int one = 1;
+  setsockopt(socket_, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  if (::connect(socket_, found->ai_addr, found->ai_addrlen) != 0)
+  {
+   ::close(socket_);
+   socket_ = -1;
+  }
+ }
+ freeaddrinfo(found);
+ return socket_ != -1 ? 1 : 0;
+}
+
+size_t WiFiClient::write(const uint8_t *buffer, size_t size)
+{
+ if (socket_ == -1)
+ {
+  return 0;
+ }
+ ssize_t sent = ::send(socket_, buffer, size, MSG_NOSIGNAL);
+ return sent < 0 ? 0 : static_cast<size_t>(sent);
+}
+
+// Pull whatever the socket holds into the buffer, without waiting
+void WiFiClient::poll()
+{
+ if (socket_ == -1 || closed_ || bufferStart_ < bufferEnd_)
+ {
+  return;
+ }
+ ssize_t got;
+ do
+ {
+  got = ::recv(socket_, buffer_, sizeof(buffer_), MSG_DONTWAIT);
+ } while (got < 0 && errno == EINTR);
+ if (got > 0)
+ {
+  bufferStart_ = 0;
+  bufferEnd_ = static_cast<size_t>(got);
+ }
+ else if (got == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+ {
+  closed_ = true;
+ }
+}
+
+int WiFiClient::available()
+{
+ poll();
+ return static_cast<int>(bufferEnd_ - bufferStart_);
+}
+
+int WiFiClient::read()
+{
+ poll();
+ return bufferStart_ < bufferEnd_ ? buffer_[bufferStart_++] : -1;
+}
+
+int WiFiClient::read(uint8_t *buffer, size_t size)
+{
+ poll();
+ size_t take = bufferEnd_ - bufferStart_;
+ if (take == 0)
+ {
+  return -1;
+ }
+ take = take < size ? take : size;
+ std::memcpy(buffer, buffer_ + bufferStart_, take);
+ bufferStart_ += take;
+ return static_cast<int>(take);
+}
+
+uint8_t WiFiClient::connected()
+{
+ poll();
+ return socket_ != -1 && (!closed_ || bufferStart_ < bufferEnd_);
+}
+
+void WiFiClient::stop()
+{
+ if (socket_ != -1)
+ {
+  ::close(socket_);
+  socket_ = -1;
+ }
+ closed_ = false;
+ bufferStart_ = 0;
+ bufferEnd_ = 0;
+}
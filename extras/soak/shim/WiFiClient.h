@@ -0,0 +1,41 @@
+/**
+ * @file WiFiClient.h
+ * @brief Host stand-in for the ESP32 WiFiClient
+ *
+ * The shimmed HTTPClient owns its socket and only needs the object to
+ * exist. RawTransport talks through it directly, so the parts of the
+ * Arduino Client interface it uses are backed by a blocking socket. The
+ * receive buffer lives in the object, off the soak heap, like the lwIP
+ * buffers on the device. available() polls without blocking.
+ */
+
+#ifndef WIFICLIENT_SHIM_H
+#define WIFICLIENT_SHIM_H
+
+#include <Arduino.h>
+
+class WiFiClient
+{
+public:
+ WiFiClient();
+ ~WiFiClient();
+
+ int connect(const char *host, uint16_t port);
+ size_t write(const uint8_t *buffer, size_t size);
+ int available();
+ int read();
+ int read(uint8_t *buffer, size_t size);
+ uint8_t connected();
+ void stop();
+
+private:
+ int socket_;
+ bool closed_; // The peer has closed; what is buffered is all that is left
+ uint8_t buffer_[1460];
+ size_t bufferStart_;
+ size_t bufferEnd_;
+
+ void poll();
+};
+
+#endif // WIFICLIENT_SHIM_H
@@ -0,0 +1,295 @@
+/**
+ * @file soak.cpp
+ * @brief gs308ep-soak: run the Arduino library for millions of iterations
+ *
+ * Builds the unmodified GS308EP library for the host against the shims in
+ * shim/, points it at a switch (normally gs308ep-mock) and loops the calls a
+ * sketch makes: login, session upkeep, full status reads, port toggles and
+ * periodic fresh logins. The heap is a fixed arena the size of the ESP32's,
+ * sampled as the run goes. Once a warm-up has passed, the second half of the
+ * run is compared with the first, and the run fails if live heap, peak heap,
+ * allocations per iteration or fragmentation kept growing, or if any
+ * allocation failed. That turns weeks of uptime into minutes.
+ */
+
+#include <GS308EP.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <getopt.h>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "SoakHeap.h"
+
+static const char *PROGRAM_NAME = "gs308ep-soak";
+
+struct Sample
+{
+ uint64_t iteration;
+ double seconds;
+ SoakHeapStats heap;
+ uint64_t errors;
+};
+
+void print_usage()
+{
+ std::cout << "Usage: " << PROGRAM_NAME << " -h <host> [OPTIONS]" << std::endl;
+ std::cout << std::endl;
+ std::cout << "Run the GS308EP Arduino library on the host and watch its heap." << std::endl;
+ std::cout << std::endl;
+ std::cout << "Options:" << std::endl;
+ std::cout << "  -h, --host=HOST[:PORT]  Switch to run against, normally gs308ep-mock" << std::endl;
+ std::cout << "  -p, --password=PASS     Administrator password (default password)" << std::endl;
+ std::cout << "  -n, --iterations=N      Loop iterations (default 1000000)" << std::endl;
+ std::cout << "      --toggle-every=N    Turn a port off and on every N iterations; 0 for never (default 50)" << std::endl;
+ std::cout << "      --relogin-every=N   Force a fresh login every N iterations; 0 for never (default 500)" << std::endl;
+ std::cout << "      --sample-every=N    Record heap statistics every N iterations (default 1000)" << std::endl;
+ std::cout << "      --heap=BYTES        Arena size (default 196608, a typical ESP32 free heap)" << std::endl;
+ std::cout << "      --tolerance=BYTES   Growth allowed between halves before failing (default 512)" << std::endl;
+ std::cout << "      --warmup=FRACTION   Leading fraction of the run left out of the verdict (default 0.1)" << std::endl;
+ std::cout << "      --time-scale=X      Virtual milliseconds per real millisecond for millis() (default 1)" << std::endl;
+ std::cout << "      --csv=FILE          Write every sample to FILE" << std::endl;
+ std::cout << "      --quiet             Print only the verdict" << std::endl;
+ std::cout << "      --help              Display this help message" << std::endl;
+ std::cout << std::endl;
+ std::cout << "Exits 0 when nothing grew, 1 when something did or an allocation failed." << std::endl;
+}
+
+static void print_sample(const Sample &sample)
+{
+ std::printf("%10llu  %8.1fs  live %7zu  peak %7zu  free %7zu  largest %7zu  allocs %11llu  errors %llu\n",
+             static_cast<unsigned long long>(sample.iteration), sample.seconds, sample.heap.liveBytes,
+             sample.heap.peakBytes, sample.heap.freeBytes, sample.heap.largestFree,
+             static_cast<unsigned long long>(sample.heap.allocations), static_cast<unsigned long long>(sample.errors));
+ std::fflush(stdout);
+}
+
+// Compare the halves of the post-warm-up samples; true when nothing grew
+static bool judge(const std::vector<Sample> &samples, double warmup, uint64_t iterations, size_t tolerance)
+{
+ size_t first = 0;
+ while (first < samples.size() && samples[first].iteration < static_cast<uint64_t>(warmup * iterations))
+ {
+  first++;
+ }
+ if (samples.size() - first < 4)
+ {
+  std::cout << "Too few samples after warm-up to judge growth; lower --sample-every" << std::endl;
+  return false;
+ }
+ size_t middle = first + (samples.size() - first) / 2;
+ const Sample &start = samples[first];
+ const Sample &mid = samples[middle];
+ const Sample &end = samples.back();
+
+ size_t live_first = 0, live_second = 0;
+ size_t largest_first = SIZE_MAX, largest_second = SIZE_MAX;
+ for (size_t i = first; i < samples.size(); i++)
+ {
+  size_t &live = i < middle ? live_first : live_second;
+  size_t &largest = i < middle ? largest_first : largest_second;
+  live = std::max(live, samples[i].heap.liveBytes);
+  largest = std::min(largest, samples[i].heap.largestFree);
+ }
+ double rate_first = static_cast<double>(mid.heap.allocations - start.heap.allocations) / (mid.iteration - start.iteration);
+ double rate_second = static_cast<double>(end.heap.allocations - mid.heap.allocations) / (end.iteration - mid.iteration);
+
+ bool ok = true;
+ auto check = [&](const char *what, bool grew, const std::string &detail) {
+  std::cout << (grew ? "FAIL  " : "ok    ") << what << ": " << detail << std::endl;
+  ok = ok && !grew;
+ };
+ check("live heap", live_second > live_first + tolerance,
+       std::to_string(live_first) + " -> " + std::to_string(live_second) + " bytes at most");
+ check("peak heap", end.heap.peakBytes > start.heap.peakBytes + tolerance,
+       std::to_string(start.heap.peakBytes) + " -> " + std::to_string(end.heap.peakBytes) + " bytes");
+ // The mix of calls repeats, so the rate is flat unless some work keeps growing
+ check("allocations per iteration", rate_second > rate_first * 1.05 + 0.5,
+       std::to_string(rate_first) + " -> " + std::to_string(rate_second));
+ check("largest free block", largest_first > largest_second + tolerance,
+       std::to_string(largest_first) + " -> " + std::to_string(largest_second) + " bytes at least");
+ check("allocation failures", end.heap.failures > 0, std::to_string(end.heap.failures));
+ return ok;
+}
+
+int main(int argc, char *argv[])
+{
+ std::string host;
+ std::string password = "password";
+ uint64_t iterations = 1000000;
+ uint64_t toggle_every = 50;
+ uint64_t relogin_every = 500;
+ uint64_t sample_every = 1000;
+ size_t heap_size = 196608;
+ size_t tolerance = 512;
+ double warmup = 0.1;
+ double time_scale = 1.0;
+ std::string csv_path;
+ bool quiet = false;
+
+ static struct option long_options[] = {{"host", required_argument, 0, 'h'},
+                                        {"password", required_argument, 0, 'p'},
+                                        {"iterations", required_argument, 0, 'n'},
+                                        {"toggle-every", required_argument, 0, 2},
+                                        {"relogin-every", required_argument, 0, 3},
+                                        {"sample-every", required_argument, 0, 4},
+                                        {"heap", required_argument, 0, 5},
+                                        {"tolerance", required_argument, 0, 6},
+                                        {"warmup", required_argument, 0, 7},
+                                        {"time-scale", required_argument, 0, 8},
+                                        {"csv", required_argument, 0, 9},
+                                        {"quiet", no_argument, 0, 10},
+                                        {"help", no_argument, 0, 11},
+                                        {0, 0, 0, 0}};
+
+ int opt;
+ int option_index = 0;
+ while ((opt = getopt_long(argc, argv, "h:p:n:", long_options, &option_index)) != -1)
+ {
+  switch (opt)
+  {
+  case 'h':
+   host = optarg;
+   break;
+  case 'p':
+   password = optarg;
+   break;
+  case 'n':
+   iterations = std::strtoull(optarg, nullptr, 10);
+   break;
+  case 2:
+   toggle_every = std::strtoull(optarg, nullptr, 10);
+   break;
+  case 3:
+   relogin_every = std::strtoull(optarg, nullptr, 10);
+   break;
+  case 4:
+   sample_every = std::max(1ULL, std::strtoull(optarg, nullptr, 10));
+   break;
+  case 5:
+   heap_size = std::strtoull(optarg, nullptr, 10);
+   break;
+  case 6:
+   tolerance = std::strtoull(optarg, nullptr, 10);
+   break;
+  case 7:
+   warmup = std::min(0.9, std::max(0.0, std::atof(optarg)));
+   break;
+  case 8:
+   time_scale = std::atof(optarg);
+   break;
+  case 9:
+   csv_path = optarg;
+   break;
+  case 10:
+   quiet = true;
+   break;
+  case 11:
+   print_usage();
+   return 0;
+  default:
+   print_usage();
+   return 1;
+  }
+ }
+
+ if (host.empty())
+ {
+  std::cerr << "Error: Host is required (-h)" << std::endl;
+  return 1;
+ }
+ if (heap_size < 16384 || heap_size > 0xFFFFFFFFu)
+ {
+  std::cerr << "Error: --heap must be at least 16384 bytes" << std::endl;
+  return 1;
+ }
+
+ FILE *csv = nullptr;
+ if (!csv_path.empty())
+ {
+  csv = std::fopen(csv_path.c_str(), "w");
+  if (!csv)
+  {
+   std::cerr << "Error: Cannot write " << csv_path << std::endl;
+   return 1;
+  }
+  std::fprintf(csv, "iteration,seconds,live,peak,free,largest_free,allocations,failures,errors\n");
+ }
+
+ soakHeapInit(heap_size);
+ shimSetTimeScale(time_scale);
+
+ std::vector<Sample> samples;
+ uint64_t errors = 0;
+ auto started = std::chrono::steady_clock::now();
+ {
+  // Scoped so every library String is released before the final check
+  GS308EP poe(host.c_str(), password.c_str());
+  PoEPortStats stats[8];
+  poe.begin();
+
+  for (uint64_t i = 1; i <= iterations; i++)
+  {
+   bool ok = poe.maintainSession();
+   ok = ok && poe.getAllPoEPortStats(stats);
+   if (ok && toggle_every && i % toggle_every == 0)
+   {
+    uint8_t port = static_cast<uint8_t>(1 + (i / toggle_every) % 8);
+    ok = poe.turnOffPoEPort(port) && poe.turnOnPoEPort(port);
+   }
+   if (ok && relogin_every && i % relogin_every == 0)
+   {
+    ok = poe.login();
+   }
+   if (!ok)
+   {
+    errors++;
+   }
+
+   if (i % sample_every == 0 || i == iterations)
+   {
+    Sample sample;
+    sample.iteration = i;
+    sample.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    sample.heap = soakHeapStats();
+    sample.errors = errors;
+    samples.push_back(sample);
+    if (!quiet)
+    {
+     print_sample(sample);
+    }
+    if (csv)
+    {
+     std::fprintf(csv, "%llu,%.3f,%zu,%zu,%zu,%zu,%llu,%llu,%llu\n", static_cast<unsigned long long>(i),
+                  sample.seconds, sample.heap.liveBytes, sample.heap.peakBytes, sample.heap.freeBytes,
+                  sample.heap.largestFree, static_cast<unsigned long long>(sample.heap.allocations),
+                  static_cast<unsigned long long>(sample.heap.failures), static_cast<unsigned long long>(errors));
+    }
+   }
+  }
+ }
+ if (csv)
+ {
+  std::fclose(csv);
+ }
+
+ SoakHeapStats after = soakHeapStats();
+ std::cout << std::endl;
+ std::cout << "Iterations: " << iterations << " | Errors: " << errors << " | Heap left after teardown: "
+           << after.liveBytes << " bytes" << std::endl;
+ bool ok = judge(samples, warmup, iterations, tolerance);
+ if (after.liveBytes != 0)
+ {
+  std::cout << "FAIL  teardown: " << after.liveBytes << " bytes still allocated" << std::endl;
+  ok = false;
+ }
+ if (errors == iterations)
+ {
+  std::cout << "FAIL  no iteration succeeded; is the switch reachable?" << std::endl;
+  ok = false;
+ }
+ std::cout << (ok ? "PASS" : "FAIL") << std::endl;
+ return ok ? 0 : 1;
+}
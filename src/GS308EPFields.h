@@ -0,0 +1,471 @@
+/**
+ * @file GS308EPFields.h
+ * @brief Page scanning and the field-set policies of BasicGS308EP
+ *
+ * GS308EPPage holds the scanning helpers every configuration shares. They
+ * work on a page's characters in place, so they need no String. The field
+ * policies build on them. Each one parses only its own fields, and a
+ * policy's parser is compiled only when a sketch asks for readings.
+ *
+ * Each port's block on the status page is anchored on a hidden input whose
+ * value is the port number. Status and class appear within 500 characters
+ * before that marker, and the readings within 1000 characters after it.
+ */
+
+#ifndef GS308EP_FIELDS_H
+#define GS308EP_FIELDS_H
+
+#include <ctype.h>
+#include <stdlib.h>
+#include "GS308EPPolicies.h"
+
+/**
+ * @struct GS308EPPage
+ * @brief Scanning helpers over a NUL-terminated page of known length
+ */
+struct GS308EPPage
+{
+ /**
+  * @brief Find the first needle lying wholly inside [from, to)
+  * @return Offset of the match, or -1
+  */
+ static int find(const char *html, const char *needle, int from, int to)
+ {
+  int length = strlen(needle);
+  for (int i = from < 0 ? 0 : from; i + length <= to; i++)
+  {
+   const char *hit = static_cast<const char *>(memchr(html + i, needle[0], to - length + 1 - i));
+   if (!hit)
+   {
+    return -1;
+   }
+   i = hit - html;
+   if (memcmp(hit, needle, length) == 0)
+   {
+    return i;
+   }
+  }
+  return -1;
+ }
+
+ /**
+  * @brief Find the last needle lying wholly inside [from, to)
+  * @return Offset of the match, or -1
+  */
+ static int findLast(const char *html, const char *needle, int from, int to)
+ {
+  int length = strlen(needle);
+  for (int i = to - length; i >= from; i--)
+  {
+   if (html[i] == needle[0] && memcmp(html + i, needle, length) == 0)
+   {
+    return i;
+   }
+  }
+  return -1;
+ }
+
+ /**
+  * @brief Narrow [start, end) past leading and trailing whitespace
+  */
+ static void trim(const char *html, int &start, int &end)
+ {
+  while (start < end && isspace(static_cast<unsigned char>(html[start])))
+  {
+   start++;
+  }
+  while (end > start && isspace(static_cast<unsigned char>(html[end - 1])))
+  {
+   end--;
+  }
+ }
+
+ /**
+  * @brief Compare [start, end) with a C string
+  */
+ static bool equals(const char *html, int start, int end, const char *text)
+ {
+  return static_cast<size_t>(end - start) == strlen(text) && memcmp(html + start, text, end - start) == 0;
+ }
+
+ /**
+  * @brief Check whether a response is the login page served for an expired session
+  */
+ static bool isLoginPage(const char *html, int length)
+ {
+  return find(html, "id=\"rand\"", 0, length) != -1 || find(html, "id='rand'", 0, length) != -1;
+ }
+
+ /**
+  * @brief Find the quoted text of the first "value" at or after from
+  * @param first Quote character tried first
+  * @param second Quote character tried when first is absent
+  * @return true with [start, end) set to the text between the quotes
+  */
+ static bool quotedValue(const char *html, int length, int from, char first, char second, int &start, int &end)
+ {
+  const char firstQuote[2] = {first, '\0'};
+  const char secondQuote[2] = {second, '\0'};
+
+  int valueIndex = find(html, "value", from, length);
+  if (valueIndex == -1)
+  {
+   return false;
+  }
+
+  start = find(html, firstQuote, valueIndex, length);
+  if (start == -1)
+  {
+   start = find(html, secondQuote, valueIndex, length);
+  }
+  if (start == -1)
+  {
+   return false;
+  }
+  start++; // Move past the quote
+
+  end = find(html, firstQuote, start, length);
+  if (end == -1)
+  {
+   end = find(html, secondQuote, start, length);
+  }
+  return end != -1;
+ }
+
+ /**
+  * @brief Find the login page's rand value
+  *
+  * Looks for: <input type=hidden id="rand" name="rand" value='1735414426'>
+  */
+ static bool randValue(const char *html, int length, int &start, int &end)
+ {
+  int randIndex = find(html, "id=\"rand\"", 0, length);
+  if (randIndex == -1)
+  {
+   randIndex = find(html, "id='rand'", 0, length);
+  }
+  return randIndex != -1 && quotedValue(html, length, randIndex, '\'', '"', start, end);
+ }
+
+ /**
+  * @brief Find a form's hash value
+  *
+  * Looks for: <input type=hidden name='hash' id='hash' value="xxxx">
+  */
+ static bool formHash(const char *html, int length, int &start, int &end)
+ {
+  int hashIndex = find(html, "name='hash'", 0, length);
+  if (hashIndex == -1)
+  {
+   hashIndex = find(html, "name=\"hash\"", 0, length);
+  }
+  return hashIndex != -1 && quotedValue(html, length, hashIndex, '"', '\'', start, end);
+ }
+
+ /**
+  * @brief Find the session ID in a Set-Cookie value such as "SID=xxxxx; path=/"
+  */
+ static bool sessionId(const char *header, int &start, int &end)
+ {
+  int length = strlen(header);
+  start = find(header, "SID=", 0, length);
+  if (start == -1)
+  {
+   return false;
+  }
+  start += 4; // Move past "SID="
+
+  end = find(header, ";", start, length);
+  if (end == -1)
+  {
+   end = find(header, "\r", start, length);
+  }
+  if (end == -1)
+  {
+   end = find(header, "\n", start, length);
+  }
+  if (end == -1)
+  {
+   end = length;
+  }
+  return true;
+ }
+
+ /**
+  * @brief Find a port's block marker: <input type="hidden" class="port" value="X">
+  * @return Offset of the marker, or -1
+  */
+ static int portMarker(const char *html, int length, uint8_t port)
+ {
+  char marker[16];
+  snprintf(marker, sizeof(marker), "value=\"%u\"", port);
+  return find(html, marker, 0, length);
+ }
+
+ /**
+  * @brief Read a port's hidPortPwr flag, which is 1 when PoE is switched on
+  */
+ static bool powerFlag(const char *html, int length, uint8_t port)
+ {
+  char marker[24];
+  snprintf(marker, sizeof(marker), "\"port\" value=\"%u\"", port);
+  int portIndex = find(html, marker, 0, length);
+  if (portIndex == -1)
+  {
+   return false;
+  }
+
+  int pwrIndex = find(html, "hidPortPwr\" value=\"", portIndex, length);
+  if (pwrIndex == -1 || pwrIndex + 19 >= length)
+  {
+   return false;
+  }
+  return html[pwrIndex + 19] == '1';
+ }
+
+ /**
+  * @brief Find the text of the first <span> after a field label
+  *
+  * The label (e.g. ml574) must start after portPos and before limit; the
+  * span may lie anywhere after it.
+  *
+  * @return true with [start, end) set to the trimmed span text
+  */
+ static bool fieldSpan(const char *html, int length, const char *field, int portPos, int limit, int &start,
+                       int &end)
+ {
+  int fieldLength = strlen(field);
+  int to = limit + fieldLength - 1 < length ? limit + fieldLength - 1 : length;
+  int fieldPos = find(html, field, portPos, to);
+  if (fieldPos == -1)
+  {
+   return false;
+  }
+
+  start = find(html, "<span>", fieldPos + fieldLength, length);
+  if (start == -1)
+  {
+   return false;
+  }
+  start += 6; // Move past "<span>"
+  end = find(html, "</span>", start, length);
+  if (end == -1)
+  {
+   return false;
+  }
+  trim(html, start, end);
+  return true;
+ }
+
+ /**
+  * @brief Read a numeric field of a port, or fallback if it is missing
+  */
+ static float reading(const char *html, int length, const char *field, int portPos, int limit, float fallback)
+ {
+  int start, end;
+  if (!fieldSpan(html, length, field, portPos, limit, start, end))
+  {
+   return fallback;
+  }
+  return atof(html + start); // The page is NUL-terminated and '<' ends the number
+ }
+
+ /**
+  * @brief Read a port's power (ml574) given its marker
+  * @return Power in watts, or -1.0 if not found
+  */
+ static float power(const char *html, int length, int portPos)
+ {
+  return reading(html, length, "ml574", portPos, portPos + 1001, -1.0);
+ }
+
+ /**
+  * @brief Find a port's status text, e.g. "Delivering Power"
+  *
+  * Looks backwards from the marker for:
+  * <span class="pull-right poe-power-mode"><span>Delivering Power</span>
+  */
+ static bool status(const char *html, int portPos, int &start, int &end)
+ {
+  int searchStart = (portPos > 500) ? portPos - 500 : 0;
+  int modePos = findLast(html, "poe-power-mode", searchStart, portPos);
+  start = modePos == -1 ? -1 : find(html, "<span>", modePos, portPos);
+  if (start == -1)
+  {
+   return false;
+  }
+  start += 6;
+  end = find(html, "</span>", start, portPos);
+  if (end == -1)
+  {
+   return false;
+  }
+  trim(html, start, end);
+  return true;
+ }
+
+ /**
+  * @brief Check whether a port's status says it is delivering power
+  */
+ static bool delivering(const char *html, int portPos)
+ {
+  int start, end;
+  return status(html, portPos, start, end) && equals(html, start, end, "Delivering Power");
+ }
+
+ /**
+  * @brief Find a port's power class
+  *
+  * Looks backwards from the marker for <span class="powClassShow">ml003@4@</span>
+  * or <span class="powClassShow">Unknown</span>. The firmware's "ml003@N@"
+  * code comes back as the span of N with isCode set.
+  */
+ static bool powerClass(const char *html, int portPos, int &start, int &end, bool &isCode)
+ {
+  int searchStart = (portPos > 500) ? portPos - 500 : 0;
+  int classPos = findLast(html, "powClassShow", searchStart, portPos);
+  start = classPos == -1 ? -1 : find(html, ">", classPos, portPos);
+  if (start == -1)
+  {
+   return false;
+  }
+  start++; // Move past ">"
+  end = find(html, "</span>", start, portPos);
+  if (end == -1)
+  {
+   return false;
+  }
+  trim(html, start, end);
+
+  isCode = end - start >= 6 && memcmp(html + start, "ml003@", 6) == 0;
+  if (!isCode)
+  {
+   return true;
+  }
+  int atPos = find(html, "@", start + 6, end);
+  if (atPos == -1 || atPos <= start + 6)
+  {
+   return false;
+  }
+  start += 6;
+  end = atPos;
+  return true;
+ }
+};
+
+/**
+ * @struct AllFields
+ * @brief Field policy parsing every field into PoEPortStats (the default)
+ */
+struct AllFields
+{
+ typedef PoEPortStats Stats;
+ static const bool READINGS = true;
+
+ /**
+  * @brief Parse one port's block
+  * @return true if the port was found on the page
+  */
+ static bool parse(const char *html, int length, uint8_t port, PoEPortStats &stats)
+ {
+  stats.port = port;
+  stats.enabled = false;
+  stats.status = "Unknown";
+  stats.voltage = 0.0;
+  stats.current = 0.0;
+  stats.power = 0.0;
+  stats.temperature = 0.0;
+  stats.fault = "Unknown";
+  stats.powerClass = "Unknown";
+
+  int portPos = GS308EPPage::portMarker(html, length, port);
+  if (portPos == -1)
+  {
+   return false;
+  }
+
+  int start, end;
+  if (GS308EPPage::status(html, portPos, start, end))
+  {
+   DynamicStrings::assign(stats.status, html + start, end - start);
+   stats.enabled = GS308EPPage::equals(html, start, end, "Delivering Power");
+  }
+
+  bool isCode;
+  if (GS308EPPage::powerClass(html, portPos, start, end, isCode))
+  {
+   DynamicStrings::assign(stats.powerClass, html + start, end - start);
+   if (isCode)
+   {
+    stats.powerClass = "Class " + stats.powerClass;
+   }
+  }
+
+  stats.voltage = GS308EPPage::reading(html, length, "ml570", portPos, portPos + 1000, 0.0);
+  stats.current = GS308EPPage::reading(html, length, "ml572", portPos, portPos + 1000, 0.0);
+  stats.power = GS308EPPage::power(html, length, portPos);
+  stats.temperature = GS308EPPage::reading(html, length, "ml575", portPos, portPos + 1000, 0.0);
+
+  if (GS308EPPage::fieldSpan(html, length, "ml581", portPos, portPos + 1000, start, end))
+  {
+   DynamicStrings::assign(stats.fault, html + start, end - start);
+  }
+  return true;
+ }
+};
+
+/**
+ * @struct PowerFields
+ * @brief Field policy parsing only the numeric readings into PoEPortPower
+ *
+ * Status, class and fault texts are never copied, so reading a port costs
+ * no heap at all.
+ */
+struct PowerFields
+{
+ typedef PoEPortPower Stats;
+ static const bool READINGS = true;
+
+ /**
+  * @brief Parse one port's block
+  * @return true if the port was found on the page
+  */
+ static bool parse(const char *html, int length, uint8_t port, PoEPortPower &stats)
+ {
+  stats.port = port;
+  stats.enabled = false;
+  stats.voltage = 0.0;
+  stats.current = 0.0;
+  stats.power = 0.0;
+  stats.temperature = 0.0;
+
+  int portPos = GS308EPPage::portMarker(html, length, port);
+  if (portPos == -1)
+  {
+   return false;
+  }
+
+  stats.enabled = GS308EPPage::delivering(html, portPos);
+  stats.voltage = GS308EPPage::reading(html, length, "ml570", portPos, portPos + 1000, 0.0);
+  stats.current = GS308EPPage::reading(html, length, "ml572", portPos, portPos + 1000, 0.0);
+  stats.power = GS308EPPage::power(html, length, portPos);
+  stats.temperature = GS308EPPage::reading(html, length, "ml575", portPos, portPos + 1000, 0.0);
+  return true;
+ }
+};
+
+/**
+ * @struct ControlFields
+ * @brief Field policy for nodes that only switch ports
+ *
+ * No readings are parsed. getAllPoEPortStats(), getPoEPortPower() and
+ * getTotalPoEPower() fail to compile with this policy; getPoEPortStatus()
+ * still works.
+ */
+struct ControlFields
+{
+ typedef PoEPortPower Stats;
+ static const bool READINGS = false;
+};
+
+#endif // GS308EP_FIELDS_H
@@ -0,0 +1,104 @@
+/**
+ * @file GS308EPHTTPClientTransport.h
+ * @brief Transport policy for BasicGS308EP built on the core's HTTPClient
+ *
+ * This is the transport of the default GS308EP client. HTTPClient keeps the
+ * connection alive between requests and follows the server's framing. Each
+ * response body is read into a String and kept until the client has parsed
+ * it.
+ */
+
+#ifndef GS308EP_HTTPCLIENT_TRANSPORT_H
+#define GS308EP_HTTPCLIENT_TRANSPORT_H
+
+#include <Arduino.h>
+#include <WiFiClient.h>
+#include <HTTPClient.h>
+
+/**
+ * @class HTTPClientTransport
+ * @brief HTTPClient and WiFiClient behind the BasicGS308EP transport interface
+ */
+class HTTPClientTransport
+{
+public:
+ ~HTTPClientTransport() { _http.end(); }
+
+ /**
+  * @brief Configure the client; called from BasicGS308EP::begin()
+  * @param timeoutMs Connect and read timeout
+  */
+ void begin(uint16_t timeoutMs)
+ {
+  _http.setTimeout(timeoutMs);
+
+  // HTTPClient only keeps the response headers it is asked for
+  const char *headerKeys[] = {"Set-Cookie"};
+  _http.collectHeaders(headerKeys, 1);
+ }
+
+ /**
+  * @brief Send a request and read the response
+  *
+  * The previous response is dropped first. The body and Set-Cookie value
+  * are kept only for a 200 response.
+  *
+  * @param host Switch address, optionally with :port
+  * @param path Absolute path of the page
+  * @param sessionId SID cookie to send, or "" for none
+  * @param form URL-encoded form to POST, or NULL to GET
+  * @return HTTP status code, or a negative HTTPC_ERROR_* code
+  */
+ template <class Wait>
+ int request(const char *host, const char *path, const char *sessionId, const char *form)
+ {
+  release();
+
+  char url[128];
+  snprintf(url, sizeof(url), "http://%s%s", host, path);
+  _http.begin(_client, url);
+
+  if (form)
+  {
+   _http.addHeader("Content-Type", "application/x-www-form-urlencoded");
+  }
+  if (sessionId[0])
+  {
+   _http.addHeader("Cookie", String("SID=") + sessionId);
+  }
+
+  int code = form ? _http.POST(reinterpret_cast<uint8_t *>(const_cast<char *>(form)), strlen(form)) : _http.GET();
+  if (code == 200)
+  {
+   _body = _http.getString();
+   _setCookie = _http.header("Set-Cookie");
+  }
+
+  _http.end();
+  return code;
+ }
+
+ /// Body of the last 200 response, NUL-terminated
+ const char *body() const { return _body.c_str(); }
+ int bodyLength() const { return _body.length(); }
+
+ /// Set-Cookie value of the last 200 response, or ""
+ const char *setCookie() const { return _setCookie.c_str(); }
+
+ /**
+  * @brief Free the last response
+  */
+ void release()
+ {
+  _body = String();
+  _setCookie = String();
+ }
+
+private:
+ HTTPClient _http;
+ WiFiClient _client;
+ String _body;
+ String _setCookie;
+};
+
+#endif // GS308EP_HTTPCLIENT_TRANSPORT_H
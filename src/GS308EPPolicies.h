@@ -0,0 +1,206 @@
+/**
+ * @file GS308EPPolicies.h
+ * @brief Compile-time policies and result types for BasicGS308EP
+ *
+ * BasicGS308EP<Transport, Fields, Storage, Wait> is configured entirely by
+ * its template arguments. The compiler instantiates only the members a
+ * sketch calls, and only for the policies it names. A node that only
+ * switches ports therefore carries no status page parser, no String code
+ * and, with RawTransport, no HTTPClient.
+ *
+ * - Fields chooses what the status page is parsed into. AllFields fills
+ *   PoEPortStats, with the text fields as String. PowerFields fills the
+ *   numeric PoEPortPower. ControlFields parses no readings at all, and the
+ *   reading calls do not compile with it.
+ * - Storage chooses how the address, password, session cookie and form
+ *   hash are held. DynamicStrings keeps them in String, StaticStrings in
+ *   fixed buffers inside the object.
+ * - Wait chooses what happens while the client waits for the switch or for
+ *   a power cycle. BlockingWait delays. CooperativeWait<hook> keeps calling
+ *   the sketch's hook instead.
+ *
+ * Transports are in their own headers, so that a transport's dependencies
+ * are only included when a sketch chooses it.
+ */
+
+#ifndef GS308EP_POLICIES_H
+#define GS308EP_POLICIES_H
+
+#include <Arduino.h>
+#include <string.h>
+
+/**
+ * @struct PoEPortStats
+ * @brief Comprehensive statistics for a single PoE port
+ */
+struct PoEPortStats
+{
+ uint8_t port;      ///< Port number (1-8)
+ bool enabled;      ///< Whether PoE is enabled on this port
+ String status;     ///< Status text ("Delivering Power", "Disabled", "Searching", etc.)
+ float voltage;     ///< Output voltage in volts (V)
+ float current;     ///< Output current in milliamps (mA)
+ float power;       ///< Output power in watts (W)
+ float temperature; ///< Temperature in Celsius (°C)
+ String fault;      ///< Fault status ("No Error", or error description)
+ String powerClass; ///< PoE class ("Class 3", "Class 4", "Unknown", etc.)
+};
+
+/**
+ * @struct PoEPortPower
+ * @brief The numeric readings of a single PoE port, without any text
+ */
+struct PoEPortPower
+{
+ uint8_t port;      ///< Port number (1-8)
+ bool enabled;      ///< Whether the port is delivering power
+ float voltage;     ///< Output voltage in volts (V)
+ float current;     ///< Output current in milliamps (mA)
+ float power;       ///< Output power in watts (W), -1.0 if the page has none
+ float temperature; ///< Temperature in Celsius (°C)
+};
+
+/**
+ * @class FixedString
+ * @brief Text of up to Capacity characters held inline, never on the heap
+ */
+template <size_t Capacity>
+class FixedString
+{
+public:
+ /**
+  * @brief Construct from a C string; empty if it does not fit
+  * @param text Initial text
+  */
+ FixedString(const char *text = "") : _length(0)
+ {
+  _text[0] = '\0';
+  assign(text, strlen(text));
+ }
+
+ /**
+  * @brief Replace the text
+  * @param text Characters to copy
+  * @param length Number of characters
+  * @return true if it fit; otherwise the text is left empty
+  */
+ bool assign(const char *text, size_t length)
+ {
+  if (length > Capacity)
+  {
+   clear();
+   return false;
+  }
+  memcpy(_text, text, length);
+  _text[length] = '\0';
+  _length = length;
+  return true;
+ }
+
+ void clear()
+ {
+  _text[0] = '\0';
+  _length = 0;
+ }
+
+ const char *c_str() const { return _text; }
+ size_t length() const { return _length; }
+ bool isEmpty() const { return _length == 0; }
+
+private:
+ char _text[Capacity + 1];
+ size_t _length;
+};
+
+/**
+ * @struct DynamicStrings
+ * @brief Storage policy keeping text in Arduino String (the default)
+ */
+struct DynamicStrings
+{
+ template <size_t Capacity>
+ using Text = String;
+
+ /**
+  * @brief Replace a String's text with a span of characters
+  * @return true (a String holds any length)
+  */
+ static bool assign(String &text, const char *value, size_t length)
+ {
+  text = "";
+  text.reserve(length);
+  for (size_t i = 0; i < length; i++)
+  {
+   text += value[i];
+  }
+  return true;
+ }
+};
+
+/**
+ * @struct StaticStrings
+ * @brief Storage policy keeping text in fixed buffers inside the client
+ *
+ * Nothing is allocated for credentials or session state, at the cost of a
+ * fixed capacity per field (see BasicGS308EP).
+ */
+struct StaticStrings
+{
+ template <size_t Capacity>
+ using Text = FixedString<Capacity>;
+
+ /**
+  * @brief Replace a FixedString's text with a span of characters
+  * @return true if it fit
+  */
+ template <size_t Capacity>
+ static bool assign(FixedString<Capacity> &text, const char *value, size_t length)
+ {
+  return text.assign(value, length);
+ }
+};
+
+/**
+ * @struct BlockingWait
+ * @brief Wait policy that delays (the default)
+ */
+struct BlockingWait
+{
+ /// Called while a transport waits for the switch
+ static void idle() { delay(1); }
+
+ /// Called for the pause of a power cycle
+ static void pause(uint32_t ms) { delay(ms); }
+};
+
+/**
+ * @struct CooperativeWait
+ * @brief Wait policy that hands every wait to the sketch
+ *
+ * Hook runs in place of each delay, so a sketch can keep servicing sensors,
+ * displays or watchdogs while the client waits for the switch or sits out
+ * a power cycle. The hook must not call back into the same client.
+ *
+ * @tparam Hook Function called repeatedly while waiting
+ */
+template <void (*Hook)()>
+struct CooperativeWait
+{
+ static void idle()
+ {
+  Hook();
+  yield();
+ }
+
+ static void pause(uint32_t ms)
+ {
+  uint32_t start = millis();
+  while (millis() - start < ms)
+  {
+   Hook();
+   yield();
+  }
+ }
+};
+
+#endif // GS308EP_POLICIES_H
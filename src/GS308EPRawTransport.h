@@ -0,0 +1,391 @@
+/**
+ * @file GS308EPRawTransport.h
+ * @brief Lean transport policy for BasicGS308EP speaking HTTP over any Client
+ *
+ * RawTransport writes its requests straight to an Arduino Client (a
+ * WiFiClient, EthernetClient or anything with the same interface) and reads
+ * the response without HTTPClient or String. The request head is formatted
+ * on the stack. The body goes into one heap buffer that is sized from
+ * Content-Length when the switch sends one, and is freed as soon as the
+ * client has parsed the page. Each request opens its own connection and
+ * asks the switch to close it.
+ *
+ * While the switch has not answered, the transport calls the client's Wait
+ * policy, so CooperativeWait keeps the sketch running during slow
+ * responses.
+ */
+
+#ifndef GS308EP_RAW_TRANSPORT_H
+#define GS308EP_RAW_TRANSPORT_H
+
+#include <Arduino.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <strings.h>
+
+/**
+ * @brief Negative response codes of RawTransport
+ *
+ * Numbered as HTTPClient's HTTPC_ERROR_* codes, so getLastResponseCode()
+ * means the same with either transport.
+ */
+enum GS308EPTransportError
+{
+ GS308EP_ERROR_CONNECTION_REFUSED = -1,
+ GS308EP_ERROR_SEND_FAILED = -2,
+ GS308EP_ERROR_CONNECTION_LOST = -5,
+ GS308EP_ERROR_NO_HTTP_SERVER = -7,
+ GS308EP_ERROR_TOO_LARGE = -8, ///< Body over MaxBody, or out of memory
+ GS308EP_ERROR_READ_TIMEOUT = -11
+};
+
+/**
+ * @class RawTransport
+ * @brief HTTP/1.1 over a bare Client behind the BasicGS308EP transport interface
+ *
+ * @tparam ClientType WiFiClient, EthernetClient or another Arduino Client
+ * @tparam MaxBody Largest response body accepted, in bytes
+ */
+template <class ClientType, size_t MaxBody = 32768>
+class RawTransport
+{
+public:
+ RawTransport() : _body(0), _length(0), _capacity(0), _timeout(5000) { _setCookie[0] = '\0'; }
+
+ ~RawTransport()
+ {
+  release();
+  _client.stop();
+ }
+
+ /**
+  * @brief Configure the client; called from BasicGS308EP::begin()
+  * @param timeoutMs Time to wait for the switch before giving up a response
+  */
+ void begin(uint16_t timeoutMs) { _timeout = timeoutMs; }
+
+ /**
+  * @brief Send a request and read the response
+  *
+  * The previous response is dropped first. The body and Set-Cookie value
+  * are kept only for a 200 response.
+  *
+  * @param host Switch address, optionally with :port
+  * @param path Absolute path of the page
+  * @param sessionId SID cookie to send, or "" for none
+  * @param form URL-encoded form to POST, or NULL to GET
+  * @return HTTP status code, or a negative GS308EPTransportError
+  */
+ template <class Wait>
+ int request(const char *host, const char *path, const char *sessionId, const char *form)
+ {
+  release();
+
+  char name[64];
+  const char *colon = strchr(host, ':');
+  size_t nameLength = colon ? static_cast<size_t>(colon - host) : strlen(host);
+  if (nameLength >= sizeof(name))
+  {
+   return GS308EP_ERROR_CONNECTION_REFUSED;
+  }
+  memcpy(name, host, nameLength);
+  name[nameLength] = '\0';
+  uint16_t port = colon ? static_cast<uint16_t>(atoi(colon + 1)) : 80;
+
+  char head[384];
+  int length = 0;
+  bool fits = append(head, sizeof(head), length, "%s %s HTTP/1.1\r\nHost: %s\r\nConnection: close\r\n",
+                     form ? "POST" : "GET", path, host);
+  if (sessionId[0])
+  {
+   fits = fits && append(head, sizeof(head), length, "Cookie: SID=%s\r\n", sessionId);
+  }
+  if (form)
+  {
+   fits = fits && append(head, sizeof(head), length,
+                         "Content-Type: application/x-www-form-urlencoded\r\nContent-Length: %u\r\n",
+                         static_cast<unsigned>(strlen(form)));
+  }
+  fits = fits && append(head, sizeof(head), length, "\r\n");
+  if (!fits)
+  {
+   return GS308EP_ERROR_SEND_FAILED;
+  }
+
+  if (!_client.connect(name, port))
+  {
+   return GS308EP_ERROR_CONNECTION_REFUSED;
+  }
+
+  int code = GS308EP_ERROR_SEND_FAILED;
+  if (_client.write(reinterpret_cast<const uint8_t *>(head), length) == static_cast<size_t>(length) &&
+      (!form || _client.write(reinterpret_cast<const uint8_t *>(form), strlen(form)) == strlen(form)))
+  {
+   code = readResponse<Wait>();
+  }
+  _client.stop();
+
+  if (code != 200)
+  {
+   release();
+  }
+  return code;
+ }
+
+ /// Body of the last 200 response, NUL-terminated
+ const char *body() const { return _body ? _body : ""; }
+ int bodyLength() const { return _length; }
+
+ /// Set-Cookie value of the last 200 response, or ""
+ const char *setCookie() const { return _setCookie; }
+
+ /**
+  * @brief Free the last response
+  */
+ void release()
+ {
+  free(_body);
+  _body = 0;
+  _length = 0;
+  _capacity = 0;
+  _setCookie[0] = '\0';
+ }
+
+private:
+ static const size_t LINE_SIZE = 192;
+ static const size_t FIRST_CAPACITY = 1024;
+
+ ClientType _client;
+ char *_body;
+ size_t _length;
+ size_t _capacity;
+ uint16_t _timeout;
+ char _setCookie[LINE_SIZE];
+
+ static bool append(char *buffer, size_t size, int &length, const char *format, ...)
+ {
+  va_list args;
+  va_start(args, format);
+  int written = vsnprintf(buffer + length, size - length, format, args);
+  va_end(args);
+  if (written < 0 || static_cast<size_t>(written) >= size - length)
+  {
+   return false;
+  }
+  length += written;
+  return true;
+ }
+
+ /**
+  * @brief Wait until bytes arrive
+  * @return Bytes available, or a negative error once the connection is
+  *         closed and drained or the timeout passed
+  */
+ template <class Wait>
+ int await()
+ {
+  uint32_t start = millis();
+  int available;
+  while ((available = _client.available()) <= 0)
+  {
+   if (!_client.connected())
+   {
+    return GS308EP_ERROR_CONNECTION_LOST;
+   }
+   if (millis() - start >= _timeout)
+   {
+    return GS308EP_ERROR_READ_TIMEOUT;
+   }
+   Wait::idle();
+  }
+  return available;
+ }
+
+ /**
+  * @brief Read one line, without its CR LF; the excess of a long line is dropped
+  * @return Characters kept, or a negative error
+  */
+ template <class Wait>
+ int readLine(char *line, size_t size)
+ {
+  size_t kept = 0;
+  for (;;)
+  {
+   int available = await<Wait>();
+   if (available < 0)
+   {
+    return available;
+   }
+   int c = _client.read();
+   if (c == '\n')
+   {
+    break;
+   }
+   if (c != '\r' && c >= 0 && kept + 1 < size)
+   {
+    line[kept++] = static_cast<char>(c);
+   }
+  }
+  line[kept] = '\0';
+  return kept;
+ }
+
+ /**
+  * @brief Make room for need body bytes plus the terminator
+  */
+ bool reserve(size_t need)
+ {
+  if (need > MaxBody)
+  {
+   return false;
+  }
+  if (need < _capacity)
+  {
+   return true;
+  }
+  // Exact when the length is known up front, doubling while it is not
+  size_t capacity = _capacity ? _capacity * 2 : (need ? need + 1 : FIRST_CAPACITY);
+  if (capacity < need + 1)
+  {
+   capacity = need + 1;
+  }
+  if (capacity > MaxBody + 1)
+  {
+   capacity = MaxBody + 1;
+  }
+  char *grown = static_cast<char *>(realloc(_body, capacity));
+  if (!grown)
+  {
+   return false;
+  }
+  _body = grown;
+  _capacity = capacity;
+  return true;
+ }
+
+ /**
+  * @brief Append body bytes; up to count, or until the connection closes if untilClose
+  * @return 0, or a negative error
+  */
+ template <class Wait>
+ int readBody(size_t count, bool untilClose)
+ {
+  while (untilClose || count > 0)
+  {
+   int available = await<Wait>();
+   if (available == GS308EP_ERROR_CONNECTION_LOST && untilClose)
+   {
+    return 0;
+   }
+   if (available < 0)
+   {
+    return available;
+   }
+   size_t chunk = static_cast<size_t>(available);
+   if (!untilClose && chunk > count)
+   {
+    chunk = count;
+   }
+   if (!reserve(_length + chunk))
+   {
+    return GS308EP_ERROR_TOO_LARGE;
+   }
+   int got = _client.read(reinterpret_cast<uint8_t *>(_body + _length), chunk);
+   if (got <= 0)
+   {
+    return GS308EP_ERROR_CONNECTION_LOST;
+   }
+   _length += got;
+   _body[_length] = '\0';
+   if (!untilClose)
+   {
+    count -= got;
+   }
+  }
+  return 0;
+ }
+
+ /**
+  * @brief Read the status line, headers and, for a 200, the body
+  * @return HTTP status code, or a negative error
+  */
+ template <class Wait>
+ int readResponse()
+ {
+  char line[LINE_SIZE];
+  int result = readLine<Wait>(line, sizeof(line));
+  if (result < 0)
+  {
+   return result;
+  }
+  if (strncmp(line, "HTTP/1.", 7) != 0 || result < 12)
+  {
+   return GS308EP_ERROR_NO_HTTP_SERVER;
+  }
+  int code = atoi(line + 9);
+
+  long contentLength = -1;
+  bool chunked = false;
+  while ((result = readLine<Wait>(line, sizeof(line))) > 0)
+  {
+   if (strncasecmp(line, "Content-Length:", 15) == 0)
+   {
+    contentLength = atol(line + 15);
+   }
+   else if (strncasecmp(line, "Transfer-Encoding:", 18) == 0)
+   {
+    chunked = strstr(line + 18, "chunked") != 0;
+   }
+   else if (strncasecmp(line, "Set-Cookie:", 11) == 0)
+   {
+    const char *value = line + 11;
+    while (*value == ' ')
+    {
+     value++;
+    }
+    strcpy(_setCookie, value);
+   }
+  }
+  if (result < 0)
+  {
+   return result;
+  }
+  if (code != 200)
+  {
+   return code;
+  }
+
+  if (!reserve(contentLength > 0 ? contentLength : 0))
+  {
+   return GS308EP_ERROR_TOO_LARGE;
+  }
+  _body[0] = '\0';
+
+  if (!chunked)
+  {
+   result = readBody<Wait>(contentLength > 0 ? contentLength : 0, contentLength < 0);
+   return result < 0 ? result : code;
+  }
+
+  for (;;)
+  {
+   result = readLine<Wait>(line, sizeof(line));
+   if (result < 0)
+   {
+    return result;
+   }
+   size_t size = strtoul(line, 0, 16);
+   if (size == 0)
+   {
+    return code;
+   }
+   result = readBody<Wait>(size, false);
+   if (result < 0 || (result = readLine<Wait>(line, sizeof(line))) < 0)
+   {
+    return result;
+   }
+  }
+ }
+};
+
+#endif // GS308EP_RAW_TRANSPORT_H
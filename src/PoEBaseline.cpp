@@ -0,0 +1,207 @@
+/**
+ * @file PoEBaseline.cpp
+ * @brief Implementation of the per-port baseline tracker
+ */
+
+#include "PoEBaseline.h"
+#include <math.h>
+
+const float PoEBaseline::SIGMA_THRESHOLD = 3.0;
+const float PoEBaseline::IDLE_FRACTION = 0.25;
+const float PoEBaseline::TEMPERATURE_DELTA = 10.0;
+
+/**
+ * @brief Constructor
+ */
+PoEBaseline::PoEBaseline(uint16_t windowSamples, float thresholdPercent)
+{
+ if (windowSamples < 2)
+ {
+  windowSamples = 2;
+ }
+ _alpha = 2.0 / (windowSamples + 1.0);
+ _relative = thresholdPercent / 100.0;
+ _warmup = windowSamples / 2;
+ reset();
+}
+
+/**
+ * @brief Forget all baselines
+ */
+void PoEBaseline::reset()
+{
+ for (uint8_t i = 0; i < 8; i++)
+ {
+  _ports[i].power.mean = 0.0;
+  _ports[i].power.variance = 0.0;
+  _ports[i].current = _ports[i].power;
+  _ports[i].temperature = _ports[i].power;
+  _ports[i].samples = 0;
+  _ports[i].flags = POE_ANOMALY_NONE;
+  _ports[i].previousFlags = POE_ANOMALY_NONE;
+ }
+}
+
+/**
+ * @brief Exponentially weighted mean and variance update (West's form)
+ */
+void PoEBaseline::fold(Stat &stat, float value, float alpha)
+{
+ float diff = value - stat.mean;
+ float increment = alpha * diff;
+ stat.mean += increment;
+ stat.variance = (1.0 - alpha) * (stat.variance + diff * increment);
+}
+
+/**
+ * @brief Compare a value to a baseline by relative margin and spread
+ */
+uint8_t PoEBaseline::score(float value, const Stat &stat, uint8_t highFlag, uint8_t lowFlag) const
+{
+ float deviation = value - stat.mean;
+ float margin = stat.mean * _relative;
+ float spread = SIGMA_THRESHOLD * sqrtf(stat.variance);
+
+ if (deviation > margin && deviation > spread)
+ {
+  return highFlag;
+ }
+ if (-deviation > margin && -deviation > spread)
+ {
+  return lowFlag;
+ }
+ return POE_ANOMALY_NONE;
+}
+
+/**
+ * @brief Score and fold one port's sample
+ */
+uint8_t PoEBaseline::updatePort(PortState &state, bool enabled, float power, float current, float temperature)
+{
+ // A port that is not delivering has no draw to learn from
+ if (!enabled)
+ {
+  return POE_ANOMALY_NONE;
+ }
+
+ if (state.samples == 0)
+ {
+  state.power.mean = power;
+  state.current.mean = current;
+  state.temperature.mean = temperature;
+  state.samples = 1;
+  return POE_ANOMALY_NONE;
+ }
+
+ uint8_t flags = POE_ANOMALY_NONE;
+ if (state.samples >= _warmup)
+ {
+  // Below ~0.5 W / 10 mA the relative checks only measure noise
+  if (state.power.mean >= 0.5)
+  {
+   if (power <= state.power.mean * IDLE_FRACTION)
+   {
+    flags |= POE_ANOMALY_IDLE_DROP;
+   }
+   else
+   {
+    flags |= score(power, state.power, POE_ANOMALY_POWER_HIGH, POE_ANOMALY_POWER_LOW);
+   }
+  }
+
+  if (state.current.mean >= 10.0)
+  {
+   flags |= score(current, state.current, POE_ANOMALY_CURRENT_HIGH, POE_ANOMALY_CURRENT_LOW);
+  }
+
+  if (temperature > state.temperature.mean + TEMPERATURE_DELTA)
+  {
+   flags |= POE_ANOMALY_TEMPERATURE_HIGH;
+  }
+ }
+
+ // Anomalous samples adapt the baseline at a quarter of the normal rate
+ float alpha = flags ? _alpha * 0.25 : _alpha;
+ fold(state.power, power, alpha);
+ fold(state.current, current, alpha);
+ fold(state.temperature, temperature, alpha);
+ if (state.samples < 0xFFFF)
+ {
+  state.samples++;
+ }
+
+ return flags;
+}
+
+/**
+ * @brief Update all ports from one getAllPoEPortStats() result
+ */
+template <class Stats>
+uint8_t PoEBaseline::updateAll(const Stats stats[8])
+{
+ uint8_t combined = POE_ANOMALY_NONE;
+ for (uint8_t i = 0; i < 8; i++)
+ {
+  uint8_t port = stats[i].port;
+  if (port < 1 || port > 8)
+  {
+   continue;
+  }
+
+  PortState &state = _ports[port - 1];
+  state.previousFlags = state.flags;
+  state.flags = updatePort(state, stats[i].enabled, stats[i].power, stats[i].current, stats[i].temperature);
+  combined |= state.flags;
+ }
+ return combined;
+}
+
+uint8_t PoEBaseline::update(const PoEPortStats stats[8])
+{
+ return updateAll(stats);
+}
+
+uint8_t PoEBaseline::update(const PoEPortPower stats[8])
+{
+ return updateAll(stats);
+}
+
+/**
+ * @brief Get anomaly flags for a port
+ */
+uint8_t PoEBaseline::getFlags(uint8_t port) const
+{
+ return (port >= 1 && port <= 8) ? _ports[port - 1].flags : 0;
+}
+
+/**
+ * @brief Check for an anomaly state change on a port
+ */
+bool PoEBaseline::changed(uint8_t port) const
+{
+ return (port >= 1 && port <= 8) && _ports[port - 1].flags != _ports[port - 1].previousFlags;
+}
+
+/**
+ * @brief Get baseline power
+ */
+float PoEBaseline::getBaselinePower(uint8_t port) const
+{
+ return (port >= 1 && port <= 8) ? _ports[port - 1].power.mean : 0.0;
+}
+
+/**
+ * @brief Get baseline current
+ */
+float PoEBaseline::getBaselineCurrent(uint8_t port) const
+{
+ return (port >= 1 && port <= 8) ? _ports[port - 1].current.mean : 0.0;
+}
+
+/**
+ * @brief Get typical temperature
+ */
+float PoEBaseline::getTypicalTemperature(uint8_t port) const
+{
+ return (port >= 1 && port <= 8) ? _ports[port - 1].temperature.mean : 0.0;
+}
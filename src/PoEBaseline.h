@@ -0,0 +1,132 @@
+/**
+ * @file PoEBaseline.h
+ * @brief Streaming per-port power baselines and anomaly flags for GS308EP
+ *
+ * Feed each result of getAllPoEPortStats() to update(), either the full
+ * PoEPortStats or the PowerFields configuration's PoEPortPower. Every port
+ * keeps an exponentially weighted mean and variance of power and current and
+ * a typical temperature in a few floats, so the cost per sample is constant
+ * and nothing is stored beyond the current baseline.
+ */
+
+#ifndef POE_BASELINE_H
+#define POE_BASELINE_H
+
+#include "GS308EPPolicies.h"
+
+/**
+ * @brief Anomaly bits returned by PoEBaseline::update() and getFlags()
+ */
+enum PoEAnomaly : uint8_t
+{
+ POE_ANOMALY_NONE = 0,
+ POE_ANOMALY_POWER_HIGH = 1 << 0,      ///< Power well above baseline
+ POE_ANOMALY_POWER_LOW = 1 << 1,       ///< Power well below baseline
+ POE_ANOMALY_IDLE_DROP = 1 << 2,       ///< Still delivering, but at idle-level draw
+ POE_ANOMALY_CURRENT_HIGH = 1 << 3,    ///< Current well above baseline
+ POE_ANOMALY_CURRENT_LOW = 1 << 4,     ///< Current well below baseline
+ POE_ANOMALY_TEMPERATURE_HIGH = 1 << 5 ///< Temperature above typical
+};
+
+/**
+ * @class PoEBaseline
+ * @brief Constant-memory baseline tracker for all eight ports of one switch
+ */
+class PoEBaseline
+{
+public:
+ /**
+  * @brief Construct a baseline tracker
+  * @param windowSamples EWMA span in samples (alpha = 2 / (N + 1))
+  * @param thresholdPercent Relative deviation that counts as anomalous
+  */
+ PoEBaseline(uint16_t windowSamples = 60, float thresholdPercent = 40.0);
+
+ /**
+  * @brief Score every port against its baseline, then fold the sample in
+  * @param stats Array of 8 port statistics from getAllPoEPortStats()
+  * @return Bitwise OR of the anomaly flags of all ports
+  */
+ uint8_t update(const PoEPortStats stats[8]);
+
+ /**
+  * @brief Score every port against its baseline, then fold the sample in
+  * @param stats Array of 8 port readings from a PowerFields client
+  * @return Bitwise OR of the anomaly flags of all ports
+  */
+ uint8_t update(const PoEPortPower stats[8]);
+
+ /**
+  * @brief Get the anomaly flags of a port from the last update
+  * @param port Port number (1-8)
+  * @return PoEAnomaly bits, or 0 for an invalid port
+  */
+ uint8_t getFlags(uint8_t port) const;
+
+ /**
+  * @brief Check whether a port's flags changed in the last update
+  * @param port Port number (1-8)
+  * @return true if the port entered, left or changed anomaly state
+  */
+ bool changed(uint8_t port) const;
+
+ /**
+  * @brief Get a port's baseline power
+  * @param port Port number (1-8)
+  * @return EWMA mean power in watts
+  */
+ float getBaselinePower(uint8_t port) const;
+
+ /**
+  * @brief Get a port's baseline current
+  * @param port Port number (1-8)
+  * @return EWMA mean current in milliamps
+  */
+ float getBaselineCurrent(uint8_t port) const;
+
+ /**
+  * @brief Get a port's typical temperature
+  * @param port Port number (1-8)
+  * @return EWMA mean temperature in Celsius
+  */
+ float getTypicalTemperature(uint8_t port) const;
+
+ /**
+  * @brief Forget all baselines (e.g. after replacing a powered device)
+  */
+ void reset();
+
+private:
+ struct Stat
+ {
+  float mean;
+  float variance;
+ };
+
+ struct PortState
+ {
+  Stat power;
+  Stat current;
+  Stat temperature;
+  uint16_t samples;
+  uint8_t flags;
+  uint8_t previousFlags;
+ };
+
+ PortState _ports[8];
+ float _alpha;
+ float _relative;
+ uint16_t _warmup;
+
+ static const float SIGMA_THRESHOLD;
+ static const float IDLE_FRACTION;
+ static const float TEMPERATURE_DELTA;
+
+ template <class Stats>
+ uint8_t updateAll(const Stats stats[8]);
+ uint8_t updatePort(PortState &state, bool enabled, float power, float current, float temperature);
+ uint8_t score(float value, const Stat &stat, uint8_t highFlag, uint8_t lowFlag) const;
+ static void fold(Stat &stat, float value, float alpha);
+};
+
+#endif // POE_BASELINE_H